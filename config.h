@@ -20,17 +20,149 @@
 // Database configuration file.
 #define DATABASE_CONFIG "/etc/u-search/database.dat"
 
-// Size of buffer which used to get smb directory entries.
-#define BUF_SIZE 512
+// Number of workers which scan smb servers simultaneously.
+// Each worker has its own connections to smb servers.
+#define WORKERS_NUMBER 8
+
+// Number of servers leased from scheduler and scanned simultaneously.
+// Their directories and files are processed by the same workers.
+#define SERVERS_NUMBER 4
+
+// Get size, mtime and attributes of files together with directory entries
+// by smbc_readdirplus(). Comment it out to use plain smbc_readdir().
+// smbc_readdirplus2() is used if the package is built with
+// READDIRPLUS2=yes.
+#define USE_READDIRPLUS
+
+// Maximum number of smb directory entries processed at once.
+#define LISTING_BATCH_SIZE 256
+
+// Table of file extensions with known MIME types.
+#define EXTENSIONS_CONFIG "/etc/u-search/extensions.dat"
+
+// Content of every n-th file with sampled extension is sniffed to
+// verify the table of extensions.
+#define EXTENSION_SAMPLE_RATE 64
+
+// Whether files with trusted extensions are read to take their sampled
+// fingerprints for duplicate detection. Fingerprints are cached, so
+// unchanged files are read once, but the first scan reads all of them.
+// With 0 such files are never read and have fingerprints only if they
+// are sniffed or hashed anyway.
+#define FINGERPRINT_TRUSTED_FILES 0
+
+// Whole content of files on shares listed in this file is hashed for
+// exact duplicate detection, one URL prefix per line, e.g.
+// "smb://server/share". Without the file nothing is hashed.
+#define CONTENT_HASH_CONFIG "/etc/u-search/contenthash.dat"
+
+// Number of workers which hash content of files simultaneously, maximum
+// number of files hashed at once on one server and maximum number of
+// files of one server waiting to be hashed.
+#define CONTENT_HASH_DEPTH 4
+#define CONTENT_HASH_PER_SERVER 2
+#define CONTENT_HASH_QUEUE_SIZE 1024
+
+// Size of each read of hashed file. libsmbclient splits large reads into
+// several requests in flight.
+#define CONTENT_HASH_CHUNK (1 << 20)
+
+// Budget of hashing reads from one server in bytes per second (0 for
+// unlimited) and number of bytes read at once after idle time.
+#define CONTENT_HASH_RATE (16 << 20)
+#define CONTENT_HASH_BURST (4 << 20)
+
+// Directories which paths match rules of this file aren't scanned, see
+// exclusions.dat.example. The file is reread when it's modified, new
+// rules are applied to the next scan of each server.
+#define EXCLUSIONS_CONFIG "/etc/u-search/exclusions.dat"
+
+// Maximum number of states of DFA compiled from exclusion rules, rules
+// aren't applied if there are more.
+#define PATH_FILTER_MAX_STATES 4096
+
+// Persistent cache of MIME types of files, it isn't used if the file
+// can't be created.
+#define STATE_DIR "/var/lib/u-search"
+#define MIME_CACHE STATE_DIR "/mimecache"
+
+// Maximum number of files in the cache of MIME types (128 bytes each)
+// and number of files in each set of the cache.
+#define MIME_CACHE_CAPACITY (1 << 20)
+#define MIME_CACHE_WAYS 8
+
+// Number of workers which fetch headers of files simultaneously, i.e.
+// number of header requests in flight. Each of them has its own
+// connections to smb servers.
+#define FETCH_DEPTH 16
+
+// Maximum number of header requests in flight to one server.
+#define FETCH_PER_SERVER 8
+
+// Maximum number of local files which headers are read by one batch, it's
+// bounded by FETCH_PER_SERVER too.
+#define FETCH_BATCH_SIZE 8
+
+// Number of requests in io_uring of each worker. Local directories are
+// statted by chunks of that size, each file of a fetch batch takes three
+// requests. Used when built with IO_URING=yes.
+#define IO_URING_DEPTH 64
+
+// Maximum rate of smb requests to one server per second and number of
+// requests sent at once after idle time.
+#define THROTTLE_RATE 500
+#define THROTTLE_BURST 32
+
+// Bounds of the number of concurrent smb requests to one server. The
+// limit starts at the minimum, grows while the server answers quickly
+// and is halved on errors and when latency exceeds its baseline
+// THROTTLE_LATENCY_TOLERANCE times.
+#define THROTTLE_MIN_CONCURRENCY 1
+#define THROTTLE_MAX_CONCURRENCY (WORKERS_NUMBER + FETCH_DEPTH)
+#define THROTTLE_LATENCY_TOLERANCE 2.0
+
+// Maximum number of files of one server waiting for their headers to be
+// fetched. Scans of a server wait while its queue is full.
+#define FETCH_QUEUE_SIZE 4096
+
+// Maximum number of classified files waiting to be written to data base.
+#define WRITE_QUEUE_SIZE 8192
+
+// Interval in seconds between reports about the scan pipeline.
+#define PIPELINE_REPORT_INTERVAL 60
+
+// Statistics of scans are written to this file when the spider gets
+// SIGUSR1 and when a lease of a server ends.
+#define STATS_FILE STATE_DIR "/stats"
+
+// Number of shards of statistics of a scan. Threads record into their
+// own shards, so they don't contend while there are fewer of them.
+#define STATS_SHARDS 8
+
+// Interval in seconds between flushes of the checkpoint of current scan
+// to STATE_DIR. Interrupted scan is resumed from the checkpoint.
+#define CHECKPOINT_INTERVAL 10
+
+// Files not seen at the full scan of a server are deleted from data base
+// by chunks of SWEEP_BATCH_SIZE files with SWEEP_PAUSE microseconds
+// between chunks. Entries migrated from the schema with full paths are
+// hashed at start by chunks of the same size.
+#define SWEEP_BATCH_SIZE 1000
+#define SWEEP_PAUSE 100000
+
+// Number of unchanged directories which files are marked as seen by one
+// query.
+#define TOUCH_BATCH_SIZE 64
 
 // Maximum size of vector with scan results.
 #define VECTOR_SIZE 2048
 
-// Name of directory to store headrs of files.
-#define TMPDIR "/tmp/u-search"
+// Size of blocks where names of files of the scan results are stored.
+#define FILE_BATCH_BLOCK (64 << 10)
 
-// The size of file header to copy in TMPDIR to detect mime type of file.
-#define HEADERSIZE 10
+// The size of file header which is read to detect mime type of file.
+// It should contain signatures of tar archives at offset 257.
+#define HEADERSIZE 512
 
 // The address family
 #define FAMILY AF_INET
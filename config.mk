@@ -18,6 +18,18 @@ CFLAGS+=-O2
 DESTDIR:=$(SRCDIR)/build/release
 endif  # DEBUG
 
+# smbc_readdirplus2() appeared in samba 4.12.
+ifeq ($(READDIRPLUS2),yes)
+DEFINES+=-DHAVE_SMBC_READDIRPLUS2
+endif  # READDIRPLUS2
+
+# Batched syscalls of local crawls, io_uring appeared in linux 5.6 and
+# direct descriptors used for linked header reads in 5.15.
+ifeq ($(IO_URING),yes)
+DEFINES+=-DHAVE_LIBURING
+LIBS+=-luring
+endif  # IO_URING
+
 INCLUDEPATH+=-I$(SRCDIR)
 LIBS+=-L$(DESTDIR)/lib
 
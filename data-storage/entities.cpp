@@ -27,15 +27,33 @@
 #define EXPAND_MY_SSQLS_STATICS
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "entities.h"
 #include "common-inl.h"
+#include "hash-inl.h"
 
 mysqlpp::TCPConnection DatabaseEntity::db_connection_;
 std::string DatabaseEntity::db_error_;
 std::shared_ptr<mysqlpp::Transaction> DatabaseEntity::current_transaction_;
 
+namespace {
+
+// "path/to/file" -> "path/to", "file" -> "".
+std::string DirOf(const std::string &path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? std::string() : path.substr(0, slash);
+}
+
+// "path/to/file" -> "file".
+std::string BaseOf(const std::string &path) {
+  size_t slash = path.rfind('/');
+  return slash == std::string::npos ? path : path.substr(slash + 1);
+}
+
+}  // namespace
+
 mysqlpp::TCPConnection & DatabaseEntity::get_db_connection() {
   if (db_connection_.connected())
     return db_connection_;
@@ -75,6 +93,28 @@ bool DatabaseEntity::Disconnect() {
   }
 }
 
+bool DatabaseEntity::ThreadStart() {
+  return mysqlpp::Connection::thread_start();
+}
+
+void DatabaseEntity::ThreadEnd() {
+  mysqlpp::Connection::thread_end();
+}
+
+time_t DatabaseEntity::GetServerTime() {
+  try {
+    mysqlpp::Query query =
+        get_db_connection().query("select unix_timestamp()");
+    mysqlpp::StoreQueryResult result = query.store();
+    if (result.size() != 1)
+      return -1;
+    return static_cast<time_t>(result[0][0]);
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return -1;
+  }
+}
+
 bool DatabaseEntity::StartTransaction() {
   if (current_transaction_ != nullptr)
     return true;
@@ -245,42 +285,84 @@ FileAttribute::AttributeType FileAttribute::StringToAttrType(
 FileEntry::FileEntry(const mss_files &orig_row)
   : id_(orig_row.id),
     name_(orig_row.name),
-    file_path_(orig_row.file_path),
+    dir_id_(orig_row.dir_id),
+    base_name_(orig_row.base_name),
     server_name_(orig_row.server_name),
+    path_hash_(orig_row.path_hash),
     timestamp_(orig_row.last_seen),
     orig_row_(orig_row) {
 }
 
-FileEntry::FileEntry(const int id, const std::string &name,
-                     const std::string &file_path,
-                     const std::string &server_name,
+FileEntry::FileEntry(const int id, const std::string &name, const int dir_id,
+                     const std::string &base_name,
+                     const std::string &server_name, const int64_t path_hash,
                      const time_t timestamp, const mss_files &orig_row)
   : id_(id),
     name_(name),
-    file_path_(file_path),
+    dir_id_(dir_id),
+    base_name_(base_name),
     server_name_(server_name),
+    path_hash_(path_hash),
     timestamp_(timestamp),
     orig_row_(orig_row) {
 }
 
 FileEntry::FileEntry(const std::string &file_name, const std::string &file_path,
-                     const std::string &server_name) {
+                     const std::string &server_name)
+  : FileEntry(file_name,
+              DirectoryEntry::ResolvePath(server_name, DirOf(file_path)),
+              BaseOf(file_path), server_name,
+              PathHash(server_name, file_path)) {
+  file_path_ = file_path;
+}
+
+FileEntry::FileEntry(const std::string &file_name, const int dir_id,
+                     const std::string &base_name,
+                     const std::string &server_name, const int64_t path_hash)
+  : id_(0),
+    name_(file_name),
+    dir_id_(dir_id),
+    base_name_(base_name),
+    server_name_(server_name),
+    path_hash_(path_hash),
+    timestamp_(0) {
+  // Error of directory is already set.
+  if (dir_id < 0)
+    return;
+
   try {
+    // Existing entry is found by the hash, entries with the same hash are
+    // told apart by servers and names.
+    mysqlpp::Query query =
+        get_db_connection().query("select id, dir_id, base_name from "
+                                  "mss_files files where "
+                                  "files.path_hash = %0:hash and "
+                                  "files.server_name = %1q:server");
+    query.parse();
+    mysqlpp::StoreQueryResult result = query.store(path_hash, server_name);
+    for (mysqlpp::Row &row : result) {
+      if (static_cast<int>(row[1]) == dir_id &&
+          row[2].c_str() == base_name) {
+        id_ = row[0];
+        break;
+      }
+    }
+
     mysqlpp::Query insert_query = get_db_connection().query();
     struct timeval current_time;
     gettimeofday(&current_time, NULL);
 
-    mss_files row(0, file_name, file_path, server_name);
+    // Id of existing entry is kept, so its parameters are updated.
+    mss_files row(id_, file_name, dir_id, base_name, server_name,
+                  path_hash);
 
     insert_query.replace(row);
     insert_query.execute();
 
-    id_ = insert_query.insert_id();
+    if (id_ == 0)
+      id_ = insert_query.insert_id();
     row.id = id_;
 
-    name_ = file_name;
-    file_path_ = file_path;
-    server_name_ = server_name;
     timestamp_ = current_time.tv_sec;
     orig_row_ = row;
   } catch(const mysqlpp::Exception &e) {
@@ -365,34 +447,60 @@ std::vector<std::shared_ptr<FileEntry> > *FileEntry::GetByServer(
   return QueryResultToVector(search_result);
 }
 
+int64_t FileEntry::PathHash(const std::string &server_name,
+                            const std::string &file_path) {
+  return static_cast<int64_t>(hash::Hash64(file_path,
+                                           hash::Hash64(server_name)));
+}
+
 std::shared_ptr<FileEntry> FileEntry::GetByPathOnServer(
     const std::string &path, const std::string &server) {
   mysqlpp::StoreQueryResult result;
 
   try {
     std::string query_text = "select * from mss_files files "
-        "where files.file_path = %0q:path and files.server_name = %1q:server";
+        "where files.path_hash = %0:hash";
     mysqlpp::Query query = get_db_connection().query(query_text.c_str());
     query.parse();
 
-    result = query.store(path, server);
+    result = query.store(PathHash(server, path));
   } catch(const mysqlpp::Exception &e) {
     db_error_ = e.what();
     MSS_DEBUG_MESSAGE(e.what());
   }
 
+  // Entries with the same hash are told apart by names, their directories
+  // are compared on collision only.
+  std::vector<mss_files> rows;
+  const std::string base_name = BaseOf(path);
+  for (mysqlpp::Row &row : result) {
+    mss_files typed_row(row);
+    if (typed_row.server_name == server && typed_row.base_name == base_name)
+      rows.push_back(typed_row);
+  }
+  if (rows.size() > 1) {
+    const std::string dir = DirOf(path);
+    std::vector<mss_files> same_dir;
+    for (const mss_files &row : rows) {
+      if (DirectoryEntry::PathOf(row.dir_id) == dir)
+        same_dir.push_back(row);
+    }
+    rows.swap(same_dir);
+  }
+
   // On Success
-  if (result.size() == 1) {
+  if (rows.size() == 1) {
     try {
-      mss_files result_row(result[0]);
-      return std::shared_ptr<FileEntry>(new FileEntry(result_row));
+      std::shared_ptr<FileEntry> entry(new FileEntry(rows[0]));
+      entry->file_path_ = path;
+      return entry;
     } catch(const std::bad_alloc &e) {
       db_error_ = std::string(e.what());
     }
   }
 
   // On error
-  if (result != 0)
+  if (rows.size() > 1)
     db_error_ = std::string("More then one row finded, this is db error");
 
   return nullptr;
@@ -451,6 +559,118 @@ std::shared_ptr<FileEntry> FileEntry::GetById(const int id) {
   return std::shared_ptr<FileEntry> (new FileEntry(only_row));
 }
 
+std::string FileEntry::get_file_path() const {
+  if (file_path_.empty()) {
+    std::string dir = DirectoryEntry::PathOf(dir_id_);
+    if (dir_id_ != 0 && dir.empty())
+      return std::string();
+    file_path_ = dir.empty() ? base_name_ : dir + "/" + base_name_;
+  }
+  return file_path_;
+}
+
+int FileEntry::TouchByDirs(const std::vector<int> &dir_ids) {
+  if (dir_ids.empty())
+    return 0;
+
+  try {
+    mysqlpp::Query query = get_db_connection().query();
+    query << "update mss_files set last_seen = now() where dir_id in (";
+    for (size_t i = 0; i < dir_ids.size(); ++i)
+      query << (i ? "," : "") << dir_ids[i];
+    query << ")";
+
+    return query.execute().rows();
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return -1;
+  }
+}
+
+int FileEntry::DeleteNotSeenSince(const std::string &server_name,
+                                  const time_t since, const int limit) {
+  try {
+    mysqlpp::Query select = get_db_connection().query(
+        "select id from mss_files files where files.server_name = "
+        "%0q:server and files.last_seen < from_unixtime(%1:since) "
+        "limit %2:limit");
+    select.parse();
+    mysqlpp::StoreQueryResult result = select.store(server_name, since,
+                                                    limit);
+    if (result.empty())
+      return 0;
+
+    std::string ids;
+    for (mysqlpp::Row &row : result) {
+      if (!ids.empty())
+        ids.push_back(',');
+      ids.append(std::to_string(static_cast<int>(row[0])));
+    }
+
+    // Parameters and files are deleted together.
+    mysqlpp::Transaction transaction(get_db_connection());
+    mysqlpp::Query query = get_db_connection().query();
+    query << "delete from mss_parameters where file_id in (" << ids << ")";
+    query.execute();
+    query.reset();
+    query << "delete from mss_files where id in (" << ids << ")";
+    int deleted = query.execute().rows();
+    transaction.commit();
+
+    return deleted;
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return -1;
+  }
+}
+
+int FileEntry::HashMigratedPaths(const int after, const int limit) {
+  try {
+    mysqlpp::Query select = get_db_connection().query(
+        "select id, server_name, dir_id, base_name from mss_files files "
+        "where files.path_hash = 0 and files.id > %0:after "
+        "order by files.id limit %1:limit");
+    select.parse();
+    mysqlpp::StoreQueryResult result = select.store(after, limit);
+    if (result.empty())
+      return 0;
+
+    // Paths of directories are resolved once per call, files of one
+    // directory are usually found together.
+    std::unordered_map<int, std::string> dirs;
+    mysqlpp::Transaction transaction(get_db_connection());
+    mysqlpp::Query query = get_db_connection().query();
+    int last = 0;
+    for (mysqlpp::Row &row : result) {
+      const std::string server_name = row[1];
+      const int dir_id = row[2];
+      std::string path = row[3];
+      if (dir_id != 0) {
+        auto dir = dirs.find(dir_id);
+        if (dir == dirs.end()) {
+          dir = dirs.emplace(dir_id, DirectoryEntry::PathOf(dir_id)).first;
+          // Error of directory is already set.
+          if (dir->second.empty())
+            return -1;
+        }
+        path = dir->second + "/" + path;
+      }
+
+      last = row[0];
+      query.reset();
+      query << "update mss_files set path_hash = "
+            << PathHash(server_name, path) << " where id = " << last;
+      query.execute();
+    }
+    transaction.commit();
+
+    return last;
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return -1;
+  }
+}
+
 FileParameter::FileParameter(const mss_parameters &orig_row)
   : str_value_(orig_row.str_value),
     num_value_(orig_row.num_value),
@@ -631,3 +851,246 @@ FileParameter::QueryResultToVector(const mysqlpp::StoreQueryResult &result) {
 
   return final_result;
 }
+
+DirectoryEntry::DirectoryEntry(const mss_dirs &orig_row)
+  : id_(orig_row.id),
+    parent_id_(orig_row.parent_id),
+    server_name_(orig_row.server_name),
+    name_(orig_row.name),
+    mtime_(orig_row.mtime),
+    child_count_(orig_row.child_count),
+    orig_row_(orig_row) {
+}
+
+DirectoryEntry::DirectoryEntry(const std::string &server_name,
+                               const std::string &dir_path,
+                               const time_t mtime, const int child_count)
+  : id_(0),
+    parent_id_(ResolvePath(server_name, DirOf(dir_path))),
+    server_name_(server_name),
+    name_(BaseOf(dir_path)),
+    dir_path_(dir_path),
+    mtime_(mtime),
+    child_count_(child_count) {
+  // Error of parent is already set.
+  if (parent_id_ >= 0)
+    Save();
+}
+
+DirectoryEntry::DirectoryEntry(const std::string &server_name,
+                               const int parent_id, const std::string &name,
+                               const time_t mtime, const int child_count)
+  : id_(0),
+    parent_id_(parent_id),
+    server_name_(server_name),
+    name_(name),
+    mtime_(mtime),
+    child_count_(child_count) {
+  Save();
+}
+
+void DirectoryEntry::Save() {
+  // Id of existing entry is kept since files refer to it.
+  try {
+    mysqlpp::Query query = get_db_connection().query();
+    query << "insert into mss_dirs (parent_id, server_name, name, mtime, "
+             "child_count, last_seen) values (" << parent_id_ << ", "
+          << mysqlpp::quote << server_name_ << ", " << mysqlpp::quote
+          << name_ << ", " << static_cast<mysqlpp::sql_bigint>(mtime_) << ", "
+          << child_count_ << ", now()) on duplicate key update "
+             "id = last_insert_id(id), mtime = values(mtime), "
+             "child_count = values(child_count), "
+             "last_seen = values(last_seen)";
+    query.execute();
+
+    id_ = query.insert_id();
+    orig_row_ = mss_dirs(id_, parent_id_, server_name_, name_, mtime_,
+                         child_count_);
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = std::string(e.what());
+  }
+}
+
+int DirectoryEntry::Resolve(const std::string &server_name,
+                            const int parent_id, const std::string &name) {
+  try {
+    mysqlpp::Query query = get_db_connection().query();
+    query << "insert into mss_dirs (parent_id, server_name, name, mtime, "
+             "child_count, last_seen) values (" << parent_id << ", "
+          << mysqlpp::quote << server_name << ", " << mysqlpp::quote << name
+          << ", 0, 0, now()) on duplicate key update id = last_insert_id(id)";
+    query.execute();
+    return query.insert_id();
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return -1;
+  }
+}
+
+int DirectoryEntry::ResolvePath(const std::string &server_name,
+                                const std::string &dir_path) {
+  // Parents are resolved before children, so id of a directory is
+  // always greater than id of its parent.
+  int id = 0;
+  size_t begin = 0;
+  while (id >= 0 && begin < dir_path.size()) {
+    size_t end = dir_path.find('/', begin);
+    if (end == std::string::npos)
+      end = dir_path.size();
+    id = Resolve(server_name, id, dir_path.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return id;
+}
+
+int DirectoryEntry::FindPath(const std::string &server_name,
+                             const std::string &dir_path) {
+  try {
+    mysqlpp::Query query =
+        get_db_connection().query("select id from mss_dirs dirs "
+                                  "where dirs.server_name = %0q:server "
+                                  "and dirs.parent_id = %1:parent "
+                                  "and dirs.name = %2q:name");
+    query.parse();
+
+    int id = 0;
+    size_t begin = 0;
+    while (begin < dir_path.size()) {
+      size_t end = dir_path.find('/', begin);
+      if (end == std::string::npos)
+        end = dir_path.size();
+      mysqlpp::StoreQueryResult result =
+          query.store(server_name, id, dir_path.substr(begin, end - begin));
+      if (result.size() != 1)
+        return -1;
+      id = result[0][0];
+      begin = end + 1;
+    }
+    return id;
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return -1;
+  }
+}
+
+std::string DirectoryEntry::PathOf(const int id) {
+  try {
+    mysqlpp::Query query =
+        get_db_connection().query("select parent_id, name from mss_dirs "
+                                  "dirs where dirs.id = %0:id");
+    query.parse();
+
+    std::string path;
+    for (int dir = id; dir != 0; ) {
+      mysqlpp::StoreQueryResult result = query.store(dir);
+      if (result.size() != 1) {
+        db_error_ = "No directory with id " + std::to_string(dir);
+        return std::string();
+      }
+      std::string name = result[0][1];
+      path = path.empty() ? name : name + "/" + path;
+      dir = result[0][0];
+    }
+    return path;
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return std::string();
+  }
+}
+
+std::string DirectoryEntry::get_dir_path() const {
+  if (dir_path_.empty() && id_ != 0)
+    dir_path_ = PathOf(id_);
+  return dir_path_;
+}
+
+std::shared_ptr<std::vector<std::shared_ptr<DirectoryEntry> > >
+DirectoryEntry::GetByServer(const std::string &server_name) {
+  try {
+    mysqlpp::Query query =
+        get_db_connection().query("select * from mss_dirs dirs "
+                                  "where dirs.server_name = %0q:server "
+                                  "order by dirs.id");
+    query.parse();
+    mysqlpp::StoreQueryResult result = query.store(server_name);
+
+    auto final_result =
+        std::shared_ptr<std::vector<std::shared_ptr<DirectoryEntry>>>(
+            new std::vector<std::shared_ptr<DirectoryEntry>>());
+    final_result->reserve(result.size());
+
+    // Parents precede their children, so paths are built in one pass.
+    std::unordered_map<int, std::string> paths;
+    for (mysqlpp::Row &row : result) {
+      std::shared_ptr<DirectoryEntry> dir(new DirectoryEntry(mss_dirs(row)));
+      if (dir->parent_id_ == 0) {
+        dir->dir_path_ = dir->name_;
+      } else {
+        auto parent = paths.find(dir->parent_id_);
+        if (parent == paths.end())
+          continue;
+        dir->dir_path_ = parent->second + "/" + dir->name_;
+      }
+      paths[dir->id_] = dir->dir_path_;
+      final_result->push_back(dir);
+    }
+
+    return final_result;
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return nullptr;
+  } catch(const std::bad_alloc &e) {
+    db_error_ = e.what();
+    return nullptr;
+  }
+}
+
+int DirectoryEntry::Touch(const std::vector<int> &ids) {
+  if (ids.empty())
+    return 0;
+
+  try {
+    mysqlpp::Query query = get_db_connection().query();
+    query << "update mss_dirs set last_seen = now() where id in (";
+    for (size_t i = 0; i < ids.size(); ++i)
+      query << (i ? "," : "") << ids[i];
+    query << ")";
+
+    return query.execute().rows();
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return -1;
+  }
+}
+
+int DirectoryEntry::DeleteNotSeenSince(const std::string &server_name,
+                                       const time_t since, const int limit) {
+  try {
+    // Directories which still have files are kept, so files never refer
+    // to deleted directories.
+    mysqlpp::Query select = get_db_connection().query(
+        "select id from mss_dirs dirs where dirs.server_name = %0q:server "
+        "and dirs.last_seen < from_unixtime(%1:since) and not exists "
+        "(select 1 from mss_files files where files.dir_id = dirs.id) "
+        "order by dirs.id desc limit %2:limit");
+    select.parse();
+    mysqlpp::StoreQueryResult result = select.store(server_name, since,
+                                                    limit);
+    if (result.empty())
+      return 0;
+
+    std::string ids;
+    for (mysqlpp::Row &row : result) {
+      if (!ids.empty())
+        ids.push_back(',');
+      ids.append(std::to_string(static_cast<int>(row[0])));
+    }
+
+    mysqlpp::Query query = get_db_connection().query();
+    query << "delete from mss_dirs where id in (" << ids << ")";
+    return query.execute().rows();
+  } catch(const mysqlpp::Exception &e) {
+    db_error_ = e.what();
+    return -1;
+  }
+}
@@ -33,6 +33,7 @@
 #define MYSQLPP_SSQLS_NO_STATICS
 #endif  // #ifndef EXPAND_MY_SSQLS_STATICS
 
+#include <stdint.h>
 #include <sys/time.h>
 
 #include <mysql++/mysql++.h>
@@ -53,11 +54,25 @@ sql_create_3(mss_attributes, 1, 3,
              mysqlpp::sql_varchar, name,
              mysqlpp::sql_enum, type);
 
-sql_create_5(mss_files, 1, 4,
+// mss_files and mss_dirs with their keys are created by schema.sql, rows
+// are read by position of columns.
+sql_create_7(mss_files, 1, 6,
              mysqlpp::sql_int, id,
              mysqlpp::sql_varchar, name,
-             mysqlpp::sql_varchar, file_path,
+             mysqlpp::sql_int, dir_id,
+             mysqlpp::sql_varchar, base_name,
              mysqlpp::sql_varchar, server_name,
+             mysqlpp::sql_bigint, path_hash,
+             mysqlpp::sql_timestamp, last_seen);
+
+// Top level directories of a server have parent_id 0.
+sql_create_7(mss_dirs, 1, 6,
+             mysqlpp::sql_int, id,
+             mysqlpp::sql_int, parent_id,
+             mysqlpp::sql_varchar, server_name,
+             mysqlpp::sql_varchar, name,
+             mysqlpp::sql_bigint, mtime,
+             mysqlpp::sql_int, child_count,
              mysqlpp::sql_timestamp, last_seen);
 
 /**
@@ -92,6 +107,29 @@ class DatabaseEntity {
      */
     static bool Disconnect();
 
+    /**
+     * Prepare calling thread to work with data base. Every thread except
+     * the one which connected to data base should call it before
+     * any request.
+     *
+     * @return true on success, false otherwise.
+     */
+    static bool ThreadStart();
+
+    /**
+     * Release resources allocated by ThreadStart(). Should be called
+     * before thread exit.
+     */
+    static void ThreadEnd();
+
+    /**
+     * Get current time of data base server. Timestamps of entries are set
+     * by data base server, so they should be compared with its time.
+     *
+     * @return Current time on success, -1 otherwise.
+     */
+    static time_t GetServerTime();
+
     /**
      * Stores the object in the database.
      * If this object is new and it still does not correspond to any record in
@@ -332,6 +370,33 @@ class FileEntry : DatabaseEntity {
     FileEntry(const std::string &file_name, const std::string &file_path,
               const std::string &server_name);
 
+    /**
+     * Constructor which create entry of file located in known directory
+     * at the database and return object corresponding to this entry.
+     *
+     * @param file_name name of new entry.
+     * @param dir_id id of directory where file located, 0 for top level.
+     * @param base_name name of file in the directory.
+     * @param server_name name or ip address of server where file located.
+     * @param path_hash hash of server and path to file, see PathHash().
+     */
+    FileEntry(const std::string &file_name, const int dir_id,
+              const std::string &base_name, const std::string &server_name,
+              const int64_t path_hash);
+
+    /**
+     * Compute hash which identifies file in data base. Entries of files
+     * are found and updated by it, names are compared only for entries
+     * with equal hashes.
+     *
+     * @param server_name name or ip address of server where file located.
+     * @param file_path path to file on server.
+     *
+     * @return 64-bit hash, it's signed to fit BIGINT column.
+     */
+    static int64_t PathHash(const std::string &server_name,
+                            const std::string &file_path);
+
     /**
      * The function finds the file entry by name. Insensitive comparison.
      *
@@ -406,7 +471,7 @@ class FileEntry : DatabaseEntity {
         const int max_rownum = 0);
 
     /**
-     * Find row with specifed server and path
+     * Find row with specifed server and path by hash of them.
      *
      * @param path path to file on server
      * @param server server where file is located
@@ -427,6 +492,45 @@ class FileEntry : DatabaseEntity {
      */
     static std::shared_ptr<FileEntry> GetById(const int id);
 
+    /**
+     * Update time when files were seen at the last time. Only files
+     * located directly in the directories are updated.
+     *
+     * @param dir_ids ids of directories.
+     *
+     * @return Number of updated entries on success, -1 otherwise.
+     */
+    static int TouchByDirs(const std::vector<int> &dir_ids);
+
+    /**
+     * Delete entries of files which weren't seen since specified time
+     * together with their parameters. At most limit entries are deleted
+     * in one transaction.
+     *
+     * @param server_name name or ip address of server where files were
+     * located.
+     * @param since time of data base server when scan of the server started.
+     * @param limit maximum number of entries to be deleted.
+     *
+     * @return Number of deleted entries on success, -1 otherwise.
+     */
+    static int DeleteNotSeenSince(const std::string &server_name,
+                                  const time_t since, const int limit);
+
+    /**
+     * Compute path hashes of entries migrated from the schema with full
+     * paths, they have path_hash 0 because MySQL can't compute the hash.
+     * At most limit entries are updated in one transaction.
+     *
+     * @param after id of the last entry updated by the previous call, 0
+     * at the first call.
+     * @param limit maximum number of entries to be updated.
+     *
+     * @return Id of the last updated entry, 0 if there are no entries
+     * left, -1 on error.
+     */
+    static int HashMigratedPaths(const int after, const int limit);
+
     /**
      * Set name of the file.
      *
@@ -473,12 +577,38 @@ class FileEntry : DatabaseEntity {
     }
 
     /**
-     * Get path to the file.
+     * Get path to the file. It's built from directories of the file on
+     * the first call.
      *
-     * @return Path to the file.
+     * @return Path to the file, empty string on error.
      */
-    inline std::string get_file_path() const {
-      return file_path_;
+    std::string get_file_path() const;
+
+    /**
+     * Get id of directory where file located.
+     *
+     * @return id of the directory, 0 for top level.
+     */
+    inline int get_dir_id() const {
+      return dir_id_;
+    }
+
+    /**
+     * Get name of the file in its directory.
+     *
+     * @return Name of the file in its directory.
+     */
+    inline std::string get_base_name() const {
+      return base_name_;
+    }
+
+    /**
+     * Get hash of server and path to the file.
+     *
+     * @return Hash of server and path to the file.
+     */
+    inline int64_t get_path_hash() const {
+      return path_hash_;
     }
 
     /**
@@ -504,17 +634,21 @@ class FileEntry : DatabaseEntity {
 
     explicit FileEntry(const mss_files &orig_row);
 
-    FileEntry(const int id, const std::string &name,
-              const std::string &file_path, const std::string &server_name,
-              const time_t timestamp, const mss_files &orig_row);
+    FileEntry(const int id, const std::string &name, const int dir_id,
+              const std::string &base_name, const std::string &server_name,
+              const int64_t path_hash, const time_t timestamp,
+              const mss_files &orig_row);
 
     static std::vector<std::shared_ptr<FileEntry> > *QueryResultToVector(
         mysqlpp::StoreQueryResult &result);
 
     int id_;
     std::string name_;
-    std::string file_path_;
+    int dir_id_;
+    std::string base_name_;
+    mutable std::string file_path_;
     std::string server_name_;
+    int64_t path_hash_;
     time_t timestamp_;
     mss_files orig_row_;
 };
@@ -691,4 +825,202 @@ class FileParameter : DatabaseEntity {
     mss_parameters orig_row_;
 };
 
+/**
+ * One instance of this class corresponds to a single row in the database
+ * mss_dirs table.
+ *
+ * mss_dirs - a table containing the tree of directories found on the net
+ * and their signatures at the last scan. Files refer to their directories,
+ * paths are built from the tree. Signatures are used to skip unchanged
+ * directories.
+ */
+class DirectoryEntry : DatabaseEntity {
+  public:
+    virtual bool Commit() { return false; }
+    virtual bool Delete() { return false; }
+
+    /**
+     * Constructor which create entry with specifed parameters at the
+     * database or update existing one and return object corresponding to
+     * this entry.
+     *
+     * @param server_name name or ip address of server where directory
+     * located.
+     * @param dir_path path to directory on server.
+     * @param mtime time of last modification of the directory.
+     * @param child_count number of entries in the directory.
+     */
+    DirectoryEntry(const std::string &server_name, const std::string &dir_path,
+                   const time_t mtime, const int child_count);
+
+    /**
+     * Constructor which create entry of directory with known parent at the
+     * database or update existing one and return object corresponding to
+     * this entry.
+     *
+     * @param server_name name or ip address of server where directory
+     * located.
+     * @param parent_id id of parent directory, 0 for top level.
+     * @param name name of directory in its parent.
+     * @param mtime time of last modification of the directory.
+     * @param child_count number of entries in the directory.
+     */
+    DirectoryEntry(const std::string &server_name, const int parent_id,
+                   const std::string &name, const time_t mtime,
+                   const int child_count);
+
+    /**
+     * Find id of directory, entry of directory is created if it doesn't
+     * exist. Signature and last_seen of existing directory aren't changed.
+     *
+     * @param server_name name or ip address of server where directory
+     * located.
+     * @param parent_id id of parent directory, 0 for top level.
+     * @param name name of directory in its parent.
+     *
+     * @return id of directory on success, -1 otherwise.
+     */
+    static int Resolve(const std::string &server_name, const int parent_id,
+                       const std::string &name);
+
+    /**
+     * Find id of directory by its path, entries of the directory and its
+     * parents are created if they don't exist.
+     *
+     * @param server_name name or ip address of server where directory
+     * located.
+     * @param dir_path path to directory on server.
+     *
+     * @return id of directory, 0 for empty path, -1 on error.
+     */
+    static int ResolvePath(const std::string &server_name,
+                           const std::string &dir_path);
+
+    /**
+     * Find id of existing directory by its path.
+     *
+     * @param server_name name or ip address of server where directory
+     * located.
+     * @param dir_path path to directory on server.
+     *
+     * @return id of directory, 0 for empty path, -1 if directory isn't
+     * found or on error.
+     */
+    static int FindPath(const std::string &server_name,
+                        const std::string &dir_path);
+
+    /**
+     * Build path to directory from its parents.
+     *
+     * @param id id of directory.
+     *
+     * @return Path to directory on server, empty string for 0 or on error.
+     */
+    static std::string PathOf(const int id);
+
+    /**
+     * Find all directories located on specified server. Paths of them are
+     * built at once.
+     *
+     * @param server_name name or ip address of server.
+     *
+     * @return pointer to vector with objects corresponding to records founded
+     * in the database, if error will ocured - returns nullptr.
+     */
+    static std::shared_ptr<std::vector<std::shared_ptr<DirectoryEntry> > >
+        GetByServer(const std::string &server_name);
+
+    /**
+     * Update time when directories were seen at the last time.
+     *
+     * @param ids ids of directories.
+     *
+     * @return Number of updated entries on success, -1 otherwise.
+     */
+    static int Touch(const std::vector<int> &ids);
+
+    /**
+     * Delete entries of directories which weren't seen since specified
+     * time and have no files. At most limit entries are deleted at once,
+     * children are deleted before their parents.
+     *
+     * @param server_name name or ip address of server where directories
+     * were located.
+     * @param since time of data base server when scan of the server started.
+     * @param limit maximum number of entries to be deleted.
+     *
+     * @return Number of deleted entries on success, -1 otherwise.
+     */
+    static int DeleteNotSeenSince(const std::string &server_name,
+                                  const time_t since, const int limit);
+
+    /**
+     * Get id of the directory.
+     *
+     * @return id of the directory.
+     */
+    inline int get_id() const { return id_; }
+
+    /**
+     * Get name of the host when directory situates.
+     *
+     * @return name of the host when directory situates.
+     */
+    inline std::string get_server_name() const { return server_name_; }
+
+    /**
+     * Get id of parent directory.
+     *
+     * @return id of parent directory, 0 for top level.
+     */
+    inline int get_parent_id() const { return parent_id_; }
+
+    /**
+     * Get name of the directory in its parent.
+     *
+     * @return Name of the directory.
+     */
+    inline std::string get_name() const { return name_; }
+
+    /**
+     * Get path to the directory. It's built from parents of the directory
+     * on the first call.
+     *
+     * @return Path to the directory.
+     */
+    std::string get_dir_path() const;
+
+    /**
+     * Get time of last modification of the directory.
+     *
+     * @return Time of last modification of the directory.
+     */
+    inline time_t get_mtime() const { return mtime_; }
+
+    /**
+     * Get number of entries in the directory.
+     *
+     * @return Number of entries in the directory.
+     */
+    inline int get_child_count() const { return child_count_; }
+
+  private:
+    DirectoryEntry();
+    explicit DirectoryEntry(const mss_dirs &orig_row);
+
+    /**
+     * Create entry of directory or update signature of existing one.
+     */
+    void Save();
+
+    int id_;
+    int parent_id_;
+    std::string server_name_;
+    std::string name_;
+    mutable std::string dir_path_;
+    time_t mtime_;
+    int child_count_;
+    mss_dirs orig_row_;
+};
+
 #endif  // DATA_STORAGE_ENTITIES_H_
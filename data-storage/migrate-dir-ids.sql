@@ -0,0 +1,114 @@
+-- Upgrade a data base which keeps full paths of files in
+-- mss_files.file_path ("path/to/file") to the schema of schema.sql.
+--
+-- Directories of the paths are moved to mss_dirs, files keep their ids
+-- and parameters and get dir_id and base_name. MySQL can't compute the
+-- path hash, so migrated files get path_hash 0 and the spider hashes
+-- them when it starts (FileEntry::HashMigratedPaths()).
+--
+-- DDL isn't transactional in MySQL, back up the data base first. Paths
+-- deeper than 1000 directories aren't supported. Names are converted
+-- to utf8mb4 and compared as bytes, so directories which differ only in
+-- case stay apart.
+
+-- mss_dirs of the old layout (server_name, dir_path) only keeps
+-- signatures of directories, they are taken again at the next scan.
+DROP TABLE IF EXISTS mss_dirs;
+
+CREATE TABLE mss_dirs (
+  id INT NOT NULL AUTO_INCREMENT,
+  parent_id INT NOT NULL DEFAULT 0,
+  server_name VARCHAR(255) NOT NULL,
+  name VARCHAR(255) NOT NULL,
+  mtime BIGINT NOT NULL DEFAULT 0,
+  child_count INT NOT NULL DEFAULT 0,
+  last_seen TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  PRIMARY KEY (id),
+  UNIQUE KEY server_parent_name (server_name, parent_id, name),
+  KEY server_last_seen (server_name, last_seen)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_bin;
+
+-- Levels 1..1000 of paths.
+CREATE TABLE mss_migrate_levels (depth INT NOT NULL PRIMARY KEY);
+INSERT INTO mss_migrate_levels (depth)
+SELECT hundreds.n * 100 + tens.n * 10 + ones.n + 1
+FROM (SELECT 0 n UNION ALL SELECT 1 UNION ALL SELECT 2 UNION ALL SELECT 3
+      UNION ALL SELECT 4 UNION ALL SELECT 5 UNION ALL SELECT 6
+      UNION ALL SELECT 7 UNION ALL SELECT 8 UNION ALL SELECT 9) hundreds
+CROSS JOIN
+     (SELECT 0 n UNION ALL SELECT 1 UNION ALL SELECT 2 UNION ALL SELECT 3
+      UNION ALL SELECT 4 UNION ALL SELECT 5 UNION ALL SELECT 6
+      UNION ALL SELECT 7 UNION ALL SELECT 8 UNION ALL SELECT 9) tens
+CROSS JOIN
+     (SELECT 0 n UNION ALL SELECT 1 UNION ALL SELECT 2 UNION ALL SELECT 3
+      UNION ALL SELECT 4 UNION ALL SELECT 5 UNION ALL SELECT 6
+      UNION ALL SELECT 7 UNION ALL SELECT 8 UNION ALL SELECT 9) ones;
+
+-- Every directory of every path, "path/to/file" gives "path" at level 1
+-- and "path/to" at level 2. Directories are numbered by levels, so like
+-- in DirectoryEntry::ResolvePath() id of a directory is always greater
+-- than id of its parent.
+CREATE TABLE mss_migrate_dirs (
+  id INT NOT NULL AUTO_INCREMENT,
+  server_name VARCHAR(255) NOT NULL,
+  path VARCHAR(4096) NOT NULL,
+  depth INT NOT NULL,
+  parent_id INT NOT NULL DEFAULT 0,
+  PRIMARY KEY (id),
+  KEY server_path (server_name(100), path(150))
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_bin;
+
+INSERT INTO mss_migrate_dirs (server_name, path, depth)
+SELECT DISTINCT
+       CONVERT(files.server_name USING utf8mb4) COLLATE utf8mb4_bin,
+       CONVERT(SUBSTRING_INDEX(files.file_path, '/', levels.depth)
+               USING utf8mb4) COLLATE utf8mb4_bin,
+       levels.depth
+FROM mss_files files
+JOIN mss_migrate_levels levels
+  ON levels.depth <= CHAR_LENGTH(files.file_path) -
+                     CHAR_LENGTH(REPLACE(files.file_path, '/', ''))
+ORDER BY levels.depth;
+
+UPDATE mss_migrate_dirs dirs
+JOIN mss_migrate_dirs parents
+  ON parents.server_name = dirs.server_name
+ AND parents.depth = dirs.depth - 1
+ AND parents.path = SUBSTRING_INDEX(dirs.path, '/', dirs.depth - 1)
+SET dirs.parent_id = parents.id;
+
+-- Signatures are unknown, so every directory is listed at the next scan.
+INSERT INTO mss_dirs (id, parent_id, server_name, name, mtime, child_count)
+SELECT id, parent_id, server_name, SUBSTRING_INDEX(path, '/', -1), 0, 0
+FROM mss_migrate_dirs
+ORDER BY id;
+
+-- Columns are added in the order of mss_files in entities.h.
+ALTER TABLE mss_files
+  ADD COLUMN dir_id INT NOT NULL DEFAULT 0 AFTER name,
+  ADD COLUMN base_name VARCHAR(255) NOT NULL DEFAULT '' AFTER dir_id,
+  ADD COLUMN path_hash BIGINT NOT NULL DEFAULT 0 AFTER server_name;
+
+UPDATE mss_files files
+SET files.base_name = SUBSTRING_INDEX(files.file_path, '/', -1);
+
+-- Files at the top level keep dir_id 0.
+UPDATE mss_files files
+JOIN mss_migrate_dirs dirs
+  ON dirs.server_name =
+     CONVERT(files.server_name USING utf8mb4) COLLATE utf8mb4_bin
+ AND dirs.path =
+     CONVERT(LEFT(files.file_path,
+                  CHAR_LENGTH(files.file_path) -
+                  CHAR_LENGTH(files.base_name) - 1)
+             USING utf8mb4) COLLATE utf8mb4_bin
+SET files.dir_id = dirs.id;
+
+ALTER TABLE mss_files
+  DROP COLUMN file_path,
+  ADD KEY path_hash (path_hash),
+  ADD KEY dir_id (dir_id),
+  ADD KEY server_last_seen (server_name, last_seen);
+
+DROP TABLE mss_migrate_dirs;
+DROP TABLE mss_migrate_levels;
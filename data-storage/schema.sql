@@ -0,0 +1,42 @@
+-- Tables of files and directories found by the spider.
+--
+-- Columns are in the order of mss_files and mss_dirs in entities.h, rows
+-- are read into them by position. mss_attributes and mss_parameters
+-- aren't changed. Data bases created with full paths in
+-- mss_files.file_path are upgraded by migrate-dir-ids.sql.
+--
+-- Unique keys on two VARCHAR(255) columns in utf8mb4 need MySQL 5.7 or
+-- later, names are compared as bytes like on the servers.
+
+CREATE TABLE mss_dirs (
+  id INT NOT NULL AUTO_INCREMENT,
+  -- Top level directories of a server have parent_id 0.
+  parent_id INT NOT NULL DEFAULT 0,
+  server_name VARCHAR(255) NOT NULL,
+  name VARCHAR(255) NOT NULL,
+  -- Signature of the directory at the last scan, 0 if it's unknown.
+  mtime BIGINT NOT NULL DEFAULT 0,
+  child_count INT NOT NULL DEFAULT 0,
+  last_seen TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  PRIMARY KEY (id),
+  UNIQUE KEY server_parent_name (server_name, parent_id, name),
+  KEY server_last_seen (server_name, last_seen)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4 COLLATE=utf8mb4_bin;
+
+CREATE TABLE mss_files (
+  id INT NOT NULL AUTO_INCREMENT,
+  -- Name parsed for search.
+  name VARCHAR(255) NOT NULL,
+  -- Directory of the file in mss_dirs, 0 for files at the top level.
+  dir_id INT NOT NULL DEFAULT 0,
+  base_name VARCHAR(255) NOT NULL,
+  server_name VARCHAR(255) NOT NULL,
+  -- FileEntry::PathHash() of the server and the path, 0 until it's
+  -- computed by the spider for migrated entries.
+  path_hash BIGINT NOT NULL DEFAULT 0,
+  last_seen TIMESTAMP NOT NULL DEFAULT CURRENT_TIMESTAMP,
+  PRIMARY KEY (id),
+  KEY path_hash (path_hash),
+  KEY dir_id (dir_id),
+  KEY server_last_seen (server_name, last_seen)
+) ENGINE=InnoDB DEFAULT CHARSET=utf8mb4;
@@ -0,0 +1,258 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/**
+ * @file hash-inl.h
+ *
+ * Fast non-cryptographic 64-bit hash (XXH64) used to build compact keys
+ * of file paths and contents.
+ */
+
+#ifndef HASH_INL_H_
+#define HASH_INL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+namespace hash {
+
+const uint64_t kPrime1 = 0x9e3779b185ebca87ULL;
+const uint64_t kPrime2 = 0xc2b2ae3d27d4eb4fULL;
+const uint64_t kPrime3 = 0x165667b19e3779f9ULL;
+const uint64_t kPrime4 = 0x85ebca77c2b2ae63ULL;
+const uint64_t kPrime5 = 0x27d4eb2f165667c5ULL;
+
+inline uint64_t Rotl(const uint64_t x, const int r) {
+  return (x << r) | (x >> (64 - r));
+}
+
+inline uint64_t Read64(const unsigned char *p) {
+  uint64_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint32_t Read32(const unsigned char *p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return value;
+}
+
+inline uint64_t Round(uint64_t acc, const uint64_t input) {
+  acc += input * kPrime2;
+  acc = Rotl(acc, 31);
+  return acc * kPrime1;
+}
+
+inline uint64_t Merge(uint64_t acc, const uint64_t value) {
+  acc ^= Round(0, value);
+  return acc * kPrime1 + kPrime4;
+}
+
+/**
+ * Combine four lanes of XXH64 after all 32-byte stripes are consumed.
+ */
+inline uint64_t Converge(const uint64_t *v) {
+  uint64_t h = Rotl(v[0], 1) + Rotl(v[1], 7) + Rotl(v[2], 12) +
+               Rotl(v[3], 18);
+  for (int i = 0; i < 4; ++i)
+    h = Merge(h, v[i]);
+  return h;
+}
+
+/**
+ * Mix the last bytes of data shorter than a stripe into the hash and
+ * avalanche it.
+ */
+inline uint64_t Finalize(uint64_t h, const unsigned char *p,
+                         const unsigned char *end) {
+  for (; p + 8 <= end; p += 8) {
+    h ^= Round(0, Read64(p));
+    h = Rotl(h, 27) * kPrime1 + kPrime4;
+  }
+  if (p + 4 <= end) {
+    h ^= static_cast<uint64_t>(Read32(p)) * kPrime1;
+    h = Rotl(h, 23) * kPrime2 + kPrime3;
+    p += 4;
+  }
+  for (; p < end; ++p) {
+    h ^= *p * kPrime5;
+    h = Rotl(h, 11) * kPrime1;
+  }
+
+  h ^= h >> 33;
+  h *= kPrime2;
+  h ^= h >> 29;
+  h *= kPrime3;
+  h ^= h >> 32;
+  return h;
+}
+
+/**
+ * Compute XXH64 hash of data. Result is the same as of the reference
+ * implementation on little-endian machines.
+ *
+ * @param data Data to be hashed.
+ * @param length Size of the data.
+ * @param seed Seed of the hash.
+ *
+ * @return 64-bit hash.
+ */
+inline uint64_t Hash64(const void *data, const size_t length,
+                       const uint64_t seed = 0) {
+  const unsigned char *p = static_cast<const unsigned char*>(data);
+  const unsigned char *end = p + length;
+  uint64_t h;
+
+  if (length >= 32) {
+    uint64_t v[4] = { seed + kPrime1 + kPrime2, seed + kPrime2, seed,
+                      seed - kPrime1 };
+    const unsigned char *limit = end - 32;
+    do {
+      v[0] = Round(v[0], Read64(p));
+      v[1] = Round(v[1], Read64(p + 8));
+      v[2] = Round(v[2], Read64(p + 16));
+      v[3] = Round(v[3], Read64(p + 24));
+      p += 32;
+    } while (p <= limit);
+    h = Converge(v);
+  } else {
+    h = seed + kPrime5;
+  }
+
+  return Finalize(h + length, p, end);
+}
+
+/**
+ * Compute XXH64 hash of string.
+ *
+ * @param str String to be hashed.
+ * @param seed Seed of the hash.
+ *
+ * @return 64-bit hash.
+ */
+inline uint64_t Hash64(const std::string &str, const uint64_t seed = 0) {
+  return Hash64(str.data(), str.size(), seed);
+}
+
+/**
+ * Streaming XXH64 for data which doesn't fit in memory, e.g. whole
+ * files read by chunks. Result is the same as of Hash64() of all data
+ * passed to Update(). Four lanes of the hash are independent, so they
+ * are computed in parallel by superscalar CPUs.
+ */
+class Stream64 {
+ public:
+  /**
+   * Start new hash.
+   *
+   * @param seed Seed of the hash.
+   */
+  explicit Stream64(const uint64_t seed = 0) { Reset(seed); }
+
+  /**
+   * Start new hash, data passed before is forgotten.
+   *
+   * @param seed Seed of the hash.
+   */
+  inline void Reset(const uint64_t seed = 0) {
+    seed_ = seed;
+    v_[0] = seed + kPrime1 + kPrime2;
+    v_[1] = seed + kPrime2;
+    v_[2] = seed;
+    v_[3] = seed - kPrime1;
+    length_ = 0;
+    buffered_ = 0;
+  }
+
+  /**
+   * Add next part of data.
+   *
+   * @param data Data to be hashed.
+   * @param length Size of the data.
+   */
+  inline void Update(const void *data, size_t length) {
+    const unsigned char *p = static_cast<const unsigned char*>(data);
+    length_ += length;
+
+    // Stripe started by the previous part is completed first.
+    if (buffered_ != 0) {
+      size_t fill = std::min(length, sizeof(buffer_) - buffered_);
+      memcpy(buffer_ + buffered_, p, fill);
+      buffered_ += fill;
+      p += fill;
+      length -= fill;
+      if (buffered_ < sizeof(buffer_))
+        return;
+      Consume(buffer_);
+      buffered_ = 0;
+    }
+
+    for (; length >= sizeof(buffer_); p += sizeof(buffer_),
+                                      length -= sizeof(buffer_))
+      Consume(p);
+
+    memcpy(buffer_, p, length);
+    buffered_ = length;
+  }
+
+  /**
+   * Get hash of data passed so far, more data can be added after it.
+   *
+   * @return 64-bit hash.
+   */
+  inline uint64_t Digest() const {
+    uint64_t h = length_ >= sizeof(buffer_) ? Converge(v_) : seed_ + kPrime5;
+    return Finalize(h + length_, buffer_, buffer_ + buffered_);
+  }
+
+  inline uint64_t get_length() const { return length_; }
+
+ private:
+  /**
+   * Mix one 32-byte stripe into the lanes.
+   */
+  inline void Consume(const unsigned char *p) {
+    v_[0] = Round(v_[0], Read64(p));
+    v_[1] = Round(v_[1], Read64(p + 8));
+    v_[2] = Round(v_[2], Read64(p + 16));
+    v_[3] = Round(v_[3], Read64(p + 24));
+  }
+
+  uint64_t seed_;
+  uint64_t v_[4];
+  uint64_t length_;
+  unsigned char buffer_[32];
+  size_t buffered_;
+};
+
+}  // namespace hash
+
+#endif  // HASH_INL_H_
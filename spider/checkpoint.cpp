@@ -0,0 +1,256 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "spider/checkpoint.h"
+
+Checkpoint::Checkpoint() : log_(NULL), start_(0), error_(0) {}
+
+Checkpoint::~Checkpoint() {
+  Close();
+}
+
+int Checkpoint::Begin(const std::string &path, const std::string &server,
+                      const time_t start) {
+  Close();
+  frontier_.clear();
+  committed_.clear();
+  committed_dirs_.clear();
+
+  if ((log_ = fopen(path.c_str(), "w")) == NULL) {
+    error_ = errno;
+    MSS_ERROR(("fopen " + path).c_str(), error_);
+    return -1;
+  }
+
+  path_ = path;
+  start_ = start;
+  fprintf(log_, "S %lld %s\n", static_cast<long long>(start),  // NOLINT
+          server.c_str());
+  Sync();
+  return 0;
+}
+
+int Checkpoint::Resume(const std::string &path, const std::string &server) {
+  Close();
+  start_ = 0;
+  frontier_.clear();
+  committed_.clear();
+  committed_dirs_.clear();
+
+  FILE *fin = fopen(path.c_str(), "r");
+  if (fin == NULL) {
+    error_ = errno;
+    return -1;
+  }
+
+  char *buf = NULL;
+  size_t size = 0;
+  ssize_t length;
+  long long start = 0;  // NOLINT(runtime/int)
+  std::vector<DirTask> found;
+  std::unordered_map<std::string, DirSignature> committed;
+
+  while ((length = getline(&buf, &size, fin)) > 0) {
+    // The last line can be torn by crash.
+    if (buf[length - 1] != '\n')
+      break;
+    buf[length - 1] = '\0';
+
+    long long mtime;  // NOLINT(runtime/int)
+    int child_count, offset = 0;
+    if (sscanf(buf, "S %lld %n", &start, &offset) == 1 && offset) {
+      if (server != buf + offset)
+        break;
+      start_ = start;
+    } else if (start_ == 0) {
+      // Log should start from the server.
+      break;
+    } else if (sscanf(buf, "D %lld %n", &mtime, &offset) == 1 && offset) {
+      DirTask dir = { buf + offset, static_cast<time_t>(mtime), 0 };
+      found.push_back(dir);
+    } else if (sscanf(buf, "C %lld %d %n", &mtime, &child_count,
+                      &offset) == 2 && offset) {
+      DirSignature signature = { static_cast<time_t>(mtime), child_count };
+      committed[buf + offset] = signature;
+    }
+    offset = 0;
+  }
+
+  free(buf);
+  fclose(fin);
+
+  if (start_ == 0) {
+    error_ = ENOENT;
+    return -1;
+  }
+
+  std::unordered_set<std::string> pending;
+  for (const DirTask &dir : found) {
+    if (committed.find(dir.path) == committed.end())
+      pending.insert(dir.path);
+  }
+
+  // Subdirectories of directories which are scanned again are found again.
+  for (const DirTask &dir : found) {
+    if (pending.find(dir.path) == pending.end() ||
+        pending.find(dir.path.substr(0, dir.path.rfind('/'))) !=
+        pending.end())
+      continue;
+    frontier_.push_back(dir);
+  }
+  for (const auto &dir : committed) {
+    committed_.push_back(dir);
+    committed_dirs_.insert(dir.first);
+  }
+
+  // Compacted log contains only committed directories and the frontier.
+  std::string compacted = path + ".tmp";
+  if ((log_ = fopen(compacted.c_str(), "w")) == NULL) {
+    error_ = errno;
+    MSS_ERROR(("fopen " + compacted).c_str(), error_);
+    return -1;
+  }
+  fprintf(log_, "S %lld %s\n", static_cast<long long>(start),  // NOLINT
+          server.c_str());
+  for (const auto &dir : committed_) {
+    fprintf(log_, "C %lld %d %s\n",
+            static_cast<long long>(dir.second.mtime),  // NOLINT
+            dir.second.child_count, dir.first.c_str());
+  }
+  for (const DirTask &dir : found) {
+    if (pending.find(dir.path) != pending.end()) {
+      fprintf(log_, "D %lld %s\n", static_cast<long long>(dir.mtime),  // NOLINT
+              dir.path.c_str());
+    }
+  }
+  Sync();
+
+  if (UNLIKELY(rename(compacted.c_str(), path.c_str()))) {
+    error_ = errno;
+    MSS_ERROR(("rename " + compacted).c_str(), error_);
+    fclose(log_);
+    log_ = NULL;
+    return -1;
+  }
+
+  path_ = path;
+  return 0;
+}
+
+void Checkpoint::AddDir(const DirTask &dir) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (log_ != NULL) {
+    fprintf(log_, "D %lld %s\n", static_cast<long long>(dir.mtime),  // NOLINT
+            dir.path.c_str());
+  }
+}
+
+bool Checkpoint::WasCommitted(const std::string &dir) const {
+  return !committed_dirs_.empty() &&
+         committed_dirs_.find(dir) != committed_dirs_.end();
+}
+
+void Checkpoint::ListedDir(const std::string &dir,
+                           const DirSignature &signature,
+                           const size_t files) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (log_ == NULL)
+    return;
+
+  if (files == 0) {
+    LogCommitted(dir, signature);
+  } else {
+    Pending pending = { signature, files };
+    pending_[dir] = pending;
+  }
+}
+
+void Checkpoint::CommittedFiles(const std::string &dir, const size_t files) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (log_ == NULL)
+    return;
+
+  auto pending = pending_.find(dir);
+  if (pending == pending_.end())
+    return;
+  pending->second.files -= std::min(files, pending->second.files);
+  if (pending->second.files == 0) {
+    LogCommitted(pending->first, pending->second.signature);
+    pending_.erase(pending);
+  }
+}
+
+void Checkpoint::LogCommitted(const std::string &dir,
+                              const DirSignature &signature) {
+  fprintf(log_, "C %lld %d %s\n",
+          static_cast<long long>(signature.mtime),  // NOLINT(runtime/int)
+          signature.child_count, dir.c_str());
+}
+
+void Checkpoint::Flush() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  Sync();
+}
+
+void Checkpoint::Sync() {
+  if (log_ == NULL)
+    return;
+
+  if (UNLIKELY(fflush(log_) || fdatasync(fileno(log_)))) {
+    error_ = errno;
+    MSS_ERROR(("fflush " + path_).c_str(), error_);
+  }
+}
+
+void Checkpoint::Finish() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (log_ == NULL)
+    return;
+
+  fclose(log_);
+  log_ = NULL;
+  pending_.clear();
+  if (UNLIKELY(unlink(path_.c_str()))) {
+    error_ = errno;
+    MSS_ERROR(("unlink " + path_).c_str(), error_);
+  }
+}
+
+void Checkpoint::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (log_ == NULL)
+    return;
+
+  Sync();
+  fclose(log_);
+  log_ = NULL;
+  pending_.clear();
+}
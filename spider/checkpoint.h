@@ -0,0 +1,228 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_CHECKPOINT_H_
+#define SPIDER_CHECKPOINT_H_
+
+#include <stdio.h>
+#include <time.h>
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "common-inl.h"
+#include "spider/dirtask.h"
+
+/**
+ * Append-only log of the scan of one server which lets the spider resume
+ * the scan after a crash or restart.
+ *
+ * A directory is logged when it's found and when all its files are
+ * committed to data base. Directories which are found but not committed
+ * form the frontier of the scan and are scanned again on resume. Files of
+ * a directory can be committed partially before the crash, so they are
+ * added again, which is harmless because file entries are upserted.
+ *
+ * Records are buffered and flushed by Flush(). A lost tail of the log only
+ * makes more directories to be scanned again, because a directory is
+ * always logged as committed after its subdirectories are logged as found.
+ *
+ * Format of records, one per line (path is last, it can contain spaces):
+ *   S <start time> <server>            scan started
+ *   D <mtime> <path>                   directory found
+ *   C <mtime> <child count> <path>     directory committed with signature
+ */
+class Checkpoint {
+ public:
+  /**
+   * Simple constructor, the checkpoint is closed and all methods which
+   * log records do nothing.
+   */
+  Checkpoint();
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+  /**
+   * Destructor, flushes and closes the log.
+   */
+  ~Checkpoint();
+#endif  // DOXYGEN_SHOULD_SKIP_THIS
+
+  /**
+   * Start new log of the scan of the server.
+   *
+   * @param path Log file name.
+   * @param server Server to be scanned.
+   * @param start Time when the scan started.
+   *
+   * @return 0 on success, -1 otherwise and error_ is set.
+   */
+  int Begin(const std::string &path, const std::string &server,
+            const time_t start);
+
+  /**
+   * Load log of interrupted scan of the server. The log is compacted and
+   * opened to continue the scan.
+   *
+   * @param path Log file name.
+   * @param server Server to be scanned.
+   *
+   * @return 0 on success, -1 if there is no log of the server and error_
+   * is set.
+   */
+  int Resume(const std::string &path, const std::string &server);
+
+  /**
+   * Log found directory.
+   *
+   * @param dir Found directory.
+   */
+  void AddDir(const DirTask &dir);
+
+  /**
+   * Check if the directory was committed before the scan was resumed.
+   * It's safe to call from any thread during the scan.
+   *
+   * @param dir Full smb path to the directory.
+   *
+   * @return true if the directory shouldn't be scanned again.
+   */
+  bool WasCommitted(const std::string &dir) const;
+
+  /**
+   * Register listed directory. It's logged as committed when all its
+   * files are committed.
+   *
+   * @param dir Full smb path to the directory.
+   * @param signature Signature of the directory, mtime is 0 if it
+   * shouldn't be saved.
+   * @param files Number of files which will be committed.
+   */
+  void ListedDir(const std::string &dir, const DirSignature &signature,
+                 const size_t files);
+
+  /**
+   * Register committed files of the directory.
+   *
+   * @param dir Full smb path to the directory.
+   * @param files Number of committed files of the directory.
+   */
+  void CommittedFiles(const std::string &dir, const size_t files);
+
+  /**
+   * Write buffered records to disk.
+   */
+  void Flush();
+
+  /**
+   * Remove the log after the scan is finished successfully.
+   */
+  void Finish();
+
+  /**
+   * Close the log, it can be resumed later.
+   */
+  void Close();
+
+  inline bool is_open() const { return log_ != NULL; }
+  inline time_t get_start() const { return start_; }
+  inline int get_error() const { return error_; }
+
+  /**
+   * Get directories which should be scanned on resume. Directories which
+   * parents are scanned again aren't included, they are found again.
+   */
+  inline const std::vector<DirTask> &get_frontier() const {
+    return frontier_;
+  }
+
+  /**
+   * Get directories committed before resume with their signatures.
+   */
+  inline const std::vector<std::pair<std::string, DirSignature>> &
+      get_committed() const {
+    return committed_;
+  }
+
+ private:
+  /**
+   * Write committed record of the directory.
+   */
+  void LogCommitted(const std::string &dir, const DirSignature &signature);
+
+  /**
+   * Write buffered records to disk, mutex_ should be locked.
+   */
+  void Sync();
+
+  /**
+   * Log file name.
+   */
+  std::string path_;
+
+  /**
+   * Opened log.
+   */
+  FILE *log_;
+
+  /**
+   * Time when the scan started.
+   */
+  time_t start_;
+
+  /**
+   * Listed directories which files aren't committed yet.
+   */
+  struct Pending {
+    DirSignature signature;
+    size_t files;
+  };
+  std::unordered_map<std::string, Pending> pending_;
+
+  /**
+   * Loaded state of interrupted scan.
+   */
+  std::vector<DirTask> frontier_;
+  std::vector<std::pair<std::string, DirSignature>> committed_;
+  std::unordered_set<std::string> committed_dirs_;
+
+  /**
+   * Mutex to protect the log and pending directories.
+   */
+  std::mutex mutex_;
+
+  /**
+   * Last error.
+   */
+  int error_;
+
+  DISALLOW_COPY_AND_ASSIGN(Checkpoint);
+};
+
+#endif  // SPIDER_CHECKPOINT_H_
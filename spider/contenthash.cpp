@@ -0,0 +1,93 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+
+#include "hash-inl.h"
+#include "spider/contenthash.h"
+
+ContentHasher::ContentHasher(const size_t chunk_size, Bandwidth *bandwidth)
+    : buffer_(std::max<size_t>(chunk_size, 1)),
+      bandwidth_(bandwidth),
+      error_(0) {}
+
+int ContentHasher::Hash(CrawlSource *source, const std::string &path,
+                        const off_t size, uint64_t *hash,
+                        uint64_t *fingerprint) {
+  CrawlSource::File file = source->OpenFile(path);
+  if (UNLIKELY(file == NULL)) {
+    error_ = source->get_error();
+    return -1;
+  }
+
+  off_t offsets[Fingerprint::kBlocks];
+  size_t count = Fingerprint::Offsets(size, offsets);
+  memset(blocks_, 0, sizeof(blocks_));
+
+  hash::Stream64 stream;
+  ssize_t read;
+  while ((read = source->ReadFile(file, buffer_.data(),
+                                  buffer_.size())) > 0) {
+    SampleChunk(offsets, count, stream.get_length(), read);
+    stream.Update(buffer_.data(), read);
+    if (bandwidth_ != NULL)
+      bandwidth_->Consume(path, read);
+  }
+
+  if (UNLIKELY(read < 0)) {
+    error_ = source->get_error();
+    source->CloseFile(file);
+    return -1;
+  }
+  source->CloseFile(file);
+
+  // Modified file is hashed again at the next scan.
+  if (UNLIKELY(stream.get_length() != static_cast<uint64_t>(size))) {
+    error_ = EAGAIN;
+    return -1;
+  }
+
+  *hash = stream.Digest();
+  *fingerprint = Fingerprint::Hash(size, blocks_);
+  return 0;
+}
+
+void ContentHasher::SampleChunk(const off_t *offsets, const size_t count,
+                                const off_t position, const size_t size) {
+  const off_t end = position + size;
+  for (size_t i = 0; i < count; ++i) {
+    off_t first = std::max(position, offsets[i]);
+    off_t last = std::min<off_t>(end, offsets[i] + Fingerprint::kBlockSize);
+    if (first < last) {
+      memcpy(blocks_ + i * Fingerprint::kBlockSize + (first - offsets[i]),
+             buffer_.data() + (first - position), last - first);
+    }
+  }
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_CONTENTHASH_H_
+#define SPIDER_CONTENTHASH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+#include "spider/crawlsource.h"
+#include "spider/fingerprint.h"
+#include "spider/throttle.h"
+
+/**
+ * Hash of whole content of files for exact duplicate detection. The file
+ * is read sequentially by large chunks, each chunk is hashed by streaming
+ * XXH64 before the next one is read. Blocks of the sampled fingerprint
+ * are copied from the chunks on the way, so the fingerprint is taken
+ * without extra reads.
+ *
+ * Hasher keeps its buffer, so it should be used by one thread at a time.
+ */
+class ContentHasher {
+ public:
+  /**
+   * Constructor.
+   *
+   * @param chunk_size Size of each read.
+   * @param bandwidth Budget of reads from each server, reads aren't
+   * limited if it's NULL.
+   */
+  ContentHasher(const size_t chunk_size, Bandwidth *bandwidth);
+
+  /**
+   * Hash whole content of the file.
+   *
+   * @param source Source of the file.
+   * @param path URL of the file.
+   * @param size Size of the file when it was listed.
+   * @param hash Where to store hash of the content.
+   * @param fingerprint Where to store sampled fingerprint, see
+   * Fingerprint::Hash().
+   *
+   * @return 0 on success, -1 otherwise and error_ is set. If the size of
+   * the file changed since it was listed error_ is EAGAIN.
+   */
+  int Hash(CrawlSource *source, const std::string &path, const off_t size,
+           uint64_t *hash, uint64_t *fingerprint);
+
+  /**
+   * Make the value stored in data base.
+   *
+   * @param size Size of the file.
+   * @param hash Hash of the content.
+   *
+   * @return "size:hash" with the hash in 16 hex digits.
+   */
+  static inline std::string Format(const off_t size, const uint64_t hash) {
+    return Fingerprint::Format(size, hash);
+  }
+
+  inline int get_error() const { return error_; }
+
+ private:
+  /**
+   * Copy parts of sampled blocks contained in the chunk.
+   *
+   * @param offsets Offsets of the blocks.
+   * @param count Number of the blocks.
+   * @param position Offset of the chunk in the file.
+   * @param size Size of the chunk.
+   */
+  void SampleChunk(const off_t *offsets, const size_t count,
+                   const off_t position, const size_t size);
+
+  /**
+   * Buffer for chunks of the file.
+   */
+  std::vector<unsigned char> buffer_;
+
+  /**
+   * Sampled blocks of the file.
+   */
+  unsigned char blocks_[Fingerprint::kBlocks * Fingerprint::kBlockSize];
+
+  /**
+   * Budget of reads, can be NULL.
+   */
+  Bandwidth *bandwidth_;
+
+  /**
+   * Last occured error.
+   */
+  int error_;
+
+  DISALLOW_COPY_AND_ASSIGN(ContentHasher);
+};
+
+#endif  // SPIDER_CONTENTHASH_H_
@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_CRAWL_H_
+#define SPIDER_CRAWL_H_
+
+#include <time.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+#include "spider/checkpoint.h"
+#include "spider/crawlstats.h"
+#include "spider/dirtask.h"
+#include "spider/filebatch.h"
+#include "spider/pathfilter.h"
+
+/**
+ * Scan of one server. Several servers are scanned at once by shared
+ * workers, so everything which belongs to one scan is kept here and
+ * every task of the pipeline refers to its scan.
+ *
+ * The scan is finished when all its directories are listed and all its
+ * files are passed to its batch. Every unit of work of the scan
+ * is counted by AddWork() before it's queued and by FinishWork() when
+ * it's done.
+ */
+struct Crawl {
+  /**
+   * Constructor.
+   *
+   * @param server Server to be scanned.
+   */
+  explicit Crawl(const std::string &server)
+      : server(server),
+        root("smb://" + server),
+        root_failed(false),
+        start(0),
+        exclusions(),
+        unchanged_dirs(0),
+        excluded_dirs(0),
+        failed_dirs(0),
+        failed_files(0),
+        batch(VECTOR_SIZE),
+        written_files(0),
+        pending_(0) {}
+
+  /**
+   * Count new unit of work.
+   */
+  inline void AddWork() {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    ++pending_;
+  }
+
+  /**
+   * Count finished unit of work. The scan can be destroyed right after
+   * the last one, so the counter is protected by the same mutex as the
+   * condition.
+   */
+  inline void FinishWork() {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    if (--pending_ == 0)
+      pending_cond_.notify_all();
+  }
+
+  /**
+   * Wait until all work of the scan is finished.
+   */
+  inline void Wait() {
+    std::unique_lock<std::mutex> lock(pending_mutex_);
+    pending_cond_.wait(lock, [this]() { return pending_ == 0; });
+  }
+
+  /**
+   * Get number of unfinished units of work.
+   *
+   * @return Number of unfinished units of work.
+   */
+  inline int get_pending() {
+    std::lock_guard<std::mutex> lock(pending_mutex_);
+    return pending_;
+  }
+
+  /**
+   * Name of the server.
+   */
+  std::string server;
+
+  /**
+   * Full smb path to the server or another directory where the scan
+   * starts.
+   */
+  std::string root;
+
+  /**
+   * If the root can't be listed.
+   */
+  std::atomic<bool> root_failed;
+
+  /**
+   * Time of data base server when the scan started.
+   */
+  time_t start;
+
+  /**
+   * Log of the scan which lets to resume it.
+   */
+  Checkpoint checkpoint;
+
+  /**
+   * Latencies and counters of the scan, it's one lease of the server.
+   */
+  CrawlStats stats;
+
+  /**
+   * Signatures of directories at the previous scan of the server
+   * indexed by path to directory on the server.
+   */
+  std::unordered_map<std::string, DirSignature> dir_signatures;
+
+  /**
+   * Ids of directories of the server in data base indexed by path to
+   * directory on the server. It's protected by data base mutex of the
+   * spider.
+   */
+  std::unordered_map<std::string, int> dir_ids;
+
+  /**
+   * Signatures of directories changed since the previous scan.
+   */
+  std::vector<std::pair<std::string, DirSignature> > changed_dirs;
+
+  /**
+   * Paths to directories which files were skipped.
+   */
+  std::vector<std::string> unchanged_paths;
+
+  /**
+   * Paths to directories which files weren't all written to data base.
+   */
+  std::unordered_set<std::string> failed_paths;
+
+  /**
+   * Mutex to protect changed_dirs, unchanged_paths and failed_paths.
+   */
+  std::mutex dirs_mutex;
+
+  /**
+   * Rules which exclude directories from the scan.
+   */
+  std::shared_ptr<const PathFilter> exclusions;
+
+  /**
+   * Number of directories which files were skipped.
+   */
+  std::atomic<int> unchanged_dirs;
+
+  /**
+   * Number of directories excluded by rules.
+   */
+  std::atomic<int> excluded_dirs;
+
+  /**
+   * Number of directories which weren't scanned because of errors.
+   */
+  std::atomic<int> failed_dirs;
+
+  /**
+   * Number of found files which weren't written to data base because of
+   * errors.
+   */
+  std::atomic<int> failed_files;
+
+  /**
+   * Files found at the scan which aren't in data base yet with their MIME
+   * types, fingerprints and content hashes.
+   */
+  FileBatch batch;
+
+  /**
+   * Mutex to protect the batch.
+   */
+  std::mutex files_mutex;
+
+  /**
+   * Number of files passed to the batch.
+   */
+  std::atomic<int> written_files;
+
+ private:
+  /**
+   * Number of unfinished units of work.
+   */
+  int pending_;
+
+  std::mutex pending_mutex_;
+  std::condition_variable pending_cond_;
+
+  DISALLOW_COPY_AND_ASSIGN(Crawl);
+};
+
+/**
+ * Directory which should be scanned and its scan.
+ */
+struct CrawlTask {
+  /**
+   * Scan the directory belongs to.
+   */
+  Crawl *crawl;
+
+  /**
+   * Directory to be scanned.
+   */
+  DirTask dir;
+};
+
+#endif  // SPIDER_CRAWL_H_
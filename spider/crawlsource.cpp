@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string>
+#include <vector>
+
+#include "spider/crawlsource.h"
+#include "spider/fingerprint.h"
+
+namespace {
+
+// Position of the server in URL.
+size_t ServerBegin(const std::string &url) {
+  size_t scheme = url.find("://");
+  return scheme == std::string::npos ? 0 : scheme + 3;
+}
+
+}  // namespace
+
+bool CrawlSource::IsLocal(const std::string &url) {
+  return url.compare(0, 7, "file://") == 0;
+}
+
+std::string CrawlSource::ServerOf(const std::string &url) {
+  size_t begin = ServerBegin(url);
+  size_t end = url.find('/', begin);
+  return url.substr(begin, end == std::string::npos ? end : end - begin);
+}
+
+std::string CrawlSource::PathOf(const std::string &url) {
+  size_t end = url.find('/', ServerBegin(url));
+  return end == std::string::npos ? std::string() : url.substr(end + 1);
+}
+
+void CrawlSource::ReadSamples(const std::vector<std::string> &paths,
+                              const off_t *sizes, unsigned char *blocks,
+                              const size_t stride, ssize_t *results) {
+  off_t offsets[Fingerprint::kBlocks] = { 0 };
+  for (size_t i = 0; i < paths.size(); ++i) {
+    size_t count = sizes != NULL ? Fingerprint::Offsets(sizes[i], offsets) : 1;
+    results[i] = ReadSample(paths[i], offsets, count, blocks + i * stride,
+                            Fingerprint::kBlockSize);
+    if (UNLIKELY(results[i] < 0))
+      results[i] = -error_;
+  }
+}
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_CRAWLSOURCE_H_
+#define SPIDER_CRAWLSOURCE_H_
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+
+#include <string>
+#include <vector>
+
+#include "common-inl.h"
+
+/**
+ * Type of directory entry.
+ */
+enum EntryType {
+  etWorkgroup,  // smb workgroup, it contains servers.
+  etServer,     // smb server, it contains shares.
+  etShare,      // smb file share.
+  etDir,        // Directory.
+  etFile,       // Regular file.
+  etLink,       // Symbolic link, it isn't followed.
+  etOther       // Printers, devices, sockets, etc.
+};
+
+/**
+ * Entry of directory with its attributes.
+ */
+struct DirEntry {
+  /**
+   * Name of the entry.
+   */
+  std::string name;
+
+  /**
+   * Type of the entry.
+   */
+  EntryType type;
+
+  /**
+   * Size of the file, 0 if it's unknown.
+   */
+  off_t size;
+
+  /**
+   * Time of last modification, 0 if it's unknown.
+   */
+  time_t mtime;
+
+  /**
+   * DOS attributes of the entry, 0 if they are unknown.
+   */
+  unsigned short attrs;  // NOLINT(runtime/int)
+};
+
+/**
+ * Source of directories and files to be indexed. Sources are addressed
+ * by URLs: "smb://server/share/path" for smb servers and
+ * "file://host/path" for local file systems, e.g. mounted NFS or CIFS
+ * shares. Host of local URL is the name under which files are indexed.
+ *
+ * Source keeps its connections and buffers, so it should be used by one
+ * thread at a time.
+ */
+class CrawlSource {
+ public:
+  /**
+   * Handle of open directory.
+   */
+  typedef void *Dir;
+
+  /**
+   * Handle of file open for sequential reading.
+   */
+  typedef void *File;
+
+  virtual ~CrawlSource() {}
+
+  /**
+   * Open directory.
+   *
+   * @param dir URL of the directory.
+   *
+   * @return Directory handle on success, NULL otherwise.
+   */
+  virtual Dir OpenDir(const std::string &dir) = 0;
+
+  /**
+   * Get next batch of directory entries. "." and ".." are skipped.
+   * Sizes and mtimes of entries are obtained if it's cheap for the
+   * source.
+   *
+   * @param dir Directory handle.
+   * @param entries Where to store entries, previous content is removed.
+   * @param batch Maximum number of entries to get.
+   *
+   * @return Number of obtained entries, 0 at the end of directory and
+   * -1 on error.
+   */
+  virtual int ReadDir(Dir dir, std::vector<DirEntry> *entries,
+                      const size_t batch) = 0;
+
+  /**
+   * Close directory.
+   *
+   * @param dir Directory handle, it's freed even on error.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  virtual int CloseDir(Dir dir) = 0;
+
+  /**
+   * Get attributes of file or directory.
+   *
+   * @param path URL of the file.
+   * @param st Where to store attributes.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  virtual int Stat(const std::string &path, struct stat *st) = 0;
+
+  /**
+   * Read blocks of file at given offsets, the file is opened once. Parts
+   * of blocks beyond the end of file are zeroed.
+   *
+   * @param path URL of the file.
+   * @param offsets Offsets of the blocks.
+   * @param count Number of the blocks.
+   * @param blocks Where to store the blocks one after another.
+   * @param size Size of each block.
+   *
+   * @return Number of bytes read into the first block on success,
+   * -1 otherwise.
+   */
+  virtual ssize_t ReadSample(const std::string &path, const off_t *offsets,
+                             const size_t count, unsigned char *blocks,
+                             const size_t size) = 0;
+
+  /**
+   * Read first bytes of file.
+   *
+   * @param path URL of the file.
+   * @param header Where to store the bytes.
+   * @param size Maximum number of bytes to read.
+   *
+   * @return Number of read bytes on success, -1 otherwise.
+   */
+  inline ssize_t ReadHeader(const std::string &path, unsigned char *header,
+                            const size_t size) {
+    const off_t offset = 0;
+    return ReadSample(path, &offset, 1, header, size);
+  }
+
+  /**
+   * Open file for reading it from the beginning to the end.
+   *
+   * @param path URL of the file.
+   *
+   * @return File handle on success, NULL otherwise.
+   */
+  virtual File OpenFile(const std::string &path) = 0;
+
+  /**
+   * Read next bytes of file. Large reads are split into several requests
+   * in flight by the source if it's possible.
+   *
+   * @param file File handle.
+   * @param buffer Where to store the bytes.
+   * @param size Maximum number of bytes to read.
+   *
+   * @return Number of read bytes, 0 at the end of file and -1 on error.
+   */
+  virtual ssize_t ReadFile(File file, void *buffer, const size_t size) = 0;
+
+  /**
+   * Close file.
+   *
+   * @param file File handle, it's freed even on error.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  virtual int CloseFile(File file) = 0;
+
+  /**
+   * Read headers of several files and, if their sizes are given, blocks
+   * for their fingerprints. Sources which can submit many requests at
+   * once override it, by default files are read one by one.
+   *
+   * @param paths URLs of the files.
+   * @param sizes Sizes of the files or NULL to read only headers.
+   * @param blocks Where to store blocks, blocks of i-th file start at
+   * blocks + i * stride and are Fingerprint::kBlockSize bytes each.
+   * @param stride Distance between blocks of files.
+   * @param results Where to store size of header or -errno for each file.
+   */
+  virtual void ReadSamples(const std::vector<std::string> &paths,
+                           const off_t *sizes, unsigned char *blocks,
+                           const size_t stride, ssize_t *results);
+
+  /**
+   * Get last occured error.
+   *
+   * @return Last occured error.
+   */
+  inline int get_error() const { return error_; }
+
+  /**
+   * Whether the URL is in a local file system.
+   *
+   * @param url URL of a file.
+   *
+   * @return true for "file://" URLs.
+   */
+  static bool IsLocal(const std::string &url);
+
+  /**
+   * Get server of URL.
+   *
+   * @param url URL of a file, "smb://server/path" -> "server".
+   *
+   * @return Server name.
+   */
+  static std::string ServerOf(const std::string &url);
+
+  /**
+   * Get path of URL on its server without leading slash.
+   *
+   * @param url URL of a file, "smb://server/path" -> "path".
+   *
+   * @return Path on the server, empty for the server itself.
+   */
+  static std::string PathOf(const std::string &url);
+
+ protected:
+  CrawlSource() : error_(0) {}
+
+  /**
+   * Save last occured error in error_.
+   */
+  inline void DetectError() { error_ = errno; }
+
+  /**
+   * Last occured error.
+   */
+  int error_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CrawlSource);
+};
+
+#endif  // SPIDER_CRAWLSOURCE_H_
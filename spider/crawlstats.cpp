@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <algorithm>
+#include <string>
+
+#include "config.h"
+#include "spider/crawlstats.h"
+
+LatencyHistogram::LatencyHistogram() {
+  Clear();
+}
+
+void LatencyHistogram::Record(const uint64_t value) {
+  buckets_[BucketOf(value)].fetch_add(1, std::memory_order_relaxed);
+  count_.fetch_add(1, std::memory_order_relaxed);
+  sum_.fetch_add(value, std::memory_order_relaxed);
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (value > max &&
+         !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::Add(const LatencyHistogram &other) {
+  for (int i = 0; i < kBuckets; ++i) {
+    uint64_t count = other.buckets_[i].load(std::memory_order_relaxed);
+    if (count != 0)
+      buckets_[i].fetch_add(count, std::memory_order_relaxed);
+  }
+  count_.fetch_add(other.get_count(), std::memory_order_relaxed);
+  sum_.fetch_add(other.get_sum(), std::memory_order_relaxed);
+  uint64_t value = other.get_max();
+  uint64_t max = max_.load(std::memory_order_relaxed);
+  while (value > max &&
+         !max_.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+}
+
+void LatencyHistogram::Clear() {
+  for (int i = 0; i < kBuckets; ++i)
+    buckets_[i].store(0, std::memory_order_relaxed);
+  count_.store(0, std::memory_order_relaxed);
+  sum_.store(0, std::memory_order_relaxed);
+  max_.store(0, std::memory_order_relaxed);
+}
+
+uint64_t LatencyHistogram::Percentile(const double percent) const {
+  // Buckets are read once, total count may lag behind them while values
+  // are recorded.
+  uint64_t counts[kBuckets], total = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    counts[i] = buckets_[i].load(std::memory_order_relaxed);
+    total += counts[i];
+  }
+  if (total == 0)
+    return 0;
+
+  uint64_t rank = static_cast<uint64_t>(
+      std::max(percent, 0.0) / 100.0 * static_cast<double>(total) + 0.5);
+  rank = std::min(std::max<uint64_t>(rank, 1), total);
+  uint64_t seen = 0;
+  for (int i = 0; i < kBuckets; ++i) {
+    seen += counts[i];
+    if (seen >= rank)
+      return std::min(UpperBoundOf(i), get_max());
+  }
+  return get_max();
+}
+
+int LatencyHistogram::BucketOf(const uint64_t value) {
+  if (value >= (uint64_t(1) << kMaxBits))
+    return kBuckets - 1;
+  if (value < (uint64_t(1) << kSubBits))
+    return static_cast<int>(value);
+
+  // The highest bit selects a group of buckets, next kSubBits bits select
+  // a bucket in it.
+  int shift = 63 - __builtin_clzll(value) - kSubBits;
+  return ((shift + 1) << kSubBits) +
+         static_cast<int>((value >> shift) - (uint64_t(1) << kSubBits));
+}
+
+uint64_t LatencyHistogram::UpperBoundOf(const int bucket) {
+  int group = bucket >> kSubBits;
+  if (group == 0)
+    return bucket;
+  uint64_t sub = bucket & ((1 << kSubBits) - 1);
+  return (((uint64_t(1) << kSubBits) + sub + 1) << (group - 1)) - 1;
+}
+
+CrawlStats::Shard::Shard() {
+  for (int i = 0; i < scCounters; ++i)
+    counters[i].store(0, std::memory_order_relaxed);
+}
+
+CrawlStats::CrawlStats() : shards_(STATS_SHARDS), start_(time(NULL)) {}
+
+void CrawlStats::Record(const Stage stage, const uint64_t usec) {
+  ShardOfThread().stages[stage].Record(usec);
+}
+
+void CrawlStats::Count(const Counter counter, const uint64_t value) {
+  ShardOfThread().counters[counter].fetch_add(value,
+                                              std::memory_order_relaxed);
+}
+
+uint64_t CrawlStats::get_counter(const Counter counter) const {
+  uint64_t value = 0;
+  for (const Shard &shard : shards_)
+    value += shard.counters[counter].load(std::memory_order_relaxed);
+  return value;
+}
+
+void CrawlStats::Merge(const Stage stage, LatencyHistogram *histogram) const {
+  for (const Shard &shard : shards_)
+    histogram->Add(shard.stages[stage]);
+}
+
+std::string CrawlStats::Report(const std::string &server) const {
+  std::string report = server + " counters elapsed_s=" +
+                       std::to_string(time(NULL) - start_) +
+                       " files=" + std::to_string(get_counter(scFiles)) +
+                       " dirs=" + std::to_string(get_counter(scDirs)) +
+                       " bytes=" + std::to_string(get_counter(scBytes)) +
+                       " errors=" + std::to_string(get_counter(scErrors)) +
+                       " extension_hits=" +
+                       std::to_string(get_counter(scExtensionHits)) +
+                       " cache_hits=" +
+                       std::to_string(get_counter(scCacheHits)) + "\n";
+
+  LatencyHistogram histogram;
+  for (int i = 0; i < ssStages; ++i) {
+    histogram.Clear();
+    Merge(static_cast<Stage>(i), &histogram);
+    uint64_t count = histogram.get_count();
+    if (count == 0)
+      continue;
+    report += server + " " + NameOf(static_cast<Stage>(i)) +
+              " count=" + std::to_string(count) +
+              " mean_us=" + std::to_string(histogram.get_sum() / count) +
+              " p50_us=" + std::to_string(histogram.Percentile(50)) +
+              " p90_us=" + std::to_string(histogram.Percentile(90)) +
+              " p99_us=" + std::to_string(histogram.Percentile(99)) +
+              " max_us=" + std::to_string(histogram.get_max()) + "\n";
+  }
+  return report;
+}
+
+const char *CrawlStats::NameOf(const Stage stage) {
+  switch (stage) {
+    case ssOpenDir:
+      return "opendir";
+    case ssReadDir:
+      return "readdir";
+    case ssOpen:
+      return "open";
+    case ssRead:
+      return "read";
+    case ssClassify:
+      return "classify";
+    case ssCommit:
+      return "commit";
+    default:
+      return "unknown";
+  }
+}
+
+CrawlStats::Shard &CrawlStats::ShardOfThread() {
+  static std::atomic<unsigned> next_thread(0);
+  static thread_local unsigned thread = next_thread++;
+  return shards_[thread % shards_.size()];
+}
+
+StageTimer::StageTimer(CrawlStats *stats, const CrawlStats::Stage stage)
+    : stats_(stats),
+      stage_(stage),
+      start_(),
+      failed_(false) {
+  if (stats_ != NULL)
+    start_ = std::chrono::steady_clock::now();
+}
+
+StageTimer::~StageTimer() {
+  if (stats_ == NULL)
+    return;
+  std::chrono::microseconds duration =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start_);
+  stats_->Record(stage_, duration.count());
+  if (failed_)
+    stats_->Count(CrawlStats::scErrors);
+}
@@ -0,0 +1,288 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_CRAWLSTATS_H_
+#define SPIDER_CRAWLSTATS_H_
+
+#include <stdint.h>
+#include <time.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "common-inl.h"
+
+/**
+ * Histogram of latencies in microseconds in the style of HdrHistogram.
+ * Values below 2^kSubBits are counted exactly, every next power of two
+ * is split into 2^kSubBits equal buckets, so percentiles are within
+ * 1/2^kSubBits of exact values whatever their scale. Counters are
+ * updated without locks, a histogram can be read while it's recorded.
+ */
+class LatencyHistogram {
+ public:
+  /**
+   * Number of bits of precision of recorded values.
+   */
+  static const int kSubBits = 4;
+
+  /**
+   * Values of 2^kMaxBits microseconds (about 19 hours) and longer are
+   * counted in the last bucket.
+   */
+  static const int kMaxBits = 36;
+
+  /**
+   * Number of buckets.
+   */
+  static const int kBuckets = (kMaxBits - kSubBits + 1) << kSubBits;
+
+  /**
+   * Constructor of empty histogram.
+   */
+  LatencyHistogram();
+
+  /**
+   * Count a value.
+   *
+   * @param value Latency in microseconds.
+   */
+  void Record(const uint64_t value);
+
+  /**
+   * Add values of other histogram to this one.
+   *
+   * @param other Histogram to be added.
+   */
+  void Add(const LatencyHistogram &other);
+
+  /**
+   * Forget all values.
+   */
+  void Clear();
+
+  /**
+   * Find value which isn't exceeded by the given percent of values.
+   *
+   * @param percent Percent of values from 0 to 100.
+   *
+   * @return Upper bound of the bucket of the value capped by the maximum
+   * value, 0 if the histogram is empty.
+   */
+  uint64_t Percentile(const double percent) const;
+
+  /**
+   * Get bucket where value is counted.
+   *
+   * @param value Latency in microseconds.
+   *
+   * @return Index of the bucket.
+   */
+  static int BucketOf(const uint64_t value);
+
+  /**
+   * Get the largest value counted in the bucket.
+   *
+   * @param bucket Index of the bucket.
+   *
+   * @return Upper bound of the bucket in microseconds.
+   */
+  static uint64_t UpperBoundOf(const int bucket);
+
+  inline uint64_t get_count() const {
+    return count_.load(std::memory_order_relaxed);
+  }
+  inline uint64_t get_sum() const {
+    return sum_.load(std::memory_order_relaxed);
+  }
+  inline uint64_t get_max() const {
+    return max_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<uint64_t> buckets_[kBuckets];
+  std::atomic<uint64_t> count_;
+  std::atomic<uint64_t> sum_;
+  std::atomic<uint64_t> max_;
+
+  DISALLOW_COPY_AND_ASSIGN(LatencyHistogram);
+};
+
+/**
+ * Statistics of one lease of a server: latency histograms of stages of
+ * the scan and counters of its work. Every thread records into its own
+ * shard, so workers don't contend on cache lines, and shards are summed
+ * when the statistics are reported.
+ */
+class CrawlStats {
+ public:
+  /**
+   * Timed stages of the scan.
+   */
+  enum Stage {
+    ssOpenDir,     // smbc_opendir(), it fetches the whole listing.
+    ssReadDir,     // smbc_readdir() family, one call per batch of entries.
+    ssOpen,        // smbc_open() of fetched and hashed files.
+    ssRead,        // smbc_read() of samples and content of files.
+    ssClassify,    // Detection of MIME type by fetched header.
+    ssCommit,      // Transaction which writes a batch to data base.
+    ssStages
+  };
+
+  /**
+   * Counters of the scan.
+   */
+  enum Counter {
+    scFiles,          // Listed files.
+    scDirs,           // Listed directories.
+    scBytes,          // Bytes read from files.
+    scErrors,         // Failed smb requests.
+    scExtensionHits,  // Files classified by extension without reading.
+    scCacheHits,      // Files found in the cache of MIME types.
+    scCounters
+  };
+
+  /**
+   * Constructor. The lease starts now.
+   */
+  CrawlStats();
+
+  /**
+   * Count duration of a stage.
+   *
+   * @param stage Stage of the scan.
+   * @param usec Duration in microseconds.
+   */
+  void Record(const Stage stage, const uint64_t usec);
+
+  /**
+   * Increase a counter.
+   *
+   * @param counter Counter of the scan.
+   * @param value Increment.
+   */
+  void Count(const Counter counter, const uint64_t value = 1);
+
+  /**
+   * Get sum of a counter over all threads.
+   *
+   * @param counter Counter of the scan.
+   *
+   * @return Value of the counter.
+   */
+  uint64_t get_counter(const Counter counter) const;
+
+  /**
+   * Add latencies of a stage recorded by all threads to histogram.
+   *
+   * @param stage Stage of the scan.
+   * @param histogram Histogram where latencies are added.
+   */
+  void Merge(const Stage stage, LatencyHistogram *histogram) const;
+
+  /**
+   * Format the statistics, one line for counters and one line per stage
+   * which was recorded, e.g.
+   * "host counters elapsed_s=5 files=10 dirs=2 bytes=5120 errors=0
+   * extension_hits=4 cache_hits=3" and
+   * "host opendir count=2 mean_us=900 p50_us=831 p90_us=1000
+   * p99_us=1000 max_us=1000".
+   *
+   * @param server Name of the server of the lease.
+   *
+   * @return Report in text format.
+   */
+  std::string Report(const std::string &server) const;
+
+  /**
+   * Get name of a stage used in reports.
+   *
+   * @param stage Stage of the scan.
+   *
+   * @return Name of the stage.
+   */
+  static const char *NameOf(const Stage stage);
+
+ private:
+  /**
+   * Statistics recorded by one thread.
+   */
+  struct Shard {
+    Shard();
+
+    LatencyHistogram stages[ssStages];
+    std::atomic<uint64_t> counters[scCounters];
+  };
+
+  /**
+   * Get shard of the calling thread. Threads get shards round robin by
+   * the order of their first record.
+   *
+   * @return Shard of the thread.
+   */
+  Shard &ShardOfThread();
+
+  std::vector<Shard> shards_;
+  time_t start_;
+
+  DISALLOW_COPY_AND_ASSIGN(CrawlStats);
+};
+
+/**
+ * Scoped timer of a stage of the scan.
+ */
+class StageTimer {
+ public:
+  /**
+   * Start timer.
+   *
+   * @param stats Statistics of the scan, nothing is done if it's NULL.
+   * @param stage Timed stage.
+   */
+  StageTimer(CrawlStats *stats, const CrawlStats::Stage stage);
+
+  /**
+   * Record duration of the stage and its error if any.
+   */
+  ~StageTimer();
+
+  /**
+   * Count failure of the stage as an error of the scan.
+   */
+  inline void set_failed() { failed_ = true; }
+
+ private:
+  CrawlStats *stats_;
+  CrawlStats::Stage stage_;
+  std::chrono::steady_clock::time_point start_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(StageTimer);
+};
+
+#endif  // SPIDER_CRAWLSTATS_H_
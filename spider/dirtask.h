@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_DIRTASK_H_
+#define SPIDER_DIRTASK_H_
+
+#include <time.h>
+
+#include <string>
+
+/**
+ * Directory which should be scanned.
+ */
+struct DirTask {
+  /**
+   * Full smb path to the directory.
+   */
+  std::string path;
+
+  /**
+   * Time of last modification of the directory, 0 if it's unknown.
+   */
+  time_t mtime;
+
+  /**
+   * State of exclusion rules after the path, see PathFilter, 0 if it's
+   * unknown.
+   */
+  int filter_state;
+};
+
+/**
+ * Signature of a directory. If it's the same as at the previous scan
+ * files in the directory weren't added, removed or renamed.
+ */
+struct DirSignature {
+  /**
+   * Time of last modification of the directory.
+   */
+  time_t mtime;
+
+  /**
+   * Number of entries in the directory.
+   */
+  int child_count;
+};
+
+#endif  // SPIDER_DIRTASK_H_
+
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "spider/extensiontable.h"
+
+namespace {
+
+/**
+ * Built-in entry of the table.
+ */
+struct DefaultExtension {
+  const char *extension;
+  const char *mime_type;
+  ExtensionTable::Policy policy;
+};
+
+/**
+ * Extensions of formats which are large and almost never misnamed are
+ * skipped. Formats which are often renamed or produced by many programs
+ * are sampled. Containers whose MIME type depends on content are sniffed
+ * always and aren't listed here.
+ */
+const DefaultExtension kDefaultExtensions[] = {
+  // Video.
+  { "mkv", "video/x-matroska", ExtensionTable::epSkip },
+  { "avi", "video/x-msvideo", ExtensionTable::epSkip },
+  { "mp4", "video/mp4", ExtensionTable::epSample },
+  { "m4v", "video/x-m4v", ExtensionTable::epSample },
+  { "mov", "video/quicktime", ExtensionTable::epSample },
+  { "wmv", "video/x-ms-asf", ExtensionTable::epSkip },
+  { "flv", "video/x-flv", ExtensionTable::epSkip },
+  { "mpg", "video/mpeg", ExtensionTable::epSample },
+  { "mpeg", "video/mpeg", ExtensionTable::epSample },
+  { "vob", "video/mpeg", ExtensionTable::epSkip },
+  { "ts", "video/mp2t", ExtensionTable::epSample },
+  { "m2ts", "video/mp2t", ExtensionTable::epSkip },
+  { "3gp", "video/3gpp", ExtensionTable::epSample },
+  { "webm", "video/webm", ExtensionTable::epSkip },
+  // Audio.
+  { "mp3", "audio/mpeg", ExtensionTable::epSkip },
+  { "flac", "audio/flac", ExtensionTable::epSkip },
+  { "ape", "audio/x-ape", ExtensionTable::epSkip },
+  { "wv", "audio/x-wavpack", ExtensionTable::epSkip },
+  { "ogg", "audio/ogg", ExtensionTable::epSample },
+  { "wav", "audio/x-wav", ExtensionTable::epSample },
+  { "wma", "video/x-ms-asf", ExtensionTable::epSkip },
+  { "m4a", "audio/x-m4a", ExtensionTable::epSample },
+  { "aiff", "audio/x-aiff", ExtensionTable::epSkip },
+  { "mid", "audio/midi", ExtensionTable::epSkip },
+  // Disk images.
+  { "iso", "application/x-iso9660-image", ExtensionTable::epSkip },
+  { "mdf", "application/octet-stream", ExtensionTable::epSkip },
+  { "vmdk", "application/octet-stream", ExtensionTable::epSkip },
+  // Images.
+  { "jpg", "image/jpeg", ExtensionTable::epSample },
+  { "jpeg", "image/jpeg", ExtensionTable::epSample },
+  { "png", "image/png", ExtensionTable::epSample },
+  { "gif", "image/gif", ExtensionTable::epSample },
+  { "bmp", "image/bmp", ExtensionTable::epSample },
+  { "tif", "image/tiff", ExtensionTable::epSample },
+  { "tiff", "image/tiff", ExtensionTable::epSample },
+  { "webp", "image/webp", ExtensionTable::epSample },
+  { "psd", "image/vnd.adobe.photoshop", ExtensionTable::epSkip },
+  { "djvu", "image/vnd.djvu", ExtensionTable::epSkip },
+  // Documents.
+  { "pdf", "application/pdf", ExtensionTable::epSample },
+  { "ps", "application/postscript", ExtensionTable::epSample },
+  { "chm", "application/vnd.ms-htmlhelp", ExtensionTable::epSkip },
+  { "rtf", "text/rtf", ExtensionTable::epSample },
+  // Archives and packages.
+  { "rar", "application/x-rar", ExtensionTable::epSample },
+  { "7z", "application/x-7z-compressed", ExtensionTable::epSkip },
+  { "gz", "application/gzip", ExtensionTable::epSample },
+  { "tgz", "application/gzip", ExtensionTable::epSample },
+  { "bz2", "application/x-bzip2", ExtensionTable::epSample },
+  { "xz", "application/x-xz", ExtensionTable::epSample },
+  { "cab", "application/vnd.ms-cab-compressed", ExtensionTable::epSkip },
+  { "deb", "application/vnd.debian.binary-package", ExtensionTable::epSkip },
+  { "rpm", "application/x-rpm", ExtensionTable::epSkip },
+  { "jar", "application/java-archive", ExtensionTable::epSample },
+  { "torrent", "application/x-bittorrent", ExtensionTable::epSample },
+  { "swf", "application/x-shockwave-flash", ExtensionTable::epSkip },
+};
+
+}  // namespace
+
+ExtensionTable::ExtensionTable() : error_(0) {
+  for (const DefaultExtension &extension : kDefaultExtensions)
+    Add(extension.extension, extension.mime_type, extension.policy);
+  Build();
+}
+
+int ExtensionTable::Load(const std::string &config) {
+  FILE *fin = fopen(config.c_str(), "r");
+  if (fin == NULL) {
+    error_ = errno;
+    MSS_ERROR(("fopen " + config).c_str(), error_);
+    return -1;
+  }
+
+  char *buf = NULL;
+  size_t size = 0;
+  int line = 0;
+
+  while (getline(&buf, &size, fin) >= 0) {
+    ++line;
+    char extension[64], mime_type[256], policy_name[16];
+    int fields = sscanf(buf, "%63s %255s %15s", extension, mime_type,
+                        policy_name);
+    // Empty lines and comments.
+    if (fields <= 0 || extension[0] == '#')
+      continue;
+
+    Policy policy;
+    if (fields != 3 || strlen(extension) > kMaxExtension ||
+        ParsePolicy(policy_name, &policy)) {
+      MSS_WARN_MESSAGE((config + ": wrong line " +
+                        std::to_string(line)).c_str());
+      continue;
+    }
+
+    Add(extension, mime_type, policy);
+  }
+
+  free(buf);
+  fclose(fin);
+
+  Build();
+  return 0;
+}
+
+const ExtensionTable::Entry *ExtensionTable::Find(
+    const std::string &path) const {
+  size_t dot = path.rfind('.');
+  size_t slash = path.rfind('/');
+  // Files without extension and hidden files like ".profile".
+  if (dot == std::string::npos || dot == 0 ||
+      (slash != std::string::npos && dot <= slash + 1))
+    return NULL;
+
+  size_t length = path.size() - dot - 1;
+  if (length == 0 || length > kMaxExtension || UNLIKELY(slots_.empty()))
+    return NULL;
+
+  char key[kMaxExtension];
+  for (size_t i = 0; i < length; ++i)
+    key[i] = tolower(static_cast<unsigned char>(path[dot + 1 + i]));
+
+  int displacement = displacements_[Hash(key, length, 0) %
+                                    displacements_.size()];
+  size_t slot = displacement < 0 ? -displacement - 1 :
+                Hash(key, length, displacement + 1) % slots_.size();
+
+  int index = slots_[slot];
+  if (index < 0 || entries_[index].extension.compare(0, std::string::npos,
+                                                     key, length))
+    return NULL;
+
+  return &entries_[index];
+}
+
+int ExtensionTable::ParsePolicy(const std::string &name, Policy *policy) {
+  if (name == "skip") {
+    *policy = epSkip;
+  } else if (name == "sample") {
+    *policy = epSample;
+  } else if (name == "always") {
+    *policy = epAlways;
+  } else {
+    return -1;
+  }
+  return 0;
+}
+
+void ExtensionTable::Add(const std::string &extension,
+                         const std::string &mime_type, const Policy policy) {
+  Entry entry = { extension, mime_type, policy };
+  std::transform(entry.extension.begin(), entry.extension.end(),
+                 entry.extension.begin(), ::tolower);
+
+  for (Entry &old : entries_) {
+    if (old.extension == entry.extension) {
+      old = entry;
+      return;
+    }
+  }
+  entries_.push_back(entry);
+}
+
+void ExtensionTable::Build() {
+  const size_t kMaxDisplacement = 1 << 16;
+
+  // Each bucket contains about four keys on average.
+  size_t buckets_number = entries_.size() / 4 + 1;
+  size_t slots_number = entries_.size() + entries_.size() / 4 + 1;
+
+  std::vector<std::vector<int>> buckets(buckets_number);
+  for (size_t i = 0; i < entries_.size(); ++i) {
+    const std::string &key = entries_[i].extension;
+    buckets[Hash(key.data(), key.size(), 0) % buckets_number].push_back(i);
+  }
+
+  // Large buckets are placed first while there are many free slots.
+  std::vector<int> order(buckets_number);
+  for (size_t i = 0; i < buckets_number; ++i)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&buckets](int a, int b) {
+    return buckets[a].size() > buckets[b].size();
+  });
+
+  bool placed = false;
+  while (!placed) {
+    displacements_.assign(buckets_number, 0);
+    slots_.assign(slots_number, -1);
+    placed = true;
+
+    size_t bucket = 0;
+    for (; bucket < buckets_number && buckets[order[bucket]].size() > 1;
+         ++bucket) {
+      const std::vector<int> &keys = buckets[order[bucket]];
+      std::vector<size_t> positions;
+      size_t displacement = 0;
+
+      for (; displacement < kMaxDisplacement; ++displacement) {
+        positions.clear();
+        for (int index : keys) {
+          const std::string &key = entries_[index].extension;
+          size_t slot = Hash(key.data(), key.size(), displacement + 1) %
+                        slots_number;
+          if (slots_[slot] != -1 || std::find(positions.begin(),
+                                              positions.end(), slot) !=
+                                    positions.end())
+            break;
+          positions.push_back(slot);
+        }
+        if (positions.size() == keys.size())
+          break;
+      }
+
+      if (displacement == kMaxDisplacement) {
+        placed = false;
+        break;
+      }
+
+      displacements_[order[bucket]] = displacement;
+      for (size_t i = 0; i < keys.size(); ++i)
+        slots_[positions[i]] = keys[i];
+    }
+
+    if (!placed) {
+      // Try again with more free slots.
+      slots_number += slots_number / 4 + 1;
+      continue;
+    }
+
+    // Buckets with one key are placed to any free slot.
+    size_t slot = 0;
+    for (; bucket < buckets_number && buckets[order[bucket]].size() == 1;
+         ++bucket) {
+      while (slots_[slot] != -1)
+        ++slot;
+      slots_[slot] = buckets[order[bucket]].front();
+      displacements_[order[bucket]] = -static_cast<int>(slot) - 1;
+    }
+  }
+}
+
+uint32_t ExtensionTable::Hash(const char *key, const size_t length,
+                              const uint32_t seed) {
+  // FNV-1a with finalizer of MurmurHash3, seed changes offset basis.
+  uint32_t hash = 2166136261u ^ (seed * 0x9e3779b9u);
+  for (size_t i = 0; i < length; ++i) {
+    hash ^= static_cast<unsigned char>(key[i]);
+    hash *= 16777619u;
+  }
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6bu;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35u;
+  hash ^= hash >> 16;
+  return hash;
+}
@@ -0,0 +1,155 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_EXTENSIONTABLE_H_
+#define SPIDER_EXTENSIONTABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+
+/**
+ * Table of file extensions with known MIME types. It lets the spider
+ * classify files by name without opening them on the smb server.
+ * Lookups use a perfect hash built by the hash and displace method,
+ * so each of them costs two hash computations and one comparison.
+ */
+class ExtensionTable {
+ public:
+  /**
+   * What should be done with content of files with the extension.
+   */
+  enum Policy {
+    epSkip,    // MIME type of extension is trusted, content isn't read.
+    epSample,  // Content of every EXTENSION_SAMPLE_RATE-th file is sniffed.
+    epAlways   // Content is always sniffed, extension is only a hint.
+  };
+
+  /**
+   * Entry of the table.
+   */
+  struct Entry {
+    std::string extension;
+    std::string mime_type;
+    Policy policy;
+  };
+
+  /**
+   * Maximum length of extension.
+   */
+  static const size_t kMaxExtension = 15;
+
+  /**
+   * Create table with built-in extensions.
+   */
+  ExtensionTable();
+
+  /**
+   * Add extensions from configuration file to the table. Each line of
+   * the file contains extension, MIME type and policy (skip, sample or
+   * always) separated by spaces. Lines starting with '#' are comments.
+   * Extensions from the file replace built-in ones.
+   *
+   * @param config Path to configuration file.
+   *
+   * @return 0 on success, -1 otherwise and error_ is set.
+   */
+  int Load(const std::string &config);
+
+  /**
+   * Find entry for the extension of file. Extensions are case insensitive.
+   *
+   * @param path Name or path of the file.
+   *
+   * @return Entry of the table or NULL if extension is unknown.
+   */
+  const Entry *Find(const std::string &path) const;
+
+  /**
+   * Parse name of policy.
+   *
+   * @param name "skip", "sample" or "always".
+   * @param policy Parsed policy.
+   *
+   * @return 0 on success, -1 if name is unknown.
+   */
+  static int ParsePolicy(const std::string &name, Policy *policy);
+
+  inline size_t get_size() const { return entries_.size(); }
+  inline int get_error() const { return error_; }
+
+ private:
+  /**
+   * Add entry to the table or replace entry with the same extension.
+   * The table should be built after all additions.
+   */
+  void Add(const std::string &extension, const std::string &mime_type,
+           const Policy policy);
+
+  /**
+   * Build perfect hash of the entries.
+   */
+  void Build();
+
+  /**
+   * Hash of extension.
+   *
+   * @param key Extension in lower case.
+   * @param length Length of the extension.
+   * @param seed Seed which selects hash function.
+   */
+  static uint32_t Hash(const char *key, const size_t length,
+                       const uint32_t seed);
+
+  /**
+   * Entries of the table.
+   */
+  std::vector<Entry> entries_;
+
+  /**
+   * Displacement of each bucket. Non-negative value d means that keys of
+   * the bucket are placed in slots Hash(key, d + 1) % slots_.size().
+   * Negative value -s - 1 means that the bucket has one key in slot s.
+   */
+  std::vector<int> displacements_;
+
+  /**
+   * Index of entry in each slot or -1 for empty slots.
+   */
+  std::vector<int> slots_;
+
+  /**
+   * Last error.
+   */
+  int error_;
+};
+
+#endif  // SPIDER_EXTENSIONTABLE_H_
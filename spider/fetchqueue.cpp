@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <string>
+
+#include "spider/fetchqueue.h"
+#include "spider/crawlsource.h"
+
+FetchQueue::FetchQueue(const size_t capacity, const size_t per_server)
+    : capacity_(capacity),
+      per_server_(per_server),
+      size_(0),
+      total_in_flight_(0),
+      closed_(false) {}
+
+bool FetchQueue::Push(const FetchRequest &request) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (UNLIKELY(closed_))
+    return false;
+
+  // The server isn't forgotten while its producers wait.
+  Server *server = ServerOfRequest(request);
+  ++server->waiting;
+  server->not_full.wait(lock, [this, server]() {
+    return closed_ || server->requests.size() < capacity_;
+  });
+  --server->waiting;
+  if (UNLIKELY(closed_)) {
+    Release(server);
+    return false;
+  }
+
+  Enqueue(server, request);
+  return true;
+}
+
+bool FetchQueue::TryPush(const FetchRequest &request) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (closed_)
+    return false;
+
+  Server *server = ServerOfRequest(request);
+  if (server->requests.size() >= capacity_) {
+    Release(server);
+    return false;
+  }
+
+  Enqueue(server, request);
+  return true;
+}
+
+bool FetchQueue::Pop(FetchRequest *request) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (;;) {
+    while (!ready_.empty()) {
+      Server *server = ready_.front();
+      ready_.pop_front();
+      server->ready = false;
+
+      // Servers which became busy are dropped from the list lazily.
+      if (server->requests.empty() || server->in_flight >= per_server_) {
+        Release(server);
+        continue;
+      }
+
+      // The server goes to the end of the list if it has free slots yet,
+      // other consumers can take its requests.
+      Take(server, request);
+      MakeReady(server);
+      if (!ready_.empty())
+        not_empty_.notify_one();
+      return true;
+    }
+
+    if (closed_ && size_ == 0)
+      return false;
+    not_empty_.wait(lock);
+  }
+}
+
+bool FetchQueue::TryPop(const std::string &server, FetchRequest *request) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = servers_.find(server);
+  if (found == servers_.end() || found->second.requests.empty() ||
+      found->second.in_flight >= per_server_)
+    return false;
+
+  Take(&found->second, request);
+  return true;
+}
+
+void FetchQueue::Done(const FetchRequest &request) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto found = servers_.find(request.server);
+  if (UNLIKELY(found == servers_.end()))
+    return;
+
+  Server &server = found->second;
+  --server.in_flight;
+  --total_in_flight_;
+
+  // Requests to the server can be taken again.
+  if (MakeReady(&server))
+    not_empty_.notify_one();
+  else
+    Release(&server);
+}
+
+void FetchQueue::Open() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  closed_ = false;
+}
+
+void FetchQueue::Close() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  closed_ = true;
+  not_empty_.notify_all();
+  for (auto &server : servers_)
+    server.second.not_full.notify_all();
+}
+
+FetchQueue::Server *FetchQueue::ServerOfRequest(const FetchRequest &request) {
+  std::string name = ServerOf(request.path);
+  Server &server = servers_[name];
+  if (server.name.empty())
+    server.name = name;
+  return &server;
+}
+
+void FetchQueue::Enqueue(Server *server, const FetchRequest &request) {
+  server->requests.push_back(request);
+  server->requests.back().server = server->name;
+  ++size_;
+
+  if (MakeReady(server))
+    not_empty_.notify_one();
+}
+
+void FetchQueue::Release(Server *server) {
+  // The key is copied, it's destroyed with the server.
+  if (!server->ready && server->requests.empty() &&
+      server->in_flight == 0 && server->waiting == 0)
+    servers_.erase(std::string(server->name));
+}
+
+void FetchQueue::Take(Server *server, FetchRequest *request) {
+  *request = server->requests.front();
+  server->requests.pop_front();
+  ++server->in_flight;
+  ++total_in_flight_;
+  --size_;
+  server->not_full.notify_one();
+
+  // Consumers waiting for the end of closed queue stop.
+  if (UNLIKELY(closed_ && size_ == 0))
+    not_empty_.notify_all();
+}
+
+bool FetchQueue::MakeReady(Server *server) {
+  if (server->ready || server->requests.empty() ||
+      server->in_flight >= per_server_)
+    return false;
+
+  server->ready = true;
+  ready_.push_back(server);
+  return true;
+}
+
+std::string FetchQueue::ServerOf(const std::string &path) {
+  // "smb://server/share/..." or "file://host/..."
+  return CrawlSource::ServerOf(path);
+}
+
+size_t FetchQueue::get_size() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return size_;
+}
+
+size_t FetchQueue::get_in_flight() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return total_in_flight_;
+}
@@ -0,0 +1,295 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_FETCHQUEUE_H_
+#define SPIDER_FETCHQUEUE_H_
+
+#include <sys/types.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "common-inl.h"
+
+struct Crawl;
+
+/**
+ * Request to fetch header of a file.
+ */
+struct FetchRequest {
+  /**
+   * Full smb path to the file.
+   */
+  std::string path;
+
+  /**
+   * Size of the file, 0 if it's unknown.
+   */
+  off_t size;
+
+  /**
+   * Time of last modification of the file, 0 if it's unknown.
+   */
+  time_t mtime;
+
+  /**
+   * MIME type expected from the extension of the file, empty if it's
+   * unknown.
+   */
+  std::string hint;
+
+  /**
+   * Server of the file, it's filled by FetchQueue.
+   */
+  std::string server;
+
+  /**
+   * Scan the file belongs to, it isn't used by FetchQueue.
+   */
+  Crawl *crawl;
+};
+
+/**
+ * Bounded queue of header fetch requests shared by scanning workers and
+ * fetching workers. Each fetching worker has one request in flight, so
+ * the number of fetching workers is the depth of the pipeline. The number
+ * of requests in flight to one server is limited, so a slow server
+ * doesn't occupy all fetching workers.
+ *
+ * Requests are kept in FIFO per server. Servers with queued requests and
+ * free slots are taken round robin from the list of ready servers, so
+ * taking a request doesn't depend on the number of queued ones.
+ *
+ * Producers are blocked while the FIFO of their server is full, so a
+ * slow server doesn't stall scans of other servers. Consumers are
+ * blocked while there are no requests to servers with free slots.
+ */
+class FetchQueue {
+ public:
+  /**
+   * Constructor.
+   *
+   * @param capacity Maximum number of queued requests to one server.
+   * @param per_server Maximum number of requests in flight to one server.
+   */
+  FetchQueue(const size_t capacity, const size_t per_server);
+
+  /**
+   * Add request to the queue, wait if the queue of its server is full.
+   *
+   * @param request Request to be added.
+   *
+   * @return true on success, false if the queue is closed.
+   */
+  bool Push(const FetchRequest &request);
+
+  /**
+   * Add request to the queue if the queue of its server isn't full,
+   * don't wait. It's used by optional stages which shouldn't slow down
+   * their producers.
+   *
+   * @param request Request to be added.
+   *
+   * @return true on success, false if the queue is full or closed.
+   */
+  bool TryPush(const FetchRequest &request);
+
+  /**
+   * Take the oldest request to the next ready server, wait if there are
+   * no such requests. Done() should be called when the request is
+   * completed.
+   *
+   * @param request Taken request.
+   *
+   * @return true on success, false if the queue is closed and empty.
+   */
+  bool Pop(FetchRequest *request);
+
+  /**
+   * Take the oldest request to given server if the server has free slot,
+   * don't wait. It's used to gather a batch of requests.
+   *
+   * @param server Name of the server.
+   * @param request Taken request.
+   *
+   * @return true on success, false if there are no such requests.
+   */
+  bool TryPop(const std::string &server, FetchRequest *request);
+
+  /**
+   * Mark the request as completed and free its slot.
+   *
+   * @param request Request taken by Pop().
+   */
+  void Done(const FetchRequest &request);
+
+  /**
+   * Open the queue for new requests.
+   */
+  void Open();
+
+  /**
+   * Close the queue. Queued requests are still returned by Pop().
+   */
+  void Close();
+
+  /**
+   * Get server of smb path.
+   *
+   * @param path Full smb path.
+   *
+   * @return Server name.
+   */
+  static std::string ServerOf(const std::string &path);
+
+  /**
+   * Get number of queued requests of all servers.
+   *
+   * @return Number of requests waiting to be taken.
+   */
+  size_t get_size() const;
+
+  /**
+   * Get number of requests of all servers taken by Pop() or TryPop()
+   * and not finished by Done() yet.
+   *
+   * @return Number of requests in flight.
+   */
+  size_t get_in_flight() const;
+
+ private:
+  /**
+   * Requests to one server.
+   */
+  struct Server {
+    Server() : in_flight(0), ready(false), waiting(0) {}
+
+    /**
+     * Name of the server, it's the key of the server in servers_.
+     */
+    std::string name;
+
+    /**
+     * Queued requests, the oldest first.
+     */
+    std::deque<FetchRequest> requests;
+
+    /**
+     * Number of requests in flight.
+     */
+    size_t in_flight;
+
+    /**
+     * If the server is in the list of ready servers.
+     */
+    bool ready;
+
+    /**
+     * Number of producers waiting for free space in the FIFO.
+     */
+    size_t waiting;
+
+    /**
+     * Condition of free space in the FIFO.
+     */
+    std::condition_variable not_full;
+  };
+
+  /**
+   * Get the server of the request, it's created if it doesn't exist.
+   * mutex_ should be locked.
+   */
+  Server *ServerOfRequest(const FetchRequest &request);
+
+  /**
+   * Add request to the FIFO of the server, mutex_ should be locked.
+   */
+  void Enqueue(Server *server, const FetchRequest &request);
+
+  /**
+   * Forget the server if it has nothing to do, mutex_ should be locked.
+   */
+  void Release(Server *server);
+
+  /**
+   * Take the oldest request of the server, mutex_ should be locked.
+   */
+  void Take(Server *server, FetchRequest *request);
+
+  /**
+   * Add the server to the list of ready servers if it has queued
+   * requests and free slots, mutex_ should be locked.
+   *
+   * @return true if the server is added.
+   */
+  bool MakeReady(Server *server);
+
+  /**
+   * Maximum number of queued requests to one server.
+   */
+  const size_t capacity_;
+
+  /**
+   * Maximum number of requests in flight to one server.
+   */
+  const size_t per_server_;
+
+  /**
+   * Servers with queued requests or requests in flight. Elements of
+   * unordered_map aren't moved, so they are referred by pointers.
+   */
+  std::unordered_map<std::string, Server> servers_;
+
+  /**
+   * Servers with queued requests and free slots.
+   */
+  std::deque<Server *> ready_;
+
+  /**
+   * Total number of queued requests.
+   */
+  size_t size_;
+
+  /**
+   * Total number of requests in flight.
+   */
+  size_t total_in_flight_;
+
+  /**
+   * If the queue is closed for new requests.
+   */
+  bool closed_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable not_empty_;
+
+  DISALLOW_COPY_AND_ASSIGN(FetchQueue);
+};
+
+#endif  // SPIDER_FETCHQUEUE_H_
@@ -0,0 +1,165 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <string.h>
+
+#include <algorithm>
+#include <new>
+#include <string>
+
+#include "config.h"
+#include "hash-inl.h"
+#include "spider/filebatch.h"
+
+size_t FileBatch::PieceHash::operator()(const Piece &piece) const {
+  return hash::Hash64(piece.data, piece.size);
+}
+
+FileBatch::FileBatch(const size_t capacity)
+    : capacity_(capacity),
+      files_(),
+      dirs_(),
+      dir_files_(),
+      dir_index_(),
+      mime_types_(),
+      mime_type_index_(),
+      blocks_(),
+      block_size_(0),
+      block_used_(0),
+      arena_size_(0),
+      error_(0) {
+  files_.reserve(capacity);
+}
+
+int FileBatch::Add(const std::string &path, const std::string &mime_type,
+                   const std::string &fingerprint,
+                   const std::string &content_hash) {
+  if (UNLIKELY(is_full())) {
+    error_ = ENOSPC;
+    return -1;
+  }
+
+  size_t slash = path.rfind('/');
+  if (UNLIKELY(slash == std::string::npos)) {
+    error_ = EINVAL;
+    MSS_ERROR_MESSAGE(("Given string " + path + " have no '/' symbol.")
+                      .c_str());
+    return -1;
+  }
+
+  // Files come by directories, so the last directory is checked first.
+  int64_t dir = dirs_.size() - 1;
+  if (dirs_.empty() ||
+      !PieceEqual()(dirs_[dir], Piece{ path.data(), slash })) {
+    dir = Intern(path.data(), slash, &dir_index_, &dirs_);
+    if (UNLIKELY(dir < 0))
+      return -1;
+    if (static_cast<size_t>(dir) == dir_files_.size())
+      dir_files_.push_back(0);
+  }
+
+  int64_t mime = Intern(mime_type.data(), mime_type.size(),
+                        &mime_type_index_, &mime_types_);
+  if (UNLIKELY(mime < 0))
+    return -1;
+
+  File file;
+  file.dir = static_cast<uint32_t>(dir);
+  file.mime_type = static_cast<uint32_t>(mime);
+  file.name = Copy(path.data() + slash + 1, path.size() - slash - 1);
+  file.fingerprint = Copy(fingerprint.data(), fingerprint.size());
+  file.content_hash = Copy(content_hash.data(), content_hash.size());
+  if (UNLIKELY(file.name.data == NULL || file.fingerprint.data == NULL ||
+               file.content_hash.data == NULL))
+    return -1;
+
+  files_.push_back(file);
+  ++dir_files_[file.dir];
+  return 0;
+}
+
+void FileBatch::Clear() {
+  files_.clear();
+  dirs_.clear();
+  dir_files_.clear();
+  dir_index_.clear();
+  mime_types_.clear();
+  mime_type_index_.clear();
+
+  blocks_.clear();
+  block_size_ = block_used_ = arena_size_ = 0;
+}
+
+std::string FileBatch::PathOf(const File &file) const {
+  const Piece &dir = dirs_[file.dir];
+  std::string path;
+  path.reserve(dir.size + 1 + file.name.size);
+  path.append(dir.data, dir.size);
+  path += '/';
+  path.append(file.name.data, file.name.size);
+  return path;
+}
+
+FileBatch::Piece FileBatch::Copy(const char *data, const size_t size) {
+  if (size == 0)
+    return Piece{ "", 0 };
+
+  if (size > block_size_ - block_used_) {
+    // Long strings get blocks of their own size.
+    size_t block_size = std::max<size_t>(FILE_BATCH_BLOCK, size);
+    char *block = new(std::nothrow) char[block_size];
+    if (UNLIKELY(block == NULL)) {
+      error_ = ENOMEM;
+      MSS_ERROR("FileBatch", error_);
+      return Piece{ NULL, 0 };
+    }
+    blocks_.push_back(std::unique_ptr<char[]>(block));
+    block_size_ = block_size;
+    block_used_ = 0;
+    arena_size_ += block_size;
+  }
+
+  char *copy = blocks_.back().get() + block_used_;
+  memcpy(copy, data, size);
+  block_used_ += size;
+  return Piece{ copy, size };
+}
+
+int64_t FileBatch::Intern(const char *data, const size_t size, Index *index,
+                          std::vector<Piece> *pieces) {
+  auto found = index->find(Piece{ data, size });
+  if (found != index->end())
+    return found->second;
+
+  Piece copy = Copy(data, size);
+  if (UNLIKELY(copy.data == NULL))
+    return -1;
+  uint32_t id = static_cast<uint32_t>(pieces->size());
+  pieces->push_back(copy);
+  index->insert(std::make_pair(copy, id));
+  return id;
+}
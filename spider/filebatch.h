@@ -0,0 +1,211 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_FILEBATCH_H_
+#define SPIDER_FILEBATCH_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "common-inl.h"
+
+/**
+ * Files found at a scan which aren't in data base yet. Files of one
+ * directory share a long prefix, so each file is stored as the index of
+ * its directory and its name, and full paths of directories are stored
+ * once per batch. MIME types are interned too. All strings are copied
+ * into blocks of FILE_BATCH_BLOCK bytes, so adding a file doesn't
+ * allocate memory and the whole batch is released at once by Clear().
+ */
+class FileBatch {
+ public:
+  /**
+   * String stored in the batch, it's valid until Clear().
+   */
+  struct Piece {
+    const char *data;
+    size_t size;
+
+    inline std::string ToString() const { return std::string(data, size); }
+  };
+
+  /**
+   * File of the batch.
+   */
+  struct File {
+    /**
+     * Index of the directory of the file.
+     */
+    uint32_t dir;
+
+    /**
+     * Index of MIME type of the file.
+     */
+    uint32_t mime_type;
+
+    /**
+     * Name of the file without the directory.
+     */
+    Piece name;
+
+    /**
+     * Sampled fingerprint and hash of content of the file, they are empty
+     * if they're unknown.
+     */
+    Piece fingerprint;
+    Piece content_hash;
+  };
+
+  /**
+   * Constructor.
+   *
+   * @param capacity Maximum number of files in the batch.
+   */
+  explicit FileBatch(const size_t capacity);
+
+  /**
+   * Add file to the batch.
+   *
+   * @param path Full path to the file, "smb://server/dir/file".
+   * @param mime_type MIME type of the file.
+   * @param fingerprint Sampled fingerprint of the file or empty string.
+   * @param content_hash Hash of content of the file or empty string.
+   *
+   * @return 0 on success, -1 if the batch is full or memory can't be
+   * allocated.
+   */
+  int Add(const std::string &path, const std::string &mime_type,
+          const std::string &fingerprint, const std::string &content_hash);
+
+  /**
+   * Forget all files and free all blocks at once.
+   */
+  void Clear();
+
+  /**
+   * Get full path to the file.
+   *
+   * @param file File of the batch.
+   *
+   * @return Full path to the file.
+   */
+  std::string PathOf(const File &file) const;
+
+  inline size_t get_size() const { return files_.size(); }
+  inline size_t get_capacity() const { return capacity_; }
+  inline bool is_full() const { return files_.size() == capacity_; }
+  inline const File &get_file(const size_t i) const { return files_[i]; }
+
+  /**
+   * Directories of the batch, full path of each one and number of its
+   * files in the batch.
+   */
+  inline size_t get_dir_count() const { return dirs_.size(); }
+  inline const Piece &get_dir(const uint32_t dir) const { return dirs_[dir]; }
+  inline size_t get_dir_files(const uint32_t dir) const {
+    return dir_files_[dir];
+  }
+
+  inline const Piece &get_mime_type(const uint32_t mime_type) const {
+    return mime_types_[mime_type];
+  }
+
+  /**
+   * Get number of bytes in blocks of the batch.
+   *
+   * @return Size of the arena.
+   */
+  inline size_t get_arena_size() const { return arena_size_; }
+
+  inline int get_error() const { return error_; }
+
+ private:
+  struct PieceHash {
+    size_t operator()(const Piece &piece) const;
+  };
+
+  struct PieceEqual {
+    inline bool operator()(const Piece &left, const Piece &right) const {
+      return left.size == right.size &&
+             memcmp(left.data, right.data, left.size) == 0;
+    }
+  };
+
+  typedef std::unordered_map<Piece, uint32_t, PieceHash, PieceEqual> Index;
+
+  /**
+   * Copy string to the arena.
+   *
+   * @return Copy of the string, data is NULL if memory can't be allocated.
+   */
+  Piece Copy(const char *data, const size_t size);
+
+  /**
+   * Find equal string in pieces or copy it there.
+   *
+   * @return Index of the string in pieces, -1 if memory can't be
+   * allocated.
+   */
+  int64_t Intern(const char *data, const size_t size, Index *index,
+                 std::vector<Piece> *pieces);
+
+  size_t capacity_;
+
+  std::vector<File> files_;
+
+  /**
+   * Interned paths of directories and their indexes.
+   */
+  std::vector<Piece> dirs_;
+  std::vector<uint32_t> dir_files_;
+  Index dir_index_;
+
+  /**
+   * Interned MIME types and their indexes.
+   */
+  std::vector<Piece> mime_types_;
+  Index mime_type_index_;
+
+  /**
+   * Blocks of the arena, only the last one has free space.
+   */
+  std::vector<std::unique_ptr<char[]> > blocks_;
+  size_t block_size_;
+  size_t block_used_;
+  size_t arena_size_;
+
+  int error_;
+
+  DISALLOW_COPY_AND_ASSIGN(FileBatch);
+};
+
+#endif  // SPIDER_FILEBATCH_H_
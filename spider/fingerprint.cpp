@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+
+#include "hash-inl.h"
+#include "spider/fingerprint.h"
+
+size_t Fingerprint::Offsets(const off_t size, off_t *offsets) {
+  offsets[0] = 0;
+  if (size <= static_cast<off_t>(kBlockSize))
+    return 1;
+
+  // Blocks can overlap in files smaller than three blocks.
+  offsets[1] = (size - kBlockSize) / 2;
+  offsets[2] = size - kBlockSize;
+  return kBlocks;
+}
+
+uint64_t Fingerprint::Hash(const off_t size, const unsigned char *blocks) {
+  off_t offsets[kBlocks];
+  size_t count = Offsets(size, offsets);
+
+  uint64_t hash = size;
+  for (size_t i = 0; i < count; ++i) {
+    size_t length = std::min<off_t>(kBlockSize, size - offsets[i]);
+    hash = hash::Hash64(blocks + i * kBlockSize, length, hash);
+  }
+  return hash;
+}
+
+std::string Fingerprint::Format(const off_t size, const uint64_t hash) {
+  char buffer[48];
+  snprintf(buffer, sizeof(buffer), "%" PRId64 ":%016" PRIx64,
+           static_cast<int64_t>(size), hash);
+  return buffer;
+}
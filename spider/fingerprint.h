@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_FINGERPRINT_H_
+#define SPIDER_FINGERPRINT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <string>
+
+#include "config.h"
+#include "common-inl.h"
+
+/**
+ * Sampled fingerprint of file content: size of the file and 64-bit hash
+ * of blocks at its head, in the middle and at the tail. The head block is
+ * the header read to detect MIME type, so a fingerprint costs two small
+ * reads of the already open file. Files with equal fingerprints are
+ * duplicates with high probability and are found by an index lookup of
+ * the "fingerprint" parameter.
+ */
+class Fingerprint {
+ public:
+  /**
+   * Size of each sampled block.
+   */
+  static const size_t kBlockSize = HEADERSIZE;
+
+  /**
+   * Maximum number of sampled blocks.
+   */
+  static const size_t kBlocks = 3;
+
+  /**
+   * Get offsets of blocks which are sampled from the file.
+   *
+   * @param size Size of the file.
+   * @param offsets Where to store kBlocks offsets at most.
+   *
+   * @return Number of blocks, files not larger than a block have one.
+   */
+  static size_t Offsets(const off_t size, off_t *offsets);
+
+  /**
+   * Hash sampled blocks of the file.
+   *
+   * @param size Size of the file.
+   * @param blocks Blocks read at Offsets(), one after another by
+   * kBlockSize bytes.
+   *
+   * @return Hash of the blocks seeded by the size.
+   */
+  static uint64_t Hash(const off_t size, const unsigned char *blocks);
+
+  /**
+   * Make the value stored in data base.
+   *
+   * @param size Size of the file.
+   * @param hash Hash of sampled blocks.
+   *
+   * @return "size:hash" with the hash in 16 hex digits.
+   */
+  static std::string Format(const off_t size, const uint64_t hash);
+
+ private:
+  Fingerprint();
+  DISALLOW_COPY_AND_ASSIGN(Fingerprint);
+};
+
+#endif  // SPIDER_FINGERPRINT_H_
@@ -24,12 +24,18 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <signal.h>
+
 #include <string>
 
 #include "common-inl.h"
 #include "config.h"
 #include "spider.h"
 
+static void RequestStats(int) {
+  Spider::RequestStats();
+}
+
 int main() {
   // Read config from database
   std::string name, server, user, password;
@@ -44,6 +50,33 @@ int main() {
     return 1;
   }
 
+  // Built-in table of extensions is used if there is no config.
+  if (UNLIKELY(spider.LoadExtensions("../" EXTENSIONS_CONFIG))) {
+    MSS_DEBUG_ERROR("LoadExtensions", spider.get_error());
+  }
+
+  // Without cache all files are sniffed at every scan.
+  if (UNLIKELY(spider.OpenMimeCache("../" MIME_CACHE))) {
+    MSS_DEBUG_ERROR("OpenMimeCache", spider.get_error());
+  }
+
+  // Content of files is hashed only on listed shares.
+  if (UNLIKELY(spider.LoadHashedShares("../" CONTENT_HASH_CONFIG))) {
+    MSS_DEBUG_ERROR("LoadHashedShares", spider.get_error());
+  }
+
+  // Excluded directories are never listed, rules are reloaded on change.
+  if (UNLIKELY(spider.LoadExclusions("../" EXCLUSIONS_CONFIG))) {
+    MSS_DEBUG_ERROR("LoadExclusions", spider.get_error());
+  }
+
+  // Interrupted scans are resumed from checkpoints.
+  spider.set_checkpoint_dir("../" STATE_DIR);
+
+  // Statistics of scans are written at the end of leases and on SIGUSR1.
+  spider.set_stats_file("../" STATS_FILE);
+  signal(SIGUSR1, RequestStats);
+
   spider.Run();
   return 0;
 }
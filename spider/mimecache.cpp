@@ -0,0 +1,226 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "spider/mimecache.h"
+#include "hash-inl.h"
+
+namespace {
+
+const char kMagic[8] = { 'U', 'S', 'M', 'I', 'M', 'E', '\0', '\0' };
+const uint32_t kVersion = 3;
+
+}  // namespace
+
+MimeCache::MimeCache()
+    : fd_(-1),
+      map_(MAP_FAILED),
+      map_size_(0),
+      header_(NULL),
+      slots_(NULL),
+      sets_(0),
+      ways_(0),
+      clock_(0),
+      error_(0) {
+  static_assert(sizeof(Header) == 64, "Header should fill a cache line");
+  static_assert(sizeof(Slot) == 128, "Slot should fill two cache lines");
+}
+
+MimeCache::~MimeCache() {
+  Close();
+}
+
+int MimeCache::Open(const std::string &path, const size_t capacity,
+                    const size_t ways) {
+  Close();
+
+  if (UNLIKELY(ways == 0 || capacity < ways)) {
+    error_ = EINVAL;
+    MSS_ERROR("MimeCache geometry", error_);
+    return -1;
+  }
+
+  size_t sets = capacity / ways;
+  size_t size = sizeof(Header) + sets * ways * sizeof(Slot);
+
+  if ((fd_ = open(path.c_str(), O_RDWR | O_CREAT, 0644)) == -1) {
+    error_ = errno;
+    MSS_ERROR(("open " + path).c_str(), error_);
+    return -1;
+  }
+
+  struct stat st;
+  if (UNLIKELY(fstat(fd_, &st))) {
+    error_ = errno;
+    MSS_ERROR(("fstat " + path).c_str(), error_);
+    Close();
+    return -1;
+  }
+
+  // File of other size is recreated, all its entries are lost.
+  bool clear = static_cast<size_t>(st.st_size) != size;
+  if (clear && (ftruncate(fd_, 0) || ftruncate(fd_, size))) {
+    error_ = errno;
+    MSS_ERROR(("ftruncate " + path).c_str(), error_);
+    Close();
+    return -1;
+  }
+
+  map_ = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+  if (UNLIKELY(map_ == MAP_FAILED)) {
+    error_ = errno;
+    MSS_ERROR(("mmap " + path).c_str(), error_);
+    Close();
+    return -1;
+  }
+  map_size_ = size;
+
+  header_ = static_cast<Header*>(map_);
+  if (clear || memcmp(header_->magic, kMagic, sizeof(kMagic)) ||
+      header_->version != kVersion || header_->slot_size != sizeof(Slot) ||
+      header_->sets != sets || header_->ways != ways) {
+    memset(map_, 0, size);
+    memcpy(header_->magic, kMagic, sizeof(kMagic));
+    header_->version = kVersion;
+    header_->slot_size = sizeof(Slot);
+    header_->sets = sets;
+    header_->ways = ways;
+  }
+
+  slots_ = reinterpret_cast<Slot*>(header_ + 1);
+  sets_ = sets;
+  ways_ = ways;
+  clock_ = header_->clock;
+  return 0;
+}
+
+void MimeCache::Close() {
+  if (map_ != MAP_FAILED) {
+    header_->clock = clock_;
+    if (UNLIKELY(msync(map_, map_size_, MS_SYNC))) {
+      error_ = errno;
+      MSS_ERROR("msync", error_);
+    }
+    munmap(map_, map_size_);
+  }
+  if (fd_ != -1)
+    close(fd_);
+
+  fd_ = -1;
+  map_ = MAP_FAILED;
+  map_size_ = 0;
+  header_ = NULL;
+  slots_ = NULL;
+  sets_ = ways_ = 0;
+}
+
+bool MimeCache::Find(const uint64_t key, const off_t size,
+                     const time_t mtime, std::string *mime_type,
+                     uint64_t *fingerprint, uint64_t *content_hash) {
+  if (UNLIKELY(slots_ == NULL))
+    return false;
+
+  size_t set = key % sets_;
+  Slot *slots = slots_ + set * ways_;
+  std::lock_guard<std::mutex> lock(locks_[set % kLocks]);
+
+  for (size_t i = 0; i < ways_; ++i) {
+    Slot &slot = slots[i];
+    if (slot.key != key)
+      continue;
+    // Modified files are sniffed again, torn entries are ignored.
+    if (slot.size != size || slot.mtime != mtime ||
+        slot.checksum != Checksum(slot))
+      return false;
+
+    slot.stamp = ++clock_;
+    mime_type->assign(slot.mime_type);
+    if (fingerprint != NULL)
+      *fingerprint = slot.fingerprint;
+    if (content_hash != NULL)
+      *content_hash = slot.content_hash;
+    return true;
+  }
+
+  return false;
+}
+
+void MimeCache::Store(const uint64_t key, const off_t size,
+                      const time_t mtime, const std::string &mime_type,
+                      const uint64_t fingerprint,
+                      const uint64_t content_hash) {
+  if (UNLIKELY(slots_ == NULL || mime_type.size() > kMaxMimeType))
+    return;
+
+  size_t set = key % sets_;
+  Slot *slots = slots_ + set * ways_;
+  std::lock_guard<std::mutex> lock(locks_[set % kLocks]);
+
+  // The same key, an empty slot or the least recently used one.
+  Slot *victim = slots;
+  for (size_t i = 0; i < ways_; ++i) {
+    Slot &slot = slots[i];
+    if (slot.key == key || slot.key == 0) {
+      victim = &slot;
+      break;
+    }
+    if (slot.stamp < victim->stamp)
+      victim = &slot;
+  }
+
+  // Key is cleared first and set after the fields, and the checksum
+  // covering all of them is written last. Lookups are serialized by the
+  // lock, so only a crash can leave a torn slot in the mapped file, and
+  // its checksum doesn't match then.
+  victim->key = 0;
+  victim->size = size;
+  victim->mtime = mtime;
+  victim->fingerprint = fingerprint;
+  victim->content_hash = content_hash;
+  memset(victim->mime_type, 0, sizeof(victim->mime_type));
+  memcpy(victim->mime_type, mime_type.data(), mime_type.size());
+  victim->stamp = ++clock_;
+  victim->key = key;
+  victim->checksum = Checksum(*victim);
+  header_->clock = victim->stamp;
+}
+
+uint64_t MimeCache::MakeKey(const std::string &path) {
+  uint64_t key = hash::Hash64(path);
+  return key ? key : 1;
+}
+
+uint32_t MimeCache::Checksum(const Slot &slot) {
+  int64_t fields[5] = { static_cast<int64_t>(slot.key), slot.size,
+                        slot.mtime, static_cast<int64_t>(slot.fingerprint),
+                        static_cast<int64_t>(slot.content_hash) };
+  uint64_t checksum = hash::Hash64(slot.mime_type, sizeof(slot.mime_type));
+  return hash::Hash64(fields, sizeof(fields), checksum);
+}
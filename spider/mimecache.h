@@ -0,0 +1,216 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_MIMECACHE_H_
+#define SPIDER_MIMECACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+
+#include "config.h"
+#include "common-inl.h"
+
+/**
+ * Persistent cache of MIME types, fingerprints and content hashes of
+ * files. Entries are keyed by hash of full smb path of the file together
+ * with its size and mtime, so the entry becomes stale as soon as the file
+ * is modified.
+ *
+ * The cache is a set-associative table in a memory-mapped file. Each set
+ * has a fixed number of ways and the least recently used entry of the set
+ * is evicted. Each entry has a checksum, so entries torn by a crash are
+ * ignored instead of returning wrong MIME types. All methods are thread
+ * safe.
+ */
+class MimeCache {
+ public:
+  /**
+   * Maximum length of stored MIME type.
+   */
+  static const size_t kMaxMimeType = 75;
+
+  /**
+   * Simple constructor, the cache should be opened before use.
+   */
+  MimeCache();
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+  /**
+   * Destructor, closes the cache.
+   */
+  ~MimeCache();
+#endif  // DOXYGEN_SHOULD_SKIP_THIS
+
+  /**
+   * Open cache file or create it if it doesn't exist. If the file was
+   * created with other geometry it's cleared.
+   *
+   * @param path Path to the cache file.
+   * @param capacity Maximum number of entries.
+   * @param ways Number of entries in each set.
+   *
+   * @return 0 on success, -1 otherwise and error_ is set.
+   */
+  int Open(const std::string &path, const size_t capacity,
+           const size_t ways);
+
+  /**
+   * Flush the cache to disk and unmap it.
+   */
+  void Close();
+
+  /**
+   * Find MIME type of the file.
+   *
+   * @param key Key of the file path, see MakeKey().
+   * @param size Size of the file.
+   * @param mtime Time of last modification of the file.
+   * @param mime_type Found MIME type.
+   * @param fingerprint Where to store hash of sampled blocks of the file,
+   * 0 if it wasn't stored. Can be NULL.
+   * @param content_hash Where to store hash of whole content of the file,
+   * 0 if it wasn't stored. Can be NULL.
+   *
+   * @return true if the file is in the cache, false otherwise.
+   */
+  bool Find(const uint64_t key, const off_t size, const time_t mtime,
+            std::string *mime_type, uint64_t *fingerprint = NULL,
+            uint64_t *content_hash = NULL);
+
+  /**
+   * Store MIME type of the file.
+   *
+   * @param key Key of the file path, see MakeKey().
+   * @param size Size of the file.
+   * @param mtime Time of last modification of the file.
+   * @param mime_type MIME type of the file. Longer than kMaxMimeType
+   * types aren't stored.
+   * @param fingerprint Hash of sampled blocks of the file, 0 if unknown.
+   * @param content_hash Hash of whole content of the file, 0 if unknown.
+   */
+  void Store(const uint64_t key, const off_t size, const time_t mtime,
+             const std::string &mime_type, const uint64_t fingerprint = 0,
+             const uint64_t content_hash = 0);
+
+  /**
+   * Make key of the file path.
+   *
+   * @param path Full smb path of the file including server name.
+   *
+   * @return Non-zero key.
+   */
+  static uint64_t MakeKey(const std::string &path);
+
+  inline bool is_open() const { return slots_ != NULL; }
+  inline size_t get_capacity() const { return sets_ * ways_; }
+  inline int get_error() const { return error_; }
+
+ private:
+  /**
+   * Header of the cache file.
+   */
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t slot_size;
+    uint64_t sets;
+    uint64_t ways;
+    uint64_t clock;
+    char reserved[24];
+  };
+
+  /**
+   * Entry of the cache. Zero key means empty slot.
+   */
+  struct Slot {
+    uint64_t key;
+    int64_t size;
+    int64_t mtime;
+    uint64_t stamp;
+    uint64_t fingerprint;
+    uint64_t content_hash;
+    uint32_t checksum;
+    char mime_type[kMaxMimeType + 1];
+  };
+
+  /**
+   * Number of mutexes protecting sets.
+   */
+  static const size_t kLocks = 64;
+
+  /**
+   * Compute checksum of the slot. Stamp isn't covered because it's
+   * updated on every hit.
+   */
+  static uint32_t Checksum(const Slot &slot);
+
+  /**
+   * Descriptor of the cache file.
+   */
+  int fd_;
+
+  /**
+   * Mapped cache file.
+   */
+  void *map_;
+  size_t map_size_;
+
+  /**
+   * Header and slots in the mapped file.
+   */
+  Header *header_;
+  Slot *slots_;
+
+  /**
+   * Geometry of the cache.
+   */
+  size_t sets_;
+  size_t ways_;
+
+  /**
+   * Logical clock for LRU stamps.
+   */
+  std::atomic<uint64_t> clock_;
+
+  /**
+   * Mutexes protecting sets, set i is protected by locks_[i % kLocks].
+   */
+  std::mutex locks_[kLocks];
+
+  /**
+   * Last error.
+   */
+  int error_;
+
+  DISALLOW_COPY_AND_ASSIGN(MimeCache);
+};
+
+#endif  // SPIDER_MIMECACHE_H_
@@ -0,0 +1,185 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif  // __SSE2__
+
+#include "config.h"
+#include "common-inl.h"
+#include "spider/mimesniffer.h"
+
+/**
+ * Signatures of the most common formats found in local networks.
+ * More specific signatures should go before less specific ones, the first
+ * matched signature is used. MIME types are the same as libmagic returns.
+ */
+static constexpr MimeSignature kSignatures[] = {
+  // Images.
+  { 0, 8, "\x89PNG\r\n\x1a\n", 0, "image/png" },
+  { 0, 3, "\xff\xd8\xff", 0, "image/jpeg" },
+  { 0, 6, "GIF87a", 0, "image/gif" },
+  { 0, 6, "GIF89a", 0, "image/gif" },
+  { 0, 4, "II*\0", 0, "image/tiff" },
+  { 0, 4, "MM\0*", 0, "image/tiff" },
+  { 0, 12, "RIFF\0\0\0\0WEBP", 0x00f0, "image/webp" },
+  // Size of bitmap info header: BITMAPCOREHEADER, BITMAPINFOHEADER,
+  // BITMAPV4HEADER and BITMAPV5HEADER.
+  { 0, 15, "BM\0\0\0\0\0\0\0\0\0\0\0\0\x0c", 0x3ffc, "image/bmp" },
+  { 0, 15, "BM\0\0\0\0\0\0\0\0\0\0\0\0\x28", 0x3ffc, "image/bmp" },
+  { 0, 15, "BM\0\0\0\0\0\0\0\0\0\0\0\0\x6c", 0x3ffc, "image/bmp" },
+  { 0, 15, "BM\0\0\0\0\0\0\0\0\0\0\0\0\x7c", 0x3ffc, "image/bmp" },
+  { 0, 4, "8BPS", 0, "image/vnd.adobe.photoshop" },
+  { 0, 8, "AT&TFORM", 0, "image/vnd.djvu" },
+  { 0, 12, "\0\0\0\x0cjP  \r\n\x87\n", 0, "image/jp2" },
+  { 0, 9, "gimp xcf ", 0, "image/x-xcf" },
+  { 4, 8, "ftypheic", 0, "image/heic" },
+  { 4, 8, "ftypmif1", 0, "image/heif" },
+  { 4, 8, "ftypavif", 0, "image/avif" },
+
+  // Documents.
+  { 0, 5, "%PDF-", 0, "application/pdf" },
+  { 0, 4, "%!PS", 0, "application/postscript" },
+  { 0, 5, "{\\rtf", 0, "text/rtf" },
+  { 0, 4, "ITSF", 0, "application/vnd.ms-htmlhelp" },
+  { 60, 8, "BOOKMOBI", 0, "application/x-mobipocket-ebook" },
+  // Type of OLE2 document (doc, xls, msi, etc.) is stored deep inside it.
+  { 0, 8, "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1", 0, NULL },
+  // Office Open XML and OpenDocument are zip archives, their type is
+  // detected by names of files inside the archive.
+  { 30, 15, "[Content_Types]", 0, NULL },
+  { 30, 8, "mimetype", 0, NULL },
+  { 30, 9, "META-INF/", 0, "application/java-archive" },
+
+  // Archives.
+  { 0, 4, "PK\x03\x04", 0, "application/zip" },
+  { 0, 4, "PK\x05\x06", 0, "application/zip" },
+  { 0, 7, "Rar!\x1a\x07\0", 0, "application/x-rar" },
+  { 0, 6, "7z\xbc\xaf\x27\x1c", 0, "application/x-7z-compressed" },
+  { 0, 2, "\x1f\x8b", 0, "application/gzip" },
+  { 0, 3, "BZh", 0, "application/x-bzip2" },
+  { 0, 6, "\xfd" "7zXZ\0", 0, "application/x-xz" },
+  { 0, 4, "\x28\xb5\x2f\xfd", 0, "application/zstd" },
+  { 0, 4, "LZIP", 0, "application/x-lzip" },
+  { 0, 2, "\x1f\x9d", 0, "application/x-compress" },
+  { 257, 8, "ustar  \0", 0, "application/x-tar" },
+  { 257, 6, "ustar\0", 0, "application/x-tar" },
+  { 0, 4, "MSCF", 0, "application/vnd.ms-cab-compressed" },
+  { 0, 4, "\xed\xab\xee\xdb", 0, "application/x-rpm" },
+  { 0, 14, "!<arch>\ndebian", 0, "application/vnd.debian.binary-package" },
+  { 0, 8, "!<arch>\n", 0, "application/x-archive" },
+  { 0, 15, "SQLite format 3", 0, "application/vnd.sqlite3" },
+  { 0, 11, "d8:announce", 0, "application/x-bittorrent" },
+
+  // Audio.
+  { 0, 3, "ID3", 0, "audio/mpeg" },
+  { 0, 2, "\xff\xfb", 0, "audio/mpeg" },
+  { 0, 2, "\xff\xf3", 0, "audio/mpeg" },
+  { 0, 2, "\xff\xf2", 0, "audio/mpeg" },
+  { 0, 4, "fLaC", 0, "audio/flac" },
+  { 28, 7, "\x01vorbis", 0, "audio/ogg" },
+  { 28, 8, "OpusHead", 0, "audio/ogg" },
+  { 28, 7, "\x80theora", 0, "video/ogg" },
+  { 0, 12, "RIFF\0\0\0\0WAVE", 0x00f0, "audio/x-wav" },
+  { 0, 12, "FORM\0\0\0\0AIFF", 0x00f0, "audio/x-aiff" },
+  { 0, 4, "MThd", 0, "audio/midi" },
+  { 4, 8, "ftypM4A ", 0, "audio/x-m4a" },
+  { 0, 4, "MAC ", 0, "audio/x-ape" },
+  { 0, 4, "wvpk", 0, "audio/x-wavpack" },
+  { 0, 6, "#!AMR\n", 0, "audio/amr" },
+
+  // Video.
+  { 0, 12, "RIFF\0\0\0\0AVI ", 0x00f0, "video/x-msvideo" },
+  { 0, 4, "\x1a\x45\xdf\xa3", 0, "video/x-matroska" },
+  { 4, 8, "ftypqt  ", 0, "video/quicktime" },
+  { 4, 7, "ftyp3gp", 0, "video/3gpp" },
+  { 4, 8, "ftypM4V ", 0, "video/x-m4v" },
+  { 4, 4, "ftyp", 0, "video/mp4" },
+  { 4, 4, "moov", 0, "video/quicktime" },
+  { 4, 4, "mdat", 0, "video/quicktime" },
+  { 0, 4, "\0\0\x01\xba", 0, "video/mpeg" },
+  { 0, 4, "\0\0\x01\xb3", 0, "video/mpeg" },
+  { 0, 8, "\x30\x26\xb2\x75\x8e\x66\xcf\x11", 0, "video/x-ms-asf" },
+  { 0, 4, "FLV\x01", 0, "video/x-flv" },
+  { 0, 3, "FWS", 0, "application/x-shockwave-flash" },
+  { 0, 3, "CWS", 0, "application/x-shockwave-flash" },
+
+  // Fonts.
+  { 0, 4, "wOFF", 0, "font/woff" },
+  { 0, 4, "wOF2", 0, "font/woff2" },
+  { 0, 4, "OTTO", 0, "font/sfnt" },
+  { 0, 5, "\0\x01\0\0\0", 0, "font/sfnt" },
+};
+
+static constexpr int kSignaturesNumber =
+    sizeof(kSignatures) / sizeof(kSignatures[0]);
+
+/**
+ * Check that all patterns fit in 16 bytes and in the header.
+ */
+static constexpr bool SignaturesFit(const int i) {
+  return i == kSignaturesNumber ||
+         (kSignatures[i].length < sizeof(kSignatures[i].pattern) &&
+          kSignatures[i].offset + kSignatures[i].length <= HEADERSIZE &&
+          SignaturesFit(i + 1));
+}
+
+static_assert(SignaturesFit(0), "Signature doesn't fit in HEADERSIZE");
+
+const char *MimeSniffer::Sniff(const unsigned char *header,
+                               const size_t size) {
+  for (const MimeSignature &signature : kSignatures)
+    if (Match(signature, header, size))
+      return signature.mime_type;
+
+  return NULL;
+}
+
+bool MimeSniffer::Match(const MimeSignature &signature,
+                        const unsigned char *header, const size_t size) {
+  if (size < static_cast<size_t>(signature.offset) + signature.length)
+    return false;
+
+  // Bytes which should be equal.
+  unsigned int significant =
+      ((1u << signature.length) - 1) & ~signature.wildcards;
+
+#ifdef __SSE2__
+  __m128i bytes = _mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(header + signature.offset));
+  __m128i pattern = _mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(signature.pattern));
+  unsigned int equal = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, pattern));
+  return (equal & significant) == significant;
+#else
+  for (int i = 0; i < signature.length; ++i)
+    if ((significant & (1u << i)) &&
+        header[signature.offset + i] !=
+        static_cast<unsigned char>(signature.pattern[i]))
+      return false;
+  return true;
+#endif  // __SSE2__
+}
@@ -0,0 +1,109 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_MIMESNIFFER_H_
+#define SPIDER_MIMESNIFFER_H_
+
+#include <stddef.h>
+
+#include "config.h"
+#include "common-inl.h"
+
+/**
+ * Signature of a file format: bytes which files of this format have at
+ * the given offset.
+ */
+struct MimeSignature {
+  /**
+   * Offset of the pattern from the beginning of the file.
+   */
+  unsigned short offset;  // NOLINT(runtime/int)
+
+  /**
+   * Number of significant bytes in the pattern, no more than 15.
+   */
+  unsigned char length;
+
+  /**
+   * Bytes of the pattern padded by zeros to 16 bytes, so it can be
+   * compared by one SIMD instruction.
+   */
+  char pattern[16];
+
+  /**
+   * If bit i is set byte i of the pattern can have any value.
+   */
+  unsigned short wildcards;  // NOLINT(runtime/int)
+
+  /**
+   * MIME type of files with this signature. NULL means that the format
+   * can't be detected by signature and libmagic should be used.
+   */
+  const char *mime_type;
+};
+
+/**
+ * Fast detection of MIME types of the most common file formats by
+ * compile-time table of signatures. Only if none of them matches
+ * libmagic should be used.
+ */
+class MimeSniffer {
+ public:
+  /**
+   * Number of bytes after the header which should be readable, because
+   * patterns are loaded by 16 bytes.
+   */
+  static const size_t kPadding = 16;
+
+  /**
+   * Detect MIME type of file by its header.
+   *
+   * @param header Header of the file. There should be kPadding readable
+   * bytes after HEADERSIZE bytes of header.
+   * @param size Size of the header.
+   *
+   * @return MIME type of the file or NULL if it isn't detected.
+   */
+  static const char *Sniff(const unsigned char *header, const size_t size);
+
+ private:
+  /**
+   * Check if the header matches given signature.
+   *
+   * @param signature Signature of file format.
+   * @param header Header of the file.
+   * @param size Size of the header.
+   *
+   * @return true if header matches the signature, false otherwise.
+   */
+  static bool Match(const MimeSignature &signature,
+                    const unsigned char *header, const size_t size);
+
+  MimeSniffer();
+  DISALLOW_COPY_AND_ASSIGN(MimeSniffer);
+};
+
+#endif  // SPIDER_MIMESNIFFER_H_
@@ -0,0 +1,275 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_MPMCQUEUE_H_
+#define SPIDER_MPMCQUEUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#include "common-inl.h"
+
+/**
+ * Bounded lock-free queue with multiple producers and multiple consumers
+ * (Dmitry Vyukov's algorithm). Each cell of the ring buffer has a sequence
+ * number which tells producers and consumers whether the cell is free or
+ * filled for the current lap, so they only contend on one CAS.
+ *
+ * Push() and Pop() wait with backoff while the queue is full or empty,
+ * which gives backpressure between pipeline stages. Consumers which are
+ * idle for long wait with a timeout on a condition variable instead, it's
+ * only notified by producers when someone waits on it. Number of pushed and
+ * popped items is counted by the positions of the queue, so throughput
+ * of a stage can be measured without additional atomics.
+ */
+template <class T> class MPMCQueue {
+ public:
+  /**
+   * Constructor.
+   *
+   * @param capacity Maximum number of items, it's rounded up to a power
+   * of two.
+   */
+  explicit MPMCQueue(const size_t capacity)
+      : enqueue_pos_(0), dequeue_pos_(0), closed_(false), waiters_(0) {
+    size_t size = 2;
+    while (size < capacity)
+      size <<= 1;
+
+    buffer_.reset(new Cell[size]);
+    mask_ = size - 1;
+    for (size_t i = 0; i < size; ++i)
+      buffer_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+
+  /**
+   * Add item to the queue if it isn't full.
+   *
+   * @param value Item to be added.
+   *
+   * @return true on success, false if the queue is full.
+   */
+  bool TryPush(const T &value) {
+    Cell *cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &buffer_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) -
+                      static_cast<intptr_t>(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    cell->data = value;
+    cell->sequence.store(pos + 1, std::memory_order_release);
+
+    // Either the item is seen by a consumer which is going to wait or
+    // the consumer is seen here, see Pop() with timeout.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (UNLIKELY(waiters_.load(std::memory_order_relaxed) > 0)) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      not_empty_.notify_one();
+    }
+    return true;
+  }
+
+  /**
+   * Take item from the queue if it isn't empty.
+   *
+   * @param value Taken item.
+   *
+   * @return true on success, false if the queue is empty.
+   */
+  bool TryPop(T *value) {
+    Cell *cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;) {
+      cell = &buffer_[pos & mask_];
+      size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      intptr_t diff = static_cast<intptr_t>(sequence) -
+                      static_cast<intptr_t>(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1,
+                                               std::memory_order_relaxed))
+          break;
+      } else if (diff < 0) {
+        return false;
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+
+    *value = std::move(cell->data);
+    cell->sequence.store(pos + mask_ + 1, std::memory_order_release);
+    return true;
+  }
+
+  /**
+   * Add item to the queue, wait while it's full.
+   *
+   * @param value Item to be added.
+   */
+  void Push(const T &value) {
+    for (int attempt = 0; !TryPush(value); ++attempt)
+      Backoff(attempt);
+  }
+
+  /**
+   * Take item from the queue, wait while it's empty.
+   *
+   * @param value Taken item.
+   *
+   * @return true on success, false if the queue is closed and empty.
+   */
+  bool Pop(T *value) {
+    for (int attempt = 0; !TryPop(value); ++attempt) {
+      // Items pushed before Close() are still returned.
+      if (closed_.load(std::memory_order_acquire))
+        return TryPop(value);
+      Backoff(attempt);
+    }
+    return true;
+  }
+
+  /**
+   * Take item from the queue, sleep while it's empty until an item is
+   * pushed or the queue is closed.
+   *
+   * @param value Taken item.
+   * @param timeout Maximum time of waiting.
+   *
+   * @return true on success, false if the queue is still empty after
+   * timeout or it's closed and empty.
+   */
+  template <class Rep, class Period>
+  bool Pop(T *value, const std::chrono::duration<Rep, Period> &timeout) {
+    if (TryPop(value))
+      return true;
+
+    bool popped = false;
+    waiters_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      not_empty_.wait_for(lock, timeout, [this, value, &popped]() {
+        popped = TryPop(value);
+        return popped || closed_.load(std::memory_order_acquire);
+      });
+    }
+    waiters_.fetch_sub(1, std::memory_order_relaxed);
+    return popped || TryPop(value);
+  }
+
+  /**
+   * Tell consumers that no more items will be pushed.
+   */
+  void Close() {
+    closed_.store(true, std::memory_order_release);
+    std::lock_guard<std::mutex> lock(mutex_);
+    not_empty_.notify_all();
+  }
+
+  /**
+   * Allow consumers to wait for new items again.
+   */
+  void Open() { closed_.store(false, std::memory_order_release); }
+
+  inline bool is_closed() const { return closed_; }
+  inline size_t get_capacity() const { return mask_ + 1; }
+
+  /**
+   * Get approximate number of items in the queue.
+   */
+  inline size_t get_size() const {
+    size_t pushed = enqueue_pos_.load(std::memory_order_relaxed);
+    size_t popped = dequeue_pos_.load(std::memory_order_relaxed);
+    return pushed > popped ? pushed - popped : 0;
+  }
+
+  /**
+   * Get number of items pushed and popped since the queue was created.
+   */
+  inline uint64_t get_pushed() const { return enqueue_pos_; }
+  inline uint64_t get_popped() const { return dequeue_pos_; }
+
+ private:
+  /**
+   * Cell of the ring buffer.
+   */
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T data;
+  };
+
+  /**
+   * Spin for a while, then yield, then sleep.
+   */
+  static void Backoff(const int attempt) {
+    if (attempt < 16) {
+      return;
+    } else if (attempt < 64) {
+      std::this_thread::yield();
+    } else {
+      usleep(100);
+    }
+  }
+
+  std::unique_ptr<Cell[]> buffer_;
+  size_t mask_;
+
+  // Producers and consumers don't share cache lines.
+  alignas(64) std::atomic<size_t> enqueue_pos_;
+  alignas(64) std::atomic<size_t> dequeue_pos_;
+  alignas(64) std::atomic<bool> closed_;
+
+  /**
+   * Number of consumers sleeping on the condition variable.
+   */
+  std::atomic<int> waiters_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+
+  DISALLOW_COPY_AND_ASSIGN(MPMCQueue);
+};
+
+#endif  // SPIDER_MPMCQUEUE_H_
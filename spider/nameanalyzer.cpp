@@ -0,0 +1,222 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif  // __SSE2__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "spider/nameanalyzer.h"
+#include "spider/utf8.h"
+
+namespace {
+
+// Names are scanned by blocks of 64 bytes, bit i of a mask stands for
+// byte i of the block.
+const size_t kBlock = 64;
+
+#ifdef __SSE2__
+// Mask of bytes within [low, high]. SSE2 has only signed comparisons, so
+// the range is shifted to start at the minimum of signed bytes.
+inline __m128i InRange(const __m128i bytes, const char low, const char high) {
+  __m128i shifted = _mm_sub_epi8(bytes, _mm_set1_epi8(low - 128));
+  return _mm_cmplt_epi8(shifted, _mm_set1_epi8(high - low - 127));
+}
+#endif  // __SSE2__
+
+// Mask of bytes of the block which have given class.
+inline uint64_t ClassMask(const unsigned char *classes,
+                          const unsigned char byte_class) {
+  uint64_t mask = 0;
+#ifdef __SSE2__
+  const __m128i pattern = _mm_set1_epi8(byte_class);
+  for (size_t i = 0; i < kBlock; i += 16) {
+    __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+        classes + i));
+    uint64_t bits = _mm_movemask_epi8(_mm_cmpeq_epi8(block, pattern));
+    mask |= bits << i;
+  }
+#else
+  for (size_t i = 0; i < kBlock; ++i)
+    mask |= static_cast<uint64_t>(classes[i] == byte_class) << i;
+#endif  // __SSE2__
+  return mask;
+}
+
+}  // namespace
+
+NameAnalyzer::NameAnalyzer() : folded_(), classes_(), tokens_() {}
+
+size_t NameAnalyzer::Analyze(const std::string &name) {
+  const size_t size = name.size();
+  tokens_.clear();
+  folded_.resize(size);
+  if (size == 0)
+    return 0;
+
+  // Classes are padded by separators, so the last token is closed in the
+  // same way as others and the next block is always readable.
+  const size_t blocks = size / kBlock + 1;
+  classes_.assign((blocks + 1) * kBlock, bcSeparator);
+  if (Classify(name.data(), size, classes_.data(), &folded_[0]))
+    Utf8::FoldCase(&folded_[0], size);
+
+  // Token starts at a byte which follows a separator, switches between
+  // letters and digits, starts a camelCase hump ("myPhotos") or ends an
+  // acronym ("HDRImage" -> "hdr", "image"). It ends at the next start or
+  // separator. Boundaries are found by bit operations on masks of byte
+  // classes, so there are no branches per byte.
+  const unsigned char *classes = classes_.data();
+  uint64_t separator_carry = 1, letter_carry = 0, lower_carry = 0,
+           upper_carry = 0;
+  size_t start = 0;
+  bool open = false;
+  for (size_t offset = 0; offset < blocks * kBlock; offset += kBlock) {
+    const unsigned char *block = classes + offset;
+    uint64_t separator = ClassMask(block, bcSeparator);
+    uint64_t lower = ClassMask(block, bcLower);
+    uint64_t upper = ClassMask(block, bcUpper);
+    uint64_t letter = ~separator & ~ClassMask(block, bcDigit);
+
+    uint64_t previous_separator = separator << 1 | separator_carry;
+    uint64_t previous_letter = letter << 1 | letter_carry;
+    uint64_t previous_lower = lower << 1 | lower_carry;
+    uint64_t previous_upper = upper << 1 | upper_carry;
+    uint64_t next_lower = lower >> 1 |
+        static_cast<uint64_t>(block[kBlock] == bcLower) << (kBlock - 1);
+
+    uint64_t starts = ~separator &
+                      (previous_separator | (letter ^ previous_letter) |
+                       (upper & previous_lower) |
+                       (upper & previous_upper & next_lower));
+    uint64_t ends = separator & ~previous_separator;
+
+    for (uint64_t bits = starts | ends; bits != 0; bits &= bits - 1) {
+      size_t bit = __builtin_ctzll(bits);
+      size_t position = offset + bit;
+      if (open) {
+        Token token = { start, position - start };
+        tokens_.push_back(token);
+      }
+      open = (starts >> bit) & 1;
+      start = position;
+    }
+
+    separator_carry = separator >> (kBlock - 1);
+    letter_carry = letter >> (kBlock - 1);
+    lower_carry = lower >> (kBlock - 1);
+    upper_carry = upper >> (kBlock - 1);
+  }
+
+  return tokens_.size();
+}
+
+std::string NameAnalyzer::Join() const {
+  std::string joined;
+  joined.reserve(folded_.size());
+  for (const Token &token : tokens_) {
+    if (!joined.empty())
+      joined += ' ';
+    joined.append(folded_, token.offset, token.length);
+  }
+  return joined;
+}
+
+bool NameAnalyzer::Classify(const char *data, const size_t size,
+                            unsigned char *classes, char *folded) {
+#ifdef __SSE2__
+  // Classes are disjoint, so masks of each class are combined by OR.
+  const __m128i zero = _mm_setzero_si128();
+  __m128i others = zero;
+  for (size_t i = 0; i < size; i += 16) {
+    // The tail is copied, so bytes behind the end of data aren't read.
+    char tail[16] = { 0 };
+    const char *chunk = data + i;
+    if (size - i < 16) {
+      memcpy(tail, chunk, size - i);
+      chunk = tail;
+    }
+    __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(
+        chunk));
+    __m128i digit = InRange(bytes, '0', '9');
+    __m128i lower = InRange(bytes, 'a', 'z');
+    __m128i upper = InRange(bytes, 'A', 'Z');
+    __m128i other = _mm_cmplt_epi8(bytes, zero);
+    others = _mm_or_si128(others, other);
+
+    __m128i result = _mm_and_si128(digit, _mm_set1_epi8(bcDigit));
+    result = _mm_or_si128(result, _mm_and_si128(lower,
+                                                _mm_set1_epi8(bcLower)));
+    result = _mm_or_si128(result, _mm_and_si128(upper,
+                                                _mm_set1_epi8(bcUpper)));
+    result = _mm_or_si128(result, _mm_and_si128(other,
+                                                _mm_set1_epi8(bcOther)));
+    __m128i lowered = _mm_add_epi8(bytes, _mm_and_si128(upper,
+                                                        _mm_set1_epi8(32)));
+    if (LIKELY(size - i >= 16)) {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(classes + i), result);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(folded + i), lowered);
+    } else {
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(tail), result);
+      memcpy(classes + i, tail, size - i);
+      _mm_storeu_si128(reinterpret_cast<__m128i *>(tail), lowered);
+      memcpy(folded + i, tail, size - i);
+      break;
+    }
+  }
+  return _mm_movemask_epi8(others) != 0;
+#else
+  return ClassifyScalar(data, size, classes, folded);
+#endif  // __SSE2__
+}
+
+bool NameAnalyzer::ClassifyScalar(const char *data, const size_t size,
+                                  unsigned char *classes, char *folded) {
+  bool other = false;
+  for (size_t i = 0; i < size; ++i) {
+    unsigned char byte = data[i];
+    folded[i] = byte;
+    if (byte >= '0' && byte <= '9') {
+      classes[i] = bcDigit;
+    } else if (byte >= 'a' && byte <= 'z') {
+      classes[i] = bcLower;
+    } else if (byte >= 'A' && byte <= 'Z') {
+      classes[i] = bcUpper;
+      folded[i] = byte + ('a' - 'A');
+    } else if (byte >= 0x80) {
+      classes[i] = bcOther;
+      other = true;
+    } else {
+      classes[i] = bcSeparator;
+    }
+  }
+  return other;
+}
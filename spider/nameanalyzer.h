@@ -0,0 +1,156 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_NAMEANALYZER_H_
+#define SPIDER_NAMEANALYZER_H_
+
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "common-inl.h"
+
+/**
+ * Analyzer of file names for the search index. The name is split into
+ * tokens on separators, camelCase humps and letter/digit boundaries and
+ * tokens are folded to lower case:
+ * "MyPhotos_2019-HDRImage.JPG" -> "my photos 2019 hdr image jpg".
+ *
+ * The name is read once. Classes of its bytes and folded bytes are
+ * computed by 16 at a time with SSE2 where it's available, tokens are
+ * cut by bit masks of the classes. Multibyte UTF-8 characters are never
+ * split, Latin-1 and Cyrillic ones are folded by Utf8::FoldCase() but
+ * don't start camelCase humps. The name should be valid UTF-8, see
+ * Utf8::Repair().
+ *
+ * Analyzer keeps its buffers between names, so it should be used by one
+ * thread at a time.
+ */
+class NameAnalyzer {
+ public:
+  /**
+   * Class of a byte of the name.
+   */
+  enum ByteClass {
+    bcSeparator = 0,  // Spaces, punctuation, control characters.
+    bcDigit = 1,
+    bcLower = 2,
+    bcUpper = 3,
+    bcOther = 4       // Bytes of non-ASCII UTF-8 characters.
+  };
+
+  /**
+   * Token of the analyzed name.
+   */
+  struct Token {
+    /**
+     * Offset of the token in the folded name.
+     */
+    size_t offset;
+
+    /**
+     * Length of the token in bytes.
+     */
+    size_t length;
+  };
+
+  /**
+   * Simple constructor.
+   */
+  NameAnalyzer();
+
+  /**
+   * Split name into tokens, tokens of the previous name are forgotten.
+   *
+   * @param name Name of the file.
+   *
+   * @return Number of tokens, 0 if the name has no letters or digits.
+   */
+  size_t Analyze(const std::string &name);
+
+  /**
+   * Get tokens of the last analyzed name joined by spaces.
+   *
+   * @return Analyzed name.
+   */
+  std::string Join() const;
+
+  /**
+   * Get text of the token.
+   *
+   * @param token Token of the last analyzed name.
+   *
+   * @return Folded text of the token.
+   */
+  inline std::string get_text(const Token &token) const {
+    return folded_.substr(token.offset, token.length);
+  }
+
+  inline const std::vector<Token> &get_tokens() const { return tokens_; }
+  inline const std::string &get_folded() const { return folded_; }
+
+  /**
+   * Classify bytes and fold them to lower case, it's vectorized if the
+   * CPU supports SSE2.
+   *
+   * @param data Bytes to be classified.
+   * @param size Number of the bytes.
+   * @param classes Where to store ByteClass of each byte.
+   * @param folded Where to store bytes folded to lower case.
+   *
+   * @return true if data has non-ASCII bytes, they aren't folded.
+   */
+  static bool Classify(const char *data, const size_t size,
+                       unsigned char *classes, char *folded);
+
+  /**
+   * Classify bytes one by one, see Classify(). It's used for the tail
+   * of data and to verify the vectorized version.
+   */
+  static bool ClassifyScalar(const char *data, const size_t size,
+                             unsigned char *classes, char *folded);
+
+ private:
+  /**
+   * Name folded to lower case.
+   */
+  std::string folded_;
+
+  /**
+   * Classes of bytes of the name.
+   */
+  std::vector<unsigned char> classes_;
+
+  /**
+   * Tokens of the name.
+   */
+  std::vector<Token> tokens_;
+
+  DISALLOW_COPY_AND_ASSIGN(NameAnalyzer);
+};
+
+#endif  // SPIDER_NAMEANALYZER_H_
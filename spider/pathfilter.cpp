@@ -0,0 +1,498 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <bitset>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "spider/pathfilter.h"
+
+namespace {
+
+typedef std::bitset<256> ByteSet;
+
+// State of Thompson NFA. It either consumes a byte of bytes and goes to
+// next or has only epsilon edges.
+struct NfaState {
+  ByteSet bytes;
+  int next;
+  std::vector<int> epsilon;
+};
+
+// Part of NFA with one entry and one exit, the exit has no edges yet.
+struct Fragment {
+  int start;
+  int end;
+};
+
+// Recursive descent parser of regular expression into NFA:
+//   alternation = concatenation ('|' concatenation)*
+//   concatenation = repetition*
+//   repetition = atom ('*' | '+' | '?')*
+//   atom = '(' alternation ')' | '[' set ']' | '.' | '\' byte | byte
+class RegexParser {
+ public:
+  RegexParser(const std::string &regex, const bool ignore_case,
+              std::vector<NfaState> *states)
+      : regex_(regex), position_(0), ignore_case_(ignore_case),
+        states_(states) {}
+
+  // Parse the whole expression, false if it's wrong.
+  bool Parse(Fragment *fragment) {
+    return Alternation(fragment) && position_ == regex_.size();
+  }
+
+ private:
+  int NewState() {
+    NfaState state;
+    state.next = -1;
+    states_->push_back(state);
+    return static_cast<int>(states_->size()) - 1;
+  }
+
+  void Connect(const int from, const int to) {
+    (*states_)[from].epsilon.push_back(to);
+  }
+
+  bool AtEnd() const { return position_ == regex_.size(); }
+  char Peek() const { return regex_[position_]; }
+
+  bool Alternation(Fragment *fragment) {
+    if (!Concatenation(fragment))
+      return false;
+    while (!AtEnd() && Peek() == '|') {
+      ++position_;
+      Fragment right;
+      if (!Concatenation(&right))
+        return false;
+      Fragment both = { NewState(), NewState() };
+      Connect(both.start, fragment->start);
+      Connect(both.start, right.start);
+      Connect(fragment->end, both.end);
+      Connect(right.end, both.end);
+      *fragment = both;
+    }
+    return true;
+  }
+
+  bool Concatenation(Fragment *fragment) {
+    fragment->start = fragment->end = NewState();
+    while (!AtEnd() && Peek() != '|' && Peek() != ')') {
+      Fragment next;
+      if (!Repetition(&next))
+        return false;
+      Connect(fragment->end, next.start);
+      fragment->end = next.end;
+    }
+    return true;
+  }
+
+  bool Repetition(Fragment *fragment) {
+    if (!Atom(fragment))
+      return false;
+    while (!AtEnd() && (Peek() == '*' || Peek() == '+' || Peek() == '?')) {
+      char op = regex_[position_++];
+      Fragment loop = { NewState(), NewState() };
+      Connect(loop.start, fragment->start);
+      if (op != '+')
+        Connect(loop.start, loop.end);
+      if (op != '?')
+        Connect(fragment->end, fragment->start);
+      Connect(fragment->end, loop.end);
+      *fragment = loop;
+    }
+    return true;
+  }
+
+  bool Atom(Fragment *fragment) {
+    if (AtEnd())
+      return false;
+    ByteSet bytes;
+    char c = regex_[position_++];
+    switch (c) {
+      case '(':
+        if (!Alternation(fragment) || AtEnd() || Peek() != ')')
+          return false;
+        ++position_;
+        return true;
+      case '[':
+        if (!Set(&bytes))
+          return false;
+        break;
+      case '.':
+        bytes.set();
+        break;
+      case '\\':
+        if (AtEnd())
+          return false;
+        bytes.set(static_cast<unsigned char>(regex_[position_++]));
+        break;
+      case ')':
+      case '*':
+      case '+':
+      case '?':
+        return false;
+      default:
+        bytes.set(static_cast<unsigned char>(c));
+        break;
+    }
+
+    if (ignore_case_) {
+      for (int letter = 'a'; letter <= 'z'; ++letter) {
+        if (bytes[letter] || bytes[letter - 'a' + 'A'])
+          bytes.set(letter).set(letter - 'a' + 'A');
+      }
+    }
+    fragment->start = NewState();
+    fragment->end = NewState();
+    (*states_)[fragment->start].bytes = bytes;
+    (*states_)[fragment->start].next = fragment->end;
+    return true;
+  }
+
+  // Set after '[': "^" negates it, ']' right after '[' or '^' is literal.
+  bool Set(ByteSet *bytes) {
+    bool negate = !AtEnd() && Peek() == '^';
+    if (negate)
+      ++position_;
+    bool first = true;
+    while (!AtEnd() && (first || Peek() != ']')) {
+      first = false;
+      unsigned char low = regex_[position_++];
+      if (low == '\\' && !AtEnd())
+        low = regex_[position_++];
+      unsigned char high = low;
+      if (position_ + 1 < regex_.size() && Peek() == '-' &&
+          regex_[position_ + 1] != ']') {
+        high = regex_[position_ + 1];
+        position_ += 2;
+        if (high == '\\' && !AtEnd())
+          high = regex_[position_++];
+        if (high < low)
+          return false;
+      }
+      for (int byte = low; byte <= high; ++byte)
+        bytes->set(byte);
+    }
+    if (AtEnd())
+      return false;
+    ++position_;  // ']'
+    if (negate)
+      bytes->flip();
+    return true;
+  }
+
+  const std::string &regex_;
+  size_t position_;
+  bool ignore_case_;
+  std::vector<NfaState> *states_;
+};
+
+// States reachable from given ones by epsilon edges. Only states which
+// consume bytes and the accepting one are kept, so equal sets of NFA
+// states make one state of DFA.
+std::vector<int> Closure(const std::vector<NfaState> &states,
+                         const std::vector<int> &from, const int accept) {
+  std::vector<bool> seen(states.size());
+  std::vector<int> stack(from), result;
+  while (!stack.empty()) {
+    int state = stack.back();
+    stack.pop_back();
+    if (seen[state])
+      continue;
+    seen[state] = true;
+    if (states[state].next >= 0 || state == accept)
+      result.push_back(state);
+    for (int next : states[state].epsilon)
+      stack.push_back(next);
+  }
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// Position of ']' which closes the set of glob opened at given position,
+// ']' right after "[" or "[!" is a member of the set.
+size_t SetEnd(const std::string &glob, const size_t open) {
+  size_t begin = open + 1;
+  if (begin < glob.size() && (glob[begin] == '!' || glob[begin] == '^'))
+    ++begin;
+  return glob.find(']', begin + 1);
+}
+
+// Rest of the line without leading and trailing spaces.
+std::string Trim(const char *begin) {
+  while (*begin == ' ' || *begin == '\t')
+    ++begin;
+  const char *end = begin + strlen(begin);
+  while (end > begin && strchr(" \t\r\n", end[-1]) != NULL)
+    --end;
+  return std::string(begin, end);
+}
+
+}  // namespace
+
+PathFilter::PathFilter()
+    : rules_(),
+      class_count_(0),
+      transitions_(),
+      accepting_(),
+      start_(0),
+      dead_(0),
+      error_(0) {
+  Compile();
+}
+
+int PathFilter::Load(const std::string &config) {
+  FILE *fin = fopen(config.c_str(), "r");
+  if (fin == NULL) {
+    error_ = errno;
+    MSS_ERROR(("fopen " + config).c_str(), error_);
+    return -1;
+  }
+
+  char *buf = NULL;
+  size_t size = 0;
+  int line = 0;
+
+  while (getline(&buf, &size, fin) >= 0) {
+    ++line;
+    char type[16];
+    int length = 0;
+    // Empty lines and comments.
+    if (sscanf(buf, "%15s%n", type, &length) <= 0 || type[0] == '#')
+      continue;
+
+    std::string pattern = Trim(buf + length);
+    bool ignore_case = type[0] == 'i';
+    const char *kind = type + (ignore_case ? 1 : 0);
+    int result = -1;
+    if (!pattern.empty() && !strcmp(kind, "glob"))
+      result = AddGlob(pattern, ignore_case);
+    else if (!pattern.empty() && !strcmp(kind, "regex"))
+      result = AddRegex(pattern, ignore_case);
+    if (result) {
+      MSS_WARN_MESSAGE((config + ": wrong line " +
+                        std::to_string(line)).c_str());
+    }
+  }
+
+  free(buf);
+  fclose(fin);
+
+  return Compile();
+}
+
+int PathFilter::AddGlob(const std::string &pattern, const bool ignore_case) {
+  if (UNLIKELY(pattern.empty())) {
+    error_ = EINVAL;
+    MSS_ERROR_MESSAGE("empty pattern is given.");
+    return -1;
+  }
+
+  // Directories are matched without trailing slash.
+  std::string glob = pattern;
+  while (glob.size() > 1 && glob[glob.size() - 1] == '/')
+    glob.erase(glob.size() - 1);
+
+  // Unanchored glob matches after any slash.
+  std::string regex = glob[0] == '/' ? "" : ".*/";
+  size_t close;
+  for (size_t i = 0; i < glob.size(); ++i) {
+    char c = glob[i];
+    if (c == '*' && i + 1 < glob.size() && glob[i + 1] == '*') {
+      ++i;
+      // "a/**/b" matches "a/b" too.
+      if (i + 1 < glob.size() && glob[i + 1] == '/') {
+        ++i;
+        regex += "(.*/)?";
+      } else {
+        regex += ".*";
+      }
+    } else if (c == '*') {
+      regex += "[^/]*";
+    } else if (c == '?') {
+      regex += "[^/]";
+    } else if (c == '[' && (close = SetEnd(glob, i)) != std::string::npos) {
+      size_t begin = i + 1;
+      regex += '[';
+      if (glob[begin] == '!' || glob[begin] == '^') {
+        regex += '^';
+        ++begin;
+      }
+      regex += glob.substr(begin, close - begin) + ']';
+      i = close;
+    } else if (c == '\\' && i + 1 < glob.size()) {
+      regex += glob.substr(i, 2);
+      ++i;
+    } else {
+      if (strchr("\\.[]()|*+?^$", c) != NULL)
+        regex += '\\';
+      regex += c;
+    }
+  }
+
+  return AddRegex(regex, ignore_case);
+}
+
+int PathFilter::AddRegex(const std::string &pattern, const bool ignore_case) {
+  // Rules match the whole path anyway.
+  std::string regex = pattern;
+  if (!regex.empty() && regex[0] == '^')
+    regex.erase(0, 1);
+  if (!regex.empty() && regex[regex.size() - 1] == '$' &&
+      (regex.size() < 2 || regex[regex.size() - 2] != '\\'))
+    regex.erase(regex.size() - 1);
+
+  // Wrong patterns are found before compilation of all rules.
+  std::vector<NfaState> states;
+  Fragment fragment;
+  if (UNLIKELY(regex.empty() ||
+               !RegexParser(regex, ignore_case, &states).Parse(&fragment))) {
+    error_ = EINVAL;
+    MSS_ERROR_MESSAGE(("wrong pattern " + pattern).c_str());
+    return -1;
+  }
+
+  Rule rule = { regex, ignore_case };
+  rules_.push_back(rule);
+  return 0;
+}
+
+int PathFilter::Compile() {
+  // NFA of all rules: the first state leads to each of them, all of them
+  // lead to the accepting state.
+  std::vector<NfaState> states(2);
+  const int entry = 0, accept = 1;
+  states[entry].next = states[accept].next = -1;
+  for (const Rule &rule : rules_) {
+    Fragment fragment;
+    RegexParser(rule.regex, rule.ignore_case, &states).Parse(&fragment);
+    states[entry].epsilon.push_back(fragment.start);
+    states[fragment.end].epsilon.push_back(accept);
+  }
+
+  // Bytes which belong to the same sets of all states have one class.
+  std::vector<ByteSet> sets;
+  for (const NfaState &state : states) {
+    if (state.next >= 0 &&
+        std::find(sets.begin(), sets.end(), state.bytes) == sets.end())
+      sets.push_back(state.bytes);
+  }
+  std::map<std::vector<bool>, unsigned char> classes;
+  std::vector<unsigned char> representatives;
+  for (int byte = 0; byte < 256; ++byte) {
+    std::vector<bool> membership(sets.size());
+    for (size_t i = 0; i < sets.size(); ++i)
+      membership[i] = sets[i][byte];
+    auto found = classes.find(membership);
+    if (found == classes.end()) {
+      unsigned char id = static_cast<unsigned char>(representatives.size());
+      found = classes.insert(std::make_pair(membership, id)).first;
+      representatives.push_back(byte);
+    }
+    byte_classes_[byte] = found->second;
+  }
+  class_count_ = representatives.size();
+
+  // Subset construction, states of DFA are numbered from 1.
+  std::map<std::vector<int>, State> ids;
+  std::vector<std::vector<int> > subsets;
+  transitions_.assign(class_count_, 0);
+  accepting_.assign(1, false);
+  auto add = [&](const std::vector<int> &subset) {
+    auto found = ids.find(subset);
+    if (found != ids.end())
+      return found->second;
+    State id = static_cast<State>(subsets.size()) + 1;
+    ids[subset] = id;
+    subsets.push_back(subset);
+    transitions_.resize(transitions_.size() + class_count_);
+    accepting_.push_back(std::binary_search(subset.begin(), subset.end(),
+                                            accept));
+    return id;
+  };
+
+  start_ = add(Closure(states, std::vector<int>(1, entry), accept));
+  for (size_t id = 1; id <= subsets.size(); ++id) {
+    if (UNLIKELY(subsets.size() > PATH_FILTER_MAX_STATES)) {
+      error_ = E2BIG;
+      MSS_ERROR("Compile", error_);
+      // The filter excludes nothing rather than a part of the rules.
+      rules_.clear();
+      Compile();
+      return -1;
+    }
+
+    const std::vector<int> subset = subsets[id - 1];
+    for (size_t byte_class = 0; byte_class < class_count_; ++byte_class) {
+      std::vector<int> moved;
+      for (int state : subset) {
+        if (states[state].next >= 0 &&
+            states[state].bytes[representatives[byte_class]])
+          moved.push_back(states[state].next);
+      }
+      // Adding of a state reallocates the table.
+      State next = add(Closure(states, moved, accept));
+      transitions_[id * class_count_ + byte_class] = next;
+    }
+  }
+
+  // Nothing is excluded after the dead state, it has no NFA states.
+  auto dead = ids.find(std::vector<int>());
+  dead_ = dead == ids.end() ? 0 : dead->second;
+  return 0;
+}
+
+PathFilter::State PathFilter::Step(State state,
+                                   const std::string &name) const {
+  if (state == dead_)
+    return state;
+  state = Next(state, '/');
+  for (size_t i = 0; i < name.size() && state != dead_; ++i)
+    state = Next(state, name[i]);
+  return state;
+}
+
+PathFilter::State PathFilter::Walk(const std::string &path) const {
+  State state = start_;
+  size_t begin = 0;
+  while (begin < path.size() && state != dead_) {
+    size_t end = path.find('/', begin);
+    if (end == std::string::npos)
+      end = path.size();
+    state = Step(state, path.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return state;
+}
@@ -0,0 +1,208 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_PATHFILTER_H_
+#define SPIDER_PATHFILTER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "common-inl.h"
+
+/**
+ * Rules which exclude directories from scans, e.g. "$RECYCLE.BIN" or
+ * build output. Each rule is a glob or a regular expression, all rules
+ * are compiled into one DFA, so a path is checked in one pass over its
+ * bytes whatever the number of rules.
+ *
+ * Paths on the server are matched as "/share/dir/subdir" in whole. The
+ * state of the DFA after a directory is kept with it, so a subdirectory
+ * is checked by its own name only: state = Step(parent_state, name).
+ *
+ * Compiled filter is immutable and can be used by many threads at once.
+ */
+class PathFilter {
+ public:
+  /**
+   * State of the DFA after a path, 0 is never a valid state.
+   */
+  typedef int32_t State;
+
+  /**
+   * Simple constructor, the filter excludes nothing.
+   */
+  PathFilter();
+
+  /**
+   * Read rules from config and compile them. Each line is the type of
+   * the rule and the pattern: "glob", "iglob", "regex" or "iregex",
+   * types with 'i' ignore case of ASCII letters. Empty lines and lines
+   * starting with '#' are skipped.
+   *
+   * @param config Path to config file.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int Load(const std::string &config);
+
+  /**
+   * Add glob rule. '*' and '?' match any bytes but '/', "**" matches
+   * anything, "[...]" matches a byte of the set ("[!...]" of the
+   * complement). Pattern without leading '/' matches the last names of
+   * the path at any depth.
+   *
+   * @param pattern Glob pattern.
+   * @param ignore_case If ASCII letters match both cases.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int AddGlob(const std::string &pattern, const bool ignore_case);
+
+  /**
+   * Add rule of extended regular expression with ".", "[...]", "(...)",
+   * '|', '*', '+', '?' and '\' escapes. It matches the whole path, so
+   * leading '^' and trailing '$' are optional.
+   *
+   * @param pattern Regular expression.
+   * @param ignore_case If ASCII letters match both cases.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int AddRegex(const std::string &pattern, const bool ignore_case);
+
+  /**
+   * Compile added rules into DFA. Rules added later are in effect after
+   * the next compilation.
+   *
+   * @return 0 on success, -1 otherwise, e.g. if the DFA has more than
+   * PATH_FILTER_MAX_STATES states.
+   */
+  int Compile();
+
+  /**
+   * Get state of the empty path, i.e. of the root of the server.
+   *
+   * @return Initial state.
+   */
+  inline State Start() const { return start_; }
+
+  /**
+   * Get state of the path after '/' and name are appended to it.
+   *
+   * @param state State of the path.
+   * @param name Name of the next directory.
+   *
+   * @return State of the longer path.
+   */
+  State Step(State state, const std::string &name) const;
+
+  /**
+   * Get state of the path on the server.
+   *
+   * @param path Path without leading slash, "share/dir".
+   *
+   * @return State of the path.
+   */
+  State Walk(const std::string &path) const;
+
+  /**
+   * Check if the path in the state is excluded.
+   *
+   * @param state State of the path.
+   *
+   * @return true if any rule matches the path.
+   */
+  inline bool IsExcluded(const State state) const {
+    return accepting_[state];
+  }
+
+  /**
+   * Check if the path on the server is excluded.
+   *
+   * @param path Path without leading slash, "share/dir".
+   *
+   * @return true if any rule matches the path.
+   */
+  inline bool Excludes(const std::string &path) const {
+    return IsExcluded(Walk(path));
+  }
+
+  inline size_t get_rule_count() const { return rules_.size(); }
+  inline size_t get_state_count() const { return accepting_.size() - 1; }
+  inline int get_error() const { return error_; }
+
+ private:
+  /**
+   * Rule in the form of regular expression.
+   */
+  struct Rule {
+    std::string regex;
+    bool ignore_case;
+  };
+
+  /**
+   * Get next state of the DFA.
+   */
+  inline State Next(const State state, const unsigned char byte) const {
+    return transitions_[state * class_count_ + byte_classes_[byte]];
+  }
+
+  /**
+   * Added rules, they are translated to regular expressions.
+   */
+  std::vector<Rule> rules_;
+
+  /**
+   * Bytes which all rules treat in the same way have one class, table of
+   * transitions has a column per class.
+   */
+  unsigned char byte_classes_[256];
+  size_t class_count_;
+
+  /**
+   * Transitions of the DFA, row per state. Row 0 is a placeholder.
+   */
+  std::vector<State> transitions_;
+
+  /**
+   * If the path in the state is excluded.
+   */
+  std::vector<bool> accepting_;
+
+  /**
+   * Initial state and the state after which nothing can be excluded.
+   */
+  State start_;
+  State dead_;
+
+  int error_;
+
+  DISALLOW_COPY_AND_ASSIGN(PathFilter);
+};
+
+#endif  // SPIDER_PATHFILTER_H_
@@ -0,0 +1,525 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "spider/posixsource.h"
+#include "spider/fingerprint.h"
+
+namespace {
+
+// Entry returned by getdents64(2), glibc provides no declaration before
+// version 2.30.
+struct LinuxDirent64 {
+  ino64_t d_ino;
+  off64_t d_off;
+  unsigned short d_reclen;  // NOLINT(runtime/int)
+  unsigned char d_type;
+  char d_name[];
+};
+
+EntryType TypeOf(const mode_t mode) {
+  if (S_ISDIR(mode))
+    return etDir;
+  if (S_ISREG(mode))
+    return etFile;
+  if (S_ISLNK(mode))
+    return etLink;
+  return etOther;
+}
+
+}  // namespace
+
+PosixSource::PosixSource()
+    : CrawlSource(),
+#ifdef STATX_TYPE
+      use_statx_(true)
+#else
+      use_statx_(false)
+#endif  // STATX_TYPE
+#ifdef HAVE_LIBURING
+      , ring_state_(rsNone),
+      direct_files_(false)
+#endif  // HAVE_LIBURING
+{}
+
+PosixSource::~PosixSource() {
+#ifdef HAVE_LIBURING
+  if (ring_state_ == rsReady)
+    io_uring_queue_exit(&ring_);
+#endif  // HAVE_LIBURING
+}
+
+CrawlSource::Dir PosixSource::OpenDir(const std::string &dir) {
+  PosixDir *posix_dir = new(std::nothrow) PosixDir;
+  if (UNLIKELY(posix_dir == NULL)) {
+    error_ = ENOMEM;
+    return NULL;
+  }
+
+  posix_dir->fd = open(LocalPathOf(dir).c_str(),
+                       O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (UNLIKELY(posix_dir->fd == -1)) {
+    DetectError();
+    delete posix_dir;
+    return NULL;
+  }
+  posix_dir->position = posix_dir->size = 0;
+  return posix_dir;
+}
+
+int PosixSource::ReadDir(Dir dir, std::vector<DirEntry> *entries,
+                         const size_t batch) {
+  PosixDir *posix_dir = static_cast<PosixDir *>(dir);
+  entries->clear();
+
+  // Entries are statted after the batch is read. If all of them are
+  // removed already, the next batch is read.
+  int count;
+  do {
+    if (UNLIKELY((count = ReadEntries(posix_dir, entries, batch)) < 0))
+      return -1;
+    StatEntries(posix_dir->fd, entries);
+  } while (entries->empty() && count > 0);
+
+  return entries->size();
+}
+
+int PosixSource::ReadEntries(PosixDir *dir, std::vector<DirEntry> *entries,
+                             const size_t batch) {
+  while (entries->size() < batch) {
+    if (dir->position == dir->size) {
+      long size = syscall(SYS_getdents64, dir->fd,  // NOLINT
+                          dir->buffer, kBufferSize);
+      if (UNLIKELY(size < 0)) {
+        DetectError();
+        return -1;
+      }
+      if (size == 0)
+        break;  // No more entries in the directory.
+      dir->position = 0;
+      dir->size = size;
+    }
+
+    const LinuxDirent64 *dirent = reinterpret_cast<const LinuxDirent64 *>(
+        dir->buffer + dir->position);
+    dir->position += dirent->d_reclen;
+
+    // Ignoring "." and ".."
+    if (dirent->d_name[0] == '.' &&
+        (dirent->d_name[1] == '\0' ||
+         (dirent->d_name[1] == '.' && dirent->d_name[2] == '\0')))
+      continue;
+
+    DirEntry entry;
+    entry.name = dirent->d_name;
+    entry.size = 0;
+    entry.mtime = 0;
+    entry.attrs = 0;
+    switch (dirent->d_type) {
+      case DT_DIR:
+        entry.type = etDir;
+        break;
+      case DT_REG:
+        entry.type = etFile;
+        break;
+      case DT_LNK:
+        entry.type = etLink;
+        break;
+      case DT_UNKNOWN:
+        // Some file systems don't fill types, statx tells them.
+        entry.type = etOther;
+        break;
+      default:
+        continue;  // Devices, pipes and sockets aren't indexed.
+    }
+    entries->push_back(entry);
+  }
+
+  return entries->size();
+}
+
+void PosixSource::StatEntries(const int fd, std::vector<DirEntry> *entries) {
+  // 1 means the entry isn't statted yet.
+  std::vector<int> results(entries->size(), 1);
+#ifdef HAVE_LIBURING
+  if (!InitRing())
+    RingStat(fd, entries, results.data());
+#endif  // HAVE_LIBURING
+
+  size_t kept = 0;
+  for (size_t i = 0; i < entries->size(); ++i) {
+    DirEntry &entry = (*entries)[i];
+
+    // Links aren't followed, so their attributes aren't needed.
+    if (entry.type != etLink && results[i] != 0 &&
+        UNLIKELY(StatEntry(fd, &entry))) {
+      if (error_ == ENOENT)
+        continue;  // The entry is removed already.
+      MSS_DEBUG_ERROR(("statx " + entry.name).c_str(), error_);
+    }
+
+    if (kept != i)
+      (*entries)[kept] = std::move(entry);
+    ++kept;
+  }
+  entries->resize(kept);
+}
+
+int PosixSource::StatEntry(const int fd, DirEntry *entry) {
+#ifdef STATX_TYPE
+  if (LIKELY(use_statx_)) {
+    // Cached attributes are enough, network file systems aren't asked
+    // to synchronize them.
+    struct statx stx;
+    if (LIKELY(!statx(fd, entry->name.c_str(),
+                      AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+                      STATX_TYPE | STATX_SIZE | STATX_MTIME, &stx))) {
+      entry->type = TypeOf(stx.stx_mode);
+      entry->size = stx.stx_size;
+      entry->mtime = stx.stx_mtime.tv_sec;
+      return 0;
+    }
+    if (errno != ENOSYS) {
+      DetectError();
+      return -1;
+    }
+    use_statx_ = false;
+  }
+#endif  // STATX_TYPE
+
+  struct stat st;
+  if (UNLIKELY(fstatat(fd, entry->name.c_str(), &st, AT_SYMLINK_NOFOLLOW))) {
+    DetectError();
+    return -1;
+  }
+  entry->type = TypeOf(st.st_mode);
+  entry->size = st.st_size;
+  entry->mtime = st.st_mtime;
+  return 0;
+}
+
+int PosixSource::CloseDir(Dir dir) {
+  PosixDir *posix_dir = static_cast<PosixDir *>(dir);
+  int result = close(posix_dir->fd);
+  delete posix_dir;
+  if (UNLIKELY(result)) {
+    DetectError();
+    return -1;
+  }
+  return 0;
+}
+
+int PosixSource::Stat(const std::string &path, struct stat *st) {
+  if (UNLIKELY(stat(LocalPathOf(path).c_str(), st))) {
+    DetectError();
+    return -1;
+  }
+  return 0;
+}
+
+ssize_t PosixSource::ReadSample(const std::string &path, const off_t *offsets,
+                                const size_t count, unsigned char *blocks,
+                                const size_t size) {
+  int fd = OpenReadOnly(LocalPathOf(path));
+  if (UNLIKELY(fd == -1)) {
+    DetectError();
+    return -1;
+  }
+
+  ssize_t header = 0;
+  for (size_t i = 0; i < count; ++i) {
+    unsigned char *block = blocks + i * size;
+    ssize_t total = 0, read = 0;
+    while (static_cast<size_t>(total) < size &&
+           (read = pread(fd, block + total, size - total,
+                         offsets[i] + total)) > 0)
+      total += read;
+
+    if (UNLIKELY(read < 0)) {
+      DetectError();
+      close(fd);
+      return -1;
+    }
+
+    memset(block + total, 0, size - total);
+    if (i == 0)
+      header = total;
+  }
+
+  close(fd);
+  return header;
+}
+
+CrawlSource::File PosixSource::OpenFile(const std::string &path) {
+  PosixFile *posix_file = new(std::nothrow) PosixFile;
+  if (UNLIKELY(posix_file == NULL)) {
+    error_ = ENOMEM;
+    return NULL;
+  }
+
+  posix_file->fd = OpenReadOnly(LocalPathOf(path));
+  if (UNLIKELY(posix_file->fd == -1)) {
+    DetectError();
+    delete posix_file;
+    return NULL;
+  }
+
+  // Larger readahead keeps the disk busy while chunks are hashed.
+  posix_fadvise(posix_file->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  return posix_file;
+}
+
+ssize_t PosixSource::ReadFile(File file, void *buffer, const size_t size) {
+  PosixFile *posix_file = static_cast<PosixFile *>(file);
+  ssize_t result;
+  do {
+    result = read(posix_file->fd, buffer, size);
+  } while (UNLIKELY(result == -1 && errno == EINTR));
+
+  if (UNLIKELY(result == -1)) {
+    DetectError();
+    return -1;
+  }
+  return result;
+}
+
+int PosixSource::CloseFile(File file) {
+  PosixFile *posix_file = static_cast<PosixFile *>(file);
+  posix_fadvise(posix_file->fd, 0, 0, POSIX_FADV_DONTNEED);
+  int result = close(posix_file->fd);
+  delete posix_file;
+  if (UNLIKELY(result)) {
+    DetectError();
+    return -1;
+  }
+  return 0;
+}
+
+void PosixSource::ReadSamples(const std::vector<std::string> &paths,
+                              const off_t *sizes, unsigned char *blocks,
+                              const size_t stride, ssize_t *results) {
+#ifdef HAVE_LIBURING
+  // Open, reads of blocks and close.
+  const size_t kRequests = Fingerprint::kBlocks + 2;
+  static_assert(kRequests * FETCH_BATCH_SIZE <= IO_URING_DEPTH,
+                "Fetch batch doesn't fit in the ring");
+
+  if (!InitRing() && direct_files_ && paths.size() <= FETCH_BATCH_SIZE) {
+    std::vector<std::string> local_paths;
+    local_paths.reserve(paths.size());
+    for (const std::string &path : paths)
+      local_paths.push_back(LocalPathOf(path));
+
+    // Each file is opened into its slot, read and closed by linked
+    // requests. If open fails the rest of its chain is cancelled. Short
+    // read breaks an ordinary link, so reads are hard linked and close
+    // is done anyway.
+    off_t offsets[FETCH_BATCH_SIZE][Fingerprint::kBlocks] = { { 0 } };
+    size_t counts[FETCH_BATCH_SIZE];
+    unsigned submitted = 0;
+    for (size_t i = 0; i < paths.size(); ++i) {
+      counts[i] = sizes != NULL ? Fingerprint::Offsets(sizes[i], offsets[i])
+                                : 1;
+      unsigned char *file_blocks = blocks + i * stride;
+      memset(file_blocks, 0, counts[i] * Fingerprint::kBlockSize);
+
+      struct io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+      io_uring_prep_openat_direct(sqe, AT_FDCWD, local_paths[i].c_str(),
+                                  O_RDONLY | O_NOATIME, 0, i);
+      sqe->flags |= IOSQE_IO_LINK;
+      sqe->user_data = kRequests * i;
+
+      for (size_t j = 0; j < counts[i]; ++j) {
+        sqe = io_uring_get_sqe(&ring_);
+        io_uring_prep_read(sqe, i, file_blocks + j * Fingerprint::kBlockSize,
+                           Fingerprint::kBlockSize, offsets[i][j]);
+        sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        sqe->user_data = kRequests * i + 1 + j;
+      }
+
+      sqe = io_uring_get_sqe(&ring_);
+      io_uring_prep_close_direct(sqe, i);
+      sqe->user_data = kRequests * i + kRequests - 1;
+      submitted += counts[i] + 2;
+    }
+
+    int ring_results[kRequests * FETCH_BATCH_SIZE];
+    if (LIKELY(!RunRing(submitted, ring_results))) {
+      for (size_t i = 0; i < paths.size(); ++i) {
+        const int *file_results = ring_results + kRequests * i;
+        results[i] = file_results[0] < 0 ? file_results[0] : file_results[1];
+        for (size_t j = 1; j < counts[i] && results[i] >= 0; ++j)
+          if (UNLIKELY(file_results[1 + j] < 0))
+            results[i] = file_results[1 + j];
+
+        // Kernels before 5.15 don't open files into slots.
+        if (UNLIKELY(file_results[0] == -EINVAL))
+          direct_files_ = false;
+
+        // Failed files are read again by plain syscalls, e.g. O_NOATIME
+        // isn't allowed for files of other users.
+        if (UNLIKELY(results[i] < 0)) {
+          results[i] = ReadSample(paths[i], offsets[i], counts[i],
+                                  blocks + i * stride,
+                                  Fingerprint::kBlockSize);
+          if (UNLIKELY(results[i] < 0))
+            results[i] = -error_;
+        }
+      }
+      return;
+    }
+  }
+#endif  // HAVE_LIBURING
+
+  CrawlSource::ReadSamples(paths, sizes, blocks, stride, results);
+}
+
+#ifdef HAVE_LIBURING
+int PosixSource::InitRing() {
+  if (LIKELY(ring_state_ != rsNone))
+    return ring_state_ == rsReady ? 0 : -1;
+
+  int result = io_uring_queue_init(IO_URING_DEPTH, &ring_, 0);
+  if (UNLIKELY(result < 0)) {
+    // Kernel is older than 5.1 or io_uring is forbidden, e.g. by seccomp.
+    MSS_DEBUG_ERROR("io_uring_queue_init", -result);
+    ring_state_ = rsUnavailable;
+    return -1;
+  }
+
+  // statx, openat, read and close are supported since 5.6.
+  struct io_uring_probe *probe = io_uring_get_probe_ring(&ring_);
+  bool supported = probe != NULL &&
+                   io_uring_opcode_supported(probe, IORING_OP_STATX) &&
+                   io_uring_opcode_supported(probe, IORING_OP_OPENAT) &&
+                   io_uring_opcode_supported(probe, IORING_OP_READ) &&
+                   io_uring_opcode_supported(probe, IORING_OP_CLOSE);
+  if (probe != NULL)
+    io_uring_free_probe(probe);
+  if (UNLIKELY(!supported)) {
+    MSS_DEBUG_MESSAGE("io_uring doesn't support file system requests");
+    io_uring_queue_exit(&ring_);
+    ring_state_ = rsUnavailable;
+    return -1;
+  }
+
+  direct_files_ = io_uring_register_files_sparse(&ring_,
+                                                 FETCH_BATCH_SIZE) == 0;
+  ring_state_ = rsReady;
+  return 0;
+}
+
+int PosixSource::RunRing(const unsigned count, int *results) {
+  int submitted = io_uring_submit_and_wait(&ring_, count);
+  int error = submitted < 0 ? -submitted : 0;
+
+  // Every submitted request is completed, even cancelled one.
+  int completed = 0;
+  while (completed < submitted) {
+    struct io_uring_cqe *cqe;
+    int result = io_uring_wait_cqe(&ring_, &cqe);
+    if (UNLIKELY(result == -EINTR))
+      continue;
+    if (UNLIKELY(result < 0)) {
+      error = -result;
+      break;
+    }
+    results[cqe->user_data] = cqe->res;
+    io_uring_cqe_seen(&ring_, cqe);
+    ++completed;
+  }
+
+  if (LIKELY(completed == static_cast<int>(count)))
+    return 0;
+
+  // Requests can't be left in the ring, so it isn't used anymore.
+  error_ = error != 0 ? error : EIO;
+  MSS_ERROR("io_uring", error_);
+  io_uring_queue_exit(&ring_);
+  ring_state_ = rsUnavailable;
+  return -1;
+}
+
+void PosixSource::RingStat(const int fd, std::vector<DirEntry> *entries,
+                           int *results) {
+  size_t owners[IO_URING_DEPTH];
+  int ring_results[IO_URING_DEPTH];
+
+  size_t next = 0;
+  while (next < entries->size()) {
+    // Requests of the chunk fill statx_ in order.
+    unsigned count = 0;
+    for (; next < entries->size() && count < IO_URING_DEPTH; ++next) {
+      if ((*entries)[next].type == etLink)
+        continue;
+      struct io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+      io_uring_prep_statx(sqe, fd, (*entries)[next].name.c_str(),
+                          AT_SYMLINK_NOFOLLOW | AT_STATX_DONT_SYNC,
+                          STATX_TYPE | STATX_SIZE | STATX_MTIME,
+                          &statx_[count]);
+      sqe->user_data = count;
+      owners[count++] = next;
+    }
+    if (count == 0)
+      break;
+
+    if (UNLIKELY(RunRing(count, ring_results)))
+      return;  // The rest is statted by plain syscalls.
+
+    for (unsigned i = 0; i < count; ++i) {
+      results[owners[i]] = ring_results[i];
+      if (LIKELY(ring_results[i] == 0)) {
+        DirEntry &entry = (*entries)[owners[i]];
+        entry.type = TypeOf(statx_[i].stx_mode);
+        entry.size = statx_[i].stx_size;
+        entry.mtime = statx_[i].stx_mtime.tv_sec;
+      }
+    }
+  }
+}
+#endif  // HAVE_LIBURING
+
+int PosixSource::OpenReadOnly(const std::string &local_path) {
+  // O_NOATIME is allowed only to owner of the file.
+  int fd = open(local_path.c_str(), O_RDONLY | O_CLOEXEC | O_NOATIME);
+  if (fd == -1 && errno == EPERM)
+    fd = open(local_path.c_str(), O_RDONLY | O_CLOEXEC);
+  return fd;
+}
+
+std::string PosixSource::LocalPathOf(const std::string &url) {
+  return IsLocal(url) ? "/" + PathOf(url) : url;
+}
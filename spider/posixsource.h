@@ -0,0 +1,320 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_POSIXSOURCE_H_
+#define SPIDER_POSIXSOURCE_H_
+
+#ifdef HAVE_LIBURING
+#include <liburing.h>
+#endif  // HAVE_LIBURING
+
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+#include "spider/crawlsource.h"
+
+/**
+ * Source of local file systems, e.g. mounted NFS or CIFS shares.
+ *
+ * Directories are read by getdents64(2) into a big buffer, attributes of
+ * entries are got by statx(2) relative to the directory descriptor
+ * without resolving the whole path, and only type, size and mtime are
+ * requested, so network file systems don't need to revalidate the rest.
+ *
+ * Built with HAVE_LIBURING the source submits statx(2) of a listing batch
+ * and open/read/close of several samples through io_uring, so many files
+ * cost one syscall. Requests failed in the ring are repeated by plain
+ * syscalls, they are used also when the kernel has no io_uring.
+ */
+class PosixSource : public CrawlSource {
+ public:
+  /**
+   * Constructor.
+   */
+  PosixSource();
+
+  /**
+   * Destructor.
+   */
+  ~PosixSource();
+
+  /**
+   * Open local directory.
+   *
+   * @param dir URL of the directory.
+   *
+   * @return Directory handle on success, NULL otherwise.
+   */
+  Dir OpenDir(const std::string &dir);
+
+  /**
+   * Get next batch of directory entries with their attributes.
+   * Entries removed while the directory is read are skipped.
+   *
+   * @param dir Directory handle.
+   * @param entries Where to store entries, previous content is removed.
+   * @param batch Maximum number of entries to get.
+   *
+   * @return Number of obtained entries, 0 at the end of directory and
+   * -1 on error.
+   */
+  int ReadDir(Dir dir, std::vector<DirEntry> *entries, const size_t batch);
+
+  /**
+   * Close local directory.
+   *
+   * @param dir Directory handle.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int CloseDir(Dir dir);
+
+  /**
+   * Get attributes of local file or directory.
+   *
+   * @param path URL of the file.
+   * @param st Where to store attributes.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int Stat(const std::string &path, struct stat *st);
+
+  /**
+   * Read blocks of local file at given offsets. Access time of the file
+   * isn't updated if it's allowed.
+   *
+   * @param path URL of the file.
+   * @param offsets Offsets of the blocks.
+   * @param count Number of the blocks.
+   * @param blocks Where to store the blocks one after another.
+   * @param size Size of each block.
+   *
+   * @return Number of bytes read into the first block on success,
+   * -1 otherwise.
+   */
+  ssize_t ReadSample(const std::string &path, const off_t *offsets,
+                     const size_t count, unsigned char *blocks,
+                     const size_t size);
+
+  /**
+   * Open local file for sequential reading. Access time of the file
+   * isn't updated if it's allowed.
+   *
+   * @param path URL of the file.
+   *
+   * @return File handle on success, NULL otherwise.
+   */
+  File OpenFile(const std::string &path);
+
+  /**
+   * Read next bytes of local file.
+   *
+   * @param file File handle.
+   * @param buffer Where to store the bytes.
+   * @param size Maximum number of bytes to read.
+   *
+   * @return Number of read bytes, 0 at the end of file and -1 on error.
+   */
+  ssize_t ReadFile(File file, void *buffer, const size_t size);
+
+  /**
+   * Close local file. Its pages are dropped from the page cache, so
+   * reading of large files doesn't evict useful data.
+   *
+   * @param file File handle.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int CloseFile(File file);
+
+  /**
+   * Read headers and fingerprint blocks of several local files. With
+   * io_uring each file is opened, read and closed by linked requests and
+   * all of them are submitted at once.
+   *
+   * @param paths URLs of the files, at most FETCH_BATCH_SIZE.
+   * @param sizes Sizes of the files or NULL to read only headers.
+   * @param blocks Where to store blocks, blocks of i-th file start at
+   * blocks + i * stride.
+   * @param stride Distance between blocks of files.
+   * @param results Where to store size of header or -errno for each file.
+   */
+  void ReadSamples(const std::vector<std::string> &paths,
+                   const off_t *sizes, unsigned char *blocks,
+                   const size_t stride, ssize_t *results);
+
+  /**
+   * Get path in local file system.
+   *
+   * @param url URL of the file, "file://host/path" -> "/path". Other
+   * strings are returned as is.
+   *
+   * @return Path in local file system.
+   */
+  static std::string LocalPathOf(const std::string &url);
+
+ private:
+  /**
+   * Size of the buffer for getdents64(2).
+   */
+  static const size_t kBufferSize = 32 * 1024;
+
+  /**
+   * Open local directory.
+   */
+  struct PosixDir {
+    /**
+     * Directory descriptor.
+     */
+    int fd;
+
+    /**
+     * Position of the next entry in the buffer and size of read data.
+     */
+    size_t position;
+    size_t size;
+
+    /**
+     * Entries read by getdents64(2).
+     */
+    char buffer[kBufferSize];
+  };
+
+  /**
+   * Open local file.
+   */
+  struct PosixFile {
+    /**
+     * File descriptor.
+     */
+    int fd;
+  };
+
+  /**
+   * Open local file for reading, O_NOATIME is used if it's allowed.
+   *
+   * @param local_path Path in local file system.
+   *
+   * @return File descriptor or -1 on error.
+   */
+  static int OpenReadOnly(const std::string &local_path);
+
+  /**
+   * Get type, size and mtime of the entry.
+   *
+   * @param fd Descriptor of the directory.
+   * @param entry Entry with name, its attributes are filled.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int StatEntry(const int fd, DirEntry *entry);
+
+  /**
+   * Read next batch of entries without their attributes.
+   *
+   * @param dir Open directory.
+   * @param entries Where to append entries.
+   * @param batch Maximum number of entries.
+   *
+   * @return Number of entries, 0 at the end of directory and -1 on error.
+   */
+  int ReadEntries(PosixDir *dir, std::vector<DirEntry> *entries,
+                  const size_t batch);
+
+  /**
+   * Get type, size and mtime of entries except links. Removed entries are
+   * dropped.
+   *
+   * @param fd Descriptor of the directory.
+   * @param entries Entries with names.
+   */
+  void StatEntries(const int fd, std::vector<DirEntry> *entries);
+
+  /**
+   * Whether statx(2) is supported by the kernel.
+   */
+  bool use_statx_;
+
+#ifdef HAVE_LIBURING
+  /**
+   * State of the ring.
+   */
+  enum RingState {
+    rsNone,        // Not created yet.
+    rsReady,       // Created.
+    rsUnavailable  // Kernel doesn't support io_uring or it's broken.
+  };
+
+  /**
+   * Create the ring at first use, so smb crawls don't allocate it.
+   *
+   * @return 0 if the ring can be used, -1 otherwise.
+   */
+  int InitRing();
+
+  /**
+   * Submit prepared requests and wait for their completions.
+   *
+   * @param count Number of prepared requests.
+   * @param results Where to store results of requests by their user data.
+   *
+   * @return 0 on success, -1 if the ring is broken and closed.
+   */
+  int RunRing(const unsigned count, int *results);
+
+  /**
+   * Stat entries through the ring.
+   *
+   * @param fd Descriptor of the directory.
+   * @param entries Entries with names.
+   * @param results Where to store 0 or -errno for each entry.
+   */
+  void RingStat(const int fd, std::vector<DirEntry> *entries, int *results);
+
+  /**
+   * The ring.
+   */
+  struct io_uring ring_;
+  RingState ring_state_;
+
+  /**
+   * Whether files can be opened into registered slots of the ring, it's
+   * needed to read and close them by requests linked to open.
+   */
+  bool direct_files_;
+
+  /**
+   * Attributes filled by statx requests.
+   */
+  struct statx statx_[IO_URING_DEPTH];
+#endif  // HAVE_LIBURING
+
+  DISALLOW_COPY_AND_ASSIGN(PosixSource);
+};
+
+#endif  // SPIDER_POSIXSOURCE_H_
@@ -32,11 +32,14 @@
 
 #include <chrono>
 #include <string>
+#include <vector>
 
 #include "spider/servermanager.h"
 #include "config.h"
 
-ServerManager::ServerManager(const std::string &server) : keepalive_(0) {
+ServerManager::ServerManager(const std::string &server,
+                             const size_t max_leases)
+    : max_leases_(max_leases), requests_(0), sockfd_(-1) {
   /*
    * Create socket and connect it to scheduler server.
    */
@@ -101,51 +104,91 @@ ServerManager::ServerManager(const std::string &server) : keepalive_(0) {
 }
 
 ServerManager::~ServerManager() {
+  std::vector<std::string> servers;
+  {
+    std::lock_guard<std::mutex> lock(leases_mutex_);
+    for (auto &lease : leases_)
+      servers.push_back(lease.first);
+  }
+  for (const std::string &server : servers)
+    ReleaseServer(server);
+
   close(sockfd_);
 }
 
 std::string ServerManager::GetServer() {
-  char buf[257];
+  // Wait for a free lease, it's reserved while the server is requested.
+  std::unique_lock<std::mutex> lock(leases_mutex_);
+  leases_cond_.wait(lock, [this]() {
+    return leases_.size() + requests_ < max_leases_;
+  });
+  ++requests_;
+  lock.unlock();
 
-  do {
-    send(sockfd_, "G", 1, 0);
-    memset(buf, 0, sizeof buf);
-    // Timeout if there are no free servers.
-    if (recv(sockfd_, buf, sizeof buf - 1, 0) == -1) {
-      MSS_ERROR("recv", errno);
-      sleep(5);
+  char buf[257];
+  std::string server;
+  while (server.empty()) {
+    {
+      // Replies aren't addressed to threads, so requests aren't concurrent.
+      std::lock_guard<std::mutex> request_lock(request_mutex_);
+      send(sockfd_, "G", 1, 0);
+      memset(buf, 0, sizeof buf);
+      // Timeout if there are no free servers.
+      if (recv(sockfd_, buf, sizeof buf - 1, 0) == -1)
+        MSS_ERROR("recv", errno);
     }
-  } while (buf[0] == '\0');
 
-  smbserver_ = buf;
+    lock.lock();
+    if (buf[0] != '\0' && leases_.find(buf) == leases_.end())
+      server = buf;
+    lock.unlock();
+    if (server.empty())
+      sleep(5);
+  }
 
-  keepalivemutex_.lock();
-  keepalive_ = 1;
-  keepalivemutex_.unlock();
+  lock.lock();
+  --requests_;
+  std::unique_ptr<Lease> &lease = leases_[server];
+  lease.reset(new Lease());
+  lease->released = false;
 
   // Send Keep Alive messages until server is released.
-  keepalivethread_ = std::thread([this]() {
-    while (1) {
-      std::this_thread::sleep_for(std::chrono::seconds(1));
-      std::string cmd = "G" + smbserver_;
-      send(sockfd_, cmd.c_str(), cmd.size(), 0);
-
-      {
-        std::lock_guard<std::mutex> lock(keepalivemutex_);
-        if (!keepalive_)
-          return;
-      }
-    }
-  });
-  return smbserver_;
+  lease->keepalive = std::thread(&ServerManager::KeepAlive, this, server,
+                                 lease.get());
+  return server;
+}
+
+void ServerManager::KeepAlive(const std::string server, Lease *lease) {
+  std::string cmd = "G" + server;
+  std::unique_lock<std::mutex> lock(leases_mutex_);
+  while (!leases_cond_.wait_for(lock, std::chrono::seconds(1),
+                                [lease]() { return lease->released; })) {
+    lock.unlock();
+    send(sockfd_, cmd.c_str(), cmd.size(), 0);
+    lock.lock();
+  }
 }
 
-void ServerManager::ReleaseServer() {
-  keepalivemutex_.lock();
-  keepalive_ = 0;
-  keepalivemutex_.unlock();
-  keepalivethread_.join();
+void ServerManager::ReleaseServer(const std::string &server) {
+  std::unique_ptr<Lease> lease;
+  {
+    std::lock_guard<std::mutex> lock(leases_mutex_);
+    auto found = leases_.find(server);
+    if (UNLIKELY(found == leases_.end() || server.empty()))
+      return;
+    lease = std::move(found->second);
+    leases_.erase(found);
+    lease->released = true;
+    // Wakes up the keep alive thread and threads waiting for a lease.
+    leases_cond_.notify_all();
+  }
+  lease->keepalive.join();
 
-  std::string cmd = "R" + smbserver_;
+  std::string cmd = "R" + server;
   send(sockfd_, cmd.c_str(), cmd.size(), 0);
 }
+
+size_t ServerManager::get_leases() const {
+  std::lock_guard<std::mutex> lock(leases_mutex_);
+  return leases_.size();
+}
@@ -27,41 +27,109 @@
 #ifndef SPIDER_SERVERMANAGER_H_
 #define SPIDER_SERVERMANAGER_H_
 
+#include <condition_variable>
+#include <map>
+#include <memory>
 #include <string>
 #include <thread>
 #include <mutex>
 
 #include "common-inl.h"
 
+/**
+ * Client of scheduler server which leases servers to be indexed. Several
+ * servers can be leased at once, each lease is kept alive by its own
+ * thread until the server is released.
+ */
 class ServerManager {
  public:
   /**
    * Constructor which inits all variables and connects to scheduler server.
    *
    * @param server Server address.
+   * @param max_leases Maximum number of servers leased at once.
    */
-  explicit ServerManager(const std::string &server);
+  explicit ServerManager(const std::string &server,
+                         const size_t max_leases = 1);
 
   /**
-   * Destructor.
+   * Destructor. All leased servers are released.
    */
   ~ServerManager();
 
   /**
-   * Get server to be indexed.
+   * Get server to be indexed. Wait while maximum number of servers are
+   * leased or there are no free servers. Can be called from any thread.
+   *
+   * @return Name of the leased server.
    */
   std::string GetServer();
 
   /**
    * Release server when indexing is finished.
+   *
+   * @param server Server returned by GetServer().
+   */
+  void ReleaseServer(const std::string &server);
+
+  /**
+   * Get number of leased servers.
+   *
+   * @return Number of leased servers.
    */
-  void ReleaseServer();
+  size_t get_leases() const;
 
  private:
-  std::mutex keepalivemutex_;
-  int keepalive_;
-  std::thread keepalivethread_;
-  std::string smbserver_;
+  /**
+   * Lease of one server.
+   */
+  struct Lease {
+    /**
+     * Thread which sends keep alive messages.
+     */
+    std::thread keepalive;
+
+    /**
+     * If the server is released.
+     */
+    bool released;
+  };
+
+  /**
+   * Send keep alive messages for the server until it's released.
+   *
+   * @param server Leased server.
+   * @param lease Lease of the server.
+   */
+  void KeepAlive(const std::string server, Lease *lease);
+
+  /**
+   * Maximum number of servers leased at once.
+   */
+  const size_t max_leases_;
+
+  /**
+   * Leases of all leased servers.
+   */
+  std::map<std::string, std::unique_ptr<Lease> > leases_;
+
+  /**
+   * Number of servers which are being requested from scheduler.
+   */
+  size_t requests_;
+
+  /**
+   * Mutex to protect leases and condition to wait for free lease or
+   * release of the server.
+   */
+  mutable std::mutex leases_mutex_;
+  std::condition_variable leases_cond_;
+
+  /**
+   * Mutex to match requests to scheduler with its replies.
+   */
+  std::mutex request_mutex_;
+
   int sockfd_;
   DISALLOW_COPY_AND_ASSIGN(ServerManager);
 };
@@ -0,0 +1,356 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <string.h>
+#include <libsmbclient.h>
+
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+#include "spider/smbsource.h"
+
+#ifndef FILE_ATTRIBUTE_DIRECTORY
+#define FILE_ATTRIBUTE_DIRECTORY 0x10
+#endif  // FILE_ATTRIBUTE_DIRECTORY
+#ifndef FILE_ATTRIBUTE_REPARSE_POINT
+#define FILE_ATTRIBUTE_REPARSE_POINT 0x400
+#endif  // FILE_ATTRIBUTE_REPARSE_POINT
+
+static void libsmbmm_guest_auth_smbc_get_data(const char *server,
+                                              const char *share,
+                                              char *workgroup, int wgmaxlen,
+                                              char *username, int unmaxlen,
+                                              char *password, int pwmaxlen) {
+  strncpy(username, "Guest", unmaxlen - 1);
+  strncpy(password, "", pwmaxlen - 1);
+  strncpy(workgroup, "", wgmaxlen - 1);
+  // Hack to prevent qt warnings
+  server = server;
+  share = share;
+}
+
+SMBSource::SMBSource()
+    : CrawlSource(),
+#if defined(HAVE_SMBC_READDIRPLUS2)
+      listing_mode_(lmReaddirPlus2),
+#elif defined(USE_READDIRPLUS)
+      listing_mode_(lmReaddirPlus),
+#else
+      listing_mode_(lmReaddir),
+#endif
+      context_(NULL),
+      throttle_(NULL),
+      stats_(NULL) {
+  // Create own smb context, so the source doesn't share connections
+  // with other sources.
+  if (UNLIKELY((context_ = smbc_new_context()) == NULL)) {
+    DetectError();
+    MSS_FATAL("smbc_new_context", error_);
+    return;
+  }
+  smbc_setFunctionAuthData(context_, libsmbmm_guest_auth_smbc_get_data);
+  if (UNLIKELY(smbc_init_context(context_) == NULL)) {
+    DetectError();
+    MSS_FATAL("smbc_init_context", error_);
+    smbc_free_context(context_, 1);
+    context_ = NULL;
+    return;
+  }
+}
+
+SMBSource::~SMBSource() {
+  if (context_)
+    smbc_free_context(context_, 1);
+}
+
+CrawlSource::Dir SMBSource::OpenDir(const std::string &dir) {
+  SMBDir *smb_dir = new(std::nothrow) SMBDir;
+  if (UNLIKELY(smb_dir == NULL)) {
+    error_ = ENOMEM;
+    return NULL;
+  }
+
+  // The whole listing is fetched by smbc_opendir(), so smbc_readdir()
+  // calls aren't throttled.
+  ThrottleGuard guard(throttle_, dir, ServerThrottle::srListing);
+  StageTimer timer(stats_, CrawlStats::ssOpenDir);
+  smb_dir->file = smbc_getFunctionOpendir(context_)(context_, dir.c_str());
+  if (UNLIKELY(smb_dir->file == NULL)) {
+    DetectError();
+    guard.set_error(error_);
+    timer.set_failed();
+    delete smb_dir;
+    return NULL;
+  }
+
+  // "smb://some.server" contains shares, directories with files start
+  // from "smb://some.server/share".
+  smb_dir->in_share = !PathOf(dir).empty();
+  return smb_dir;
+}
+
+int SMBSource::ReadDir(Dir dir, std::vector<DirEntry> *entries,
+                       const size_t batch) {
+  SMBDir *smb_dir = static_cast<SMBDir *>(dir);
+  entries->clear();
+  StageTimer timer(stats_, CrawlStats::ssReadDir);
+  ListingMode mode = smb_dir->in_share ? listing_mode_ : lmReaddir;
+
+  while (entries->size() < batch) {
+    DirEntry entry;
+    // NULL is returned at the end of directory and on error, errno
+    // is set only on error.
+    errno = 0;
+
+    switch (mode) {
+      case lmReaddir: {
+        struct smbc_dirent *dirent =
+            smbc_getFunctionReaddir(context_)(context_, smb_dir->file);
+        if (dirent == NULL)
+          break;
+        entry.name = dirent->name;
+        entry.type = TypeOf(dirent->smbc_type);
+        entry.size = 0;
+        entry.mtime = 0;
+        entry.attrs = 0;
+        break;
+      }
+      case lmReaddirPlus: {
+        const struct libsmb_file_info *info =
+            smbc_getFunctionReaddirPlus(context_)(context_, smb_dir->file);
+        if (info == NULL)
+          break;
+        entry.name = info->name;
+        entry.type = TypeOfAttrs(info->attrs,
+                                 (info->attrs & FILE_ATTRIBUTE_DIRECTORY) != 0);
+        entry.size = info->size;
+        entry.mtime = info->mtime_ts.tv_sec;
+        entry.attrs = info->attrs;
+        break;
+      }
+      case lmReaddirPlus2: {
+#ifdef HAVE_SMBC_READDIRPLUS2
+        struct stat st;
+        const struct libsmb_file_info *info =
+            smbc_getFunctionReaddirPlus2(context_)(context_, smb_dir->file,
+                                                   &st);
+        if (info == NULL)
+          break;
+        entry.name = info->name;
+        entry.type = TypeOfAttrs(info->attrs, S_ISDIR(st.st_mode));
+        entry.size = st.st_size;
+        entry.mtime = st.st_mtime;
+        entry.attrs = info->attrs;
+#else
+        MSS_FATAL_MESSAGE("smbc_readdirplus2 is not supported");
+        errno = ENOSYS;
+#endif  // HAVE_SMBC_READDIRPLUS2
+        break;
+      }
+    }
+
+    if (entry.name.empty()) {
+      if (UNLIKELY(errno)) {
+        DetectError();
+        timer.set_failed();
+        return -1;
+      }
+      break;  // No more entries in the directory.
+    }
+
+    // Ignoring "." and ".."
+    if (entry.name == "." || entry.name == "..")
+      continue;
+
+    entries->push_back(entry);
+  }
+
+  return entries->size();
+}
+
+int SMBSource::CloseDir(Dir dir) {
+  SMBDir *smb_dir = static_cast<SMBDir *>(dir);
+  int result = smbc_getFunctionClosedir(context_)(context_, smb_dir->file);
+  delete smb_dir;
+  if (UNLIKELY(result < 0)) {
+    DetectError();
+    return -1;
+  }
+  return 0;
+}
+
+int SMBSource::Stat(const std::string &path, struct stat *st) {
+  ThrottleGuard guard(throttle_, path, ServerThrottle::srMetadata);
+  if (UNLIKELY(smbc_getFunctionStat(context_)(context_, path.c_str(), st))) {
+    DetectError();
+    guard.set_error(error_);
+    return -1;
+  }
+  return 0;
+}
+
+ssize_t SMBSource::ReadSample(const std::string &path, const off_t *offsets,
+                              const size_t count, unsigned char *blocks,
+                              const size_t size) {
+  ThrottleGuard guard(throttle_, path, ServerThrottle::srSample);
+  SMBCFILE *file;
+  {
+    StageTimer timer(stats_, CrawlStats::ssOpen);
+    file = smbc_getFunctionOpen(context_)(context_, path.c_str(), O_RDONLY,
+                                          0);
+    if (UNLIKELY(file == NULL)) {
+      DetectError();
+      guard.set_error(error_);
+      timer.set_failed();
+      return -1;
+    }
+  }
+
+  ssize_t header = 0;
+  off_t position = 0;
+  for (size_t i = 0; i < count; ++i) {
+    unsigned char *block = blocks + i * size;
+    if (offsets[i] != position &&
+        UNLIKELY(smbc_getFunctionLseek(context_)(context_, file, offsets[i],
+                                                 SEEK_SET) < 0)) {
+      DetectError();
+      guard.set_error(error_);
+      smbc_getFunctionClose(context_)(context_, file);
+      return -1;
+    }
+
+    // smbc_read() can return less than requested before the end of file.
+    ssize_t total = 0, read = 0;
+    StageTimer timer(stats_, CrawlStats::ssRead);
+    while (static_cast<size_t>(total) < size &&
+           (read = smbc_getFunctionRead(context_)(context_, file,
+                                                  block + total,
+                                                  size - total)) > 0)
+      total += read;
+
+    if (UNLIKELY(read < 0)) {
+      DetectError();
+      guard.set_error(error_);
+      timer.set_failed();
+      smbc_getFunctionClose(context_)(context_, file);
+      return -1;
+    }
+    if (stats_ != NULL)
+      stats_->Count(CrawlStats::scBytes, total);
+
+    memset(block + total, 0, size - total);
+    position = offsets[i] + total;
+    if (i == 0)
+      header = total;
+  }
+
+  if (UNLIKELY(smbc_getFunctionClose(context_)(context_, file) < 0))
+    MSS_ERROR(("smbc_close " + path).c_str(), errno);
+
+  return header;
+}
+
+CrawlSource::File SMBSource::OpenFile(const std::string &path) {
+  SMBFile *smb_file = new(std::nothrow) SMBFile;
+  if (UNLIKELY(smb_file == NULL)) {
+    error_ = ENOMEM;
+    return NULL;
+  }
+
+  ThrottleGuard guard(throttle_, path, ServerThrottle::srMetadata);
+  StageTimer timer(stats_, CrawlStats::ssOpen);
+  smb_file->file = smbc_getFunctionOpen(context_)(context_, path.c_str(),
+                                                  O_RDONLY, 0);
+  if (UNLIKELY(smb_file->file == NULL)) {
+    DetectError();
+    guard.set_error(error_);
+    timer.set_failed();
+    delete smb_file;
+    return NULL;
+  }
+  smb_file->path = path;
+  return smb_file;
+}
+
+ssize_t SMBSource::ReadFile(File file, void *buffer, const size_t size) {
+  SMBFile *smb_file = static_cast<SMBFile *>(file);
+  ThrottleGuard guard(throttle_, smb_file->path, ServerThrottle::srBulk);
+  StageTimer timer(stats_, CrawlStats::ssRead);
+  ssize_t result = smbc_getFunctionRead(context_)(context_, smb_file->file,
+                                                  buffer, size);
+  if (UNLIKELY(result < 0)) {
+    DetectError();
+    guard.set_error(error_);
+    timer.set_failed();
+    return -1;
+  }
+  if (stats_ != NULL)
+    stats_->Count(CrawlStats::scBytes, result);
+  return result;
+}
+
+int SMBSource::CloseFile(File file) {
+  SMBFile *smb_file = static_cast<SMBFile *>(file);
+  int result = smbc_getFunctionClose(context_)(context_, smb_file->file);
+  delete smb_file;
+  if (UNLIKELY(result < 0)) {
+    DetectError();
+    return -1;
+  }
+  return 0;
+}
+
+EntryType SMBSource::TypeOf(const unsigned int type) {
+  switch (type) {
+    case SMBC_WORKGROUP:
+      return etWorkgroup;
+    case SMBC_SERVER:
+      return etServer;
+    case SMBC_FILE_SHARE:
+      return etShare;
+    case SMBC_DIR:
+      return etDir;
+    case SMBC_FILE:
+      return etFile;
+    case SMBC_LINK:
+      return etLink;
+    default:
+      // Printer, communication and IPC shares.
+      return etOther;
+  }
+}
+
+EntryType SMBSource::TypeOfAttrs(const unsigned int attrs, const bool dir) {
+  // Symbolic links and junctions are reparse points, they are skipped
+  // like SMBC_LINK entries of readdir.
+  if (attrs & FILE_ATTRIBUTE_REPARSE_POINT)
+    return etLink;
+  return dir ? etDir : etFile;
+}
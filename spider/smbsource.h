@@ -0,0 +1,268 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_SMBSOURCE_H_
+#define SPIDER_SMBSOURCE_H_
+
+#include <libsmbclient.h>
+
+#include <string>
+#include <vector>
+
+#include "common-inl.h"
+#include "spider/crawlsource.h"
+#include "spider/crawlstats.h"
+#include "spider/throttle.h"
+
+/**
+ * Source of smb servers with its own libsmbclient context.
+ *
+ * libsmbclient keeps all connection state in a context, so different
+ * sources can do smb requests at the same time as long as every context
+ * is used by one thread at a time.
+ */
+class SMBSource : public CrawlSource {
+ public:
+  /**
+   * Functions used to list directories inside shares.
+   */
+  enum ListingMode {
+    lmReaddir,        // smbc_readdir(), only names and types.
+    lmReaddirPlus,    // smbc_readdirplus(), names with size, mtime and
+                      // DOS attributes.
+    lmReaddirPlus2    // smbc_readdirplus2(), the same with struct stat.
+  };
+
+  /**
+   * Constructor which creates and initializes smb context.
+   */
+  SMBSource();
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+  /**
+   * Destructor.
+   */
+  ~SMBSource();
+
+  /**
+   * Get the way to list directories inside shares.
+   *
+   * @return Listing mode.
+   */
+  inline ListingMode get_listing_mode() const { return listing_mode_; }
+
+  /**
+   * Set the way to list directories inside shares.
+   *
+   * @param mode Listing mode.
+   */
+  inline void set_listing_mode(const ListingMode mode) {
+    listing_mode_ = mode;
+  }
+
+  /**
+   * Set throttle of smb servers shared by sources. Requests aren't
+   * throttled if it's NULL.
+   *
+   * @param throttle Throttle of smb servers.
+   */
+  inline void set_throttle(Throttle *throttle) { throttle_ = throttle; }
+
+  /**
+   * Set statistics of the scan which requests are done by the source.
+   * Requests aren't timed if it's NULL.
+   *
+   * @param stats Statistics of the scan.
+   */
+  inline void set_stats(CrawlStats *stats) { stats_ = stats; }
+#endif  // DOXYGEN_SHOULD_SKIP_THIS
+
+  /**
+   * Open smb directory. The request is throttled.
+   *
+   * @param dir Full smb path to the directory.
+   *
+   * @return Directory handle on success, NULL otherwise.
+   */
+  Dir OpenDir(const std::string &dir);
+
+  /**
+   * Get next batch of directory entries.
+   *
+   * libsmbclient gets the whole listing with attributes when the
+   * directory is opened, so in readdirplus modes size and mtime of files
+   * are obtained without extra requests. Lists of workgroups, servers
+   * and shares have no attributes and are always read by smbc_readdir().
+   *
+   * @param dir Directory handle.
+   * @param entries Where to store entries, previous content is removed.
+   * @param batch Maximum number of entries to get.
+   *
+   * @return Number of obtained entries, 0 at the end of directory and
+   * -1 on error.
+   */
+  int ReadDir(Dir dir, std::vector<DirEntry> *entries, const size_t batch);
+
+  /**
+   * Close smb directory.
+   *
+   * @param dir Directory handle.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int CloseDir(Dir dir);
+
+  /**
+   * Get attributes of smb file or directory. The request is throttled.
+   *
+   * @param path Full smb path to the file.
+   * @param st Where to store attributes.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int Stat(const std::string &path, struct stat *st);
+
+  /**
+   * Read blocks of smb file at given offsets. Opening, reading and
+   * closing of the file are throttled as one request.
+   *
+   * @param path Full smb path to the file.
+   * @param offsets Offsets of the blocks.
+   * @param count Number of the blocks.
+   * @param blocks Where to store the blocks one after another.
+   * @param size Size of each block.
+   *
+   * @return Number of bytes read into the first block on success,
+   * -1 otherwise.
+   */
+  ssize_t ReadSample(const std::string &path, const off_t *offsets,
+                     const size_t count, unsigned char *blocks,
+                     const size_t size);
+
+  /**
+   * Open smb file for sequential reading.
+   *
+   * @param path Full smb path to the file.
+   *
+   * @return File handle on success, NULL otherwise.
+   */
+  File OpenFile(const std::string &path);
+
+  /**
+   * Read next bytes of smb file. Each call is throttled as one request,
+   * libsmbclient splits large reads into several requests in flight.
+   *
+   * @param file File handle.
+   * @param buffer Where to store the bytes.
+   * @param size Maximum number of bytes to read.
+   *
+   * @return Number of read bytes, 0 at the end of file and -1 on error.
+   */
+  ssize_t ReadFile(File file, void *buffer, const size_t size);
+
+  /**
+   * Close smb file.
+   *
+   * @param file File handle.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int CloseFile(File file);
+
+ private:
+  /**
+   * Open smb file.
+   */
+  struct SMBFile {
+    /**
+     * File handle of libsmbclient.
+     */
+    SMBCFILE *file;
+
+    /**
+     * Full smb path to the file, reads are throttled by its server.
+     */
+    std::string path;
+  };
+
+  /**
+   * Open smb directory.
+   */
+  struct SMBDir {
+    /**
+     * Directory handle of libsmbclient.
+     */
+    SMBCFILE *file;
+
+    /**
+     * Whether the directory is inside a share.
+     */
+    bool in_share;
+  };
+
+  /**
+   * Convert type of smb entry.
+   *
+   * @param type Type of smb entry (SMBC_FILE, SMBC_DIR, etc.).
+   *
+   * @return Type of the entry.
+   */
+  static EntryType TypeOf(const unsigned int type);
+
+  /**
+   * Convert DOS attributes of entry listed by readdirplus.
+   *
+   * @param attrs DOS attributes of the entry (FILE_ATTRIBUTE_*).
+   * @param dir If the entry is a directory.
+   *
+   * @return Type of the entry.
+   */
+  static EntryType TypeOfAttrs(const unsigned int attrs, const bool dir);
+
+  /**
+   * The way to list directories inside shares.
+   */
+  ListingMode listing_mode_;
+
+  /**
+   * Context of libsmbclient used only by this source.
+   */
+  SMBCCTX *context_;
+
+  /**
+   * Throttle of smb servers, it's shared by sources.
+   */
+  Throttle *throttle_;
+
+  /**
+   * Statistics of the current scan.
+   */
+  CrawlStats *stats_;
+
+  DISALLOW_COPY_AND_ASSIGN(SMBSource);
+};
+
+#endif  // SPIDER_SMBSOURCE_H_
@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <magic.h>
+#include <assert.h>
+
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+#include "spider/smbworker.h"
+
+SMBWorker::SMBWorker(const int id)
+    : id_(id),
+      smb_source_(),
+      posix_source_(),
+      cookie_(NULL),
+      header_(),
+      error_(0) {
+  if (UNLIKELY(smb_source_.get_error())) {
+    error_ = smb_source_.get_error();
+    return;
+  }
+
+  // Prepare to work with libmagic
+  if ((cookie_ = magic_open(MAGIC_MIME_TYPE | MAGIC_ERROR)) == NULL) {
+    error_ = errno;
+    MSS_ERROR("magic_open", error_);
+    return;
+  }
+  if (magic_load(cookie_, NULL) == -1) {
+    error_ = magic_errno(cookie_);
+    MSS_ERROR("magic_load", error_);
+    return;
+  }
+}
+
+SMBWorker::~SMBWorker() {
+  if (cookie_)
+    magic_close(cookie_);
+}
+
+ssize_t SMBWorker::ReadHeader(const std::string &path) {
+  CrawlSource *source = SourceOf(path);
+  ssize_t size = source->ReadHeader(path, header_[0], HEADERSIZE);
+  if (UNLIKELY(size < 0))
+    error_ = source->get_error();
+  return size;
+}
+
+void SMBWorker::ReadSamples(const std::vector<std::string> &paths,
+                            const off_t *sizes, ssize_t *results) {
+  assert(paths.size() <= FETCH_BATCH_SIZE);
+  SourceOf(paths.front())->ReadSamples(paths, sizes, header_[0],
+                                       kSampleStride, results);
+}
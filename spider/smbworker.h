@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_SMBWORKER_H_
+#define SPIDER_SMBWORKER_H_
+
+#include <magic.h>
+
+#include <string>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+#include "spider/crawlsource.h"
+#include "spider/fingerprint.h"
+#include "spider/mimesniffer.h"
+#include "spider/posixsource.h"
+#include "spider/smbsource.h"
+#include "spider/throttle.h"
+
+/**
+ * Worker which owns its own crawl sources and libmagic cookie, so
+ * different workers can access files at the same time.
+ */
+class SMBWorker {
+ public:
+  /**
+   * Constructor which creates and initializes sources and
+   * magic cookie.
+   *
+   * @param id Number of the worker in the spider.
+   */
+  explicit SMBWorker(const int id);
+
+#ifndef DOXYGEN_SHOULD_SKIP_THIS
+  /**
+   * Destructor.
+   */
+  ~SMBWorker();
+
+  /**
+   * Get last occured error.
+   *
+   * @return Last occured error.
+   */
+  inline int get_error() const { return error_; }
+
+  /**
+   * Get number of the worker.
+   *
+   * @return Number of the worker.
+   */
+  inline int get_id() const { return id_; }
+
+  /**
+   * Get cookie for magic library.
+   *
+   * @return Cookie for magic library.
+   */
+  inline magic_t get_cookie() const { return cookie_; }
+
+  /**
+   * Get header of the file readen by the last ReadHeader() call or
+   * of index-th file of the last ReadSamples() call. Sampled blocks of
+   * the file follow the header.
+   *
+   * @param index Number of the file in the batch.
+   *
+   * @return Header of the file.
+   */
+  inline const unsigned char *get_header(const size_t index = 0) const {
+    return header_[index];
+  }
+
+  /**
+   * Get source of smb servers.
+   *
+   * @return Source of smb servers.
+   */
+  inline SMBSource *get_smb_source() { return &smb_source_; }
+
+  /**
+   * Set throttle of smb servers shared by workers. Requests aren't
+   * throttled if it's NULL.
+   *
+   * @param throttle Throttle of smb servers.
+   */
+  inline void set_throttle(Throttle *throttle) {
+    smb_source_.set_throttle(throttle);
+  }
+
+  /**
+   * Set statistics of the scan which task is done by the worker now.
+   * smb requests aren't timed if it's NULL.
+   *
+   * @param stats Statistics of the scan.
+   */
+  inline void set_stats(CrawlStats *stats) { smb_source_.set_stats(stats); }
+#endif  // DOXYGEN_SHOULD_SKIP_THIS
+
+  /**
+   * Get source of the URL.
+   *
+   * @param url URL of a file or directory.
+   *
+   * @return Local source for "file://" URLs, smb source otherwise.
+   */
+  inline CrawlSource *SourceOf(const std::string &url) {
+    if (CrawlSource::IsLocal(url))
+      return &posix_source_;
+    return &smb_source_;
+  }
+
+  /**
+   * Read up to HEADERSIZE first bytes of the file into the buffer of
+   * the worker. The buffer is reused by every call, so no memory is
+   * allocated and nothing is written to local file system.
+   *
+   * @param path URL of the file.
+   *
+   * @return Size of the header on success, -1 otherwise.
+   */
+  ssize_t ReadHeader(const std::string &path);
+
+  /**
+   * Read headers and fingerprint blocks of several files of one source
+   * into the buffers of the worker. Local files are read by batched
+   * requests.
+   *
+   * @param paths URLs of the files, at most FETCH_BATCH_SIZE.
+   * @param sizes Sizes of the files or NULL to read only headers.
+   * @param results Where to store size of each header or -errno.
+   */
+  void ReadSamples(const std::vector<std::string> &paths, const off_t *sizes,
+                   ssize_t *results);
+
+ private:
+  /**
+   * Number of the worker.
+   */
+  int id_;
+
+  /**
+   * Source of smb servers with its own context of libsmbclient.
+   */
+  SMBSource smb_source_;
+
+  /**
+   * Source of local file systems.
+   */
+  PosixSource posix_source_;
+
+  /**
+   * Cookie for magic library to detect MIME-types.
+   */
+  magic_t cookie_;
+
+  /**
+   * Size of buffer for one file: the header, other sampled blocks and
+   * padding used by MimeSniffer.
+   */
+  static const size_t kSampleStride =
+      Fingerprint::kBlocks * Fingerprint::kBlockSize + MimeSniffer::kPadding;
+
+  /**
+   * Buffers for headers and sampled blocks of files.
+   */
+  unsigned char header_[FETCH_BATCH_SIZE][kSampleStride];
+
+  /**
+   * Last occured error.
+   */
+  int error_;
+
+  DISALLOW_COPY_AND_ASSIGN(SMBWorker);
+};
+
+#endif  // SPIDER_SMBWORKER_H_
@@ -29,74 +29,119 @@
 #include <libsmbclient.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <assert.h>
+#include <string.h>
 
 #include <algorithm>
+#include <chrono>
 #include <string>
 #include <list>
 #include <vector>
 #include <memory>
+#include <thread>
 
 #include "config.h"
 #include "common-inl.h"
 #include "spider/spider.h"
+#include "spider/mimesniffer.h"
+#include "spider/fingerprint.h"
+#include "spider/utf8.h"
 
-static void libsmbmm_guest_auth_smbc_get_data(const char *server,
-                                              const char *share,
-                                              char *workgroup, int wgmaxlen,
-                                              char *username, int unmaxlen,
-                                              char *password, int pwmaxlen) {
-  strncpy(username, "Guest", unmaxlen - 1);
-  strncpy(password, "", pwmaxlen - 1);
-  strncpy(workgroup, "", wgmaxlen - 1);
-  // Hack to prevent qt warnings
-  server = server;
-  share = share;
-}
+std::atomic<bool> Spider::stats_requested_(false);
 
 Spider::Spider()
-    : db_name_(),
+    : pending_dirs_(WORKERS_NUMBER),
+      throttle_(),
+      fetch_queue_(FETCH_QUEUE_SIZE, FETCH_PER_SERVER),
+      hash_bandwidth_(CONTENT_HASH_RATE, CONTENT_HASH_BURST),
+      hash_queue_(CONTENT_HASH_QUEUE_SIZE, CONTENT_HASH_PER_SERVER),
+      write_queue_(WRITE_QUEUE_SIZE),
+      pipeline_running_(false),
+      scan_start_(0),
+      listed_files_(0),
+      fetched_files_(0),
+      hashed_files_(0),
+      written_files_(0),
+      crawl_(),
+      name_analyzer_(),
+      repaired_names_(0),
+      sniffer_hits_(0),
+      sniffer_misses_(0),
+      extensions_(),
+      extension_hits_(0),
+      sampled_files_(0),
+      mime_cache_(),
+      cache_hits_(0),
+      exclusions_mtime_(0),
+      exclusions_(std::make_shared<PathFilter>()),
+      db_name_(),
       db_server_(),
       db_user_(),
-      db_password_() {
+      db_password_(),
+      error_(0) {
   openlog("spider", LOG_CONS | LOG_ODELAY, LOG_USER);
 
   mime_type_attr_ = NULL;
   pserver_manager_ = NULL;
-  result_ = NULL;
+  writer_worker_ = NULL;
+
+  // Each worker has its own smb context and magic cookie.
+  for (int i = 0; i < WORKERS_NUMBER; ++i) {
+    SMBWorker *worker = new(std::nothrow) SMBWorker(i);
+    if (UNLIKELY(worker == NULL)) {
+      error_ = ENOMEM;
+      MSS_FATAL("worker", error_);
+      return;
+    }
+    workers_.push_back(worker);
+    worker->set_throttle(&throttle_);
 
-  if (smbc_init(libsmbmm_guest_auth_smbc_get_data, 0) < 0) {
-    DetectError();
-    MSS_FATAL("smbc_init", error_);
-    return;
+    if (UNLIKELY(worker->get_error())) {
+      error_ = worker->get_error();
+      return;
+    }
   }
 
-  // Create a directory to store file headers.
-  if (mkdir(TMPDIR, 00744 /* rwxr--r-- */) && errno != EEXIST) {
-    DetectError();
-    MSS_ERROR("mkdir", error_);
-    return;
+  // Fetchers have their own contexts too, so header requests don't wait
+  // for directory listings.
+  for (int i = 0; i < FETCH_DEPTH; ++i) {
+    SMBWorker *fetcher = new(std::nothrow) SMBWorker(WORKERS_NUMBER + i);
+    if (UNLIKELY(fetcher == NULL)) {
+      error_ = ENOMEM;
+      MSS_FATAL("fetcher", error_);
+      return;
+    }
+    fetchers_.push_back(fetcher);
+    fetcher->set_throttle(&throttle_);
+
+    if (UNLIKELY(fetcher->get_error())) {
+      error_ = fetcher->get_error();
+      return;
+    }
   }
 
-  // Prepare to work with libmagic
-  if ((cookie_ = magic_open(MAGIC_MIME_TYPE | MAGIC_ERROR)) == NULL) {
-    error_ = magic_errno(cookie_);
-    MSS_ERROR("magic_open", error_);
+  // The writer reads headers of files passed without MIME types, scan
+  // workers may use their contexts at the same time.
+  writer_worker_ = new(std::nothrow) SMBWorker(WORKERS_NUMBER + FETCH_DEPTH +
+                                               CONTENT_HASH_DEPTH);
+  if (UNLIKELY(writer_worker_ == NULL)) {
+    error_ = ENOMEM;
+    MSS_FATAL("writer_worker_", error_);
     return;
   }
-  if (magic_load(cookie_, NULL) == -1) {
-    error_ = magic_errno(cookie_);
-    MSS_ERROR("magic_open", error_);
+  writer_worker_->set_throttle(&throttle_);
+  if (UNLIKELY(writer_worker_->get_error())) {
+    error_ = writer_worker_->get_error();
     return;
   }
 
-  // Allocate memory to the result vector.
-  result_ = new(std::nothrow) std::vector<std::string>(VECTOR_SIZE);
-  if (result_ == NULL) {
+  // Scan run by ScanSMBDir() without scheduler.
+  crawl_.reset(new(std::nothrow) Crawl(""));
+  if (UNLIKELY(!crawl_)) {
     error_ = ENOMEM;
-    MSS_FATAL("result_", error_);
+    MSS_FATAL("crawl_", error_);
     return;
   }
-  last_ = result_->begin();
 
   error_ = 0;
 }
@@ -127,15 +172,125 @@ int Spider::ReadConfig(const std::string &config) {
   return 0;
 }
 
+int Spider::LoadExtensions(const std::string &config) {
+  if (UNLIKELY(extensions_.Load(config))) {
+    error_ = extensions_.get_error();
+    return -1;
+  }
+  return 0;
+}
+
+int Spider::OpenMimeCache(const std::string &path) {
+  if (UNLIKELY(mime_cache_.Open(path, MIME_CACHE_CAPACITY,
+                                MIME_CACHE_WAYS))) {
+    error_ = mime_cache_.get_error();
+    return -1;
+  }
+  return 0;
+}
+
+int Spider::LoadHashedShares(const std::string &config) {
+  FILE *fin = fopen(config.c_str(), "r");
+  if (fin == NULL) {
+    // Hashing is optional.
+    if (errno == ENOENT)
+      return 0;
+    DetectError();
+    MSS_ERROR(("fopen " + config).c_str(), error_);
+    return -1;
+  }
+
+  char *buf = NULL;
+  size_t size = 0;
+  while (getline(&buf, &size, fin) >= 0) {
+    char prefix[1024];
+    // Empty lines and comments.
+    if (sscanf(buf, "%1023s", prefix) <= 0 || prefix[0] == '#')
+      continue;
+    hashed_shares_.push_back(prefix);
+  }
+  free(buf);
+  fclose(fin);
+
+  // Hashers have their own contexts, so long reads of whole files don't
+  // delay header requests.
+  for (size_t i = hashers_.size();
+       !hashed_shares_.empty() && i < CONTENT_HASH_DEPTH; ++i) {
+    SMBWorker *hasher = new(std::nothrow) SMBWorker(WORKERS_NUMBER +
+                                                    FETCH_DEPTH + i);
+    if (UNLIKELY(hasher == NULL)) {
+      error_ = ENOMEM;
+      MSS_FATAL("hasher", error_);
+      return -1;
+    }
+    hashers_.push_back(hasher);
+    hasher->set_throttle(&throttle_);
+
+    if (UNLIKELY(hasher->get_error())) {
+      error_ = hasher->get_error();
+      return -1;
+    }
+  }
+  return 0;
+}
+
+int Spider::LoadExclusions(const std::string &config) {
+  {
+    std::lock_guard<std::mutex> lock(exclusions_mutex_);
+    exclusions_config_ = config;
+    exclusions_mtime_ = 0;
+  }
+  Exclusions();
+  return 0;
+}
+
+std::shared_ptr<const PathFilter> Spider::Exclusions() {
+  std::lock_guard<std::mutex> lock(exclusions_mutex_);
+  if (exclusions_config_.empty())
+    return exclusions_;
+
+  // Without the file nothing is excluded.
+  struct stat st;
+  if (stat(exclusions_config_.c_str(), &st) != 0) {
+    if (exclusions_mtime_ != 0 && errno == ENOENT) {
+      MSS_INFO_MESSAGE((exclusions_config_ + " is removed, nothing is "
+                        "excluded").c_str());
+      exclusions_ = std::make_shared<PathFilter>();
+      exclusions_mtime_ = 0;
+    }
+    return exclusions_;
+  }
+  if (st.st_mtime == exclusions_mtime_)
+    return exclusions_;
+
+  exclusions_mtime_ = st.st_mtime;
+  std::shared_ptr<PathFilter> filter = std::make_shared<PathFilter>();
+  if (UNLIKELY(filter->Load(exclusions_config_))) {
+    MSS_ERROR(("PathFilter::Load " + exclusions_config_ +
+               ", previous rules are kept").c_str(), filter->get_error());
+    return exclusions_;
+  }
+  MSS_INFO_MESSAGE((exclusions_config_ + ": " +
+                    std::to_string(filter->get_rule_count()) + " rules, " +
+                    std::to_string(filter->get_state_count()) +
+                    " states").c_str());
+  exclusions_ = filter;
+  return exclusions_;
+}
+
 Spider::Spider(const std::string &config,
                const std::string &db_name,
                const std::string &db_server,
                const std::string &db_user,
-               const std::string &db_password) {
+               const std::string &db_password) : Spider() {
+  if (error_)
+    return;
+
   if (ReadConfig(config) == -1)
     return;
 
-  pserver_manager_ = new(std::nothrow) ServerManager(scheduler_);
+  pserver_manager_ = new(std::nothrow) ServerManager(scheduler_,
+                                                     SERVERS_NUMBER);
   if (UNLIKELY(pserver_manager_ == NULL)) {
     error_ = ENOMEM;
     MSS_FATAL("pserver_manager_", error_);
@@ -150,24 +305,28 @@ Spider::Spider(const std::string &config,
   if (ConnectToDataBase()) {
     MSS_FATAL_MESSAGE(DatabaseEntity::get_db_error().c_str());
     error_ = ENOMSG;
-    delete result_;
-    result_ = NULL;
     return;
   }
 
-  // Detect an attribute to store mime types
-  mime_type_attr_ = FileAttribute::GetByNameAndType("mime-type",
-                                                    FileAttribute::faString);
-  if (!mime_type_attr_) {
-    // Create attribute if it doesn't exists
-    mime_type_attr_ = std::shared_ptr<FileAttribute>(
-        new(std::nothrow) FileAttribute("mime-type", FileAttribute::faString));
-    if (!mime_type_attr_) {
-      MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
-      error_ = ENOMSG;
-      delete result_;
-      result_ = NULL;
-    }
+  // Detect attributes to store mime types, fingerprints and hashes
+  mime_type_attr_ = InitAttribute("mime-type");
+  fingerprint_attr_ = InitAttribute("fingerprint");
+  content_hash_attr_ = InitAttribute("content-hash");
+  if (!mime_type_attr_ || !fingerprint_attr_ || !content_hash_attr_) {
+    MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    error_ = ENOMSG;
+    return;
+  }
+
+  // Entries migrated by data-storage/migrate-dir-ids.sql get their path
+  // hashes before the first scan, otherwise they would be added again.
+  int last = 0;
+  do {
+    last = FileEntry::HashMigratedPaths(last, SWEEP_BATCH_SIZE);
+  } while (last > 0);
+  if (UNLIKELY(last < 0)) {
+    MSS_FATAL_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    error_ = ENOMSG;
   }
 }
 
@@ -176,165 +335,843 @@ Spider::~Spider() {
   if (!DatabaseEntity::Disconnect())
     MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
 
-  if (rmdir(TMPDIR))
-    MSS_ERROR("rmdir", errno);
-
   if (pserver_manager_ != NULL)
     delete pserver_manager_;
 
-  if (cookie_)
-    magic_close(cookie_);
-
-  if (result_)
-    delete result_;
+  for (SMBWorker *worker : workers_)
+    delete worker;
+  for (SMBWorker *fetcher : fetchers_)
+    delete fetcher;
+  for (SMBWorker *hasher : hashers_)
+    delete hasher;
+  if (writer_worker_ != NULL)
+    delete writer_worker_;
 
   closelog();
 }
 
 void Spider::Run() {
-  while (1) {
-    std::string server = pserver_manager_->GetServer();
-    // Scan each server for all files.
-    if (UNLIKELY(ScanSMBDir("smb://" + server))) {
-      MSS_DEBUG_ERROR(("ScanSMBDir smb://" + server).c_str(), error_);
+  StartPipeline();
+
+  // Each thread scans leased servers one by one, all their directories
+  // and files are processed by the shared pipeline.
+  std::vector<std::thread> crawlers;
+  for (int i = 0; i < SERVERS_NUMBER; ++i) {
+    crawlers.push_back(std::thread([this]() {
+      DatabaseEntity::ThreadStart();
+      while (1)
+        CrawlServer(pserver_manager_->GetServer());
+    }));
+  }
+
+  for (std::thread &crawler : crawlers)
+    crawler.join();
+
+  StopPipeline();
+}
+
+void Spider::CrawlServer(const std::string &server) {
+  Crawl crawl(server);
+  crawl.exclusions = Exclusions();
+
+  // Unchanged directories are skipped.
+  if (UNLIKELY(LoadDirSignatures(&crawl))) {
+    MSS_DEBUG_MESSAGE(("LoadDirSignatures " + server).c_str());
+  }
+  // Scan each server for all files. Interrupted scan is resumed from
+  // its frontier.
+  // Files which weren't seen since this time are deleted after the scan.
+  {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    crawl.start = DatabaseEntity::GetServerTime();
+  }
+  std::vector<DirTask> dirs;
+  if (LIKELY(!ResumeCheckpoint(&crawl))) {
+    MSS_INFO_MESSAGE(("Resume scan of " + server + " from " +
+                      std::to_string(crawl.checkpoint.get_frontier().size()) +
+                      " directories").c_str());
+    dirs = crawl.checkpoint.get_frontier();
+  } else {
+    DirTask root = { crawl.root, 0, 0 };
+    crawl.checkpoint.AddDir(root);
+    dirs.push_back(root);
+  }
+  int result = ScanSMBDirs(&crawl, dirs);
+  if (UNLIKELY(result)) {
+    MSS_DEBUG_ERROR(("ScanSMBDir smb://" + server).c_str(), error_);
+  }
+  pserver_manager_->ReleaseServer(server);
+  // Added content to data base.
+  if (UNLIKELY(DumpToDataBase(&crawl))) {
+    MSS_DEBUG_ERROR(("DumpToDataBase smb://" + server).c_str(), error_);
+  } else if (UNLIKELY(SaveDirSignatures(&crawl))) {
+    MSS_DEBUG_MESSAGE(("SaveDirSignatures " + server).c_str());
+  } else if (LIKELY(result == 0)) {
+    // The whole server is in data base.
+    if (UNLIKELY(SweepServer(&crawl))) {
+      MSS_DEBUG_ERROR(("SweepServer " + server).c_str(), error_);
     }
-    pserver_manager_->ReleaseServer();
-    // Added content to data base.
-    if (UNLIKELY(DumpToDataBase())) {
-      MSS_DEBUG_ERROR(("DumpToDataBase smb://" + server).c_str(), error_);
+    crawl.checkpoint.Finish();
+  }
+  crawl.checkpoint.Close();
+
+  // Other leases run at once, so only counters of the scan belong to
+  // the server.
+  MSS_INFO_MESSAGE((server + ": " + std::to_string(crawl.written_files) +
+                    " files found, " +
+                    std::to_string(crawl.stats.get_counter(
+                        CrawlStats::scExtensionHits)) +
+                    " files classified by extension, " +
+                    std::to_string(crawl.stats.get_counter(
+                        CrawlStats::scCacheHits)) +
+                    " found in cache; all servers since start: " +
+                    std::to_string(repaired_names_) + " names repaired,"
+                    " signature table hit rate " +
+                    std::to_string(get_sniffer_hit_rate()) + "%").c_str());
+
+  // Statistics of the lease are kept until the next lease of the server.
+  std::string stats = crawl.stats.Report(server);
+  for (size_t begin = 0, end; begin < stats.size(); begin = end + 1) {
+    end = stats.find('\n', begin);
+    MSS_INFO_MESSAGE(stats.substr(begin, end - begin).c_str());
+  }
+  {
+    std::lock_guard<std::mutex> lock(stats_mutex_);
+    lease_stats_[server] = stats;
+  }
+  WriteStats();
+}
+
+std::string Spider::ReportStats() {
+  std::string report = "# running leases\n";
+  {
+    std::lock_guard<std::mutex> lock(crawls_mutex_);
+    for (Crawl *crawl : crawls_) {
+      if (!crawl->server.empty())
+        report += crawl->stats.Report(crawl->server);
     }
   }
+
+  report += "# last finished leases\n";
+  std::lock_guard<std::mutex> lock(stats_mutex_);
+  for (const auto &lease : lease_stats_)
+    report += lease.second;
+  return report;
 }
 
-int Spider::ScanSMBDir(const std::string &dir) {
-  int directory_handler = 0, dirc = 0, dsize = 0;
-  char *dirp = NULL;
-  char buf[BUF_SIZE];
+int Spider::WriteStats() {
+  if (stats_file_.empty())
+    return 0;
 
-  // Open given smb directory.
-  if (UNLIKELY((directory_handler = smbc_opendir(dir.c_str())) < 0)) {
+  // Readers never see a partly written file.
+  std::string report = ReportStats();
+  std::string temp = stats_file_ + ".tmp";
+  FILE *fout = fopen(temp.c_str(), "w");
+  if (UNLIKELY(fout == NULL)) {
+    DetectError();
+    MSS_ERROR(("fopen " + temp).c_str(), error_);
+    return -1;
+  }
+  bool written = fwrite(report.data(), 1, report.size(), fout) ==
+                 report.size();
+  if (UNLIKELY(fclose(fout) || !written)) {
     DetectError();
-    MSS_ERROR(("smbc_opendir " + dir).c_str(), error_);
+    MSS_ERROR(("fwrite " + temp).c_str(), error_);
+    unlink(temp.c_str());
     return -1;
   }
+  if (UNLIKELY(rename(temp.c_str(), stats_file_.c_str()))) {
+    DetectError();
+    MSS_ERROR(("rename " + temp).c_str(), error_);
+    unlink(temp.c_str());
+    return -1;
+  }
+  return 0;
+}
+
+int Spider::ScanSMBDir(const std::string &dir) {
+  crawl_->root = dir;
+  crawl_->root_failed = false;
+  crawl_->changed_dirs.clear();
+  crawl_->unchanged_paths.clear();
+  crawl_->dir_ids.clear();
+  crawl_->exclusions = Exclusions();
+
+  DirTask root = { dir, 0, 0 };
+  StartPipeline();
+  int result = ScanSMBDirs(crawl_.get(), std::vector<DirTask>(1, root));
+  StopPipeline();
+  return result;
+}
+
+int Spider::ScanSMBDirs(Crawl *crawl, const std::vector<DirTask> &dirs) {
+  {
+    std::lock_guard<std::mutex> lock(crawls_mutex_);
+    crawls_.push_back(crawl);
+  }
 
-  // Getting content of the directory.
-  // smbc_getdents() returns the readen size.
-  // When no more content in the directory smbc_getdents() returns 0.
-  // Use smbc_getdents() while returned value not equal 0.
-  while (true) {
-    dirp = static_cast<char *>(buf);
+  // The scan isn't finished until all directories are pushed. They are
+  // spread between workers, idle ones steal them anyway. They are in the
+  // checkpoint already.
+  crawl->AddWork();
+  for (size_t i = 0; i < dirs.size(); ++i) {
+    CrawlTask task = { crawl, dirs[i] };
+    crawl->AddWork();
+    pending_dirs_.Push(i % workers_.size(), task);
+  }
+  crawl->FinishWork();
 
-    // Get dir content which can placed in buf.
-    if (UNLIKELY((dirc = smbc_getdents(directory_handler,
-                                       (struct smbc_dirent *)dirp,
-                                       sizeof(buf)))) < 0) {
-      DetectError();
-      MSS_ERROR("smbc_getdents", error_);
-      return -1;
+  // Directories of the scan are listed, their files are classified and
+  // passed to the batch of the scan.
+  crawl->Wait();
+
+  {
+    std::lock_guard<std::mutex> lock(crawls_mutex_);
+    crawls_.remove(crawl);
+  }
+  return crawl->root_failed ? -1 : 0;
+}
+
+void Spider::StartPipeline() {
+  scan_start_ = time(NULL);
+  listed_files_ = fetched_files_ = hashed_files_ = written_files_ = 0;
+
+  // Classified files are written to data base while directories are
+  // scanned, so scanning doesn't stop while data base commits.
+  write_queue_.Open();
+  pipeline_running_ = true;
+  writer_thread_ = std::thread(&Spider::WriterWorker, this);
+
+  // Content of files on hashed shares is hashed in background.
+  hash_queue_.Open();
+  for (SMBWorker *hasher : hashers_)
+    hash_threads_.push_back(std::thread(&Spider::HashWorker, this, hasher));
+
+  // Headers of found files are fetched while directories are scanned.
+  fetch_queue_.Open();
+  for (SMBWorker *fetcher : fetchers_)
+    fetch_threads_.push_back(std::thread(&Spider::FetchWorker, this,
+                                         fetcher));
+
+  // Found directories are scanned by all workers. Idle workers steal
+  // them from the deques of the others. Workers wait for new scans
+  // until the pipeline is stopped.
+  pending_dirs_.Hold();
+  for (SMBWorker *worker : workers_)
+    scan_threads_.push_back(std::thread(&Spider::ScanWorker, this, worker));
+}
+
+void Spider::StopPipeline() {
+  pending_dirs_.Finish();
+  for (std::thread &thread : scan_threads_)
+    thread.join();
+  scan_threads_.clear();
+
+  // Queued headers are fetched before the pipeline is stopped.
+  fetch_queue_.Close();
+  for (std::thread &thread : fetch_threads_)
+    thread.join();
+  fetch_threads_.clear();
+
+  // Fetchers can pass files to hashers.
+  hash_queue_.Close();
+  for (std::thread &thread : hash_threads_)
+    thread.join();
+  hash_threads_.clear();
+
+  write_queue_.Close();
+  writer_thread_.join();
+  pipeline_running_ = false;
+
+  ReportPipeline();
+}
+
+void Spider::PushDir(const int worker, Crawl *crawl, const DirTask &dir) {
+  // Directories committed before resume are skipped with their subtrees,
+  // uncommitted subdirectories are in the frontier.
+  if (UNLIKELY(crawl->checkpoint.WasCommitted(dir.path)))
+    return;
+
+  crawl->checkpoint.AddDir(dir);
+  crawl->AddWork();
+  CrawlTask task = { crawl, dir };
+  pending_dirs_.Push(worker, task);
+}
+
+void Spider::ScanWorker(SMBWorker *worker) {
+  // Worker can dump full batch to data base.
+  DatabaseEntity::ThreadStart();
+
+  CrawlTask task;
+  while (pending_dirs_.Pop(worker->get_id(), &task)) {
+    worker->set_stats(&task.crawl->stats);
+    if (UNLIKELY(ListSMBDir(worker, task.crawl, task.dir))) {
+      ++task.crawl->failed_dirs;
+      if (task.dir.path == task.crawl->root)
+        task.crawl->root_failed = true;
     }
+    pending_dirs_.Finish();
+    task.crawl->FinishWork();
+  }
 
-    // Break the cycle if no more content in this directory.
-    if (dirc == 0)
-      break;
+  DatabaseEntity::ThreadEnd();
+}
 
-    // Put readen content in list
-    while (dirc > 0) {
-      dsize = ((struct smbc_dirent *)dirp)->dirlen;
+void Spider::FetchWorker(SMBWorker *worker) {
+  // Worker can dump full batch to data base.
+  DatabaseEntity::ThreadStart();
+
+  std::vector<FetchRequest> requests;
+  std::vector<std::string> paths;
+  off_t sizes[FETCH_BATCH_SIZE];
+  ssize_t results[FETCH_BATCH_SIZE];
+  FetchRequest request;
+  while (fetch_queue_.Pop(&request)) {
+    // Samples of local files are read by batches of requests to the same
+    // host, smb requests are throttled one by one.
+    requests.assign(1, request);
+    if (CrawlSource::IsLocal(request.path)) {
+      const std::string server = request.server;
+      while (requests.size() < FETCH_BATCH_SIZE &&
+             fetch_queue_.TryPop(server, &request))
+        requests.push_back(request);
+    }
 
-      // Ignoring "." and ".."
-      if ((strcmp(((struct smbc_dirent *)dirp)->name, ".") == 0) ||
-          (strcmp(((struct smbc_dirent *)dirp)->name, "..") == 0)) {
-        dirp += dsize;  // Promote pointer
-        dirc -= dsize;  // Decrease size
-        continue;
+    paths.clear();
+    for (size_t i = 0; i < requests.size(); ++i) {
+      paths.push_back(requests[i].path);
+      sizes[i] = requests[i].size;
+    }
+    // Batches are read from one server, so they belong to one scan.
+    worker->set_stats(&request.crawl->stats);
+    worker->ReadSamples(paths, sizes, results);
+
+    for (size_t i = 0; i < requests.size(); ++i) {
+      const FetchRequest &fetched = requests[i];
+
+      // Fingerprints of empty files and files of unknown size are useless.
+      uint64_t hash = 0;
+      if (results[i] >= 0 && fetched.size > 0)
+        hash = Fingerprint::Hash(fetched.size, worker->get_header(i));
+
+      std::string mime_type;
+      {
+        StageTimer timer(&fetched.crawl->stats, CrawlStats::ssClassify);
+        mime_type = ResolveMimeType(
+            fetched, SniffHeader(worker, fetched.path, i, results[i]), hash);
       }
+      CompleteFile(fetched, mime_type,
+                   hash ? Fingerprint::Format(fetched.size, hash) : "", 0);
+      ++fetched_files_;
+      fetch_queue_.Done(fetched);
+      fetched.crawl->FinishWork();
+    }
+  }
 
-      switch (((struct smbc_dirent *)dirp)->smbc_type) {
-        case SMBC_WORKGROUP: {
-          ScanSMBDir(dir + "/" + ((struct smbc_dirent *)dirp)->name);
-          break;
-        }
-        case SMBC_SERVER: {
-          ScanSMBDir(dir + "/" + ((struct smbc_dirent *)dirp)->name);
-          break;
-        }
-        case SMBC_FILE_SHARE: {
-          ScanSMBDir(dir + "/" + ((struct smbc_dirent *)dirp)->name);
-          break;
-        }
-        case SMBC_PRINTER_SHARE: {
-          // Do nothing
-          break;
-        }
-        case SMBC_COMMS_SHARE: {
-          // Do nothing
-          break;
-        }
-        case SMBC_IPC_SHARE: {
-          // Do nothing
-          break;
-        }
-        case SMBC_DIR: {
-          ScanSMBDir(dir + "/" + ((struct smbc_dirent *)dirp)->name);
+  DatabaseEntity::ThreadEnd();
+}
+
+void Spider::HashWorker(SMBWorker *worker) {
+  // Worker can dump full batch to data base.
+  DatabaseEntity::ThreadStart();
+
+  ContentHasher hasher(CONTENT_HASH_CHUNK, &hash_bandwidth_);
+  FetchRequest request;
+  while (hash_queue_.Pop(&request)) {
+    uint64_t content_hash = 0, fingerprint = 0;
+    worker->set_stats(&request.crawl->stats);
+    if (UNLIKELY(hasher.Hash(worker->SourceOf(request.path), request.path,
+                             request.size, &content_hash, &fingerprint))) {
+      // Files modified while they are hashed aren't an error.
+      if (hasher.get_error() != EAGAIN)
+        MSS_ERROR(("Hash " + request.path).c_str(), hasher.get_error());
+      content_hash = fingerprint = 0;
+    } else if (request.mtime != 0 && mime_cache_.is_open() &&
+               request.hint != "unknown") {
+      mime_cache_.Store(MimeCache::MakeKey(request.path), request.size,
+                        request.mtime, request.hint, fingerprint,
+                        content_hash);
+    }
+
+    AddSMBFile(request.crawl, request.path, request.hint,
+               fingerprint ? Fingerprint::Format(request.size, fingerprint)
+                           : "",
+               content_hash ? ContentHasher::Format(request.size,
+                                                    content_hash) : "");
+    ++hashed_files_;
+    hash_queue_.Done(request);
+    request.crawl->FinishWork();
+  }
+
+  DatabaseEntity::ThreadEnd();
+}
+
+void Spider::WriterWorker() {
+  DatabaseEntity::ThreadStart();
+
+  FileRecord record;
+  time_t last_report = time(NULL), last_checkpoint = last_report;
+  for (;;) {
+    // The idle writer wakes up once a second to check requests of
+    // statistics, they can't notify it from the signal handler.
+    if (write_queue_.Pop(&record, std::chrono::seconds(1))) {
+      BufferSMBFile(record.crawl, record.path, record.mime_type,
+                    record.fingerprint, record.content_hash);
+      ++written_files_;
+      record.crawl->FinishWork();
+    } else if (write_queue_.is_closed() && write_queue_.get_size() == 0) {
+      // All producers are stopped before the queue is closed.
+      break;
+    }
+
+    if (UNLIKELY(stats_requested_.load(std::memory_order_relaxed)) &&
+        stats_requested_.exchange(false))
+      WriteStats();
+
+    time_t now = time(NULL);
+    if (now - last_report >= PIPELINE_REPORT_INTERVAL) {
+      ReportPipeline();
+      last_report = now;
+    }
+    if (now - last_checkpoint >= CHECKPOINT_INTERVAL) {
+      std::lock_guard<std::mutex> lock(crawls_mutex_);
+      for (Crawl *crawl : crawls_)
+        crawl->checkpoint.Flush();
+      last_checkpoint = now;
+    }
+  }
+
+  DatabaseEntity::ThreadEnd();
+}
+
+void Spider::ReportPipeline() {
+  time_t elapsed = std::max<time_t>(time(NULL) - scan_start_, 1);
+  auto stage = [elapsed](const char *name, int count) {
+    return std::to_string(count) + " " + name + " (" +
+           std::to_string(count / elapsed) + "/s)";
+  };
+
+  MSS_INFO_MESSAGE(("pipeline: " + stage("listed", listed_files_) +
+                    ", " + stage("fetched", fetched_files_) + " [" +
+                    std::to_string(fetch_queue_.get_size()) + " queued, " +
+                    std::to_string(fetch_queue_.get_in_flight()) +
+                    " in flight], " + stage("written", written_files_) +
+                    " [" + std::to_string(write_queue_.get_size()) +
+                    " queued]").c_str());
+  MSS_INFO_MESSAGE(("throttle: " + throttle_.Report()).c_str());
+  if (!hashers_.empty()) {
+    MSS_INFO_MESSAGE(("hashing: " + stage("hashed", hashed_files_) + " [" +
+                      std::to_string(hash_queue_.get_size()) + " queued, " +
+                      std::to_string(hash_queue_.get_in_flight()) +
+                      " in flight], " + hash_bandwidth_.Report()).c_str());
+  }
+
+  std::string crawls;
+  {
+    std::lock_guard<std::mutex> lock(crawls_mutex_);
+    for (Crawl *crawl : crawls_) {
+      crawls += (crawls.empty() ? "" : ", ") + crawl->server + " (" +
+                std::to_string(crawl->get_pending()) + " pending, " +
+                std::to_string(crawl->written_files) + " written)";
+    }
+  }
+  if (!crawls.empty())
+    MSS_INFO_MESSAGE(("scanning: " + crawls).c_str());
+}
+
+int Spider::ListSMBDir(SMBWorker *worker, Crawl *crawl,
+                       const DirTask &task) {
+  const std::string &dir = task.path;
+  int count = 0, child_count = 0;
+  CrawlSource *source = worker->SourceOf(dir);
+  CrawlSource::Dir directory_handler = NULL;
+
+  // Subdirectories are checked by parents, roots and directories resumed
+  // from checkpoint are checked by their whole paths.
+  const PathFilter *exclusions = crawl->exclusions.get();
+  PathFilter::State filter_state = task.filter_state;
+  if (exclusions != NULL && filter_state == 0) {
+    filter_state = exclusions->Walk(CrawlSource::PathOf(dir));
+    if (UNLIKELY(exclusions->IsExcluded(filter_state))) {
+      // It isn't logged as committed, committed directories without
+      // signatures are unchanged ones which files are kept on resume.
+      // The directory stays in the frontier and is excluded again.
+      ++crawl->excluded_dirs;
+      return 0;
+    }
+  }
+
+  // Open given directory.
+  if (UNLIKELY((directory_handler = source->OpenDir(dir)) == NULL)) {
+    error_ = source->get_error();
+    MSS_ERROR(("OpenDir " + dir).c_str(), error_);
+    return -1;
+  }
+
+  // Path to the directory on the server. "smb://some.server" contains
+  // shares, directories with files start from "smb://some.server/share".
+  std::string path = CrawlSource::PathOf(dir);
+  bool in_share = !path.empty();
+
+  // Signatures are stored with the same path as files of the directory.
+  if (UNLIKELY(Utf8::RepairPath(&path)))
+    ++repaired_names_;
+
+  // Files are processed only when the whole directory is listed
+  // and its signature is known.
+  std::vector<DirEntry> files;
+
+  // Getting content of the directory by batches.
+  // ReadDir() returns 0 when no more content in the directory.
+  std::vector<DirEntry> entries;
+  entries.reserve(LISTING_BATCH_SIZE);
+  while ((count = source->ReadDir(directory_handler, &entries,
+                                  LISTING_BATCH_SIZE)) > 0) {
+    child_count += count;
+    for (const DirEntry &entry : entries) {
+      switch (entry.type) {
+        case etWorkgroup:
+        case etServer:
+        case etShare:
+        case etDir: {
+          // Excluded directories are never opened.
+          PathFilter::State state = 0;
+          if (exclusions != NULL) {
+            state = exclusions->Step(filter_state, entry.name);
+            if (exclusions->IsExcluded(state)) {
+              ++crawl->excluded_dirs;
+              break;
+            }
+          }
+          DirTask subdir = { dir + "/" + entry.name, entry.mtime, state };
+          PushDir(worker->get_id(), crawl, subdir);
           break;
         }
-        case SMBC_FILE: {
-          AddSMBFile(dir+"/"+((struct smbc_dirent *)dirp)->name);
+        case etFile: {
+          files.push_back(entry);
           break;
         }
-        case SMBC_LINK: {
+        case etLink:
+        case etOther: {
           // Do nothing
           break;
         }
         default: {
-          MSS_FATAL_MESSAGE("Unknown smb entry type");
+          MSS_FATAL_MESSAGE("Unknown entry type");
           assert(0);  // This can't happen
         }
       }
+    }
+  }
+
+  if (UNLIKELY(count < 0)) {
+    error_ = source->get_error();
+    MSS_ERROR(("ReadDir " + dir).c_str(), error_);
+    source->CloseDir(directory_handler);
+    return -1;
+  }
+
+  // Close given directory
+  if (UNLIKELY(source->CloseDir(directory_handler))) {
+    error_ = source->get_error();
+    MSS_ERROR(("CloseDir " + dir).c_str(), error_);
+  }
+
+  crawl->stats.Count(CrawlStats::scDirs);
+  crawl->stats.Count(CrawlStats::scFiles, files.size());
+
+  // Lists of shares have no mtime, roots of shares can be statted.
+  DirSignature signature = { task.mtime, child_count };
+  if (signature.mtime == 0 && in_share) {
+    struct stat st;
+    if (LIKELY(!source->Stat(dir, &st)))
+      signature.mtime = st.st_mtime;
+  }
 
-      dirp += dsize;  // Promote pointer
-      dirc -= dsize;  // Decrease size
+  if (signature.mtime != 0) {
+    auto old = crawl->dir_signatures.find(path);
+    if (old != crawl->dir_signatures.end() &&
+        old->second.mtime == signature.mtime &&
+        old->second.child_count == signature.child_count &&
+        FilesUnchanged(dir, files)) {
+      // Files of this directory are already in data base.
+      ++crawl->unchanged_dirs;
+      crawl->checkpoint.ListedDir(dir, DirSignature(), 0);
+      std::lock_guard<std::mutex> lock(crawl->dirs_mutex);
+      crawl->unchanged_paths.push_back(path);
+      return 0;
     }
   }
 
-  // Close given smb directory
-  if (UNLIKELY(smbc_closedir(directory_handler) < 0)) {
-    DetectError();
-    MSS_ERROR(("smbc_closedir " + dir).c_str(), error_);
+  // Directories without mtime are saved without signatures, so they are
+  // marked as seen anyway.
+  if (in_share) {
+    std::lock_guard<std::mutex> lock(crawl->dirs_mutex);
+    crawl->changed_dirs.push_back(std::make_pair(path, signature));
+  }
+
+  // Directory is committed in the checkpoint when all its files are.
+  crawl->checkpoint.ListedDir(dir, signature, files.size());
+
+  // Paths of files share one buffer, only requests which are passed on
+  // own their copies.
+  listed_files_ += files.size();
+  std::string name = dir + "/";
+  const size_t prefix = name.size();
+  for (const DirEntry &file : files) {
+    name.resize(prefix);
+    name += file.name;
+    std::string mime_type, fingerprint;
+    uint64_t content_hash = 0;
+    FetchRequest request = { name, file.size, file.mtime, "", "", crawl };
+    if (ClassifyFile(crawl, name, file, &mime_type, &fingerprint,
+                     &content_hash)) {
+      CompleteFile(request, mime_type, fingerprint, content_hash);
+      continue;
+    }
+
+    // Header is fetched and classified by fetchers.
+    request.hint = mime_type;
+    crawl->AddWork();
+    if (UNLIKELY(!fetch_queue_.Push(request))) {
+      AddSMBFile(crawl, name, FetchMimeType(worker, request));
+      crawl->FinishWork();
+    }
   }
 
   return 0;
 }
 
+int Spider::ResumeCheckpoint(Crawl *crawl) {
+  if (checkpoint_dir_.empty())
+    return -1;
+
+  const std::string &server = crawl->server;
+  std::string path = checkpoint_dir_ + "/checkpoint." + server;
+  if (crawl->checkpoint.Resume(path, server)) {
+    if (UNLIKELY(crawl->checkpoint.Begin(path, server, crawl->start))) {
+      MSS_DEBUG_ERROR(("Checkpoint " + path).c_str(),
+                      crawl->checkpoint.get_error());
+    }
+    return -1;
+  }
+
+  // Signatures of directories committed before resume are saved too,
+  // files of unchanged ones are kept by the sweep.
+  crawl->start = crawl->checkpoint.get_start();
+  for (const auto &dir : crawl->checkpoint.get_committed()) {
+    std::string dir_path = CrawlSource::PathOf(dir.first);
+    if (dir_path.empty())
+      continue;
+    Utf8::RepairPath(&dir_path);
+    if (dir.second.mtime != 0) {
+      crawl->changed_dirs.push_back(std::make_pair(dir_path, dir.second));
+    } else {
+      crawl->unchanged_paths.push_back(dir_path);
+    }
+  }
+  return 0;
+}
+
+int Spider::SweepServer(Crawl *crawl) {
+  const std::string &server = crawl->server;
+  // Files of directories which weren't scanned because of errors are
+  // still on the server probably, entries of files which weren't written
+  // weren't marked as seen.
+  if (UNLIKELY(crawl->failed_dirs != 0 || crawl->failed_files != 0 ||
+               crawl->start <= 0)) {
+    MSS_INFO_MESSAGE((server + ": sweep is skipped after incomplete "
+                      "scan, " + std::to_string(crawl->failed_dirs) +
+                      " directories and " +
+                      std::to_string(crawl->failed_files) +
+                      " files failed").c_str());
+    return 0;
+  }
+
+  // Files of unchanged directories weren't added again but they exist.
+  // Directories without ids have no files in data base.
+  std::vector<int> unchanged;
+  {
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    for (const std::string &path : crawl->unchanged_paths) {
+      auto dir = crawl->dir_ids.find(path);
+      if (dir != crawl->dir_ids.end())
+        unchanged.push_back(dir->second);
+    }
+  }
+  for (size_t i = 0; i < unchanged.size(); i += TOUCH_BATCH_SIZE) {
+    std::vector<int> batch(
+        unchanged.begin() + i,
+        unchanged.begin() + std::min(i + TOUCH_BATCH_SIZE, unchanged.size()));
+    std::lock_guard<std::mutex> lock(db_mutex_);
+    if (UNLIKELY(FileEntry::TouchByDirs(batch) < 0 ||
+                 DirectoryEntry::Touch(batch) < 0)) {
+      MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+      error_ = ENOMSG;
+      return -1;
+    }
+  }
+
+  // Vanished directories are deleted after their files.
+  const time_t since = crawl->start;
+  int files = SweepChunks([&server, since]() {
+    return FileEntry::DeleteNotSeenSince(server, since, SWEEP_BATCH_SIZE);
+  });
+  if (UNLIKELY(files < 0))
+    return -1;
+  int dirs = SweepChunks([&server, since]() {
+    return DirectoryEntry::DeleteNotSeenSince(server, since,
+                                              SWEEP_BATCH_SIZE);
+  });
+  if (UNLIKELY(dirs < 0))
+    return -1;
+
+  MSS_INFO_MESSAGE((server + ": " + std::to_string(files) +
+                    " vanished files and " + std::to_string(dirs) +
+                    " directories are deleted").c_str());
+  return 0;
+}
+
+int Spider::SweepChunks(const std::function<int()> &delete_chunk) {
+  // Entries are deleted by small chunks with pauses, so searches and
+  // other scans aren't blocked for a long time.
+  int deleted, total = 0;
+  for (;;) {
+    {
+      std::lock_guard<std::mutex> lock(db_mutex_);
+      deleted = delete_chunk();
+    }
+    if (deleted <= 0)
+      break;
+    total += deleted;
+    if (deleted < SWEEP_BATCH_SIZE)
+      break;
+    usleep(SWEEP_PAUSE);
+  }
+
+  if (UNLIKELY(deleted < 0)) {
+    MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    error_ = ENOMSG;
+    return -1;
+  }
+  return total;
+}
+
+int Spider::LoadDirSignatures(Crawl *crawl) {
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  auto dirs = DirectoryEntry::GetByServer(crawl->server);
+  if (UNLIKELY(!dirs)) {
+    MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    error_ = ENOMSG;
+    return -1;
+  }
+
+  // Directories which were created for their files have no signatures.
+  for (std::shared_ptr<DirectoryEntry> dir : *dirs) {
+    crawl->dir_ids[dir->get_dir_path()] = dir->get_id();
+    if (dir->get_mtime() == 0)
+      continue;
+    DirSignature signature = { dir->get_mtime(), dir->get_child_count() };
+    crawl->dir_signatures[dir->get_dir_path()] = signature;
+  }
+
+  return 0;
+}
+
+int Spider::SaveDirSignatures(Crawl *crawl) {
+  MSS_DEBUG_MESSAGE((crawl->server + ": unchanged directories: " +
+                     std::to_string(crawl->unchanged_dirs) + ", changed: " +
+                     std::to_string(crawl->changed_dirs.size()) +
+                     ", excluded: " +
+                     std::to_string(crawl->excluded_dirs)).c_str());
+
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  if (UNLIKELY(!DatabaseEntity::StartTransaction())) {
+    MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    error_ = ENOMSG;
+    return -1;
+  }
+
+  for (const std::pair<std::string, DirSignature> &dir : crawl->changed_dirs) {
+    // The directory is listed again at the next scan.
+    if (UNLIKELY(crawl->failed_paths.count(dir.first) != 0))
+      continue;
+    size_t slash = dir.first.rfind('/');
+    int parent = slash == std::string::npos ?
+        0 : DirIdOf(crawl, crawl->server, dir.first.substr(0, slash));
+    if (UNLIKELY(parent < 0)) {
+      DatabaseEntity::RollbackTransaction();
+      return -1;
+    }
+    DirectoryEntry entry(crawl->server, parent,
+                         dir.first.substr(slash + 1), dir.second.mtime,
+                         dir.second.child_count);
+    if (LIKELY(entry.get_id() > 0))
+      crawl->dir_ids[dir.first] = entry.get_id();
+  }
+
+  if (UNLIKELY(!DatabaseEntity::CommitTransaction())) {
+    MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    error_ = ENOMSG;
+    return -1;
+  }
+
+  crawl->changed_dirs.clear();
+  return 0;
+}
+
 int Spider::AddFileEntryInDataBase(const std::string &file,
-                                   const std::string &server) {
+                                   const std::string &server,
+                                   const std::string &mime_type,
+                                   const std::string &fingerprint,
+                                   const std::string &content_hash) {
   if (UNLIKELY(file.empty() || server.empty())) {
     MSS_ERROR_MESSAGE("Given string is empthy.");
     error_ = EINVAL;
     return -1;
   }
 
+  // Example:
+  // full path to a file = "smb://some.server/path/to/file"
+  // server = some.server
+  // path = path/to/file
+  // directory = path/to
+  std::string path = CrawlSource::PathOf(file);
+  Utf8::RepairPath(&path);
+  size_t pos = path.rfind('/');
+  int dir_id = DirectoryEntry::ResolvePath(
+      server, pos == std::string::npos ? std::string() : path.substr(0, pos));
+  if (UNLIKELY(dir_id < 0)) {
+    MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    error_ = ENOMSG;
+    return -1;
+  }
+
+  return AddFileEntryInDir(dir_id, file, server, mime_type, fingerprint,
+                           content_hash);
+}
+
+int Spider::AddFileEntryInDir(const int dir_id, const std::string &file,
+                              const std::string &server,
+                              const std::string &mime_type,
+                              const std::string &fingerprint,
+                              const std::string &content_hash) {
   size_t pos = file.rfind("/");
   if (UNLIKELY(pos == std::string::npos)) {
     MSS_ERROR_MESSAGE(("Given string " + file + "have no '/' symbol.").c_str());
     error_ = EINVAL;
     return -1;
   }
-  std::string name = file.substr(pos + 1);  // '+ 1' to delete '/' symbol.
-
-  // '+ 7':
-  // '+ 6' to delete "smb://" from full path to file
-  // '+ 1' to delete "/" after hostname
-  //
-  // Example:
-  // full path to a file = "smb://some.server/path/to/file"
-  // server = some.server
-  // path = path/to/file
-  // file = file
-  std::string path = file.substr(server.length() + 7);
+  // Entries are found by hash of server and repaired path.
+  std::string path = CrawlSource::PathOf(file);
+  if (UNLIKELY(Utf8::RepairPath(&path)))
+    ++repaired_names_;
+  const int64_t path_hash = FileEntry::PathHash(server, path);
+  pos = path.rfind('/');
+  std::string base_name = path.substr(pos + 1);  // '+ 1' to delete '/'.
 
   // Parsing file name to simplify further search.
+  std::string name = base_name;
   if (UNLIKELY(NameParser(&name))) {
     MSS_DEBUG_MESSAGE("NameParser: -1 returned");
     return -1;
@@ -344,12 +1181,63 @@ int Spider::AddFileEntryInDataBase(const std::string &file,
   // after issue #5 will fixed.
 
   // Add new entry or updaste existing
-  FileEntry entry(name, path, server);
-  FileParameter(entry, *mime_type_attr_, DetectMimeType(file), 0, true);
+  FileEntry entry(name, dir_id, base_name, server, path_hash);
+  if (UNLIKELY(entry.get_id() <= 0)) {
+    error_ = ENOMSG;
+    return -1;
+  }
+
+  // Parameters are upserted, duplicates are found by equal fingerprints.
+  bool written =
+      FileParameter(entry, *mime_type_attr_,
+                    mime_type.empty() ? DetectMimeType(file) : mime_type, 0,
+                    true).get_file() != nullptr;
+  if (written && !fingerprint.empty()) {
+    written = FileParameter(entry, *fingerprint_attr_, fingerprint, 0,
+                            true).get_file() != nullptr;
+  }
+  if (written && !content_hash.empty()) {
+    written = FileParameter(entry, *content_hash_attr_, content_hash, 0,
+                            true).get_file() != nullptr;
+  }
+  if (UNLIKELY(!written)) {
+    error_ = ENOMSG;
+    return -1;
+  }
 
   return 0;
 }
 
+int Spider::DirIdOf(Crawl *crawl, const std::string &server,
+                    const std::string &path) {
+  if (path.empty())
+    return 0;
+
+  // Only directories of the server of the scan are cached.
+  const bool cached = crawl->server == server;
+  if (cached) {
+    auto found = crawl->dir_ids.find(path);
+    if (found != crawl->dir_ids.end())
+      return found->second;
+  }
+
+  size_t slash = path.rfind('/');
+  int parent = slash == std::string::npos ?
+      0 : DirIdOf(crawl, server, path.substr(0, slash));
+  if (UNLIKELY(parent < 0))
+    return -1;
+
+  int id = DirectoryEntry::Resolve(server, parent, path.substr(slash + 1));
+  if (UNLIKELY(id < 0)) {
+    MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    error_ = ENOMSG;
+    return -1;
+  }
+  if (cached)
+    crawl->dir_ids[path] = id;
+  return id;
+}
+
 int Spider::NameParser(std::string *name) {
   if (UNLIKELY(name->empty())) {
     MSS_ERROR_MESSAGE("empty string is given.");
@@ -357,39 +1245,75 @@ int Spider::NameParser(std::string *name) {
     return -1;
   }
 
-  size_t pos;
-  while (true) {
-    if ((pos = name->find("_")) == std::string::npos)
-      return 0;  // No '_' symbols in name.
-
-    name->replace(pos, 1, " ");  // Replase '_' with space.
-  }
-
+  if (UNLIKELY(Utf8::Repair(name)))
+    ++repaired_names_;
+  if (name_analyzer_.Analyze(*name) > 0)
+    *name = name_analyzer_.Join();
   return 0;
 }
 
-// TODO(yulyugin): Add check on errors and rollback transaction in case
-// of fatal error.
+std::vector<std::string> Spider::get_result() const {
+  std::lock_guard<std::mutex> lock(crawl_->files_mutex);
+  std::vector<std::string> result;
+  for (size_t i = 0; i < crawl_->batch.get_size(); ++i)
+    result.push_back(crawl_->batch.PathOf(crawl_->batch.get_file(i)));
+  return result;
+}
+
 int Spider::DumpToDataBase() {
-  if (UNLIKELY(last_ == result_->begin())) {
+  std::lock_guard<std::mutex> lock(crawl_->files_mutex);
+  return DumpToDataBase(crawl_.get());
+}
+
+int Spider::DumpToDataBase(Crawl *crawl) {
+  const FileBatch &batch = crawl->batch;
+  if (UNLIKELY(batch.get_size() == 0)) {
     MSS_DEBUG_MESSAGE("No result's to dump.");
     return 0;
   }
 
   // Extract the name of server.
   // "smb://some.server/path/to/file" -> "some.server"
-  std::string server(result_->front(), 6, result_->front().find("/", 6) - 6);
+  std::string server = CrawlSource::ServerOf(batch.get_dir(0).ToString());
+
+  // Directories of the batch are resolved once.
+  std::vector<std::string> paths(batch.get_dir_count());
+  std::vector<int> dir_ids(batch.get_dir_count(), -1);
+  for (uint32_t dir = 0; dir < batch.get_dir_count(); ++dir) {
+    paths[dir] = CrawlSource::PathOf(batch.get_dir(dir).ToString());
+    Utf8::RepairPath(&paths[dir]);
+  }
 
-  DatabaseEntity::StartTransaction();
-  /*if (UNLIKELY(!DatabaseEntity::get_db_error().empty())) {
+  std::lock_guard<std::mutex> lock(db_mutex_);
+  StageTimer timer(&crawl->stats, CrawlStats::ssCommit);
+  if (UNLIKELY(!DatabaseEntity::StartTransaction())) {
     MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    timer.set_failed();
     error_ = ENOMSG;
+    // Files of the batch aren't in data base, they aren't swept.
+    for (uint32_t dir = 0; dir < batch.get_dir_count(); ++dir)
+      FailFiles(crawl, paths[dir], batch.get_dir_files(dir));
+    crawl->batch.Clear();
     return -1;
-  }*/
+  }
 
-  for (std::vector<std::string>::iterator itr = result_->begin();
-       itr != last_; ++itr) {
-    if (UNLIKELY(AddFileEntryInDataBase(*itr, server))) {
+  for (uint32_t dir = 0; dir < batch.get_dir_count(); ++dir)
+    dir_ids[dir] = DirIdOf(crawl, server, paths[dir]);
+
+  // Files which can't be written are counted, so their old entries
+  // aren't swept.
+  std::vector<int> failed(batch.get_dir_count());
+  for (size_t i = 0; i < batch.get_size(); ++i) {
+    const FileBatch::File &file = batch.get_file(i);
+    if (UNLIKELY(dir_ids[file.dir] < 0)) {
+      ++failed[file.dir];
+      continue;
+    }
+    if (UNLIKELY(AddFileEntryInDir(
+            dir_ids[file.dir], batch.PathOf(file), server,
+            batch.get_mime_type(file.mime_type).ToString(),
+            file.fingerprint.ToString(), file.content_hash.ToString()))) {
+      ++failed[file.dir];
       if (error_ == ENOMSG) {  // Data base error.
         MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
       } else {
@@ -398,139 +1322,252 @@ int Spider::DumpToDataBase() {
     }
   }
 
-  DatabaseEntity::CommitTransaction();
-  /*if (UNLIKELY(!DatabaseEntity::get_db_error().empty())) {
+  if (UNLIKELY(!DatabaseEntity::CommitTransaction())) {
     MSS_ERROR_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    DatabaseEntity::RollbackTransaction();
+    timer.set_failed();
     error_ = ENOMSG;
+    for (uint32_t dir = 0; dir < batch.get_dir_count(); ++dir)
+      FailFiles(crawl, paths[dir], batch.get_dir_files(dir));
+    crawl->batch.Clear();
     return -1;
-  }*/
+  }
+
+  // Files are counted by directories. Directories with failed files
+  // are never committed in the checkpoint, so they are scanned again on
+  // resume.
+  for (uint32_t dir = 0; dir < batch.get_dir_count(); ++dir) {
+    if (UNLIKELY(failed[dir])) {
+      FailFiles(crawl, paths[dir], failed[dir]);
+    } else {
+      crawl->checkpoint.CommittedFiles(batch.get_dir(dir).ToString(),
+                                       batch.get_dir_files(dir));
+    }
+  }
+
+  // All results are in data base now, names are released at once.
+  crawl->batch.Clear();
 
   return 0;
 }
 
-void Spider::AddSMBFile(const std::string &name) {
-  *last_ = name;
-  ++last_;
+void Spider::FailFiles(Crawl *crawl, const std::string &dir,
+                       const size_t files) {
+  crawl->failed_files += files;
+  std::lock_guard<std::mutex> lock(crawl->dirs_mutex);
+  crawl->failed_paths.insert(dir);
+}
 
-  if (UNLIKELY(last_ == result_->end())) {
-    DumpToDataBase();
-    last_ = result_->begin();
+void Spider::AddSMBFile(const std::string &name,
+                        const std::string &mime_type) {
+  AddSMBFile(crawl_.get(), name, mime_type);
+}
+
+void Spider::AddSMBFile(Crawl *crawl, const std::string &name,
+                        const std::string &mime_type,
+                        const std::string &fingerprint,
+                        const std::string &content_hash) {
+  if (LIKELY(pipeline_running_)) {
+    FileRecord record = { name, mime_type, fingerprint, content_hash, crawl };
+    crawl->AddWork();
+    write_queue_.Push(record);
+  } else {
+    BufferSMBFile(crawl, name, mime_type, fingerprint, content_hash);
   }
 }
 
-const char *Spider::DetectMimeType(const std::string &path) {
-  int smb_fd = smbc_open(path.c_str(), O_RDONLY, 0);
-  if (UNLIKELY(smb_fd < 0)) {
-    if (LIKELY(errno == EISDIR))
-      return "inode/directory";
+void Spider::BufferSMBFile(Crawl *crawl, const std::string &name,
+                           const std::string &mime_type,
+                           const std::string &fingerprint,
+                           const std::string &content_hash) {
+  std::lock_guard<std::mutex> lock(crawl->files_mutex);
+  if (UNLIKELY(crawl->batch.Add(name, mime_type, fingerprint,
+                                content_hash))) {
+    MSS_DEBUG_ERROR(("FileBatch::Add " + name).c_str(),
+                    crawl->batch.get_error());
+    std::string dir = CrawlSource::PathOf(name.substr(0, name.rfind('/')));
+    Utf8::RepairPath(&dir);
+    FailFiles(crawl, dir, 1);
+    return;
+  }
+  ++crawl->written_files;
 
-    DetectError();
-    MSS_ERROR(("smbc_open " + path).c_str(), error_);
-    return "unknown";
+  if (UNLIKELY(crawl->batch.is_full()))
+    DumpToDataBase(crawl);
+}
+
+bool Spider::ClassifyFile(Crawl *crawl, const std::string &path,
+                          const DirEntry &file, std::string *mime_type,
+                          std::string *fingerprint, uint64_t *content_hash) {
+  // Nothing is read from the server if the extension is trusted, unless
+  // fingerprint or content hash of the file should be taken.
+  const ExtensionTable::Entry *entry = extensions_.Find(path);
+  bool sniff = entry == NULL || entry->policy == ExtensionTable::epAlways ||
+               (entry->policy == ExtensionTable::epSample &&
+                ++sampled_files_ % EXTENSION_SAMPLE_RATE == 0);
+  bool hashed = file.size > 0 && IsHashed(path);
+  if (!sniff && !hashed && (!FINGERPRINT_TRUSTED_FILES || file.size == 0)) {
+    ++extension_hits_;
+    crawl->stats.Count(CrawlStats::scExtensionHits);
+    *mime_type = entry->mime_type;
+    return true;
   }
 
-  // Extract name of the file
-  // Don't detele '/' symbol it need to form path.
-  std::string name(path, path.rfind("/"));
+  // Files not modified since the previous sniff aren't read again.
+  // Without mtime modification can't be detected.
+  uint64_t hash = 0;
+  if (file.mtime != 0 && mime_cache_.is_open() &&
+      mime_cache_.Find(MimeCache::MakeKey(path), file.size, file.mtime,
+                       mime_type, &hash, content_hash)) {
+    if (hash != 0)
+      *fingerprint = Fingerprint::Format(file.size, hash);
+    ++cache_hits_;
+    crawl->stats.Count(CrawlStats::scCacheHits);
+    return true;
+  }
 
-  // Create a storage for file header in TMPDIR and open it
-  int fd = open((TMPDIR + name).c_str(), O_CREAT | O_RDWR | O_EXCL,
-                00744 /* rwxr--r-- */);
-  if (UNLIKELY(fd == -1)) {
-    if (LIKELY(errno = ENOTDIR)) {
-      // TODO(yulyugin): Check if TMPDIR doesn't exists create it.
-    }
-    DetectError();
-    MSS_ERROR("open", error_);
-    if (UNLIKELY(smbc_close(smb_fd))) {
-      DetectError();
-      MSS_ERROR("smbc_close", error_);
-    }
-    return "unknown";
+  // Hashers take fingerprints of hashed files on the way.
+  if (!sniff && hashed) {
+    ++extension_hits_;
+    crawl->stats.Count(CrawlStats::scExtensionHits);
+    *mime_type = entry->mime_type;
+    return true;
   }
 
-  void *buf = malloc(HEADERSIZE);  // Buffer to store header.
+  *mime_type = entry != NULL ? entry->mime_type : std::string();
+  return false;
+}
 
-  // Copy file header to TMPDIR
-  if (UNLIKELY(smbc_read(smb_fd, buf, HEADERSIZE) < 0)) {
-    DetectError();
-    MSS_ERROR("smbc_read", error_);
-    if (UNLIKELY(smbc_close(smb_fd))) {
-      DetectError();
-      MSS_ERROR("smbc_close", error_);
-    }
-    if (UNLIKELY(close(fd))) {
-      DetectError();
-      MSS_ERROR("close", error_);
-    }
-    free(buf);
-    return "unknown";
+bool Spider::FilesUnchanged(const std::string &dir,
+                            const std::vector<DirEntry> &files) {
+  if (!mime_cache_.is_open())
+    return true;
+
+  std::string name = dir + "/", mime_type;
+  const size_t prefix = name.size();
+  for (const DirEntry &file : files) {
+    if (file.mtime == 0)
+      continue;
+    name.resize(prefix);
+    name += file.name;
+
+    // Files classified by trusted extensions aren't cached, their entries
+    // don't depend on content.
+    const ExtensionTable::Entry *entry = extensions_.Find(name);
+    bool hashed = file.size > 0 && IsHashed(name);
+    if (entry != NULL && entry->policy != ExtensionTable::epAlways &&
+        !hashed && (!FINGERPRINT_TRUSTED_FILES || file.size == 0))
+      continue;
+
+    // Files which weren't hashed yet are hashed at this scan.
+    uint64_t content_hash = 0;
+    if (!mime_cache_.Find(MimeCache::MakeKey(name), file.size, file.mtime,
+                          &mime_type, NULL, &content_hash) ||
+        (hashed && content_hash == 0))
+      return false;
   }
+  return true;
+}
 
-  if (UNLIKELY(write(fd, buf, HEADERSIZE) < 0)) {
-    DetectError();
-    MSS_ERROR("write", error_);
-    if (UNLIKELY(smbc_close(smb_fd))) {
-      DetectError();
-      MSS_ERROR("smbc_close", error_);
-    }
-    if (UNLIKELY(close(fd))) {
-      DetectError();
-      MSS_ERROR("close", error_);
-    }
-    free(buf);
-    return "unknown";
+void Spider::CompleteFile(const FetchRequest &file,
+                          const std::string &mime_type,
+                          const std::string &fingerprint,
+                          const uint64_t content_hash) {
+  if (content_hash == 0 && pipeline_running_ && file.size > 0 &&
+      IsHashed(file.path)) {
+    FetchRequest request = file;
+    request.hint = mime_type;
+    file.crawl->AddWork();
+    if (LIKELY(hash_queue_.TryPush(request)))
+      return;
+    file.crawl->FinishWork();
   }
 
-  // Move to the begining of the file
-  if (UNLIKELY(lseek(fd, 0, SEEK_SET) != 0)) {
-    DetectError();
-    MSS_ERROR("lseek", error_);
-    if (UNLIKELY(smbc_close(smb_fd))) {
-      DetectError();
-      MSS_ERROR("smbc_close", error_);
-    }
-    if (UNLIKELY(close(fd))) {
-      DetectError();
-      MSS_ERROR("close", error_);
-    }
-    free(buf);
-    return "unknown";
+  AddSMBFile(file.crawl, file.path, mime_type, fingerprint,
+             content_hash ? ContentHasher::Format(file.size, content_hash)
+                          : "");
+}
+
+bool Spider::IsHashed(const std::string &path) const {
+  for (const std::string &prefix : hashed_shares_) {
+    // "smb://server/share" doesn't contain "smb://server/share2".
+    if (path.compare(0, prefix.size(), prefix) == 0 &&
+        (path.size() == prefix.size() || path[prefix.size()] == '/' ||
+         prefix.back() == '/'))
+      return true;
   }
+  return false;
+}
 
-  const char *mime_type = magic_descriptor(cookie_, fd);
-  if (UNLIKELY(mime_type == NULL)) {
-    error_ = magic_errno(cookie_);
-    MSS_ERROR("magic_descriptor", error_);
-    if (UNLIKELY(smbc_close(smb_fd))) {
-      DetectError();
-      MSS_ERROR("smbc_close", error_);
-    }
-    if (UNLIKELY(close(fd))) {
-      DetectError();
-      MSS_ERROR("close", error_);
-    }
-    free(buf);
+std::string Spider::FetchMimeType(SMBWorker *worker,
+                                  const FetchRequest &request) {
+  return ResolveMimeType(request, DetectMimeType(worker, request.path));
+}
+
+std::string Spider::ResolveMimeType(const FetchRequest &request,
+                                    const char *detected,
+                                    const uint64_t fingerprint) {
+  std::string mime_type = detected;
+  if (UNLIKELY(mime_type == "unknown")) {
+    // If the file can't be read its extension is trusted.
+    return request.hint.empty() ? mime_type : request.hint;
+  }
+
+  if (!request.hint.empty() && request.hint != mime_type) {
+    MSS_DEBUG_MESSAGE((request.path + ": " + mime_type + " instead of " +
+                       request.hint).c_str());
+  }
+  if (request.mtime != 0 && mime_cache_.is_open()) {
+    mime_cache_.Store(MimeCache::MakeKey(request.path), request.size,
+                      request.mtime, mime_type, fingerprint);
+  }
+  return mime_type;
+}
+
+const char *Spider::DetectMimeType(const std::string &path) {
+  return DetectMimeType(writer_worker_, path);
+}
+
+const char *Spider::DetectMimeType(SMBWorker *worker,
+                                   const std::string &path) {
+  ssize_t size = worker->ReadHeader(path);
+  return SniffHeader(worker, path, 0, size < 0 ? -worker->get_error() : size);
+}
+
+const char *Spider::SniffHeader(SMBWorker *worker, const std::string &path,
+                                const size_t index, const ssize_t size) {
+  if (UNLIKELY(size < 0)) {
+    if (LIKELY(size == -EISDIR))
+      return "inode/directory";
+
+    error_ = -size;
+    MSS_ERROR(("ReadHeader " + path).c_str(), error_);
     return "unknown";
   }
 
-  if (UNLIKELY(smbc_close(smb_fd))) {
-    DetectError();
-    MSS_ERROR("smbc_close", error_);
+  // Most files are detected by the table of signatures,
+  // libmagic is used for the rest.
+  const unsigned char *header = worker->get_header(index);
+  const char *mime_type = MimeSniffer::Sniff(header, size);
+  if (LIKELY(mime_type != NULL)) {
+    ++sniffer_hits_;
+    return mime_type;
   }
-  free(buf);
+  ++sniffer_misses_;
 
-  // Remove temporary file.
-  if (UNLIKELY(unlink((TMPDIR + name).c_str()))) {
-    DetectError();
-    MSS_ERROR("unlink", error_);
+  // Header is analyzed in memory of the worker.
+  mime_type = magic_buffer(worker->get_cookie(), header, size);
+  if (UNLIKELY(mime_type == NULL)) {
+    error_ = magic_errno(worker->get_cookie());
+    MSS_ERROR("magic_buffer", error_);
+    return "unknown";
   }
 
   return mime_type;
 }
 
 int Spider::InitMimeTypeAttr()  {
-  if (mime_type_attr_)
+  if (mime_type_attr_ && fingerprint_attr_ && content_hash_attr_)
     return 0;
 
   if (ConnectToDataBase()) {
@@ -539,18 +1576,26 @@ int Spider::InitMimeTypeAttr()  {
     return -1;
   }
 
-  mime_type_attr_ = FileAttribute::GetByNameAndType("mime-type",
-                                                    FileAttribute::faString);
-  if (UNLIKELY(!mime_type_attr_)) {
-    // Create attribute if it doesn't exists
-    mime_type_attr_ = std::shared_ptr<FileAttribute>(
-        new(std::nothrow) FileAttribute("mime-type", FileAttribute::faString));
-    if (UNLIKELY((!mime_type_attr_))) {
-      MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
-      error_ = ENOMSG;
-      return -1;
-    }
+  mime_type_attr_ = InitAttribute("mime-type");
+  fingerprint_attr_ = InitAttribute("fingerprint");
+  content_hash_attr_ = InitAttribute("content-hash");
+  if (UNLIKELY(!mime_type_attr_ || !fingerprint_attr_ ||
+               !content_hash_attr_)) {
+    MSS_DEBUG_MESSAGE(DatabaseEntity::get_db_error().c_str());
+    error_ = ENOMSG;
+    return -1;
   }
 
   return 0;
 }
+
+std::shared_ptr<FileAttribute> Spider::InitAttribute(const std::string &name) {
+  std::shared_ptr<FileAttribute> attribute =
+      FileAttribute::GetByNameAndType(name, FileAttribute::faString);
+  if (UNLIKELY(!attribute)) {
+    // Create attribute if it doesn't exists
+    attribute = std::shared_ptr<FileAttribute>(
+        new(std::nothrow) FileAttribute(name, FileAttribute::faString));
+  }
+  return attribute;
+}
@@ -27,17 +27,62 @@
 #ifndef SPIDER_SPIDER_H_
 #define SPIDER_SPIDER_H_
 
-#include <magic.h>
-
+#include <atomic>
+#include <functional>
 #include <string>
 #include <list>
+#include <map>
 #include <vector>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include "common-inl.h"
 #include "spider/servermanager.h"
+#include "spider/checkpoint.h"
+#include "spider/contenthash.h"
+#include "spider/crawl.h"
+#include "spider/extensiontable.h"
+#include "spider/fetchqueue.h"
+#include "spider/mimecache.h"
+#include "spider/mpmcqueue.h"
+#include "spider/nameanalyzer.h"
+#include "spider/pathfilter.h"
+#include "spider/smbworker.h"
+#include "spider/throttle.h"
+#include "spider/workstealingqueue.h"
 #include "data-storage/entities.h"
 
+/**
+ * Classified file which should be written to data base.
+ */
+struct FileRecord {
+  /**
+   * Full smb path to the file.
+   */
+  std::string path;
+
+  /**
+   * MIME type of the file.
+   */
+  std::string mime_type;
+
+  /**
+   * Sampled fingerprint of the file, empty if it's unknown.
+   */
+  std::string fingerprint;
+
+  /**
+   * Hash of whole content of the file, empty if it isn't hashed.
+   */
+  std::string content_hash;
+
+  /**
+   * Scan the file belongs to.
+   */
+  Crawl *crawl;
+};
+
 /**
  * Class to index files located in local network.
  */
@@ -71,6 +116,89 @@ class Spider {
    */
   int ReadConfig(const std::string &config);
 
+  /**
+   * Read table of file extensions in addition to built-in one.
+   * It should be called before Run().
+   *
+   * @param config Extensions configuration file name.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int LoadExtensions(const std::string &config);
+
+  /**
+   * Open persistent cache of MIME types. Without it content of files is
+   * read at every scan. It should be called before Run().
+   *
+   * @param path Cache file name.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int OpenMimeCache(const std::string &path);
+
+  /**
+   * Read list of shares which files are hashed by whole content, one URL
+   * prefix per line. Only files which size or mtime changed since they
+   * were hashed are read again. It should be called before Run().
+   *
+   * @param config Configuration file name. Nothing is hashed if it
+   * doesn't exist.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int LoadHashedShares(const std::string &config);
+
+  /**
+   * Read rules which exclude directories from scans, see PathFilter.
+   * The config is checked before each scan of a server and reread if
+   * it's modified since.
+   *
+   * @param config Configuration file name. Nothing is excluded if it
+   * doesn't exist.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int LoadExclusions(const std::string &config);
+
+  /**
+   * Set directory where checkpoints of scans are stored. Without it
+   * interrupted scans start from the beginning.
+   *
+   * @param dir Directory name.
+   */
+  inline void set_checkpoint_dir(const std::string &dir) {
+    checkpoint_dir_ = dir;
+  }
+
+  /**
+   * Set file where statistics of scans are written by WriteStats().
+   * Without it statistics are only logged when leases end.
+   *
+   * @param path Statistics file name.
+   */
+  inline void set_stats_file(const std::string &path) { stats_file_ = path; }
+
+  /**
+   * Get statistics of running scans and of the last finished lease of
+   * every server, see CrawlStats::Report().
+   *
+   * @return Statistics in text format.
+   */
+  std::string ReportStats();
+
+  /**
+   * Replace the statistics file with current statistics.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int WriteStats();
+
+  /**
+   * Ask the running spider to write its statistics. It's safe to call
+   * from signal handlers.
+   */
+  static inline void RequestStats() { stats_requested_ = true; }
+
 #ifndef DOXYGEN_SHOULD_SKIP_THIS
   /**
    * Destructor.
@@ -79,7 +207,9 @@ class Spider {
 #endif  // DOXYGEN_SHOULD_SKIP_THIS
 
   /**
-   * Index all servers from servers list.
+   * Index all servers from servers list. SERVERS_NUMBER servers are
+   * leased and scanned at once by shared workers, so slow servers don't
+   * leave the spider idle.
    */
   void Run();
 
@@ -92,25 +222,53 @@ class Spider {
   inline int get_error() const { return error_; }
 
   /**
-   * Get set of indexed files which still don't dumped in data base.
+   * Get set of indexed files which still don't dumped in data base
+   * by ScanSMBDir().
    *
-   * @return Get vector of indexed files.
+   * @return Get vector of full paths of indexed files.
    */
-  inline std::vector<std::string> get_result() const { return *result_; }
+  std::vector<std::string> get_result() const;
 
   /**
-   * Get an iterator to the last indexed file.
+   * Get a MIME type attribute.
    *
-   * @return iterator to the last indexed file.
+   * @return MIME type attribute.
    */
-  inline std::vector<std::string>::iterator get_last() const { return last_; }
+  inline FileAttribute get_mime_type_attr() const { return *mime_type_attr_; }
 
   /**
-   * Get a MIME type attribute.
+   * Get percent of files which MIME types were detected by the table of
+   * signatures without libmagic since the spider started.
    *
-   * @return MIME type attribute.
+   * @return Hit rate of the table of signatures.
    */
-  inline FileAttribute get_mime_type_attr() const { return *mime_type_attr_; }
+  inline int get_sniffer_hit_rate() const {
+    int total = sniffer_hits_ + sniffer_misses_;
+    return total ? 100 * sniffer_hits_ / total : 0;
+  }
+
+  /**
+   * Get number of files classified by extension without reading their
+   * content since the spider started.
+   *
+   * @return Number of files classified by extension.
+   */
+  inline int get_extension_hits() const { return extension_hits_; }
+
+  /**
+   * Get table of file extensions.
+   *
+   * @return Table of file extensions.
+   */
+  inline const ExtensionTable &get_extensions() const { return extensions_; }
+
+  /**
+   * Get number of files which MIME types were found in the cache since
+   * the spider started.
+   *
+   * @return Number of cache hits.
+   */
+  inline int get_cache_hits() const { return cache_hits_; }
 #endif  // DOXYGEN_SHOULD_SKIP_THIS
 
  protected:
@@ -151,12 +309,24 @@ class Spider {
 #endif  // DOXYGEN_SHOULD_SKIP_THIS
 
   /**
-   * Dump the result vector to data base.
+   * Dump the batch of ScanSMBDir() to data base.
    *
    * @return 0 on success, -1 otherwise.
    */
   int DumpToDataBase();
 
+  /**
+   * Dump the batch of the scan to data base. Caller should hold
+   * files_mutex of the scan or be the only user of its batch. Files
+   * which aren't written are counted in failed_files of the scan, the
+   * batch is cleared anyway.
+   *
+   * @param crawl Scan which files are dumped.
+   *
+   * @return 0 on success, -1 if the transaction fails.
+   */
+  int DumpToDataBase(Crawl *crawl);
+
   /**
    * Connect to data base server.
    *
@@ -181,13 +351,53 @@ class Spider {
    *
    * @param server Name of the server when file is stored.
    *
+   * @param mime_type MIME type of the file. If it's empty MIME type is
+   * detected.
+   *
+   * @param fingerprint Sampled fingerprint of the file, it isn't stored
+   * if it's empty.
+   *
+   * @param content_hash Hash of whole content of the file, it isn't
+   * stored if it's empty.
+   *
    * @return 0 on siccess, -1 otherwise.
    */
   int AddFileEntryInDataBase(const std::string &file,
-                             const std::string &server);
+                             const std::string &server,
+                             const std::string &mime_type = std::string(),
+                             const std::string &fingerprint = std::string(),
+                             const std::string &content_hash = std::string());
+
+  /**
+   * Add new file entry of file located in known directory in data base.
+   *
+   * @param dir_id Id of directory where file is located in data base.
+   *
+   * @param file Full path to file in network.
+   *
+   * @param server Name of the server when file is stored.
+   *
+   * @param mime_type MIME type of the file. If it's empty MIME type is
+   * detected.
+   *
+   * @param fingerprint Sampled fingerprint of the file, it isn't stored
+   * if it's empty.
+   *
+   * @param content_hash Hash of whole content of the file, it isn't
+   * stored if it's empty.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int AddFileEntryInDir(const int dir_id, const std::string &file,
+                        const std::string &server,
+                        const std::string &mime_type,
+                        const std::string &fingerprint,
+                        const std::string &content_hash);
 
   /**
-   * Search files in smb directory and all subdirectories.
+   * Search files in smb directory and all subdirectories. The pipeline
+   * is run only for this scan. Found files are in the batch or in
+   * data base after it.
    *
    * @param dir name of the smb directory.
    *
@@ -195,10 +405,120 @@ class Spider {
    */
   int ScanSMBDir(const std::string &dir);
 
+  /**
+   * Scan the leased server, write its files to data base and delete
+   * vanished ones. Interrupted scan is resumed from its checkpoint.
+   * The pipeline should be running.
+   *
+   * @param server Leased server.
+   */
+  void CrawlServer(const std::string &server);
+
+  /**
+   * Search files in given smb directories and all their subdirectories
+   * on the running pipeline. Subdirectories are scanned by all workers
+   * simultaneously, idle workers steal pending directories from busy
+   * ones. Directories of other scans are scanned at the same time.
+   *
+   * @param crawl Scan the directories belong to.
+   * @param dirs Directories to start from, e.g. root of the server or
+   * frontier of interrupted scan. They should be in the checkpoint.
+   *
+   * @return 0 if the scan is completed, -1 if root of the server can't
+   * be listed.
+   */
+  int ScanSMBDirs(Crawl *crawl, const std::vector<DirTask> &dirs);
+
+  /**
+   * Load checkpoint of interrupted scan of the server or start new one.
+   *
+   * @param crawl Scan of the server. Its start time is replaced by the
+   * start of interrupted scan.
+   *
+   * @return 0 if the scan should be resumed, -1 otherwise.
+   */
+  int ResumeCheckpoint(Crawl *crawl);
+
+  /**
+   * Delete files and directories which weren't seen since the scan
+   * started. Should be called when all found files are in data base and
+   * signatures of directories are saved. Nothing is deleted if some
+   * directories weren't scanned or some files weren't written.
+   *
+   * @param crawl Finished scan of the server.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int SweepServer(Crawl *crawl);
+
+  /**
+   * Delete entries by chunks until nothing is left, data base is
+   * unlocked between chunks.
+   *
+   * @param delete_chunk Function which deletes one chunk of at most
+   * SWEEP_BATCH_SIZE entries and returns their number or -1 on error.
+   *
+   * @return Number of deleted entries on success, -1 otherwise.
+   */
+  int SweepChunks(const std::function<int()> &delete_chunk);
+
+  /**
+   * Search files in smb directory without entering subdirectories.
+   * Found subdirectories are added to the deque of the worker.
+   *
+   * If signature of the directory is the same as at the previous scan
+   * its files are skipped. Subdirectories are scanned anyway, because
+   * changes inside them don't change signature of the directory.
+   *
+   * @param worker Worker which context is used to access the directory.
+   * @param crawl Scan the directory belongs to.
+   * @param dir smb directory to be scanned.
+   *
+   * @return 0 if functions completed, -1 otherwise.
+   */
+  int ListSMBDir(SMBWorker *worker, Crawl *crawl, const DirTask &dir);
+
+  /**
+   * Load signatures of directories of the server saved at the previous
+   * scan.
+   *
+   * @param crawl Scan of the server.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int LoadDirSignatures(Crawl *crawl);
+
+  /**
+   * Save signatures of changed directories to data base. Should be called
+   * when files of these directories are in data base, directories with
+   * failed files are skipped.
+   *
+   * @param crawl Scan of the server.
+   *
+   * @return 0 on success, -1 otherwise.
+   */
+  int SaveDirSignatures(Crawl *crawl);
+
+  /**
+   * Find id of directory in data base, entries of the directory and its
+   * parents are created if they don't exist. Ids are cached in the scan
+   * of the server. db_mutex_ should be locked.
+   *
+   * @param crawl Scan of the server.
+   * @param server Name of the server where directory is located.
+   * @param path Path to directory on the server.
+   *
+   * @return Id of directory, 0 for empty path, -1 on error.
+   */
+  int DirIdOf(Crawl *crawl, const std::string &server,
+              const std::string &path);
+
   /**
    * Parsing the given name.
    *
-   * Now just replace '_' symbols with spaces.
+   * Names which aren't valid UTF-8 are repaired by Utf8::Repair() first.
+   * The name is split into lower case tokens by NameAnalyzer and they are
+   * joined by spaces. Names without letters and digits are kept as is.
    *
    * @param name Name to be parsed.
    *
@@ -207,16 +527,152 @@ class Spider {
   int NameParser(std::string *name);
 
   /**
-   * Add a file to result vector and if it full - dump it to data base.
+   * Add a file to results of ScanSMBDir().
    *
    * @param name Name to be added.
+   * @param mime_type MIME type of the file. If it's empty MIME type is
+   * detected while dumping to data base.
+   */
+  void AddSMBFile(const std::string &name,
+                  const std::string &mime_type = std::string());
+
+  /**
+   * Add a file to results of the scan. While the pipeline is running the
+   * file is passed to the data base writer, otherwise it's added to
+   * the batch directly. Can be called from any worker.
    *
-   * @return 0 on success, -1 otherwise.
+   * @param crawl Scan the file belongs to.
+   * @param name Name to be added.
+   * @param mime_type MIME type of the file. If it's empty MIME type is
+   * detected while dumping to data base.
+   * @param fingerprint Sampled fingerprint of the file or empty string.
+   * @param content_hash Hash of content of the file or empty string.
+   */
+  void AddSMBFile(Crawl *crawl, const std::string &name,
+                  const std::string &mime_type,
+                  const std::string &fingerprint = std::string(),
+                  const std::string &content_hash = std::string());
+
+  /**
+   * Add a file to the batch of the scan and if it's full - dump it to
+   * data base.
+   *
+   * @param crawl Scan the file belongs to.
+   * @param name Name to be added.
+   * @param mime_type MIME type of the file.
+   * @param fingerprint Sampled fingerprint of the file or empty string.
+   * @param content_hash Hash of content of the file or empty string.
+   */
+  void BufferSMBFile(Crawl *crawl, const std::string &name,
+                     const std::string &mime_type,
+                     const std::string &fingerprint,
+                     const std::string &content_hash);
+
+  /**
+   * Pass classified file to the writer or, if its content should be
+   * hashed and the hash isn't known, to hashers. Files which don't fit
+   * in the queue of hashers are written without the hash and hashed at
+   * one of the next scans.
+   *
+   * @param file Listed file, its hint is ignored.
+   * @param mime_type MIME type of the file.
+   * @param fingerprint Sampled fingerprint of the file or empty string.
+   * @param content_hash Cached hash of content of the file or 0.
+   */
+  void CompleteFile(const FetchRequest &file, const std::string &mime_type,
+                    const std::string &fingerprint,
+                    const uint64_t content_hash);
+
+  /**
+   * Whether content of the file should be hashed.
+   *
+   * @param path Full path of the file.
+   *
+   * @return true if the file is on one of hashed shares.
+   */
+  bool IsHashed(const std::string &path) const;
+
+  /**
+   * Count files which weren't written to data base. Signature of their
+   * directory isn't saved, so it's scanned again next time.
+   *
+   * @param crawl Scan the files belong to.
+   * @param dir Path to the directory on the server.
+   * @param files Number of failed files.
+   */
+  void FailFiles(Crawl *crawl, const std::string &dir, const size_t files);
+
+  /**
+   * Get exclusion rules for a new scan, they are reloaded if the config
+   * was modified. If reload fails, the previous rules are kept.
+   *
+   * @return Compiled rules.
+   */
+  std::shared_ptr<const PathFilter> Exclusions();
+
+  /**
+   * Classify file by its extension or find it in the cache without
+   * reading its content.
+   *
+   * @param crawl Scan the file belongs to, hits are counted in its
+   * statistics.
+   * @param name Name of the file.
+   * @param file Directory entry of the file with its size and mtime.
+   * @param mime_type MIME type of the file if it's classified, otherwise
+   * MIME type expected from its extension or empty string.
+   * @param fingerprint Fingerprint of the file if it's found in the cache.
+   * @param content_hash Hash of content of the file if it's found in the
+   * cache, otherwise 0.
+   *
+   * @return true if the file is classified, false if its header should
+   * be fetched.
+   */
+  bool ClassifyFile(Crawl *crawl, const std::string &name,
+                    const DirEntry &file, std::string *mime_type,
+                    std::string *fingerprint, uint64_t *content_hash);
+
+  /**
+   * Check files of a directory with unchanged signature. Files rewritten
+   * in place don't change the signature, so files which are classified
+   * by content are looked up in the cache by their size and mtime.
+   * Files listed without mtime can't be checked.
+   *
+   * @param dir Full smb path to the directory.
+   * @param files Listed files of the directory.
+   *
+   * @return true if none of the files should be classified again.
    */
-  void AddSMBFile(const std::string &name);
+  bool FilesUnchanged(const std::string &dir,
+                      const std::vector<DirEntry> &files);
 
   /**
-   * Detect MIME type of given file.
+   * Detect MIME type of the file by its fetched header and store it in
+   * the cache.
+   *
+   * @param worker Worker which context is used to access the file.
+   * @param request Request to fetch header of the file.
+   *
+   * @return Mime type of given file on success, "unknown" otherwise.
+   */
+  std::string FetchMimeType(SMBWorker *worker, const FetchRequest &request);
+
+  /**
+   * Choose MIME type of the fetched file between detected one and the
+   * hint and store it in the cache.
+   *
+   * @param request Request to fetch header of the file.
+   * @param mime_type MIME type detected by the header.
+   * @param fingerprint Hash of sampled blocks of the file or 0.
+   *
+   * @return Mime type of given file on success, "unknown" otherwise.
+   */
+  std::string ResolveMimeType(const FetchRequest &request,
+                              const char *mime_type,
+                              const uint64_t fingerprint = 0);
+
+  /**
+   * Detect MIME type of given file using context of the writer. It's
+   * called only by the writer or while the pipeline isn't running.
    *
    * @param name Name of the file to be observed.
    *
@@ -225,12 +681,45 @@ class Spider {
   const char *DetectMimeType(const std::string &name);
 
   /**
-   * Initilize file attribute to store MIME type in data base.
+   * Detect MIME type of given file using context of given worker.
+   *
+   * @param worker Worker which context is used to access the file.
+   * @param name Name of the file to be observed.
+   *
+   * @return Mime type of given file on success, "unknown" otherwise.
+   */
+  const char *DetectMimeType(SMBWorker *worker, const std::string &name);
+
+  /**
+   * Detect MIME type by header read into buffer of the worker.
+   *
+   * @param worker Worker which read the header.
+   * @param name Name of the file.
+   * @param index Number of the header in the last batch of the worker.
+   * @param size Size of the header or -errno if it isn't read.
+   *
+   * @return Mime type of given file on success, "unknown" otherwise.
+   */
+  const char *SniffHeader(SMBWorker *worker, const std::string &name,
+                          const size_t index, const ssize_t size);
+
+  /**
+   * Initilize file attributes to store MIME type, fingerprint and content
+   * hash in data base.
    *
    * @return 0 on success, -1 otherwise.
    */
   int InitMimeTypeAttr();
 
+  /**
+   * Find string file attribute in data base or create it.
+   *
+   * @param name Name of the attribute.
+   *
+   * @return The attribute or NULL on error.
+   */
+  static std::shared_ptr<FileAttribute> InitAttribute(const std::string &name);
+
  private:
   /**
    * Save last occured error in error_.
@@ -238,14 +727,241 @@ class Spider {
   inline void DetectError() { error_ = errno; }
 
   /**
-   * Vector with scan results.
+   * Start all stages of the pipeline: scanning workers, fetchers and data
+   * base writer. They serve all scans until the pipeline is stopped.
+   */
+  void StartPipeline();
+
+  /**
+   * Stop the pipeline when all scans are finished.
+   */
+  void StopPipeline();
+
+  /**
+   * Add found directory to pending ones and to the checkpoint.
+   *
+   * @param worker Number of the worker which deque gets the directory.
+   * @param crawl Scan the directory belongs to.
+   * @param dir Found directory.
+   */
+  void PushDir(const int worker, Crawl *crawl, const DirTask &dir);
+
+  /**
+   * Scan pending directories until the pipeline is stopped.
+   *
+   * @param worker Worker which scans directories.
+   */
+  void ScanWorker(SMBWorker *worker);
+
+  /**
+   * Fetch headers of found files and classify them until the pipeline
+   * is stopped.
+   *
+   * @param worker Worker which fetches headers.
+   */
+  void FetchWorker(SMBWorker *worker);
+
+  /**
+   * Hash content of files on hashed shares until the pipeline is
+   * stopped.
+   *
+   * @param worker Worker which reads files.
+   */
+  void HashWorker(SMBWorker *worker);
+
+  /**
+   * Write classified files to batches of their scans until the
+   * pipeline is stopped.
+   */
+  void WriterWorker();
+
+  /**
+   * Log queue depth and throughput of each stage of the scan.
+   */
+  void ReportPipeline();
+
+  /**
+   * Workers which do all network requests.
+   */
+  std::vector<SMBWorker *> workers_;
+
+  /**
+   * Directories of all scans which are found but still not scanned.
+   */
+  WorkStealingQueue<CrawlTask> pending_dirs_;
+
+  /**
+   * Workers which fetch headers of files, each of them has one request
+   * in flight.
+   */
+  std::vector<SMBWorker *> fetchers_;
+
+  /**
+   * Workers which hash whole content of files, they are created only if
+   * some shares are hashed.
+   */
+  std::vector<SMBWorker *> hashers_;
+
+  /**
+   * Worker of the writer which reads headers of files written without
+   * MIME types, scan workers never use its context.
+   */
+  SMBWorker *writer_worker_;
+
+  /**
+   * Limits of smb requests to each server, shared by workers and
+   * fetchers.
+   */
+  Throttle throttle_;
+
+  /**
+   * Files which headers should be fetched.
+   */
+  FetchQueue fetch_queue_;
+
+  /**
+   * Budget of reads of hashers from each server.
+   */
+  Bandwidth hash_bandwidth_;
+
+  /**
+   * Classified files which content should be hashed. Hint of each
+   * request is MIME type of the file.
+   */
+  FetchQueue hash_queue_;
+
+  /**
+   * Classified files waiting to be written to data base.
+   */
+  MPMCQueue<FileRecord> write_queue_;
+
+  /**
+   * If the pipeline is running.
+   */
+  std::atomic<bool> pipeline_running_;
+
+  /**
+   * Threads of all stages of the pipeline.
+   */
+  std::vector<std::thread> scan_threads_;
+  std::vector<std::thread> fetch_threads_;
+  std::vector<std::thread> hash_threads_;
+  std::thread writer_thread_;
+
+  /**
+   * Time when the pipeline was started.
+   */
+  time_t scan_start_;
+
+  /**
+   * Number of files listed by scanners, files which headers were fetched,
+   * files which content was hashed and files written to batches
+   * since the pipeline started.
+   */
+  std::atomic<int> listed_files_;
+  std::atomic<int> fetched_files_;
+  std::atomic<int> hashed_files_;
+  std::atomic<int> written_files_;
+
+  /**
+   * Scans which are running on the pipeline.
+   */
+  std::list<Crawl *> crawls_;
+
+  /**
+   * Mutex to protect crawls_.
+   */
+  std::mutex crawls_mutex_;
+
+  /**
+   * Scan run by ScanSMBDir().
+   */
+  std::unique_ptr<Crawl> crawl_;
+
+  /**
+   * Mutex to serialize access to data base, it's shared by the writer
+   * and scans which load and save their state.
+   */
+  std::mutex db_mutex_;
+
+  /**
+   * Analyzer of names of files written to data base, it's protected by
+   * db_mutex_.
    */
-  std::vector<std::string> *result_ = NULL;
+  NameAnalyzer name_analyzer_;
 
   /**
-   * last Iterator on last valid element in result vector.
+   * Number of names and paths which weren't valid UTF-8 and were repaired
+   * before writing to data base since start.
    */
-  std::vector<std::string>::iterator last_;
+  std::atomic<int> repaired_names_;
+
+  /**
+   * Number of files detected by the table of signatures and by libmagic.
+   */
+  std::atomic<int> sniffer_hits_;
+  std::atomic<int> sniffer_misses_;
+
+  /**
+   * Table of file extensions with known MIME types.
+   */
+  ExtensionTable extensions_;
+
+  /**
+   * Number of files classified by extension and number of files with
+   * sampled extensions which were seen.
+   */
+  std::atomic<int> extension_hits_;
+  std::atomic<unsigned> sampled_files_;
+
+  /**
+   * Persistent cache of MIME types of files.
+   */
+  MimeCache mime_cache_;
+
+  /**
+   * Number of files which MIME types were found in the cache.
+   */
+  std::atomic<int> cache_hits_;
+
+  /**
+   * URL prefixes of shares which files are hashed by whole content.
+   */
+  std::vector<std::string> hashed_shares_;
+
+  /**
+   * Config of exclusion rules, its mtime when it was read and compiled
+   * rules. Running scans keep rules they started with.
+   */
+  std::string exclusions_config_;
+  time_t exclusions_mtime_;
+  std::shared_ptr<const PathFilter> exclusions_;
+  std::mutex exclusions_mutex_;
+
+  /**
+   * Directory with checkpoints, they aren't used if it's empty.
+   */
+  std::string checkpoint_dir_;
+
+  /**
+   * File where statistics of scans are written.
+   */
+  std::string stats_file_;
+
+  /**
+   * Statistics of the last finished lease of every server.
+   */
+  std::map<std::string, std::string> lease_stats_;
+
+  /**
+   * Mutex to protect lease_stats_.
+   */
+  std::mutex stats_mutex_;
+
+  /**
+   * Whether statistics are requested by RequestStats().
+   */
+  static std::atomic<bool> stats_requested_;
 
   /**
    * Name of the database on the server where data is stored.
@@ -269,14 +985,19 @@ class Spider {
   std::string db_password_;
 
   /**
-   * Cookie for magic library to detect MIME-types.
+   * Id of attribute to store MIME type in data base.
+   */
+  std::shared_ptr<FileAttribute> mime_type_attr_;
+
+  /**
+   * Attribute to store sampled fingerprints of files in data base.
    */
-  magic_t cookie_;
+  std::shared_ptr<FileAttribute> fingerprint_attr_;
 
   /**
-   * Id of attribute to store MIME type in data base.
+   * Attribute to store hashes of whole content of files in data base.
    */
-  std::shared_ptr<FileAttribute> mime_type_attr_;
+  std::shared_ptr<FileAttribute> content_hash_attr_;
 
   /*
    * Scheduler hostname.
@@ -291,7 +1012,7 @@ class Spider {
   /**
    * Last occured error.
    */
-  int error_;
+  std::atomic<int> error_;
 
   DISALLOW_COPY_AND_ASSIGN(Spider);
 };
@@ -1,4 +1,13 @@
 TEMPLATE = lib
-SOURCES += spider.cpp main.cpp servermanager.cpp
-HEADERS += spider.h servermanager.h
+SOURCES += spider.cpp main.cpp servermanager.cpp smbworker.cpp \
+    mimesniffer.cpp extensiontable.cpp mimecache.cpp fetchqueue.cpp \
+    checkpoint.cpp throttle.cpp crawlsource.cpp smbsource.cpp posixsource.cpp \
+    fingerprint.cpp contenthash.cpp nameanalyzer.cpp utf8.cpp \
+    pathfilter.cpp filebatch.cpp crawlstats.cpp
+HEADERS += spider.h servermanager.h smbworker.h \
+    workstealingqueue.h mimesniffer.h extensiontable.h \
+    mimecache.h fetchqueue.h mpmcqueue.h dirtask.h checkpoint.h \
+    throttle.h crawl.h crawlsource.h smbsource.h posixsource.h \
+    fingerprint.h contenthash.h nameanalyzer.h utf8.h \
+    pathfilter.h filebatch.h crawlstats.h
 OTHER_FILES += Makefile
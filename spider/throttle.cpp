@@ -0,0 +1,287 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <errno.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+
+#include "config.h"
+#include "spider/fetchqueue.h"
+#include "spider/throttle.h"
+
+namespace {
+
+// Weight of the last request in smoothed latency.
+const double kSmoothing = 0.1;
+
+// Part of the gap between smoothed latency and the baseline by which
+// the baseline is raised per request.
+const double kDrift = 0.001;
+
+// Factor of the multiplicative decrease of the concurrency limit.
+const double kDecrease = 0.5;
+
+// Minimum interval in seconds between decreases of the limit.
+const double kMinDecreaseInterval = 0.01;
+
+// Names of kinds of requests with measured latency in reports.
+const char *const kRequestNames[] = { "listing", "metadata", "sample" };
+
+}  // namespace
+
+ServerThrottle::ServerThrottle(const double rate, const double burst,
+                               const int min_limit, const int max_limit,
+                               const double tolerance)
+    : rate_(rate),
+      burst_(std::max(burst, 1.0)),
+      min_limit_(std::max(min_limit, 1)),
+      max_limit_(std::max(max_limit, min_limit_)),
+      tolerance_(tolerance),
+      tokens_(burst_),
+      refill_(Clock::now()),
+      limit_(min_limit_),
+      in_flight_(0),
+      latency_(),
+      baseline_(),
+      samples_(),
+      decrease_(),
+      requests_(0),
+      failures_(0) {}
+
+void ServerThrottle::Acquire() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  released_.wait(lock, [this]() {
+    return in_flight_ < static_cast<int>(limit_);
+  });
+  ++in_flight_;
+
+  // The slot is kept while waiting for a token, so the rate isn't
+  // exceeded by threads which got their slots later.
+  for (Refill(Clock::now()); tokens_ < 1; Refill(Clock::now()))
+    released_.wait_for(lock,
+                       std::chrono::duration<double>((1 - tokens_) / rate_));
+  tokens_ -= 1;
+}
+
+void ServerThrottle::Release(const double latency, const bool failed,
+                             const Request request) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  --in_flight_;
+  ++requests_;
+
+  // Failed requests are often answered at once, their latency would
+  // hide the congestion. Duration of bulk reads depends on their size
+  // and on the bandwidth budget rather than on load of the server.
+  bool congested = failed;
+  if (failed) {
+    ++failures_;
+  } else if (request != srBulk) {
+    double &smoothed = latency_[request];
+    double &baseline = baseline_[request];
+    if (++samples_[request] == 1) {
+      smoothed = baseline = latency;
+    } else {
+      smoothed += kSmoothing * (latency - smoothed);
+      if (smoothed < baseline)
+        baseline = smoothed;
+      else
+        baseline += kDrift * (smoothed - baseline);
+    }
+    congested = smoothed > baseline * tolerance_;
+  }
+
+  Clock::time_point now = Clock::now();
+  if (congested) {
+    std::chrono::duration<double> interval(std::max(latency_[request],
+                                                    kMinDecreaseInterval));
+    if (now - decrease_ > interval) {
+      limit_ = std::max<double>(min_limit_, limit_ * kDecrease);
+      decrease_ = now;
+    }
+  } else if (request != srBulk) {
+    limit_ = std::min<double>(max_limit_, limit_ + 1 / limit_);
+  }
+
+  released_.notify_all();
+}
+
+void ServerThrottle::Refill(const Clock::time_point now) {
+  std::chrono::duration<double> elapsed = now - refill_;
+  tokens_ = std::min(burst_, tokens_ + elapsed.count() * rate_);
+  refill_ = now;
+}
+
+double ServerThrottle::get_limit() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return limit_;
+}
+
+int ServerThrottle::get_in_flight() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return in_flight_;
+}
+
+double ServerThrottle::get_latency(const Request request) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return latency_[request];
+}
+
+double ServerThrottle::get_baseline(const Request request) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return baseline_[request];
+}
+
+int ServerThrottle::get_requests() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return requests_;
+}
+
+int ServerThrottle::get_failures() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return failures_;
+}
+
+Throttle::Throttle() {}
+
+ServerThrottle *Throttle::Get(const std::string &path) {
+  std::string server = FetchQueue::ServerOf(path);
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::unique_ptr<ServerThrottle> &throttle = servers_[server];
+  if (!throttle)
+    throttle.reset(new ServerThrottle(THROTTLE_RATE, THROTTLE_BURST,
+                                      THROTTLE_MIN_CONCURRENCY,
+                                      THROTTLE_MAX_CONCURRENCY,
+                                      THROTTLE_LATENCY_TOLERANCE));
+  return throttle.get();
+}
+
+bool Throttle::IsCongestion(const int error) {
+  switch (error) {
+    case EAGAIN:
+    case EBUSY:
+    case EIO:
+    case ENOMEM:
+    case EPIPE:
+    case ETIMEDOUT:
+    case ECONNABORTED:
+    case ECONNREFUSED:
+    case ECONNRESET:
+    case EHOSTUNREACH:
+    case ENETUNREACH:
+      return true;
+    default:
+      return false;
+  }
+}
+
+std::string Throttle::Report() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string report;
+  for (auto &server : servers_) {
+    const ServerThrottle &throttle = *server.second;
+    if (!report.empty())
+      report += ", ";
+    report += (server.first.empty() ? "(network)" : server.first) +
+              ": limit " +
+              std::to_string(static_cast<int>(throttle.get_limit())) + ", " +
+              std::to_string(throttle.get_in_flight()) + " in flight, ";
+    for (int i = 0; i < ServerThrottle::srBulk; ++i) {
+      ServerThrottle::Request request = static_cast<ServerThrottle::Request>(i);
+      report += std::string(kRequestNames[i]) + " " +
+                std::to_string(static_cast<int>(
+                    throttle.get_latency(request) * 1000)) + " ms (baseline " +
+                std::to_string(static_cast<int>(
+                    throttle.get_baseline(request) * 1000)) + " ms), ";
+    }
+    report += std::to_string(throttle.get_failures()) + "/" +
+              std::to_string(throttle.get_requests()) + " failed";
+  }
+  return report;
+}
+
+Bandwidth::Bandwidth(const double rate, const double burst)
+    : rate_(rate),
+      burst_(std::max(burst, 0.0)) {}
+
+void Bandwidth::Consume(const std::string &path, const size_t bytes) {
+  std::string server = FetchQueue::ServerOf(path);
+  double debt;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    Bucket initial = { burst_, now, 0 };
+    Bucket &bucket = buckets_.insert(std::make_pair(server,
+                                                    initial)).first->second;
+    bucket.bytes += bytes;
+    if (rate_ <= 0)
+      return;
+
+    std::chrono::duration<double> elapsed = now - bucket.refill;
+    bucket.tokens = std::min(burst_, bucket.tokens + elapsed.count() * rate_);
+    bucket.refill = now;
+    bucket.tokens -= bytes;
+    debt = -bucket.tokens;
+  }
+
+  // Concurrent readers of the server wait for the whole debt including
+  // reads of each other, so they share the budget.
+  if (debt > 0)
+    std::this_thread::sleep_for(std::chrono::duration<double>(debt / rate_));
+}
+
+std::string Bandwidth::Report() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::string report;
+  for (auto &server : buckets_) {
+    if (!report.empty())
+      report += ", ";
+    report += (server.first.empty() ? "(network)" : server.first) + ": " +
+              std::to_string(server.second.bytes >> 20) + " MiB";
+  }
+  return report;
+}
+
+ThrottleGuard::ThrottleGuard(Throttle *throttle, const std::string &path,
+                             const ServerThrottle::Request request)
+    : server_(throttle == NULL ? NULL : throttle->Get(path)),
+      request_(request),
+      start_(),
+      failed_(false) {
+  if (server_ != NULL)
+    server_->Acquire();
+  // Waiting for the slot isn't a part of latency of the server.
+  start_ = std::chrono::steady_clock::now();
+}
+
+ThrottleGuard::~ThrottleGuard() {
+  if (server_ == NULL)
+    return;
+  std::chrono::duration<double> latency =
+      std::chrono::steady_clock::now() - start_;
+  server_->Release(latency.count(), failed_, request_);
+}
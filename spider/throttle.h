@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_THROTTLE_H_
+#define SPIDER_THROTTLE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "common-inl.h"
+
+/**
+ * Limiter of smb requests to one server. Requests are limited by a token
+ * bucket, which caps their rate, and by a concurrency limit adjusted by
+ * AIMD: the limit is increased by one per limit successful requests and
+ * halved when requests fail or their latency grows above the baseline,
+ * so the spider backs off from overloaded servers and speeds up on idle
+ * ones. Latency is compared with the baseline of requests of the same
+ * kind, since a listing of a large directory takes much longer than
+ * stat() of a file without any congestion.
+ */
+class ServerThrottle {
+ public:
+  /**
+   * Kinds of requests with separate latency and baseline.
+   */
+  enum Request {
+    srListing,   // smbc_opendir(), it fetches the whole listing.
+    srMetadata,  // smbc_stat() and smbc_open().
+    srSample,    // Open, seeks and reads of samples of a file.
+    srBulk,      // Reads of whole files, they're paced by Bandwidth and
+                 // only their failures adjust the limit.
+    srRequests
+  };
+
+  /**
+   * Constructor.
+   *
+   * @param rate Maximum number of requests per second.
+   * @param burst Maximum number of requests sent at once after idle time.
+   * @param min_limit Minimum number of concurrent requests.
+   * @param max_limit Maximum number of concurrent requests.
+   * @param tolerance How many times latency of requests can exceed the
+   * baseline until they are considered congested.
+   */
+  ServerThrottle(const double rate, const double burst, const int min_limit,
+                 const int max_limit, const double tolerance);
+
+  /**
+   * Wait for a free slot and a token. Release() should be called when
+   * the request is completed.
+   */
+  void Acquire();
+
+  /**
+   * Free the slot and adjust the concurrency limit.
+   *
+   * @param latency Duration of the request in seconds.
+   * @param failed Whether the request failed because of the server.
+   * @param request Kind of the request.
+   */
+  void Release(const double latency, const bool failed,
+               const Request request);
+
+  double get_limit() const;
+  int get_in_flight() const;
+  double get_latency(const Request request) const;
+  double get_baseline(const Request request) const;
+  int get_requests() const;
+  int get_failures() const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * Add tokens accumulated since the last refill.
+   *
+   * @param now Current time.
+   */
+  void Refill(const Clock::time_point now);
+
+  /**
+   * Maximum number of requests per second.
+   */
+  const double rate_;
+
+  /**
+   * Maximum number of tokens in the bucket.
+   */
+  const double burst_;
+
+  /**
+   * Bounds of the concurrency limit.
+   */
+  const int min_limit_;
+  const int max_limit_;
+
+  /**
+   * How many times latency can exceed the baseline.
+   */
+  const double tolerance_;
+
+  /**
+   * Number of tokens in the bucket.
+   */
+  double tokens_;
+
+  /**
+   * Time of the last refill of the bucket.
+   */
+  Clock::time_point refill_;
+
+  /**
+   * Current concurrency limit, it's fractional to be increased by
+   * 1 / limit per request.
+   */
+  double limit_;
+
+  /**
+   * Number of requests in flight.
+   */
+  int in_flight_;
+
+  /**
+   * Exponentially smoothed latency of requests of each kind in seconds.
+   */
+  double latency_[srRequests];
+
+  /**
+   * Smoothed latency of each kind of requests to the unloaded server.
+   * It's the minimum of smoothed latency slowly drifting up, so the
+   * throttle adapts when the server becomes slower for good.
+   */
+  double baseline_[srRequests];
+
+  /**
+   * Number of measured requests of each kind.
+   */
+  int samples_[srRequests];
+
+  /**
+   * Time of the last decrease of the limit. The limit is decreased at
+   * most once per latency, since requests sent before the decrease
+   * report the same congestion.
+   */
+  Clock::time_point decrease_;
+
+  /**
+   * Number of completed and failed requests.
+   */
+  int requests_;
+  int failures_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable released_;
+
+  DISALLOW_COPY_AND_ASSIGN(ServerThrottle);
+};
+
+/**
+ * Throttles of all servers accessed by the spider. It's shared by all
+ * smb workers.
+ */
+class Throttle {
+ public:
+  /**
+   * Constructor. Limits of new servers are taken from config.h.
+   */
+  Throttle();
+
+  /**
+   * Get throttle of the server of smb path, it's created on the first
+   * request to the server.
+   *
+   * @param path Full smb path.
+   *
+   * @return Throttle of the server.
+   */
+  ServerThrottle *Get(const std::string &path);
+
+  /**
+   * Whether the error is caused by overload of the server or network
+   * rather than by the requested file.
+   *
+   * @param error Error code.
+   *
+   * @return true if the error is a congestion signal.
+   */
+  static bool IsCongestion(const int error);
+
+  /**
+   * Get state of throttles of all servers.
+   *
+   * @return Human readable report.
+   */
+  std::string Report() const;
+
+ private:
+  std::unordered_map<std::string, std::unique_ptr<ServerThrottle> > servers_;
+  mutable std::mutex mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(Throttle);
+};
+
+/**
+ * Budget of bytes read from each server per second for bulk reads, e.g.
+ * hashing of whole files. It's a token bucket of bytes which can go into
+ * debt, so a read is never split because of the budget and the next
+ * read from the server waits until the debt is paid off.
+ */
+class Bandwidth {
+ public:
+  /**
+   * Constructor.
+   *
+   * @param rate Maximum number of bytes per second read from one server,
+   * 0 for unlimited.
+   * @param burst Maximum number of bytes read at once after idle time.
+   */
+  Bandwidth(const double rate, const double burst);
+
+  /**
+   * Take bytes from the budget of the server, wait if the server is in
+   * debt.
+   *
+   * @param path Full path of the read file.
+   * @param bytes Number of bytes which are read.
+   */
+  void Consume(const std::string &path, const size_t bytes);
+
+  /**
+   * Get number of bytes read from each server.
+   *
+   * @return Human readable report.
+   */
+  std::string Report() const;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  /**
+   * Budget of one server.
+   */
+  struct Bucket {
+    double tokens;
+    Clock::time_point refill;
+    uint64_t bytes;
+  };
+
+  /**
+   * Maximum number of bytes per second.
+   */
+  const double rate_;
+
+  /**
+   * Maximum number of tokens in a bucket.
+   */
+  const double burst_;
+
+  std::unordered_map<std::string, Bucket> buckets_;
+  mutable std::mutex mutex_;
+
+  DISALLOW_COPY_AND_ASSIGN(Bandwidth);
+};
+
+/**
+ * Scoped request to a throttled server.
+ */
+class ThrottleGuard {
+ public:
+  /**
+   * Acquire a slot of the server of the path.
+   *
+   * @param throttle Throttle of all servers, nothing is done if it's NULL.
+   * @param path Full smb path of the request.
+   * @param request Kind of the request.
+   */
+  ThrottleGuard(Throttle *throttle, const std::string &path,
+                const ServerThrottle::Request request);
+
+  /**
+   * Release the slot with measured latency of the request.
+   */
+  ~ThrottleGuard();
+
+  /**
+   * Report failure of the request.
+   *
+   * @param error Error code.
+   */
+  inline void set_error(const int error) {
+    failed_ = Throttle::IsCongestion(error);
+  }
+
+ private:
+  ServerThrottle *server_;
+  const ServerThrottle::Request request_;
+  std::chrono::steady_clock::time_point start_;
+  bool failed_;
+
+  DISALLOW_COPY_AND_ASSIGN(ThrottleGuard);
+};
+
+#endif  // SPIDER_THROTTLE_H_
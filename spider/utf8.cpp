@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif  // __SSE2__
+
+#include <stdint.h>
+#include <string.h>
+
+#include <string>
+
+#include "spider/utf8.h"
+
+namespace {
+
+// Code points of bytes 0x80..0xff of legacy code pages, bytes below 0x80
+// are ASCII. Undefined 0x98 of CP1251 is U+FFFD.
+const uint16_t kCP1251[128] = {
+  0x0402, 0x0403, 0x201a, 0x0453, 0x201e, 0x2026, 0x2020, 0x2021,
+  0x20ac, 0x2030, 0x0409, 0x2039, 0x040a, 0x040c, 0x040b, 0x040f,
+  0x0452, 0x2018, 0x2019, 0x201c, 0x201d, 0x2022, 0x2013, 0x2014,
+  0xfffd, 0x2122, 0x0459, 0x203a, 0x045a, 0x045c, 0x045b, 0x045f,
+  0x00a0, 0x040e, 0x045e, 0x0408, 0x00a4, 0x0490, 0x00a6, 0x00a7,
+  0x0401, 0x00a9, 0x0404, 0x00ab, 0x00ac, 0x00ad, 0x00ae, 0x0407,
+  0x00b0, 0x00b1, 0x0406, 0x0456, 0x0491, 0x00b5, 0x00b6, 0x00b7,
+  0x0451, 0x2116, 0x0454, 0x00bb, 0x0458, 0x0405, 0x0455, 0x0457,
+  0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+  0x0418, 0x0419, 0x041a, 0x041b, 0x041c, 0x041d, 0x041e, 0x041f,
+  0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+  0x0428, 0x0429, 0x042a, 0x042b, 0x042c, 0x042d, 0x042e, 0x042f,
+  0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+  0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e, 0x043f,
+  0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+  0x0448, 0x0449, 0x044a, 0x044b, 0x044c, 0x044d, 0x044e, 0x044f
+};
+
+const uint16_t kCP866[128] = {
+  0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+  0x0418, 0x0419, 0x041a, 0x041b, 0x041c, 0x041d, 0x041e, 0x041f,
+  0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+  0x0428, 0x0429, 0x042a, 0x042b, 0x042c, 0x042d, 0x042e, 0x042f,
+  0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+  0x0438, 0x0439, 0x043a, 0x043b, 0x043c, 0x043d, 0x043e, 0x043f,
+  0x2591, 0x2592, 0x2593, 0x2502, 0x2524, 0x2561, 0x2562, 0x2556,
+  0x2555, 0x2563, 0x2551, 0x2557, 0x255d, 0x255c, 0x255b, 0x2510,
+  0x2514, 0x2534, 0x252c, 0x251c, 0x2500, 0x253c, 0x255e, 0x255f,
+  0x255a, 0x2554, 0x2569, 0x2566, 0x2560, 0x2550, 0x256c, 0x2567,
+  0x2568, 0x2564, 0x2565, 0x2559, 0x2558, 0x2552, 0x2553, 0x256b,
+  0x256a, 0x2518, 0x250c, 0x2588, 0x2584, 0x258c, 0x2590, 0x2580,
+  0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+  0x0448, 0x0449, 0x044a, 0x044b, 0x044c, 0x044d, 0x044e, 0x044f,
+  0x0401, 0x0451, 0x0404, 0x0454, 0x0407, 0x0457, 0x040e, 0x045e,
+  0x00b0, 0x2219, 0x00b7, 0x221a, 0x2116, 0x00a4, 0x25a0, 0x00a0
+};
+
+const uint16_t *const kCodepages[] = { kCP1251, kCP866 };
+
+// Replacement character U+FFFD.
+const char kReplacement[] = "\xef\xbf\xbd";
+
+// Size of the valid UTF-8 character at data, 0 if it's invalid.
+inline size_t CharacterSize(const unsigned char *data, const size_t size) {
+  const unsigned char lead = data[0];
+  if (lead < 0x80)
+    return 1;
+
+  // Range of the second byte depends on the lead byte, it excludes
+  // overlong forms, surrogates and code points above U+10FFFF.
+  unsigned char low = 0x80, high = 0xbf;
+  size_t length;
+  if (lead < 0xc2) {
+    return 0;
+  } else if (lead < 0xe0) {
+    length = 2;
+  } else if (lead < 0xf0) {
+    length = 3;
+    if (lead == 0xe0)
+      low = 0xa0;
+    else if (lead == 0xed)
+      high = 0x9f;
+  } else if (lead < 0xf5) {
+    length = 4;
+    if (lead == 0xf0)
+      low = 0x90;
+    else if (lead == 0xf4)
+      high = 0x8f;
+  } else {
+    return 0;
+  }
+
+  if (size < length || data[1] < low || data[1] > high)
+    return 0;
+  for (size_t i = 2; i < length; ++i) {
+    if ((data[i] & 0xc0) != 0x80)
+      return 0;
+  }
+  return length;
+}
+
+// Number of ASCII bytes at the start of data, it's checked by 16 or 8
+// bytes at a time. Bytes behind size aren't read.
+inline size_t AsciiPrefix(const unsigned char *data, const size_t size) {
+  size_t i = 0;
+#ifdef __SSE2__
+  for (; i + 16 <= size; i += 16) {
+    int mask = _mm_movemask_epi8(_mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(data + i)));
+    if (mask != 0)
+      return i + __builtin_ctz(mask);
+  }
+#else
+  for (; i + 8 <= size; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    if ((word & 0x8080808080808080ULL) != 0)
+      break;
+  }
+#endif  // __SSE2__
+  while (i < size && data[i] < 0x80)
+    ++i;
+  return i;
+}
+
+// Weight of the code point for the guess of code page.
+inline int LetterWeight(const uint16_t code_point) {
+  if (code_point >= 0x0430 && code_point <= 0x045f)  // а..я, ѐ..џ
+    return 2;
+  if (code_point >= 0x0400 && code_point <= 0x042f)  // Ѐ..Џ, А..Я
+    return 1;
+  return 0;
+}
+
+inline void AppendCharacter(const uint16_t code_point, std::string *utf8) {
+  if (code_point < 0x80) {
+    *utf8 += static_cast<char>(code_point);
+  } else if (code_point < 0x800) {
+    *utf8 += static_cast<char>(0xc0 | (code_point >> 6));
+    *utf8 += static_cast<char>(0x80 | (code_point & 0x3f));
+  } else {
+    *utf8 += static_cast<char>(0xe0 | (code_point >> 12));
+    *utf8 += static_cast<char>(0x80 | ((code_point >> 6) & 0x3f));
+    *utf8 += static_cast<char>(0x80 | (code_point & 0x3f));
+  }
+}
+
+}  // namespace
+
+size_t Utf8::Validate(const char *data, const size_t size) {
+  bool supplementary;
+  return ValidatePrefix(data, size, &supplementary);
+}
+
+size_t Utf8::ValidatePrefix(const char *data, const size_t size,
+                            bool *supplementary) {
+  const unsigned char *bytes = reinterpret_cast<const unsigned char *>(data);
+  *supplementary = false;
+  size_t i = 0;
+  while (i < size) {
+    i += AsciiPrefix(bytes + i, size - i);
+    if (i == size)
+      break;
+
+    size_t length = CharacterSize(bytes + i, size - i);
+    if (UNLIKELY(length == 0))
+      return i;
+    *supplementary |= length == 4;
+    i += length;
+  }
+  return size;
+}
+
+Utf8::Codepage Utf8::Guess(const std::string &text) {
+  int cp1251 = 0, cp866 = 0;
+  for (const char c : text) {
+    unsigned char byte = c;
+    if (byte < 0x80)
+      continue;
+    cp1251 += LetterWeight(kCP1251[byte - 0x80]);
+    cp866 += LetterWeight(kCP866[byte - 0x80]);
+  }
+  return cp866 > cp1251 ? cpCP866 : cpCP1251;
+}
+
+void Utf8::Decode(const std::string &text, const Codepage codepage,
+                  std::string *utf8) {
+  const uint16_t *table = kCodepages[codepage];
+  utf8->clear();
+  utf8->reserve(text.size() * 2);
+  for (const char c : text) {
+    unsigned char byte = c;
+    if (byte < 0x80)
+      *utf8 += c;
+    else
+      AppendCharacter(table[byte - 0x80], utf8);
+  }
+}
+
+bool Utf8::Repair(std::string *text) {
+  bool supplementary;
+  if (LIKELY(ValidatePrefix(text->data(), text->size(), &supplementary) ==
+             text->size())) {
+    if (LIKELY(!supplementary))
+      return false;
+
+    // Only lead bytes of 4-byte characters are 0xf0 and above in valid
+    // UTF-8.
+    std::string repaired;
+    repaired.reserve(text->size());
+    for (size_t i = 0; i < text->size();) {
+      if (static_cast<unsigned char>((*text)[i]) >= 0xf0) {
+        repaired += kReplacement;
+        i += 4;
+      } else {
+        repaired += (*text)[i++];
+      }
+    }
+    text->swap(repaired);
+    return true;
+  }
+
+  std::string decoded;
+  Decode(*text, Guess(*text), &decoded);
+  text->swap(decoded);
+  return true;
+}
+
+bool Utf8::RepairPath(std::string *path) {
+  bool supplementary;
+  if (LIKELY(ValidatePrefix(path->data(), path->size(), &supplementary) ==
+             path->size() && !supplementary))
+    return false;
+
+  std::string repaired;
+  repaired.reserve(path->size() * 2);
+  size_t begin = 0;
+  while (true) {
+    size_t end = path->find('/', begin);
+    std::string name = path->substr(begin, end - begin);
+    Repair(&name);
+    repaired += name;
+    if (end == std::string::npos)
+      break;
+    repaired += '/';
+    begin = end + 1;
+  }
+  path->swap(repaired);
+  return true;
+}
+
+void Utf8::FoldCase(char *data, const size_t size) {
+  unsigned char *bytes = reinterpret_cast<unsigned char *>(data);
+  for (size_t i = 0; i < size; ++i) {
+    const unsigned char lead = bytes[i];
+    if (lead < 0x80) {
+      if (lead >= 'A' && lead <= 'Z')
+        bytes[i] = lead + ('a' - 'A');
+      continue;
+    }
+
+    // Continuation bytes are never taken for lead bytes below.
+    if (i + 1 == size || (bytes[i + 1] & 0xc0) != 0x80)
+      continue;
+    const unsigned char next = bytes[i + 1];
+    switch (lead) {
+      case 0xc3:  // À..Þ -> à..þ, except ×.
+        if (next <= 0x9e && next != 0x97)
+          bytes[i + 1] = next + 0x20;
+        break;
+      case 0xd0:
+        if (next < 0x90) {  // Ѐ..Џ -> ѐ..џ
+          bytes[i] = 0xd1;
+          bytes[i + 1] = next + 0x10;
+        } else if (next < 0xa0) {  // А..П -> а..п
+          bytes[i + 1] = next + 0x20;
+        } else if (next < 0xb0) {  // Р..Я -> р..я
+          bytes[i] = 0xd1;
+          bytes[i + 1] = next - 0x20;
+        }
+        break;
+      case 0xd2:  // Ґ -> ґ
+        if (next == 0x90)
+          bytes[i + 1] = 0x91;
+        break;
+      default:
+        break;
+    }
+    ++i;
+  }
+}
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_UTF8_H_
+#define SPIDER_UTF8_H_
+
+#include <stddef.h>
+
+#include <string>
+
+#include "common-inl.h"
+
+/**
+ * UTF-8 checks and repair of file names before they are written to data
+ * base. Names of old shares are often in legacy Cyrillic code pages, data
+ * base connection is "SET CHARSET UTF8" and rejects such rows.
+ *
+ * Validation skips runs of ASCII bytes by 16 at a time with SSE2 where
+ * it's available, only non-ASCII characters are decoded one by one.
+ */
+class Utf8 {
+ public:
+  /**
+   * Legacy code pages of names which aren't valid UTF-8.
+   */
+  enum Codepage {
+    cpCP1251 = 0,  // Windows Cyrillic.
+    cpCP866 = 1    // DOS Cyrillic.
+  };
+
+  /**
+   * Check UTF-8 text. Overlong forms, surrogates, code points above
+   * U+10FFFF and truncated sequences are invalid.
+   *
+   * @param data Text to be checked.
+   * @param size Size of the text in bytes.
+   *
+   * @return Size of the valid prefix of the text, size if whole text
+   * is valid.
+   */
+  static size_t Validate(const char *data, const size_t size);
+
+  static inline bool IsValid(const std::string &text) {
+    return Validate(text.data(), text.size()) == text.size();
+  }
+
+  /**
+   * Guess the code page of the text which isn't UTF-8. The code page
+   * which decodes more bytes to Cyrillic letters wins, lowercase letters
+   * weigh more because names are mostly in lower case.
+   *
+   * @param text Text in a legacy code page.
+   *
+   * @return Guessed code page, cpCP1251 if both are equally likely.
+   */
+  static Codepage Guess(const std::string &text);
+
+  /**
+   * Convert text from a legacy code page to UTF-8.
+   *
+   * @param text Text in the code page.
+   * @param codepage Code page of the text.
+   * @param utf8 Where to store converted text.
+   */
+  static void Decode(const std::string &text, const Codepage codepage,
+                     std::string *utf8);
+
+  /**
+   * Make text storable by data base. Text which isn't valid UTF-8 is
+   * decoded from guessed legacy code page. Characters above U+FFFF are
+   * replaced by U+FFFD, "utf8" charset of MySQL can't store them.
+   *
+   * @param text Text to be repaired.
+   *
+   * @return true if the text is changed.
+   */
+  static bool Repair(std::string *text);
+
+  /**
+   * Repair each name of the path separately, see Repair(). So a path of
+   * a directory is repaired to the prefix of repaired paths of its files.
+   *
+   * @param path Path separated by '/'.
+   *
+   * @return true if the path is changed.
+   */
+  static bool RepairPath(std::string *path);
+
+  /**
+   * Fold ASCII, Latin-1 and Cyrillic letters to lower case in place,
+   * lowercase forms of these letters have the same size in UTF-8.
+   * Invalid sequences are left as is.
+   *
+   * @param data UTF-8 text.
+   * @param size Size of the text in bytes.
+   */
+  static void FoldCase(char *data, const size_t size);
+
+ private:
+  /**
+   * Check UTF-8 text, see Validate().
+   *
+   * @param supplementary Set to true if the valid prefix has characters
+   * above U+FFFF.
+   */
+  static size_t ValidatePrefix(const char *data, const size_t size,
+                               bool *supplementary);
+
+  Utf8();
+  DISALLOW_COPY_AND_ASSIGN(Utf8);
+};
+
+#endif  // SPIDER_UTF8_H_
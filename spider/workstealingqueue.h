@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#ifndef SPIDER_WORKSTEALINGQUEUE_H_
+#define SPIDER_WORKSTEALINGQUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "common-inl.h"
+
+/**
+ * Queue of tasks shared by a fixed number of workers.
+ *
+ * Every worker has its own deque. Worker puts found tasks in the back of
+ * its deque and takes them from the back too, so it goes depth-first and
+ * works with its own data. Worker with an empty deque steals tasks from the
+ * front of other deques, where the oldest tasks (the biggest subtrees) are.
+ * So the load is rebalanced automatically, even if one worker has got
+ * a huge subtree.
+ *
+ * Tasks can produce new tasks. Queue is finished when there are no tasks
+ * in deques and no tasks in progress.
+ */
+template <class Task> class WorkStealingQueue {
+ public:
+  /**
+   * Constructor which creates deques for all workers.
+   *
+   * @param workers Number of workers.
+   */
+  explicit WorkStealingQueue(const int workers) : queued_(0), pending_(0) {
+    for (int i = 0; i < workers; ++i)
+      deques_.push_back(std::unique_ptr<Deque>(new Deque));
+  }
+
+  /**
+   * Add a task to the deque of given worker.
+   *
+   * @param worker Number of the worker.
+   * @param task Task to be added.
+   */
+  void Push(const int worker, const Task &task) {
+    ++pending_;
+    {
+      std::lock_guard<std::mutex> lock(deques_[worker]->mutex);
+      deques_[worker]->tasks.push_back(task);
+    }
+
+    // Wake up an idle worker to steal the task.
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    ++queued_;
+    idle_cond_.notify_one();
+  }
+
+  /**
+   * Get a task for given worker. Take it from own deque or steal it from
+   * other workers. Wait if there are no tasks in deques but there are tasks
+   * in progress, because they can produce new tasks.
+   *
+   * Every obtained task should be finished by Finish().
+   *
+   * @param worker Number of the worker.
+   * @param task Where to store obtained task.
+   *
+   * @return true if task was obtained, false if all tasks are finished.
+   */
+  bool Pop(const int worker, Task *task) {
+    while (true) {
+      if (TakeBack(worker, task))
+        return true;
+
+      // Own deque is empty, try to steal.
+      int workers = deques_.size();
+      for (int i = 1; i < workers; ++i)
+        if (StealFront((worker + i) % workers, task))
+          return true;
+
+      std::unique_lock<std::mutex> lock(idle_mutex_);
+      idle_cond_.wait(lock, [this]() { return queued_ > 0 || pending_ == 0; });
+      if (queued_ == 0)
+        return false;
+    }
+  }
+
+  /**
+   * Keep the queue unfinished until Finish() is called, so workers wait
+   * for tasks which are still to be pushed from outside.
+   */
+  void Hold() { ++pending_; }
+
+  /**
+   * Tell that task obtained by Pop() or hold by Hold() is finished.
+   */
+  void Finish() {
+    if (--pending_ == 0) {
+      // Wake up all idle workers to exit.
+      std::lock_guard<std::mutex> lock(idle_mutex_);
+      idle_cond_.notify_all();
+    }
+  }
+
+  /**
+   * Get number of tasks which are queued or in progress.
+   *
+   * @return Number of unfinished tasks.
+   */
+  inline int get_pending() const { return pending_; }
+
+ private:
+  /**
+   * Deque of one worker.
+   */
+  struct Deque {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  /**
+   * Take the newest task from the deque of given worker.
+   */
+  bool TakeBack(const int worker, Task *task) {
+    {
+      std::lock_guard<std::mutex> lock(deques_[worker]->mutex);
+      if (deques_[worker]->tasks.empty())
+        return false;
+      *task = deques_[worker]->tasks.back();
+      deques_[worker]->tasks.pop_back();
+    }
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    --queued_;
+    return true;
+  }
+
+  /**
+   * Take the oldest task from the deque of given worker.
+   */
+  bool StealFront(const int victim, Task *task) {
+    {
+      std::lock_guard<std::mutex> lock(deques_[victim]->mutex);
+      if (deques_[victim]->tasks.empty())
+        return false;
+      *task = deques_[victim]->tasks.front();
+      deques_[victim]->tasks.pop_front();
+    }
+    std::lock_guard<std::mutex> lock(idle_mutex_);
+    --queued_;
+    return true;
+  }
+
+  /**
+   * Deques of all workers.
+   */
+  std::vector<std::unique_ptr<Deque> > deques_;
+
+  /**
+   * Number of tasks in all deques. Protected by idle_mutex_.
+   */
+  int queued_;
+
+  /**
+   * Number of tasks which are in deques or in progress.
+   */
+  std::atomic<int> pending_;
+
+  /**
+   * Mutex and condition to wait for new tasks.
+   */
+  std::mutex idle_mutex_;
+  std::condition_variable idle_cond_;
+
+  DISALLOW_COPY_AND_ASSIGN(WorkStealingQueue);
+};
+
+#endif  // SPIDER_WORKSTEALINGQUEUE_H_
@@ -0,0 +1,4 @@
+TEMPLATE = app
+TARGET = crawlbench
+SOURCES += crawlbench.cpp
+OTHER_FILES += Makefile
@@ -0,0 +1,229 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ftw.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "config.h"
+#include "common-inl.h"
+#include "spider/fingerprint.h"
+#include "spider/mimesniffer.h"
+#include "spider/posixsource.h"
+#include "spider/workstealingqueue.h"
+
+// Benchmark of crawling a local tree by the same pipeline pieces which
+// are used by spider: work-stealing queue of directories, PosixSource
+// for listing and sampling of files, MimeSniffer and Fingerprint. The
+// tree is generated from command line parameters, so results are
+// reproducible. Build with
+// IO_URING=yes to compare batched syscalls with plain ones.
+//
+// Usage: crawlbench [-t threads] [-w width] [-d depth] [-f files]
+//                   [-p existing/tree]
+
+namespace {
+
+// Headers of generated files, they are written in turn.
+const char *kHeaders[] = { "%PDF-1.4\n", "\x89PNG\r\n\x1a\n", "PK\x03\x04",
+                           "ID3\x03\x00", "plain text file\n" };
+
+int MakeTree(const std::string &dir, const int width, const int depth,
+             const int files) {
+  for (int i = 0; i < files; ++i) {
+    std::string path = dir + "/file" + std::to_string(i);
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (UNLIKELY(fd == -1))
+      return -1;
+    const char *header = kHeaders[i % (sizeof(kHeaders) / sizeof(*kHeaders))];
+    ssize_t written = write(fd, header, strlen(header));
+    close(fd);
+    if (UNLIKELY(written == -1))
+      return -1;
+  }
+  if (depth == 0)
+    return 0;
+  for (int i = 0; i < width; ++i) {
+    std::string subdir = dir + "/dir" + std::to_string(i);
+    if (UNLIKELY(mkdir(subdir.c_str(), 0755) && errno != EEXIST))
+      return -1;
+    if (UNLIKELY(MakeTree(subdir, width, depth - 1, files)))
+      return -1;
+  }
+  return 0;
+}
+
+int RemoveEntry(const char *path, const struct stat *, int, struct FTW *) {
+  return remove(path);
+}
+
+struct Counters {
+  std::atomic<long> dirs;   // NOLINT(runtime/int)
+  std::atomic<long> files;  // NOLINT(runtime/int)
+  std::atomic<long> known;  // NOLINT(runtime/int)
+  std::atomic<long> errors;  // NOLINT(runtime/int)
+  std::atomic<uint64_t> checksum;  // Of fingerprints, keeps them computed.
+};
+
+void CrawlWorker(const int id, WorkStealingQueue<std::string> *queue,
+                 Counters *counters) {
+  PosixSource source;
+  std::vector<DirEntry> entries;
+  entries.reserve(LISTING_BATCH_SIZE);
+  const size_t stride = Fingerprint::kBlocks * Fingerprint::kBlockSize +
+                        MimeSniffer::kPadding;
+  unsigned char blocks[FETCH_BATCH_SIZE * stride];
+  ssize_t results[FETCH_BATCH_SIZE];
+  std::vector<std::string> paths;
+  std::vector<off_t> sizes;
+  std::string dir;
+  while (queue->Pop(id, &dir)) {
+    CrawlSource::Dir handle = source.OpenDir(dir);
+    if (UNLIKELY(handle == NULL)) {
+      ++counters->errors;
+      queue->Finish();
+      continue;
+    }
+    int count;
+    while ((count = source.ReadDir(handle, &entries,
+                                   LISTING_BATCH_SIZE)) > 0) {
+      for (const DirEntry &entry : entries) {
+        std::string path = dir + "/" + entry.name;
+        if (entry.type == etDir) {
+          queue->Push(id, path);
+        } else if (entry.type == etFile) {
+          paths.push_back(path);
+          sizes.push_back(entry.size);
+        }
+      }
+
+      // Samples are read by batches like fetch workers of spider do.
+      for (size_t first = 0; first < paths.size(); first += FETCH_BATCH_SIZE) {
+        std::vector<std::string> batch(
+            paths.begin() + first,
+            paths.begin() + std::min(first + FETCH_BATCH_SIZE, paths.size()));
+        source.ReadSamples(batch, sizes.data() + first, blocks, stride,
+                           results);
+        for (size_t i = 0; i < batch.size(); ++i) {
+          ++counters->files;
+          if (UNLIKELY(results[i] < 0)) {
+            ++counters->errors;
+            continue;
+          }
+          const unsigned char *sample = blocks + i * stride;
+          if (MimeSniffer::Sniff(sample, results[i]) != NULL)
+            ++counters->known;
+          if (sizes[first + i] > 0)
+            counters->checksum ^= Fingerprint::Hash(sizes[first + i], sample);
+        }
+      }
+      paths.clear();
+      sizes.clear();
+    }
+    if (UNLIKELY(count < 0))
+      ++counters->errors;
+    source.CloseDir(handle);
+    ++counters->dirs;
+    queue->Finish();
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int threads = WORKERS_NUMBER, width = 8, depth = 3, files = 32;
+  std::string path;
+  int option;
+  while ((option = getopt(argc, argv, "t:w:d:f:p:")) != -1) {
+    switch (option) {
+      case 't': threads = atoi(optarg); break;
+      case 'w': width = atoi(optarg); break;
+      case 'd': depth = atoi(optarg); break;
+      case 'f': files = atoi(optarg); break;
+      case 'p': path = optarg; break;
+      default:
+        fprintf(stderr, "Usage: %s [-t threads] [-w width] [-d depth] "
+                "[-f files] [-p path]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (threads < 1)
+    threads = 1;
+
+  bool generated = path.empty();
+  if (generated) {
+    char root[] = "/tmp/crawlbenchXXXXXX";
+    if (UNLIKELY(mkdtemp(root) == NULL)) {
+      perror("mkdtemp");
+      return 1;
+    }
+    path = root;
+    if (UNLIKELY(MakeTree(path, width, depth, files))) {
+      perror("MakeTree");
+      nftw(path.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+      return 1;
+    }
+  }
+
+  Counters counters;
+  counters.dirs = counters.files = counters.known = counters.errors = 0;
+  counters.checksum = 0;
+  WorkStealingQueue<std::string> queue(threads);
+  queue.Push(0, "file://localhost" + path);
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int i = 0; i < threads; ++i)
+    workers.push_back(std::thread(CrawlWorker, i, &queue, &counters));
+  for (std::thread &worker : workers)
+    worker.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  double seconds = elapsed.count() > 0 ? elapsed.count() : 1e-9;
+  printf("threads: %d, dirs: %ld, files: %ld, sniffed: %ld, errors: %ld\n",
+         threads, counters.dirs.load(), counters.files.load(),
+         counters.known.load(), counters.errors.load());
+  printf("time: %.3f s, %.0f dirs/s, %.0f files/s\n", seconds,
+         counters.dirs / seconds, counters.files / seconds);
+
+  if (generated)
+    nftw(path.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+  return counters.errors == 0 ? 0 : 1;
+}
@@ -24,6 +24,11 @@
  * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 */
 
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
 #include "config.h"
 #include "common-inl.h"
 #include "datastoragetest.h"
@@ -58,6 +63,17 @@ void FileEntryTest::GetByPathOnServerTestCase() {
   CPPUNIT_ASSERT_MESSAGE("Error in path", db_file->get_file_path() == path);
   CPPUNIT_ASSERT_MESSAGE("Error in timestamp",
                          db_file->get_timestamp() >= time.tv_sec);
+  CPPUNIT_ASSERT_MESSAGE("Error in path hash",
+                         db_file->get_path_hash() ==
+                         FileEntry::PathHash(server, path));
+  CPPUNIT_ASSERT_MESSAGE("Error in PathHash",
+                         FileEntry::PathHash(server, path) !=
+                         FileEntry::PathHash("other.server", path));
+
+  // Existing entry is updated in place.
+  FileEntry entry(name, path, server);
+  CPPUNIT_ASSERT_MESSAGE("Error in upsert",
+                         entry.get_id() == db_file->get_id());
 
   // Try to add russian file.
   name = ("русский файл");
@@ -77,6 +93,49 @@ void FileEntryTest::GetByPathOnServerTestCase() {
                          db_file->get_timestamp() >= time.tv_sec);
 }
 
+void FileEntryTest::SweepTestCase() {
+  std::string server("sweep.test.server");
+
+  CPPUNIT_ASSERT_MESSAGE("Connect to data base",
+                         DatabaseEntity::ConnectToServer(name_, server_, user_,
+                                                         password_, false));
+
+  FileEntry("file", "dir_1/file", server);
+  FileEntry("nested", "dir_1/sub/nested", server);
+  FileEntry("other", "dir%1/other", server);
+
+  // Timestamps have one second resolution.
+  sleep(2);
+  time_t start = DatabaseEntity::GetServerTime();
+  CPPUNIT_ASSERT_MESSAGE("Error in GetServerTime", start > 0);
+
+  // Only files located directly in the directory are touched.
+  std::vector<int> dirs(1, DirectoryEntry::FindPath(server, "dir_1"));
+  CPPUNIT_ASSERT_MESSAGE("Error in FindPath", dirs[0] > 0);
+  CPPUNIT_ASSERT_MESSAGE("Error in TouchByDirs",
+                         FileEntry::TouchByDirs(dirs) == 1);
+  CPPUNIT_ASSERT_MESSAGE("Error in Touch", DirectoryEntry::Touch(dirs) == 1);
+
+  CPPUNIT_ASSERT_MESSAGE("Error in DeleteNotSeenSince",
+                         FileEntry::DeleteNotSeenSince(server, start, 1) == 1);
+  CPPUNIT_ASSERT_MESSAGE("Error in DeleteNotSeenSince",
+                         FileEntry::DeleteNotSeenSince(server, start, 10) == 1);
+  CPPUNIT_ASSERT_MESSAGE("Error in DeleteNotSeenSince",
+                         FileEntry::DeleteNotSeenSince(server, start, 10) == 0);
+
+  CPPUNIT_ASSERT(FileEntry::GetByPathOnServer("dir_1/file", server));
+  CPPUNIT_ASSERT(!FileEntry::GetByPathOnServer("dir_1/sub/nested", server));
+  CPPUNIT_ASSERT(!FileEntry::GetByPathOnServer("dir%1/other", server));
+
+  // Directories are deleted after their files, seen ones are kept.
+  CPPUNIT_ASSERT_MESSAGE("Error in DeleteNotSeenSince",
+                         DirectoryEntry::DeleteNotSeenSince(server, start,
+                                                            10) == 2);
+  CPPUNIT_ASSERT(DirectoryEntry::FindPath(server, "dir_1") == dirs[0]);
+  CPPUNIT_ASSERT(DirectoryEntry::FindPath(server, "dir_1/sub") == -1);
+  CPPUNIT_ASSERT(DirectoryEntry::FindPath(server, "dir%1") == -1);
+}
+
 void FileAttributeTest::setUp() {
   CPPUNIT_ASSERT_MESSAGE("Error in reading configuration files",
                          read_database_config(&name_, &server_, &user_,
@@ -131,3 +190,63 @@ void FileParameterTest::ConstructorsTestCase() {
   CPPUNIT_ASSERT_MESSAGE("FileParameter", param);
   CPPUNIT_ASSERT_MESSAGE("Wrong number of parameters", param->size() == 1);
 }
+
+void DirectoryEntryTest::setUp() {
+  CPPUNIT_ASSERT_MESSAGE("Error in reading configuration files",
+                         read_database_config(&name_, &server_, &user_,
+                                              &password_,
+                                              "../" DATABASE_CONFIG) == 0);
+}
+
+void DirectoryEntryTest::ConstructorsTestCase() {
+  CPPUNIT_ASSERT_MESSAGE("Connect to data base",
+                         DatabaseEntity::ConnectToServer(name_, server_, user_,
+                                                         password_, false));
+
+  std::string path("path/to/test_dir");
+  std::string server("test.server");
+  DirectoryEntry(server, path, 1000, 5);
+
+  // Signature of existing directory should be updated.
+  DirectoryEntry(server, path, 2000, 6);
+
+  auto dirs = DirectoryEntry::GetByServer(server);
+  CPPUNIT_ASSERT_MESSAGE("Error in GetByServer", dirs);
+
+  int found = 0;
+  for (std::shared_ptr<DirectoryEntry> dir : *dirs) {
+    if (dir->get_dir_path() != path)
+      continue;
+    ++found;
+    CPPUNIT_ASSERT_MESSAGE("Error in server",
+                           dir->get_server_name() == server);
+    CPPUNIT_ASSERT_MESSAGE("Error in mtime", dir->get_mtime() == 2000);
+    CPPUNIT_ASSERT_MESSAGE("Error in child count",
+                           dir->get_child_count() == 6);
+    CPPUNIT_ASSERT_MESSAGE("Error in name", dir->get_name() == "test_dir");
+  }
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of directories", found == 1);
+
+  // Parents are stored once and files refer to their directories.
+  int id = DirectoryEntry::FindPath(server, path);
+  int parent = DirectoryEntry::FindPath(server, "path/to");
+  CPPUNIT_ASSERT_MESSAGE("Error in FindPath", id > 0 && parent > 0);
+  CPPUNIT_ASSERT_MESSAGE("Error in ResolvePath",
+                         DirectoryEntry::ResolvePath(server, path) == id);
+  CPPUNIT_ASSERT_MESSAGE("Error in Resolve",
+                         DirectoryEntry::Resolve(server, parent,
+                                                 "test_dir") == id);
+  CPPUNIT_ASSERT_MESSAGE("Error in PathOf",
+                         DirectoryEntry::PathOf(id) == path);
+  CPPUNIT_ASSERT_MESSAGE("Error in FindPath",
+                         DirectoryEntry::FindPath(server, "path/none") == -1);
+
+  FileEntry file("test file", path + "/test_file", server);
+  CPPUNIT_ASSERT_MESSAGE("Error in dir id", file.get_dir_id() == id);
+  CPPUNIT_ASSERT_MESSAGE("Error in base name",
+                         file.get_base_name() == "test_file");
+  std::shared_ptr<FileEntry> db_file = FileEntry::GetById(file.get_id());
+  CPPUNIT_ASSERT_MESSAGE("Error in GetById", db_file);
+  CPPUNIT_ASSERT_MESSAGE("Error in path",
+                         db_file->get_file_path() == path + "/test_file");
+}
@@ -37,10 +37,12 @@ class FileEntryTest : public CppUnit::TestFixture {
  public:
   void setUp();
   void GetByPathOnServerTestCase();
+  void SweepTestCase();
 
  private:
   CPPUNIT_TEST_SUITE(FileEntryTest);
   CPPUNIT_TEST(GetByPathOnServerTestCase);
+  CPPUNIT_TEST(SweepTestCase);
   CPPUNIT_TEST_SUITE_END();
 
   std::string name_;
@@ -81,4 +83,20 @@ class FileParameterTest : public CppUnit::TestFixture {
   std::string password_;
 };
 
+class DirectoryEntryTest : public CppUnit::TestFixture {
+ public:
+  void setUp();
+  void ConstructorsTestCase();
+
+ private:
+  CPPUNIT_TEST_SUITE(DirectoryEntryTest);
+  CPPUNIT_TEST(ConstructorsTestCase);
+  CPPUNIT_TEST_SUITE_END();
+
+  std::string name_;
+  std::string server_;
+  std::string user_;
+  std::string password_;
+};
+
 #endif  // TEST_DATASTORAGETEST_H_
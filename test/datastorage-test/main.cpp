@@ -31,6 +31,7 @@
 CPPUNIT_TEST_SUITE_REGISTRATION(FileEntryTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(FileAttributeTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(FileParameterTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(DirectoryEntryTest);
 
 int main() {
   CppUnit::TextUi::TestRunner runner;
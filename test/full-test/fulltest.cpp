@@ -37,6 +37,7 @@ CPPUNIT_TEST_SUITE_REGISTRATION(AbstractSocketTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(FileEntryTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(FileAttributeTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(FileParameterTest);
+CPPUNIT_TEST_SUITE_REGISTRATION(DirectoryEntryTest);
 CPPUNIT_TEST_SUITE_REGISTRATION(ServerQueueTest);
 
 int main() {
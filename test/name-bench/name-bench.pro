@@ -0,0 +1,4 @@
+TEMPLATE = app
+TARGET = namebench
+SOURCES += namebench.cpp
+OTHER_FILES += Makefile
@@ -0,0 +1,181 @@
+/*
+ * Copyright (c) 2013 Morgen Matvey, Yulugin Evgeny and others.
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in the
+ *     documentation and/or other materials provided with the distribution.
+ *   * The names of its contributors may be used to endorse or promote products
+ *     derived from this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ * ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+ * DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ * ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+ * (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+ * LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ * ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ * SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "common-inl.h"
+#include "spider/nameanalyzer.h"
+#include "spider/utf8.h"
+
+// Benchmark of analysis of file names: the former underscore replacement
+// of Spider::NameParser against NameAnalyzer, vectorized byte
+// classification against the scalar one and UTF-8 validation. Names are generated from
+// command line parameters, so results are reproducible.
+//
+// Usage: namebench [-n names] [-r rounds] [-l long-names-percent]
+
+namespace {
+
+// The last two words are "Фото" and "отчет" in UTF-8.
+const char *kWords[] = { "Photo", "report", "IMG", "backup", "Draft",
+                         "final", "HTMLPage", "v", "notes", "Q",
+                         "\xd0\xa4\xd0\xbe\xd1\x82\xd0\xbe",
+                         "\xd0\xbe\xd1\x82\xd1\x87\xd0\xb5\xd1\x82" };
+const char *kSeparators[] = { "_", "-", " ", ".", "" };
+const char *kExtensions[] = { ".jpg", ".PDF", ".tar.gz", ".docx", "" };
+
+std::vector<std::string> MakeNames(const int count, const int long_percent) {
+  std::vector<std::string> names;
+  unsigned seed = 1;
+  auto next = [&seed](const unsigned range) {
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) % range;
+  };
+  for (int i = 0; i < count; ++i) {
+    // Long names of downloads and exports have tens of underscores.
+    int words = static_cast<int>(next(100)) < long_percent ? 40 :
+                1 + next(6);
+    std::string name;
+    for (int j = 0; j < words; ++j) {
+      name += kWords[next(sizeof(kWords) / sizeof(*kWords))];
+      if (next(3) == 0)
+        name += std::to_string(next(2020));
+      name += kSeparators[next(sizeof(kSeparators) / sizeof(*kSeparators))];
+    }
+    name += kExtensions[next(sizeof(kExtensions) / sizeof(*kExtensions))];
+    names.push_back(name);
+  }
+  return names;
+}
+
+// Former NameParser: each replacement searches from the beginning.
+void ReplaceUnderscores(std::string *name) {
+  size_t pos;
+  while ((pos = name->find("_")) != std::string::npos)
+    name->replace(pos, 1, " ");
+}
+
+double Seconds(const std::chrono::steady_clock::time_point start) {
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() > 0 ? elapsed.count() : 1e-9;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  int count = 100000, rounds = 10, long_percent = 5;
+  int option;
+  while ((option = getopt(argc, argv, "n:r:l:")) != -1) {
+    switch (option) {
+      case 'n': count = atoi(optarg); break;
+      case 'r': rounds = atoi(optarg); break;
+      case 'l': long_percent = atoi(optarg); break;
+      default:
+        fprintf(stderr, "Usage: %s [-n names] [-r rounds] "
+                "[-l long-names-percent]\n", argv[0]);
+        return 1;
+    }
+  }
+  if (count < 1 || rounds < 1)
+    return 1;
+
+  std::vector<std::string> names = MakeNames(count, long_percent);
+  size_t bytes = 0;
+  for (const std::string &name : names)
+    bytes += name.size();
+  double total = static_cast<double>(count) * rounds;
+  double megabytes = static_cast<double>(bytes) * rounds / (1 << 20);
+  printf("names: %d, average length: %.1f, rounds: %d\n", count,
+         static_cast<double>(bytes) / count, rounds);
+
+  // Checksums keep the compiler from dropping the work.
+  size_t checksum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (const std::string &name : names) {
+      std::string parsed = name;
+      ReplaceUnderscores(&parsed);
+      checksum += parsed.size();
+    }
+  }
+  double seconds = Seconds(start);
+  printf("replace:  %.3f s, %.0f names/s, %.1f MiB/s\n", seconds,
+         total / seconds, megabytes / seconds);
+
+  NameAnalyzer analyzer;
+  size_t tokens = 0;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (const std::string &name : names) {
+      tokens += analyzer.Analyze(name);
+      checksum += analyzer.Join().size();
+    }
+  }
+  seconds = Seconds(start);
+  printf("analyze:  %.3f s, %.0f names/s, %.1f MiB/s, %.1f tokens/name\n",
+         seconds, total / seconds, megabytes / seconds, tokens / total);
+
+  std::vector<unsigned char> classes(bytes);
+  std::string folded(bytes, 0);
+  std::string all;
+  all.reserve(bytes);
+  for (const std::string &name : names)
+    all += name;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    NameAnalyzer::ClassifyScalar(all.data(), bytes, classes.data(),
+                                 &folded[0]);
+    checksum += classes[round % bytes];
+  }
+  seconds = Seconds(start);
+  printf("scalar:   %.3f s, %.1f MiB/s\n", seconds, megabytes / seconds);
+
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    NameAnalyzer::Classify(all.data(), bytes, classes.data(), &folded[0]);
+    checksum += classes[round % bytes];
+  }
+  seconds = Seconds(start);
+  printf("classify: %.3f s, %.1f MiB/s\n", seconds, megabytes / seconds);
+
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < rounds; ++round) {
+    for (const std::string &name : names)
+      checksum += Utf8::Validate(name.data(), name.size());
+  }
+  seconds = Seconds(start);
+  printf("validate: %.3f s, %.0f names/s, %.1f MiB/s\n", seconds,
+         total / seconds, megabytes / seconds);
+
+  return checksum == 0;
+}
@@ -29,12 +29,34 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <signal.h>
+#include <string.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
 
 #include "config.h"
 #include "common-inl.h"
 #include "spidertest.h"
+#include "spider/workstealingqueue.h"
+#include "spider/mimesniffer.h"
+#include "spider/extensiontable.h"
+#include "spider/mimecache.h"
+#include "spider/fetchqueue.h"
+#include "spider/filebatch.h"
+#include "spider/crawlstats.h"
+#include "spider/mpmcqueue.h"
+#include "spider/checkpoint.h"
+#include "spider/throttle.h"
+#include "spider/posixsource.h"
+#include "spider/fingerprint.h"
+#include "spider/contenthash.h"
+#include "spider/nameanalyzer.h"
+#include "spider/pathfilter.h"
+#include "spider/utf8.h"
+#include "hash-inl.h"
 #include "scheduler/schedulerserver.h"
 
 SpiderTest::SpiderTest() : Spider() {}
@@ -78,12 +100,21 @@ void SpiderTest::ServerInteractionTestCase() {
     CPPUNIT_ASSERT(serv.is_error() == 0);
     serv.Run();
   } else {
-    ServerManager pserver_manager("localhost");
-    
+    ServerManager pserver_manager("localhost", 2);
+
     CPPUNIT_ASSERT(pserver_manager.GetServer() == "test2");
-    pserver_manager.ReleaseServer();
-    CPPUNIT_ASSERT(pserver_manager.GetServer() == "test1");
-    pserver_manager.ReleaseServer();
+    pserver_manager.ReleaseServer("test2");
+    CPPUNIT_ASSERT(pserver_manager.get_leases() == 0);
+
+    // Both servers are leased at once.
+    std::string first = pserver_manager.GetServer();
+    std::string second = pserver_manager.GetServer();
+    CPPUNIT_ASSERT(first != second);
+    CPPUNIT_ASSERT(pserver_manager.get_leases() == 2);
+    pserver_manager.ReleaseServer(first);
+    CPPUNIT_ASSERT(pserver_manager.get_leases() == 1);
+    pserver_manager.ReleaseServer(second);
+    CPPUNIT_ASSERT(pserver_manager.get_leases() == 0);
   }
 }
 
@@ -104,7 +135,7 @@ void SpiderTest::ScanSMBDirTestCase() {
   CPPUNIT_ASSERT_MESSAGE("test_folder/test_file not found",
                          files[1] == dir + "/test_folder/test_file");
   CPPUNIT_ASSERT_MESSAGE("Wrong number of search elements",
-                         *get_last() == files[2]);
+                         files.size() == 2);
 }
 
 void SpiderTest::NameParserTestCase() {
@@ -113,6 +144,16 @@ void SpiderTest::NameParserTestCase() {
   CPPUNIT_ASSERT(!NameParser(&str));
   CPPUNIT_ASSERT_MESSAGE("Wrong parsing", !strcmp(str.c_str(),
                                                   "some short string"));
+  str = "MyPhotos_2019-HDRImage.JPG";
+  CPPUNIT_ASSERT(!NameParser(&str));
+  CPPUNIT_ASSERT(str == "my photos 2019 hdr image jpg");
+  str = "___";
+  CPPUNIT_ASSERT(!NameParser(&str));
+  CPPUNIT_ASSERT(str == "___");
+  // "Фото.JPG" in CP1251 is stored in UTF-8.
+  str = "\xd4\xee\xf2\xee.JPG";
+  CPPUNIT_ASSERT(!NameParser(&str));
+  CPPUNIT_ASSERT(str == "\xd1\x84\xd0\xbe\xd1\x82\xd0\xbe jpg");
 
   SpiderTest spider;
   // Try to parse empthy string
@@ -177,7 +218,7 @@ void SpiderTest::DumpToDataBaseTestCase() {
 
   auto db_file = FileEntry::GetByPathOnServer("path/to/file1", "some.server");
   CPPUNIT_ASSERT_MESSAGE("No such entry in data base", db_file);
-  CPPUNIT_ASSERT_MESSAGE("FileEntry name", "file1" == db_file->get_name());
+  CPPUNIT_ASSERT_MESSAGE("FileEntry name", "file 1" == db_file->get_name());
   CPPUNIT_ASSERT_MESSAGE("FileEntry path",
                          "path/to/file1" == db_file->get_file_path());
   CPPUNIT_ASSERT_MESSAGE("FileEntry server",
@@ -186,7 +227,7 @@ void SpiderTest::DumpToDataBaseTestCase() {
                          current_time.tv_sec <= db_file->get_timestamp());
 
   db_file = FileEntry::GetByPathOnServer("path/to/file2", "some.server");
-  CPPUNIT_ASSERT_MESSAGE("FileEntry name", "file2" == db_file->get_name());
+  CPPUNIT_ASSERT_MESSAGE("FileEntry name", "file 2" == db_file->get_name());
   CPPUNIT_ASSERT_MESSAGE("FileEntry path",
                          "path/to/file2" == db_file->get_file_path());
   CPPUNIT_ASSERT_MESSAGE("FileEntry server",
@@ -210,3 +251,870 @@ void SpiderTest::DetectMimeTypeTestCase() {
   CPPUNIT_ASSERT_MESSAGE("PDF file not recognized",
                          !strcmp(type, "application/pdf"));
 }
+
+void SpiderTest::WorkStealingQueueTestCase() {
+  const int kWorkers = 4;
+  const int kDepth = 10;
+  WorkStealingQueue<int> queue(kWorkers);
+  std::atomic<int> processed(0);
+
+  // All tasks are put in the deque of the first worker, the others
+  // should steal them. Every task with depth less than kDepth produces
+  // two new tasks, so full binary tree should be processed.
+  queue.Push(0, 0);
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kWorkers; ++i) {
+    threads.push_back(std::thread([&queue, &processed, i]() {
+      int depth;
+      while (queue.Pop(i, &depth)) {
+        if (depth < kDepth) {
+          queue.Push(i, depth + 1);
+          queue.Push(i, depth + 1);
+        }
+        ++processed;
+        queue.Finish();
+      }
+    }));
+  }
+
+  for (std::thread &thread : threads)
+    thread.join();
+
+  CPPUNIT_ASSERT_MESSAGE("Wrong number of processed tasks",
+                         processed == (1 << (kDepth + 1)) - 1);
+  CPPUNIT_ASSERT(queue.get_pending() == 0);
+}
+
+void SpiderTest::MimeSnifferTestCase() {
+  unsigned char header[HEADERSIZE + MimeSniffer::kPadding] = {0};
+
+  memcpy(header, "\x89PNG\r\n\x1a\n", 8);
+  const char *type = MimeSniffer::Sniff(header, 64);
+  CPPUNIT_ASSERT(type != NULL && !strcmp(type, "image/png"));
+
+  // Bytes at offsets 4-7 of RIFF are the size of the chunk.
+  memset(header, 0, sizeof(header));
+  memcpy(header, "RIFF\x10\x20\x30\x40WAVE", 12);
+  type = MimeSniffer::Sniff(header, 64);
+  CPPUNIT_ASSERT(type != NULL && !strcmp(type, "audio/x-wav"));
+
+  // Signature of tar is not at the beginning of the header.
+  memset(header, 0, sizeof(header));
+  memcpy(header + 257, "ustar", 5);
+  type = MimeSniffer::Sniff(header, HEADERSIZE);
+  CPPUNIT_ASSERT(type != NULL && !strcmp(type, "application/x-tar"));
+  CPPUNIT_ASSERT(MimeSniffer::Sniff(header, 200) == NULL);
+
+  // Unknown data are left to libmagic.
+  memset(header, 'a', HEADERSIZE);
+  CPPUNIT_ASSERT(MimeSniffer::Sniff(header, HEADERSIZE) == NULL);
+  CPPUNIT_ASSERT(MimeSniffer::Sniff(header, 0) == NULL);
+}
+
+void SpiderTest::ExtensionTableTestCase() {
+  ExtensionTable table;
+  CPPUNIT_ASSERT(table.get_size() > 0);
+
+  const ExtensionTable::Entry *entry = table.Find("smb://host/share/a.MKV");
+  CPPUNIT_ASSERT(entry != NULL && entry->mime_type == "video/x-matroska");
+  CPPUNIT_ASSERT(entry->policy == ExtensionTable::epSkip);
+
+  // Files without extensions and hidden files.
+  CPPUNIT_ASSERT(table.Find("smb://host/share/mkv") == NULL);
+  CPPUNIT_ASSERT(table.Find("smb://host/share/.mkv") == NULL);
+  CPPUNIT_ASSERT(table.Find("smb://host/share.mkv/file") == NULL);
+  CPPUNIT_ASSERT(table.Find("smb://host/share/a.mkvv") == NULL);
+
+  char config[] = "/tmp/extensionsXXXXXX";
+  int fd = mkstemp(config);
+  CPPUNIT_ASSERT(fd != -1);
+  const char kConfig[] = "# comment\n\nmkv video/webm always\n"
+                         "txt text/plain sample\nwrong line\n";
+  CPPUNIT_ASSERT(write(fd, kConfig, sizeof(kConfig) - 1) ==
+                 sizeof(kConfig) - 1);
+  close(fd);
+
+  CPPUNIT_ASSERT(table.Load(config) == 0);
+  unlink(config);
+
+  // Extensions from config replace built-in ones.
+  entry = table.Find("a.mkv");
+  CPPUNIT_ASSERT(entry != NULL && entry->mime_type == "video/webm");
+  CPPUNIT_ASSERT(entry->policy == ExtensionTable::epAlways);
+  entry = table.Find("a.txt");
+  CPPUNIT_ASSERT(entry != NULL && entry->policy == ExtensionTable::epSample);
+  CPPUNIT_ASSERT(table.Find("a.mp3") != NULL);
+
+  CPPUNIT_ASSERT(table.Load(config) == -1);
+  CPPUNIT_ASSERT(table.get_error() == ENOENT);
+}
+
+void SpiderTest::MimeCacheTestCase() {
+  const int kFiles = 1000;
+  char path[] = "/tmp/mimecacheXXXXXX";
+  int fd = mkstemp(path);
+  CPPUNIT_ASSERT(fd != -1);
+  close(fd);
+
+  std::string mime_type;
+  uint64_t key = MimeCache::MakeKey("smb://host/share/file");
+  {
+    MimeCache cache;
+    CPPUNIT_ASSERT(cache.Open(path, 64, 4) == 0);
+    CPPUNIT_ASSERT(cache.get_capacity() == 64);
+
+    CPPUNIT_ASSERT(!cache.Find(key, 10, 20, &mime_type));
+    cache.Store(key, 10, 20, "text/plain");
+    CPPUNIT_ASSERT(cache.Find(key, 10, 20, &mime_type));
+    CPPUNIT_ASSERT(mime_type == "text/plain");
+
+    // Modified file isn't found.
+    CPPUNIT_ASSERT(!cache.Find(key, 11, 20, &mime_type));
+    CPPUNIT_ASSERT(!cache.Find(key, 10, 21, &mime_type));
+
+    // Fingerprint and content hash are kept with the mime type.
+    uint64_t fingerprint = 0, content_hash = 0;
+    cache.Store(key, 10, 20, "text/plain", 42);
+    CPPUNIT_ASSERT(cache.Find(key, 10, 20, &mime_type, &fingerprint));
+    CPPUNIT_ASSERT(fingerprint == 42);
+    cache.Store(key, 10, 20, "text/plain", 42, 43);
+    CPPUNIT_ASSERT(cache.Find(key, 10, 20, &mime_type, &fingerprint,
+                              &content_hash));
+    CPPUNIT_ASSERT(fingerprint == 42 && content_hash == 43);
+
+    // Cache can't contain more than its capacity.
+    int found = 0;
+    for (int i = 0; i < kFiles; ++i) {
+      cache.Store(MimeCache::MakeKey(std::to_string(i)), i, i, "a/b");
+    }
+    for (int i = 0; i < kFiles; ++i) {
+      found += cache.Find(MimeCache::MakeKey(std::to_string(i)), i, i,
+                          &mime_type);
+    }
+    CPPUNIT_ASSERT(found > 0 && found <= 64);
+    cache.Store(key, 10, 20, "text/plain");
+  }
+
+  // Entries persist after the cache is reopened.
+  MimeCache cache;
+  CPPUNIT_ASSERT(cache.Open(path, 64, 4) == 0);
+  CPPUNIT_ASSERT(cache.Find(key, 10, 20, &mime_type));
+  CPPUNIT_ASSERT(mime_type == "text/plain");
+
+  // Cache with other geometry is cleared.
+  CPPUNIT_ASSERT(cache.Open(path, 128, 4) == 0);
+  CPPUNIT_ASSERT(!cache.Find(key, 10, 20, &mime_type));
+
+  cache.Close();
+  unlink(path);
+}
+
+void SpiderTest::FetchQueueTestCase() {
+  const int kFetchers = 6;
+  const int kRequests = 1000;
+  const int kPerServer = 2;
+  FetchQueue queue(8, kPerServer);
+  std::atomic<int> processed(0), in_flight(0), max_in_flight(0);
+
+  CPPUNIT_ASSERT(FetchQueue::ServerOf("smb://host/share/file") == "host");
+  CPPUNIT_ASSERT(FetchQueue::ServerOf("smb://host") == "host");
+
+  // Requests to the slow server shouldn't occupy more than kPerServer
+  // fetchers.
+  std::vector<std::thread> threads;
+  for (int i = 0; i < kFetchers; ++i) {
+    threads.push_back(std::thread([&]() {
+      FetchRequest request;
+      while (queue.Pop(&request)) {
+        if (request.server == "slow") {
+          int current = ++in_flight;
+          int max = max_in_flight;
+          while (current > max &&
+                 !max_in_flight.compare_exchange_weak(max, current)) {}
+          usleep(100);
+          --in_flight;
+        }
+        ++processed;
+        queue.Done(request);
+      }
+    }));
+  }
+
+  for (int i = 0; i < kRequests; ++i) {
+    FetchRequest request = { i % 2 ? "smb://slow/a" : "smb://fast/a", 0, 0,
+                             "", "", NULL };
+    CPPUNIT_ASSERT(queue.Push(request));
+  }
+  queue.Close();
+
+  for (std::thread &thread : threads)
+    thread.join();
+
+  CPPUNIT_ASSERT(processed == kRequests);
+  CPPUNIT_ASSERT(max_in_flight <= kPerServer);
+  CPPUNIT_ASSERT(queue.get_size() == 0 && queue.get_in_flight() == 0);
+
+  FetchRequest request = { "smb://fast/a", 0, 0, "", "", NULL };
+  CPPUNIT_ASSERT(!queue.Push(request));
+
+  // Batches are gathered from requests to one server within its limit.
+  FetchQueue batch(16, 2);
+  FetchRequest a = { "file://local/a", 0, 0, "", "", NULL };
+  FetchRequest b = { "smb://host/b", 0, 0, "", "", NULL };
+  CPPUNIT_ASSERT(batch.Push(a) && batch.Push(b) && batch.Push(a) &&
+                 batch.Push(a));
+  CPPUNIT_ASSERT(batch.Pop(&request) && request.server == "local");
+  CPPUNIT_ASSERT(batch.TryPop("local", &request));
+  CPPUNIT_ASSERT(request.path == a.path);
+  CPPUNIT_ASSERT(!batch.TryPop("local", &request));
+  CPPUNIT_ASSERT(!batch.TryPop("other", &request));
+  CPPUNIT_ASSERT(batch.get_size() == 2 && batch.get_in_flight() == 2);
+
+  // Ready servers are taken round robin, so a long queue of one server
+  // doesn't delay requests to others.
+  FetchQueue fair(16, 4);
+  CPPUNIT_ASSERT(fair.Push(b) && fair.Push(b) && fair.Push(b) &&
+                 fair.Push(a));
+  CPPUNIT_ASSERT(fair.Pop(&request) && request.server == "host");
+  CPPUNIT_ASSERT(fair.Pop(&request) && request.server == "local");
+  CPPUNIT_ASSERT(fair.Pop(&request) && request.server == "host");
+  fair.Done(request);
+  CPPUNIT_ASSERT(fair.get_size() == 1 && fair.get_in_flight() == 2);
+
+  // Optional requests are dropped when the queue of their server is
+  // full, other servers aren't affected.
+  FetchQueue full(1, 1);
+  full.Open();
+  CPPUNIT_ASSERT(full.TryPush(a));
+  CPPUNIT_ASSERT(!full.TryPush(a));
+  CPPUNIT_ASSERT(full.Push(b));
+  CPPUNIT_ASSERT(full.get_size() == 2);
+}
+
+void SpiderTest::MPMCQueueTestCase() {
+  const int kProducers = 4;
+  const int kConsumers = 4;
+  const int kItems = 100000;
+  MPMCQueue<std::string> queue(100);
+  CPPUNIT_ASSERT(queue.get_capacity() == 128);
+
+  // Every item should be taken exactly once.
+  std::atomic<long long> sum(0);  // NOLINT(runtime/int)
+  std::atomic<int> count(0);
+  std::vector<std::thread> consumers, producers;
+  for (int i = 0; i < kConsumers; ++i) {
+    consumers.push_back(std::thread([&queue, &sum, &count]() {
+      std::string item;
+      while (queue.Pop(&item)) {
+        sum += std::stoll(item);
+        ++count;
+      }
+    }));
+  }
+  for (int i = 0; i < kProducers; ++i) {
+    producers.push_back(std::thread([&queue, i]() {
+      for (int j = 0; j < kItems; ++j)
+        queue.Push(std::to_string(i * kItems + j));
+    }));
+  }
+
+  for (std::thread &producer : producers)
+    producer.join();
+  queue.Close();
+  for (std::thread &consumer : consumers)
+    consumer.join();
+
+  long long total = kProducers * kItems;  // NOLINT(runtime/int)
+  CPPUNIT_ASSERT(count == total);
+  CPPUNIT_ASSERT(sum == total * (total - 1) / 2);
+  CPPUNIT_ASSERT(queue.get_size() == 0);
+  CPPUNIT_ASSERT(queue.get_pushed() == queue.get_popped());
+
+  std::string item;
+  CPPUNIT_ASSERT(!queue.Pop(&item));
+  CPPUNIT_ASSERT(queue.TryPush("1") && queue.TryPop(&item) && item == "1");
+
+  // Sleeping consumer is woken up by a push or by closing of the queue.
+  queue.Open();
+  CPPUNIT_ASSERT(!queue.Pop(&item, std::chrono::milliseconds(10)));
+  std::thread producer([&queue]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    queue.Push("2");
+  });
+  auto start = std::chrono::steady_clock::now();
+  CPPUNIT_ASSERT(queue.Pop(&item, std::chrono::seconds(10)) && item == "2");
+  CPPUNIT_ASSERT(std::chrono::steady_clock::now() - start <
+                 std::chrono::seconds(5));
+  producer.join();
+  std::thread closer([&queue]() {
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    queue.Close();
+  });
+  start = std::chrono::steady_clock::now();
+  CPPUNIT_ASSERT(!queue.Pop(&item, std::chrono::seconds(10)));
+  CPPUNIT_ASSERT(std::chrono::steady_clock::now() - start <
+                 std::chrono::seconds(5));
+  closer.join();
+}
+
+void SpiderTest::CheckpointTestCase() {
+  char path[] = "/tmp/checkpointXXXXXX";
+  int fd = mkstemp(path);
+  CPPUNIT_ASSERT(fd != -1);
+  close(fd);
+
+  {
+    Checkpoint checkpoint;
+    CPPUNIT_ASSERT(checkpoint.Begin(path, "host", 1000) == 0);
+
+    // Root with two subdirectories, one of them has a subdirectory
+    // with a space in its name and two files.
+    DirTask root = { "smb://host", 0, 0 }, a = { "smb://host/a", 0, 0 },
+            b = { "smb://host/b", 0, 0 }, c = { "smb://host/a/c d", 5, 0 };
+    checkpoint.AddDir(root);
+    checkpoint.AddDir(a);
+    checkpoint.AddDir(b);
+    checkpoint.ListedDir(root.path, DirSignature(), 0);
+    checkpoint.AddDir(c);
+    DirSignature signature = { 10, 3 };
+    checkpoint.ListedDir(a.path, signature, 2);
+
+    checkpoint.CommittedFiles(a.path, 1);
+    checkpoint.CommittedFiles(a.path, 1);
+    // The spider is interrupted here.
+  }
+
+  Checkpoint checkpoint;
+  CPPUNIT_ASSERT(checkpoint.Resume(path, "other") == -1);
+  CPPUNIT_ASSERT(checkpoint.Resume(path, "host") == 0);
+  CPPUNIT_ASSERT(checkpoint.get_start() == 1000);
+
+  // Uncommitted directories are scanned again.
+  const std::vector<DirTask> &frontier = checkpoint.get_frontier();
+  CPPUNIT_ASSERT(frontier.size() == 2);
+  CPPUNIT_ASSERT(frontier[0].path == "smb://host/b");
+  CPPUNIT_ASSERT(frontier[1].path == "smb://host/a/c d");
+  CPPUNIT_ASSERT(frontier[1].mtime == 5);
+
+  CPPUNIT_ASSERT(checkpoint.get_committed().size() == 2);
+  CPPUNIT_ASSERT(checkpoint.WasCommitted("smb://host/a"));
+  CPPUNIT_ASSERT(!checkpoint.WasCommitted("smb://host/b"));
+
+  // Finished scan can't be resumed.
+  checkpoint.Finish();
+  CPPUNIT_ASSERT(access(path, F_OK) == -1);
+  CPPUNIT_ASSERT(checkpoint.Resume(path, "host") == -1);
+}
+
+void SpiderTest::ThrottleTestCase() {
+  // The limit grows by one per limit successful requests up to maximum.
+  ServerThrottle throttle(1e6, 1e6, 1, 8, 2.0);
+  CPPUNIT_ASSERT(throttle.get_limit() == 1);
+  for (int i = 0; i < 100; ++i) {
+    throttle.Acquire();
+    CPPUNIT_ASSERT(throttle.get_in_flight() == 1);
+    throttle.Release(0.01, false, ServerThrottle::srMetadata);
+  }
+  CPPUNIT_ASSERT(throttle.get_limit() == 8);
+  CPPUNIT_ASSERT(throttle.get_in_flight() == 0);
+
+  // Failures halve the limit once per latency.
+  throttle.Acquire();
+  throttle.Release(0.01, true, ServerThrottle::srMetadata);
+  CPPUNIT_ASSERT(throttle.get_limit() == 4);
+  throttle.Acquire();
+  throttle.Release(0.01, true, ServerThrottle::srMetadata);
+  CPPUNIT_ASSERT(throttle.get_limit() == 4);
+  CPPUNIT_ASSERT(throttle.get_failures() == 2);
+  CPPUNIT_ASSERT(throttle.get_requests() == 102);
+
+  // Latency above the baseline is congestion too.
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  for (int i = 0; i < 20; ++i) {
+    throttle.Acquire();
+    throttle.Release(0.1, false, ServerThrottle::srMetadata);
+  }
+  CPPUNIT_ASSERT(throttle.get_latency(ServerThrottle::srMetadata) >
+                 2 * throttle.get_baseline(ServerThrottle::srMetadata));
+  CPPUNIT_ASSERT(static_cast<int>(throttle.get_limit()) == 2);
+
+  // Slow requests of another kind are compared with their own baseline,
+  // durations of bulk reads are ignored.
+  ServerThrottle mixed(1e6, 1e6, 1, 8, 2.0);
+  for (int i = 0; i < 100; ++i) {
+    mixed.Acquire();
+    mixed.Release(0.01, false, ServerThrottle::srMetadata);
+    mixed.Acquire();
+    mixed.Release(1, false, ServerThrottle::srListing);
+    mixed.Acquire();
+    mixed.Release(i % 2 == 0 ? 0.01 : 10, false, ServerThrottle::srBulk);
+  }
+  CPPUNIT_ASSERT(mixed.get_limit() == 8);
+  CPPUNIT_ASSERT(mixed.get_baseline(ServerThrottle::srListing) == 1);
+  CPPUNIT_ASSERT(mixed.get_latency(ServerThrottle::srBulk) == 0);
+  mixed.Acquire();
+  mixed.Release(0.01, true, ServerThrottle::srBulk);
+  CPPUNIT_ASSERT(mixed.get_limit() == 4);
+
+  // Requests over the limit wait for a free slot.
+  ServerThrottle serial(1e6, 1e6, 1, 1, 2.0);
+  std::atomic<bool> acquired(false);
+  serial.Acquire();
+  std::thread waiter([&serial, &acquired]() {
+    serial.Acquire();
+    acquired = true;
+    serial.Release(0.01, false, ServerThrottle::srMetadata);
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  CPPUNIT_ASSERT(!acquired);
+  serial.Release(0.01, false, ServerThrottle::srMetadata);
+  waiter.join();
+  CPPUNIT_ASSERT(acquired);
+
+  // Rate of requests is limited by the token bucket.
+  ServerThrottle slow(100, 1, 8, 8, 2.0);
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < 11; ++i) {
+    slow.Acquire();
+    slow.Release(0, false, ServerThrottle::srMetadata);
+  }
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  CPPUNIT_ASSERT(elapsed.count() >= 0.09);
+
+  // Servers are distinguished by smb paths.
+  Throttle servers;
+  CPPUNIT_ASSERT(servers.Get("smb://host/share/file") ==
+                 servers.Get("smb://host/other"));
+  CPPUNIT_ASSERT(servers.Get("smb://host") != servers.Get("smb://other"));
+  CPPUNIT_ASSERT(servers.Report().find("host: limit ") != std::string::npos);
+  CPPUNIT_ASSERT(Throttle::IsCongestion(ETIMEDOUT));
+  CPPUNIT_ASSERT(!Throttle::IsCongestion(ENOENT));
+  CPPUNIT_ASSERT(!Throttle::IsCongestion(EACCES));
+
+  // Bulk reads wait until debt of the server is paid off.
+  Bandwidth bandwidth(1e6, 0);
+  start = std::chrono::steady_clock::now();
+  bandwidth.Consume("smb://host/a", 50000);
+  bandwidth.Consume("smb://host/b", 50000);
+  elapsed = std::chrono::steady_clock::now() - start;
+  CPPUNIT_ASSERT(elapsed.count() >= 0.09);
+  Bandwidth unlimited(0, 0);
+  start = std::chrono::steady_clock::now();
+  unlimited.Consume("smb://host/a", 1 << 30);
+  elapsed = std::chrono::steady_clock::now() - start;
+  CPPUNIT_ASSERT(elapsed.count() < 0.05);
+  CPPUNIT_ASSERT(unlimited.Report() == "host: 1024 MiB");
+}
+
+void SpiderTest::PosixSourceTestCase() {
+  char root[] = "/tmp/posixsourceXXXXXX";
+  CPPUNIT_ASSERT(mkdtemp(root) != NULL);
+  std::string dir(root);
+  CPPUNIT_ASSERT(mkdir((dir + "/sub").c_str(), 0755) == 0);
+  int fd = open((dir + "/file").c_str(), O_WRONLY | O_CREAT, 0644);
+  CPPUNIT_ASSERT(fd != -1);
+  CPPUNIT_ASSERT(write(fd, "%PDF-1.4", 8) == 8);
+  close(fd);
+  CPPUNIT_ASSERT(symlink("file", (dir + "/link").c_str()) == 0);
+
+  // URLs of local sources.
+  std::string url = "file://local" + dir;
+  CPPUNIT_ASSERT(CrawlSource::IsLocal(url));
+  CPPUNIT_ASSERT(!CrawlSource::IsLocal("smb://host/share"));
+  CPPUNIT_ASSERT(CrawlSource::ServerOf(url) == "local");
+  CPPUNIT_ASSERT(CrawlSource::PathOf(url) == dir.substr(1));
+  CPPUNIT_ASSERT(CrawlSource::PathOf("smb://host") == "");
+  CPPUNIT_ASSERT(PosixSource::LocalPathOf(url) == dir);
+  CPPUNIT_ASSERT(FetchQueue::ServerOf(url + "/file") == "local");
+
+  // Listing with types, sizes and mtimes.
+  PosixSource source;
+  CrawlSource::Dir handle = source.OpenDir(url);
+  CPPUNIT_ASSERT(handle != NULL);
+  std::vector<DirEntry> entries, all;
+  int count;
+  while ((count = source.ReadDir(handle, &entries, 2)) > 0) {
+    CPPUNIT_ASSERT(count <= 2);
+    all.insert(all.end(), entries.begin(), entries.end());
+  }
+  CPPUNIT_ASSERT(count == 0);
+  CPPUNIT_ASSERT(source.CloseDir(handle) == 0);
+  CPPUNIT_ASSERT(all.size() == 3);
+  for (const DirEntry &entry : all) {
+    if (entry.name == "sub") {
+      CPPUNIT_ASSERT(entry.type == etDir);
+    } else if (entry.name == "file") {
+      CPPUNIT_ASSERT(entry.type == etFile);
+      CPPUNIT_ASSERT(entry.size == 8);
+      CPPUNIT_ASSERT(entry.mtime != 0);
+    } else {
+      CPPUNIT_ASSERT(entry.name == "link");
+      CPPUNIT_ASSERT(entry.type == etLink);
+    }
+  }
+
+  // Attributes and header of file.
+  struct stat st;
+  CPPUNIT_ASSERT(source.Stat(url + "/file", &st) == 0);
+  CPPUNIT_ASSERT(st.st_size == 8);
+  unsigned char header[16];
+  CPPUNIT_ASSERT(source.ReadHeader(url + "/file", header, sizeof(header)) == 8);
+  CPPUNIT_ASSERT(memcmp(header, "%PDF", 4) == 0);
+
+  // Batch of samples, the failed file doesn't break others.
+  const size_t kStride = Fingerprint::kBlocks * Fingerprint::kBlockSize;
+  std::vector<std::string> paths;
+  paths.push_back(url + "/file");
+  paths.push_back(url + "/none");
+  paths.push_back(url + "/file");
+  const off_t sizes[] = {8, 8, 8};
+  std::vector<unsigned char> samples(3 * kStride, 0xff);
+  ssize_t results[3];
+  source.ReadSamples(paths, sizes, samples.data(), kStride, results);
+  CPPUNIT_ASSERT(results[0] == 8 && results[2] == 8);
+  CPPUNIT_ASSERT(results[1] == -ENOENT);
+  CPPUNIT_ASSERT(memcmp(samples.data() + 2 * kStride, "%PDF", 4) == 0);
+  CPPUNIT_ASSERT(samples[2 * kStride + 8] == 0);
+  CPPUNIT_ASSERT(Fingerprint::Hash(8, samples.data()) ==
+                 Fingerprint::Hash(8, samples.data() + 2 * kStride));
+
+  // Errors.
+  CPPUNIT_ASSERT(source.OpenDir(url + "/none") == NULL);
+  CPPUNIT_ASSERT(source.get_error() == ENOENT);
+  CPPUNIT_ASSERT(source.ReadHeader(url + "/none", header, 4) == -1);
+  CPPUNIT_ASSERT(source.get_error() == ENOENT);
+
+  unlink((dir + "/link").c_str());
+  unlink((dir + "/file").c_str());
+  rmdir((dir + "/sub").c_str());
+  rmdir(root);
+}
+
+void SpiderTest::FingerprintTestCase() {
+  const off_t kBlock = Fingerprint::kBlockSize;
+  off_t offsets[Fingerprint::kBlocks];
+
+  // Small files have one block, others head, middle and tail.
+  CPPUNIT_ASSERT(Fingerprint::Offsets(kBlock, offsets) == 1);
+  CPPUNIT_ASSERT(offsets[0] == 0);
+  CPPUNIT_ASSERT(Fingerprint::Offsets(10 * kBlock, offsets) == 3);
+  CPPUNIT_ASSERT(offsets[0] == 0);
+  CPPUNIT_ASSERT(offsets[1] == 9 * kBlock / 2);
+  CPPUNIT_ASSERT(offsets[2] == 9 * kBlock);
+
+  // Hash depends on size and content of every block.
+  std::vector<unsigned char> blocks(Fingerprint::kBlocks * kBlock, 'a');
+  uint64_t hash = Fingerprint::Hash(10 * kBlock, blocks.data());
+  CPPUNIT_ASSERT(hash == Fingerprint::Hash(10 * kBlock, blocks.data()));
+  CPPUNIT_ASSERT(hash != Fingerprint::Hash(11 * kBlock, blocks.data()));
+  blocks[2 * kBlock + 1] = 'b';
+  CPPUNIT_ASSERT(hash != Fingerprint::Hash(10 * kBlock, blocks.data()));
+
+  // Bytes behind the end of a small file don't matter.
+  std::vector<unsigned char> other(blocks);
+  other[100] = 'c';
+  CPPUNIT_ASSERT(Fingerprint::Hash(100, blocks.data()) ==
+                 Fingerprint::Hash(100, other.data()));
+
+  CPPUNIT_ASSERT(Fingerprint::Format(8, 0xabc) == "8:0000000000000abc");
+}
+
+void SpiderTest::ContentHashTestCase() {
+  // Streaming hash is the same as hash of the whole data.
+  std::vector<unsigned char> data(10000);
+  for (size_t i = 0; i < data.size(); ++i)
+    data[i] = i * 7 + i / 251;
+  for (size_t step : { 1, 7, 32, 100, 4096 }) {
+    hash::Stream64 stream(5);
+    for (size_t i = 0; i < data.size(); i += step)
+      stream.Update(data.data() + i, std::min(step, data.size() - i));
+    CPPUNIT_ASSERT(stream.Digest() ==
+                   hash::Hash64(data.data(), data.size(), 5));
+  }
+
+  char path[] = "/tmp/contenthashXXXXXX";
+  int fd = mkstemp(path);
+  CPPUNIT_ASSERT(fd != -1);
+  CPPUNIT_ASSERT(write(fd, data.data(), data.size()) ==
+                 static_cast<ssize_t>(data.size()));
+  close(fd);
+
+  // Content is hashed by small chunks, blocks of the fingerprint are
+  // taken on the way.
+  PosixSource source;
+  Bandwidth bandwidth(0, 0);
+  ContentHasher hasher(100, &bandwidth);
+  std::string url = std::string("file://local") + path;
+  uint64_t content_hash = 0, fingerprint = 0;
+  CPPUNIT_ASSERT(hasher.Hash(&source, url, data.size(), &content_hash,
+                             &fingerprint) == 0);
+  CPPUNIT_ASSERT(content_hash == hash::Hash64(data.data(), data.size()));
+
+  const size_t kStride = Fingerprint::kBlocks * Fingerprint::kBlockSize;
+  std::vector<unsigned char> blocks(kStride);
+  off_t offsets[Fingerprint::kBlocks];
+  size_t count = Fingerprint::Offsets(data.size(), offsets);
+  CPPUNIT_ASSERT(source.ReadSample(url, offsets, count, blocks.data(),
+                                   Fingerprint::kBlockSize) >= 0);
+  CPPUNIT_ASSERT(fingerprint == Fingerprint::Hash(data.size(),
+                                                  blocks.data()));
+  CPPUNIT_ASSERT(bandwidth.Report() == "local: 0 MiB");
+
+  // Modified and missing files aren't hashed.
+  CPPUNIT_ASSERT(hasher.Hash(&source, url, data.size() - 1, &content_hash,
+                             &fingerprint) == -1);
+  CPPUNIT_ASSERT(hasher.get_error() == EAGAIN);
+  unlink(path);
+  CPPUNIT_ASSERT(hasher.Hash(&source, url, data.size(), &content_hash,
+                             &fingerprint) == -1);
+  CPPUNIT_ASSERT(hasher.get_error() == ENOENT);
+}
+
+void SpiderTest::NameAnalyzerTestCase() {
+  NameAnalyzer analyzer;
+  CPPUNIT_ASSERT(analyzer.Analyze("") == 0);
+  CPPUNIT_ASSERT(analyzer.Analyze(" - ") == 0);
+
+  // Separators, camelCase, acronyms and letter/digit boundaries.
+  CPPUNIT_ASSERT(analyzer.Analyze("XMLHttpRequest v2.final") == 6);
+  CPPUNIT_ASSERT(analyzer.Join() == "xml http request v 2 final");
+  CPPUNIT_ASSERT(analyzer.get_text(analyzer.get_tokens()[1]) == "http");
+  CPPUNIT_ASSERT(analyzer.Analyze("ABook") == 2);
+  CPPUNIT_ASSERT(analyzer.Join() == "a book");
+
+  // Boundaries are found across blocks of long names.
+  const std::string padding(62, 'x');
+  CPPUNIT_ASSERT(analyzer.Analyze(padding + "HDRImage") == 3);
+  CPPUNIT_ASSERT(analyzer.Join() == padding + " hdr image");
+  CPPUNIT_ASSERT(analyzer.get_tokens()[2].offset == 65);
+
+  // UTF-8 characters aren't split, Cyrillic ones are folded too:
+  // "Фото_2019" -> "фото 2019".
+  const std::string photo = "\xd0\xa4\xd0\xbe\xd1\x82\xd0\xbe";
+  CPPUNIT_ASSERT(analyzer.Analyze(photo + "_2019") == 2);
+  CPPUNIT_ASSERT(analyzer.Join() == "\xd1\x84" + photo.substr(2) + " 2019");
+
+  // Vectorized classification is the same as scalar one at any offset.
+  std::string bytes;
+  for (int i = 0; i < 256; ++i)
+    bytes += static_cast<char>(i);
+  std::vector<unsigned char> classes(bytes.size()), expected_classes(classes);
+  std::string folded(bytes.size(), 0), expected_folded(folded);
+  for (int offset = 15; offset >= 0; --offset) {
+    size_t size = bytes.size() - offset;
+    NameAnalyzer::Classify(bytes.data() + offset, size, classes.data(),
+                           &folded[0]);
+    NameAnalyzer::ClassifyScalar(bytes.data() + offset, size,
+                                 expected_classes.data(),
+                                 &expected_folded[0]);
+    CPPUNIT_ASSERT(classes == expected_classes);
+    CPPUNIT_ASSERT(folded == expected_folded);
+  }
+  CPPUNIT_ASSERT(classes['A'] == NameAnalyzer::bcUpper && folded['A'] == 'a');
+  CPPUNIT_ASSERT(classes['_'] == NameAnalyzer::bcSeparator);
+  CPPUNIT_ASSERT(classes[0xd0] == NameAnalyzer::bcOther);
+}
+
+void SpiderTest::Utf8TestCase() {
+  // "Фото" in UTF-8, CP1251 and CP866.
+  const std::string utf8 = "\xd0\xa4\xd0\xbe\xd1\x82\xd0\xbe";
+  const std::string cp1251 = "\xd4\xee\xf2\xee";
+  const std::string cp866 = "\x94\xae\xe2\xae";
+
+  CPPUNIT_ASSERT(Utf8::IsValid(""));
+  CPPUNIT_ASSERT(Utf8::IsValid("plain ASCII name of more than 16 bytes"));
+  CPPUNIT_ASSERT(Utf8::IsValid(utf8));
+  CPPUNIT_ASSERT(Utf8::IsValid("\xe2\x82\xac \xf0\x9f\x93\xb7"));
+  CPPUNIT_ASSERT(!Utf8::IsValid(cp1251));
+  // Overlong '/', surrogate, above U+10FFFF, truncated sequence.
+  CPPUNIT_ASSERT(!Utf8::IsValid("\xc0\xaf"));
+  CPPUNIT_ASSERT(!Utf8::IsValid("\xed\xa0\x80"));
+  CPPUNIT_ASSERT(!Utf8::IsValid("\xf4\x90\x80\x80"));
+  CPPUNIT_ASSERT(!Utf8::IsValid("\xd0"));
+
+  // Invalid byte is found after a run of ASCII at any offset.
+  for (size_t offset = 0; offset < 40; ++offset) {
+    std::string text = std::string(offset, 'a') + cp1251 + "tail";
+    CPPUNIT_ASSERT(Utf8::Validate(text.data(), text.size()) == offset);
+  }
+
+  CPPUNIT_ASSERT(Utf8::Guess(cp1251) == Utf8::cpCP1251);
+  CPPUNIT_ASSERT(Utf8::Guess(cp866) == Utf8::cpCP866);
+
+  std::string text = "IMG_" + cp1251 + ".jpg";
+  CPPUNIT_ASSERT(Utf8::Repair(&text));
+  CPPUNIT_ASSERT(text == "IMG_" + utf8 + ".jpg");
+  text = cp866;
+  CPPUNIT_ASSERT(Utf8::Repair(&text));
+  CPPUNIT_ASSERT(text == utf8);
+  CPPUNIT_ASSERT(!Utf8::Repair(&text));
+  // Characters above U+FFFF can't be stored by data base.
+  text = "a\xf0\x9f\x93\xb7" "b";
+  CPPUNIT_ASSERT(Utf8::Repair(&text));
+  CPPUNIT_ASSERT(text == "a\xef\xbf\xbd" "b");
+
+  // Names of the path are repaired separately.
+  text = "share/" + cp1251 + "/" + cp866 + ".txt";
+  CPPUNIT_ASSERT(Utf8::RepairPath(&text));
+  CPPUNIT_ASSERT(text == "share/" + utf8 + "/" + utf8 + ".txt");
+
+  // "ФОТО Ёж À×" -> "фото ёж à×".
+  text = "\xd0\xa4\xd0\x9e\xd0\xa2\xd0\x9e "
+         "\xd0\x81\xd0\xb6 \xc3\x80\xc3\x97";
+  Utf8::FoldCase(&text[0], text.size());
+  CPPUNIT_ASSERT(text == "\xd1\x84\xd0\xbe\xd1\x82\xd0\xbe "
+                         "\xd1\x91\xd0\xb6 \xc3\xa0\xc3\x97");
+}
+
+void SpiderTest::PathFilterTestCase() {
+  PathFilter filter;
+  CPPUNIT_ASSERT(!filter.Excludes("share/dir"));
+
+  CPPUNIT_ASSERT(filter.AddGlob("$RECYCLE.BIN", true) == 0);
+  CPPUNIT_ASSERT(filter.AddGlob("/backup/*.old", false) == 0);
+  CPPUNIT_ASSERT(filter.AddGlob("/src/**/build", false) == 0);
+  CPPUNIT_ASSERT(filter.AddGlob("tmp[0-9]", false) == 0);
+  CPPUNIT_ASSERT(filter.AddRegex("^.*/(bin|obj)/(Debug|Release)$", true) == 0);
+  CPPUNIT_ASSERT(filter.AddRegex("(unclosed", false) == -1);
+  CPPUNIT_ASSERT(filter.get_error() == EINVAL);
+  CPPUNIT_ASSERT(filter.Compile() == 0);
+  CPPUNIT_ASSERT(filter.get_rule_count() == 5);
+
+  // Unanchored globs match names at any depth, case is ignored by iglob.
+  CPPUNIT_ASSERT(filter.Excludes("$RECYCLE.BIN"));
+  CPPUNIT_ASSERT(filter.Excludes("share/$Recycle.Bin"));
+  CPPUNIT_ASSERT(!filter.Excludes("share/$Recycle.Bin.old"));
+  CPPUNIT_ASSERT(filter.Excludes("share/tmp1"));
+  CPPUNIT_ASSERT(!filter.Excludes("share/tmpx"));
+  // '*' doesn't match '/', "**" does.
+  CPPUNIT_ASSERT(filter.Excludes("backup/2019.old"));
+  CPPUNIT_ASSERT(!filter.Excludes("backup/2019/a.old"));
+  CPPUNIT_ASSERT(!filter.Excludes("share/backup/2019.old"));
+  CPPUNIT_ASSERT(filter.Excludes("src/build"));
+  CPPUNIT_ASSERT(filter.Excludes("src/a/b/build"));
+  CPPUNIT_ASSERT(filter.Excludes("share/app/BIN/release"));
+  CPPUNIT_ASSERT(!filter.Excludes("share/app/bin"));
+
+  // State of a path is extended by names of subdirectories.
+  PathFilter::State state = filter.Step(filter.Start(), "src");
+  state = filter.Step(state, "a");
+  CPPUNIT_ASSERT(!filter.IsExcluded(state));
+  CPPUNIT_ASSERT(filter.IsExcluded(filter.Step(state, "build")));
+  CPPUNIT_ASSERT(state == filter.Walk("src/a"));
+
+  // Rules are read from config, wrong lines are skipped.
+  char path[] = "/tmp/exclusionsXXXXXX";
+  int fd = mkstemp(path);
+  CPPUNIT_ASSERT(fd >= 0);
+  const char config[] = "# comment\n\niglob System Volume Information\n"
+                        "regex /[a-z]+/cache\nunknown x\nglob\n";
+  CPPUNIT_ASSERT(write(fd, config, sizeof(config) - 1) ==
+                 static_cast<ssize_t>(sizeof(config) - 1));
+  close(fd);
+  PathFilter loaded;
+  CPPUNIT_ASSERT(loaded.Load(path) == 0);
+  unlink(path);
+  CPPUNIT_ASSERT(loaded.get_rule_count() == 2);
+  CPPUNIT_ASSERT(loaded.Excludes("c/system volume information"));
+  CPPUNIT_ASSERT(loaded.Excludes("share/cache"));
+  CPPUNIT_ASSERT(!loaded.Excludes("share/sub/cache"));
+  CPPUNIT_ASSERT(loaded.Load("/nonexistent/exclusions.dat") == -1);
+}
+
+void SpiderTest::FileBatchTestCase() {
+  FileBatch batch(3);
+  CPPUNIT_ASSERT(batch.get_size() == 0 && !batch.is_full());
+
+  CPPUNIT_ASSERT(batch.Add("smb://host/share/dir/a.txt", "text/plain", "",
+                           "") == 0);
+  CPPUNIT_ASSERT(batch.Add("smb://host/share/dir/b.txt", "text/plain",
+                           "3:0000000000000001", "00000000000000ff") == 0);
+  CPPUNIT_ASSERT(batch.Add("smb://host/share/c", "image/png", "", "") == 0);
+  CPPUNIT_ASSERT(batch.is_full());
+  CPPUNIT_ASSERT(batch.Add("smb://host/share/d", "image/png", "", "") == -1);
+  CPPUNIT_ASSERT(batch.get_error() == ENOSPC);
+
+  // Directories and MIME types are stored once.
+  CPPUNIT_ASSERT(batch.get_dir_count() == 2);
+  CPPUNIT_ASSERT(batch.get_dir(0).ToString() == "smb://host/share/dir");
+  CPPUNIT_ASSERT(batch.get_dir_files(0) == 2 && batch.get_dir_files(1) == 1);
+  const FileBatch::File &a = batch.get_file(0), &b = batch.get_file(1);
+  CPPUNIT_ASSERT(a.dir == b.dir && a.mime_type == b.mime_type);
+  CPPUNIT_ASSERT(batch.get_mime_type(a.mime_type).ToString() == "text/plain");
+  CPPUNIT_ASSERT(a.name.ToString() == "a.txt");
+  CPPUNIT_ASSERT(a.fingerprint.size == 0);
+  CPPUNIT_ASSERT(b.fingerprint.ToString() == "3:0000000000000001");
+  CPPUNIT_ASSERT(b.content_hash.ToString() == "00000000000000ff");
+  CPPUNIT_ASSERT(batch.PathOf(batch.get_file(2)) == "smb://host/share/c");
+  CPPUNIT_ASSERT(batch.get_arena_size() == FILE_BATCH_BLOCK);
+
+  // Names longer than a block get their own block.
+  batch.Clear();
+  CPPUNIT_ASSERT(batch.get_size() == 0 && batch.get_arena_size() == 0);
+  std::string name(FILE_BATCH_BLOCK + 1, 'x');
+  CPPUNIT_ASSERT(batch.Add("smb://host/" + name, "", "", "") == 0);
+  CPPUNIT_ASSERT(batch.get_file(0).name.ToString() == name);
+  CPPUNIT_ASSERT(batch.Add("smb://host/y", "", "", "") == 0);
+  CPPUNIT_ASSERT(batch.get_dir_count() == 1);
+  CPPUNIT_ASSERT(batch.get_arena_size() == 3 * FILE_BATCH_BLOCK + 1);
+  CPPUNIT_ASSERT(batch.Add("no-slash", "", "", "") == -1);
+  CPPUNIT_ASSERT(batch.get_error() == EINVAL);
+}
+
+void SpiderTest::CrawlStatsTestCase() {
+  // Small values are exact, larger ones share buckets of 1/16 of a power.
+  CPPUNIT_ASSERT(LatencyHistogram::BucketOf(15) == 15);
+  CPPUNIT_ASSERT(LatencyHistogram::UpperBoundOf(
+      LatencyHistogram::BucketOf(16)) == 16);
+  CPPUNIT_ASSERT(LatencyHistogram::BucketOf(32) ==
+                 LatencyHistogram::BucketOf(33));
+  CPPUNIT_ASSERT(LatencyHistogram::BucketOf(33) !=
+                 LatencyHistogram::BucketOf(34));
+  CPPUNIT_ASSERT(LatencyHistogram::UpperBoundOf(
+      LatencyHistogram::BucketOf(800)) == 831);
+  CPPUNIT_ASSERT(LatencyHistogram::BucketOf(uint64_t(1) << 40) ==
+                 LatencyHistogram::kBuckets - 1);
+
+  LatencyHistogram histogram;
+  CPPUNIT_ASSERT(histogram.Percentile(50) == 0);
+  for (uint64_t i = 1; i <= 100; ++i)
+    histogram.Record(i * 10);
+  CPPUNIT_ASSERT(histogram.get_count() == 100);
+  CPPUNIT_ASSERT(histogram.get_sum() == 50500);
+  CPPUNIT_ASSERT(histogram.get_max() == 1000);
+  CPPUNIT_ASSERT(histogram.Percentile(50) >= 500 &&
+                 histogram.Percentile(50) <= 500 + 500 / 16);
+  CPPUNIT_ASSERT(histogram.Percentile(100) == 1000);
+
+  CrawlStats stats;
+  stats.Record(CrawlStats::ssOpenDir, 800);
+  stats.Record(CrawlStats::ssOpenDir, 1000);
+  stats.Count(CrawlStats::scFiles, 10);
+  stats.Count(CrawlStats::scDirs);
+  stats.Count(CrawlStats::scCacheHits, 3);
+  {
+    StageTimer timer(&stats, CrawlStats::ssRead);
+    timer.set_failed();
+  }
+  StageTimer nothing(NULL, CrawlStats::ssRead);
+  CPPUNIT_ASSERT(stats.get_counter(CrawlStats::scFiles) == 10);
+  CPPUNIT_ASSERT(stats.get_counter(CrawlStats::scErrors) == 1);
+
+  histogram.Clear();
+  stats.Merge(CrawlStats::ssOpenDir, &histogram);
+  CPPUNIT_ASSERT(histogram.get_count() == 2 && histogram.get_max() == 1000);
+  CPPUNIT_ASSERT(histogram.Percentile(50) == 831);
+
+  std::string report = stats.Report("host");
+  CPPUNIT_ASSERT(report.find("host counters ") == 0);
+  CPPUNIT_ASSERT(report.find(" files=10 dirs=1 ") != std::string::npos);
+  CPPUNIT_ASSERT(report.find(" extension_hits=0 cache_hits=3\n") !=
+                 std::string::npos);
+  CPPUNIT_ASSERT(report.find("host opendir count=2 mean_us=900 p50_us=831 "
+                             "p90_us=1000 p99_us=1000 max_us=1000\n") !=
+                 std::string::npos);
+  CPPUNIT_ASSERT(report.find("host read count=1 ") != std::string::npos);
+  CPPUNIT_ASSERT(report.find(" commit ") == std::string::npos);
+}
@@ -46,6 +46,22 @@ class SpiderTest : public CppUnit::TestFixture, public Spider {
   void AddFileEntryInDataBaseTestCase();
   void DetectMimeTypeTestCase();
   void DumpToDataBaseTestCase();
+  void WorkStealingQueueTestCase();
+  void MimeSnifferTestCase();
+  void ExtensionTableTestCase();
+  void MimeCacheTestCase();
+  void FetchQueueTestCase();
+  void MPMCQueueTestCase();
+  void CheckpointTestCase();
+  void ThrottleTestCase();
+  void PosixSourceTestCase();
+  void FingerprintTestCase();
+  void ContentHashTestCase();
+  void NameAnalyzerTestCase();
+  void Utf8TestCase();
+  void PathFilterTestCase();
+  void FileBatchTestCase();
+  void CrawlStatsTestCase();
 
   void setUp();
   void tearDown();
@@ -58,6 +74,22 @@ class SpiderTest : public CppUnit::TestFixture, public Spider {
   CPPUNIT_TEST(AddFileEntryInDataBaseTestCase);
   CPPUNIT_TEST(DetectMimeTypeTestCase);
   CPPUNIT_TEST(DumpToDataBaseTestCase);
+  CPPUNIT_TEST(WorkStealingQueueTestCase);
+  CPPUNIT_TEST(MimeSnifferTestCase);
+  CPPUNIT_TEST(ExtensionTableTestCase);
+  CPPUNIT_TEST(MimeCacheTestCase);
+  CPPUNIT_TEST(FetchQueueTestCase);
+  CPPUNIT_TEST(MPMCQueueTestCase);
+  CPPUNIT_TEST(CheckpointTestCase);
+  CPPUNIT_TEST(ThrottleTestCase);
+  CPPUNIT_TEST(PosixSourceTestCase);
+  CPPUNIT_TEST(FingerprintTestCase);
+  CPPUNIT_TEST(ContentHashTestCase);
+  CPPUNIT_TEST(NameAnalyzerTestCase);
+  CPPUNIT_TEST(Utf8TestCase);
+  CPPUNIT_TEST(PathFilterTestCase);
+  CPPUNIT_TEST(FileBatchTestCase);
+  CPPUNIT_TEST(CrawlStatsTestCase);
   CPPUNIT_TEST_SUITE_END();
 
   std::string name_;
@@ -5,7 +5,9 @@ SUBDIRS +=                  \
     datastorage-test        \
     spider-test             \
     serverqueue-test        \
-    full-test
+    full-test               \
+    crawl-bench             \
+    name-bench
 
 OTHER_FILES += testing.sh   \
                Makefile
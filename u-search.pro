@@ -5,10 +5,13 @@ SUBDIRS +=          \
     spider          \
     scheduler       \
     test
-HEADERS += common-inl.h
+HEADERS += common-inl.h hash-inl.h
 OTHER_FILES +=      \
     servers.dat     \
     database.dat    \
+    extensions.dat  \
+    contenthash.dat \
+    exclusions.dat  \
     README          \
     config.mk       \
     Makefile        \